@@ -0,0 +1,32 @@
+# - try to find the zstd compression library
+#
+# Cache Variables: (probably not for direct use in your scripts)
+#  ZSTD_INCLUDE_DIR
+#  ZSTD_LIBRARY
+#
+# Non-cache variables you might use in your CMakeLists.txt:
+#  ZSTD_FOUND
+#  ZSTD_INCLUDE_DIRS
+#  ZSTD_LIBRARIES
+#
+# Requires these CMake modules:
+#  FindPackageHandleStandardArgs (known included with CMake >=2.6.2)
+
+find_library(ZSTD_LIBRARY
+  NAMES zstd zstd_static libzstd)
+
+find_path(ZSTD_INCLUDE_DIR
+  NAMES zstd.h zdict.h)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Zstd
+  DEFAULT_MSG
+  ZSTD_LIBRARY
+  ZSTD_INCLUDE_DIR)
+
+if(ZSTD_FOUND)
+  set(ZSTD_LIBRARIES "${ZSTD_LIBRARY}")
+  set(ZSTD_INCLUDE_DIRS "${ZSTD_INCLUDE_DIR}")
+endif()
+
+mark_as_advanced(ZSTD_INCLUDE_DIR ZSTD_LIBRARY)
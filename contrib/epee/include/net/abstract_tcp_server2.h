@@ -134,6 +134,9 @@ namespace net_utils
 		bool speed_limit_is_enabled() const; ///< tells us should we be sleeping here (e.g. do not sleep on RPC connections)
 
     bool cancel();
+
+    /// `counter` is incremented now and decremented when the connection is destroyed
+    void set_load_counter(std::shared_ptr<std::atomic<long>> counter);
     
   private:
     //----------------- i_service_endpoint ---------------------
@@ -145,8 +148,10 @@ namespace net_utils
     virtual boost::asio::io_context& get_io_context();
     virtual bool add_ref();
     virtual bool release();
+    virtual bool send_when_drained(std::function<bool()> f);
     //------------------------------------------------------
     bool do_send_chunk(byte_slice chunk); ///< will send (or queue) a part of data. internal use only
+    void call_send_drained();
 
     boost::shared_ptr<connection<t_protocol_handler> > safe_shared_from_this();
     bool shutdown();
@@ -196,7 +201,9 @@ namespace net_utils
     boost::asio::deadline_timer m_timer;
     bool m_local;
     bool m_ready_to_close;
+    std::function<bool()> m_send_drained; // guarded by m_send_que_lock
     std::string m_host;
+    std::shared_ptr<std::atomic<long>> m_load_counter;
 
 	public:
 			void setRpcStation();
@@ -237,6 +244,24 @@ namespace net_utils
 	const std::string port_ipv6 = "", const std::string address_ipv6 = "::", bool use_ipv6 = false, bool require_ipv4 = true,
 	ssl_options_t ssl_options = ssl_support_t::e_ssl_support_autodetect);
 
+    struct io_shard_stats
+    {
+      uint64_t connections;
+      uint64_t accepted;
+      uint64_t handlers;
+    };
+
+    /*! Runs connections on `count` io_contexts with a single thread each,
+        on top of the main io_context, which keeps its threads for timers, idle
+        handlers and connections made from a shard's own thread. A connection
+        stays on the io_context it was created on, so its handlers never
+        contend with those of connections on other shards. Where SO_REUSEPORT is available
+        each shard has its own IPv4 listening socket and the kernel spreads new
+        connections among them, otherwise they go to the least loaded shard.
+        Must be called before `init_server`. */
+    bool enable_io_shards(size_t count);
+    std::vector<io_shard_stats> get_io_shard_stats() const;
+
     /// Run the server's io_service loop.
     bool run_server(size_t threads_count, bool wait = true, const boost::thread::attributes& attrs = boost::thread::attributes());
 
@@ -350,15 +375,22 @@ namespace net_utils
     }
 
   private:
-    /// Run the server's io_service loop.
-    bool worker_thread();
+    struct io_shard;
+
+    /// Run the server's io_service loop, or only the shard's one.
+    bool worker_thread(io_shard *shard);
+    /// Start an asynchronous accept on the IPv4, IPv6 or shard's acceptor.
+    void start_accept(bool ipv6, io_shard *shard, epee::net_utils::ssl_support_t ssl_support);
     /// Handle completion of an asynchronous accept operation.
-    void handle_accept_ipv4(const boost::system::error_code& e);
-    void handle_accept_ipv6(const boost::system::error_code& e);
-    void handle_accept(const boost::system::error_code& e, bool ipv6 = false);
+    void handle_accept(const boost::system::error_code& e, bool ipv6, io_shard *shard);
 
     bool is_thread_worker();
 
+    /// A new connection on the given shard, or the least loaded one.
+    connection_ptr make_connection(io_shard *shard, epee::net_utils::ssl_support_t ssl_support);
+    /// Count a started connection in the load of its shard.
+    void track_connection(const connection_ptr &conn, bool accepted);
+
     const std::shared_ptr<typename connection<t_protocol_handler>::shared_state> m_state;
 
     /// The io_service used to perform asynchronous operations.
@@ -374,6 +406,27 @@ namespace net_utils
     std::unique_ptr<worker> m_io_context_local_instance;
     boost::asio::io_context& io_context_;
 
+    struct io_shard
+    {
+      io_shard()
+        : local(new worker()),
+          io_context(local->io_context),
+          acceptor(io_context),
+          connections(std::make_shared<std::atomic<long>>(0)),
+          accepted(0),
+          handlers(0)
+      {}
+
+      std::unique_ptr<worker> local;
+      boost::asio::io_context& io_context;
+      boost::asio::ip::tcp::acceptor acceptor; // only used with SO_REUSEPORT
+      connection_ptr new_connection;
+      std::shared_ptr<std::atomic<long>> connections;
+      std::atomic<uint64_t> accepted;
+      std::atomic<uint64_t> handlers;
+    };
+    std::vector<std::unique_ptr<io_shard>> m_shards;
+
     /// Acceptor used to listen for incoming connections.
     boost::asio::ip::tcp::acceptor acceptor_;
     boost::asio::ip::tcp::acceptor acceptor_ipv6;
@@ -124,6 +124,18 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     }
 
     _dbg3("[sock " << socket().native_handle() << "] Socket destroyed");
+    if (m_load_counter)
+      --*m_load_counter;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::set_load_counter(std::shared_ptr<std::atomic<long>> counter)
+  {
+    if (m_load_counter)
+      --*m_load_counter;
+    m_load_counter = std::move(counter);
+    if (m_load_counter)
+      ++*m_load_counter;
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
@@ -299,6 +311,41 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::send_when_drained(std::function<bool()> f)
+  {
+    TRY_ENTRY();
+    auto self = safe_shared_from_this();
+    if(!self)
+      return false;
+    CRITICAL_REGION_LOCAL(m_send_que_lock);
+    m_send_drained = std::move(f);
+    if(m_send_que.empty())
+      boost::asio::post(strand_, std::bind(&connection<t_protocol_handler>::call_send_drained, self));
+    return true;
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::send_when_drained()", false);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::call_send_drained()
+  {
+    TRY_ENTRY();
+    std::function<bool()> f;
+    CRITICAL_REGION_BEGIN(m_send_que_lock);
+    if(!m_send_que.empty())
+      return; // called again from handle_write
+    f = std::move(m_send_drained);
+    m_send_drained = nullptr;
+    CRITICAL_REGION_END();
+    if(!f || m_was_shutdown || !f())
+      return;
+    CRITICAL_REGION_LOCAL(m_send_que_lock);
+    m_send_drained = std::move(f);
+    if(m_send_que.empty())
+      boost::asio::post(strand_, std::bind(&connection<t_protocol_handler>::call_send_drained, connection<t_protocol_handler>::shared_from_this()));
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::call_send_drained()", void());
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   void connection<t_protocol_handler>::call_back_starter()
   {
     TRY_ENTRY();
@@ -857,6 +904,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 		}
 
     bool do_shutdown = false;
+    bool drained = false;
     CRITICAL_REGION_BEGIN(m_send_que_lock);
     if(m_send_que.empty())
     {
@@ -871,6 +919,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       {
         do_shutdown = true;
       }
+      drained = bool(m_send_drained);
     }else
     {
       //have more data to send
@@ -893,6 +942,10 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     {
       shutdown();
     }
+    else if(drained)
+    {
+      call_send_drained();
+    }
     CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_write", void());
   }
 
@@ -989,6 +1042,28 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     {
       boost::asio::ip::tcp::resolver resolver(io_context_);
       boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve(address, boost::lexical_cast<std::string>(port)).begin();
+#if defined(SO_REUSEPORT)
+      if (m_shards.size() > 1)
+      {
+        typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+        for (auto &shard: m_shards)
+        {
+          shard->acceptor.open(endpoint.protocol());
+          shard->acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+          shard->acceptor.set_option(reuse_port(true));
+          shard->acceptor.bind(endpoint);
+          shard->acceptor.listen();
+          // the other shards must bind to the same port if it was picked by the system
+          endpoint.port(shard->acceptor.local_endpoint().port());
+        }
+        m_port = endpoint.port();
+        MDEBUG("start accept (IPv4) on " << m_shards.size() << " shards");
+        for (auto &shard: m_shards)
+          start_accept(false, shard.get(), m_state->ssl_options().support);
+      }
+      else
+#endif
+      {
       acceptor_.open(endpoint.protocol());
 #if !defined(_WIN32)
       acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
@@ -998,10 +1073,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_.local_endpoint();
       m_port = binded_endpoint.port();
       MDEBUG("start accept (IPv4)");
-      new_connection_.reset(new connection<t_protocol_handler>(io_context_, m_state, m_connection_type, m_state->ssl_options().support));
-      acceptor_.async_accept(new_connection_->socket(),
-      boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept_ipv4, this,
-      boost::asio::placeholders::error));
+      start_accept(false, nullptr, m_state->ssl_options().support);
+      }
     }
     catch (const std::exception &e)
     {
@@ -1034,10 +1107,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
         boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_ipv6.local_endpoint();
         m_port_ipv6 = binded_endpoint.port();
         MDEBUG("start accept (IPv6)");
-        new_connection_ipv6.reset(new connection<t_protocol_handler>(io_context_, m_state, m_connection_type, m_state->ssl_options().support));
-        acceptor_ipv6.async_accept(new_connection_ipv6->socket(),
-            boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept_ipv6, this,
-              boost::asio::placeholders::error));
+        start_accept(true, nullptr, m_state->ssl_options().support);
       }
       catch (const std::exception &e)
       {
@@ -1092,7 +1162,7 @@ DISABLE_GCC_WARNING(maybe-uninitialized)
 POP_WARNINGS
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  bool boosted_tcp_server<t_protocol_handler>::worker_thread()
+  bool boosted_tcp_server<t_protocol_handler>::worker_thread(io_shard *shard)
   {
     TRY_ENTRY();
     uint32_t local_thr_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index); 
@@ -1104,7 +1174,13 @@ POP_WARNINGS
     {
       try
       {
-        io_context_.run();
+        if (shard)
+        {
+          while (shard->io_context.run_one())
+            ++shard->handlers;
+        }
+        else
+          io_context_.run();
         return true;
       }
       catch(const std::exception& ex)
@@ -1139,10 +1215,70 @@ POP_WARNINGS
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  bool boosted_tcp_server<t_protocol_handler>::enable_io_shards(size_t count)
+  {
+    CHECK_AND_ASSERT_MES(count > 0, false, "Invalid number of io shards");
+    CHECK_AND_ASSERT_MES(m_shards.empty() && !acceptor_.is_open() && !acceptor_ipv6.is_open(), false,
+        "io shards must be enabled once, before the server is initialized");
+    m_shards.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+      m_shards.emplace_back(new io_shard());
+    MINFO("Running " << m_thread_name_prefix << " server on " << count << " io shards");
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  std::vector<typename boosted_tcp_server<t_protocol_handler>::io_shard_stats> boosted_tcp_server<t_protocol_handler>::get_io_shard_stats() const
+  {
+    std::vector<io_shard_stats> stats;
+    stats.reserve(m_shards.size());
+    for (const auto &shard: m_shards)
+      stats.push_back({(uint64_t)std::max<long>(*shard->connections, 0), shard->accepted.load(), shard->handlers.load()});
+    return stats;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  typename boosted_tcp_server<t_protocol_handler>::connection_ptr boosted_tcp_server<t_protocol_handler>::make_connection(io_shard *shard, epee::net_utils::ssl_support_t ssl_support)
+  {
+    if (m_shards.empty())
+      return connection_ptr(new connection<t_protocol_handler>(io_context_, m_state, m_connection_type, ssl_support));
+    if (!shard)
+    {
+      // a caller on a shard's thread may block until the connection is up,
+      // which that thread could then never handle
+      for (const auto &s: m_shards)
+        if (!s->io_context.get_executor().running_in_this_thread() && (!shard || s->connections->load() < shard->connections->load()))
+          shard = s.get();
+      if (!shard)
+        return connection_ptr(new connection<t_protocol_handler>(io_context_, m_state, m_connection_type, ssl_support));
+    }
+    return connection_ptr(new connection<t_protocol_handler>(shard->io_context, m_state, m_connection_type, ssl_support));
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void boosted_tcp_server<t_protocol_handler>::track_connection(const connection_ptr &conn, bool accepted)
+  {
+    const boost::asio::io_context *context = std::addressof(static_cast<boost::asio::io_context&>(conn->socket().get_executor().context()));
+    for (const auto &shard: m_shards)
+    {
+      if (std::addressof(shard->io_context) == context)
+      {
+        if (accepted)
+          ++shard->accepted;
+        conn->set_load_counter(shard->connections);
+        return;
+      }
+    }
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   bool boosted_tcp_server<t_protocol_handler>::run_server(size_t threads_count, bool wait, const boost::thread::attributes& attrs)
   {
     TRY_ENTRY();
-    m_threads_count = threads_count;
+    // one more thread per shard, so handlers of a connection always run on the
+    // same thread, while timers, idle handlers and blocking connects keep
+    // running on the main io_context's threads
+    m_threads_count = threads_count + m_shards.size();
     m_main_thread_id = boost::this_thread::get_id();
     MLOG_SET_THREAD_NAME("[SRV_MAIN]");
     while(!m_stop_signal_sent)
@@ -1150,10 +1286,11 @@ POP_WARNINGS
 
       // Create a pool of threads to run all of the io_services.
       CRITICAL_REGION_BEGIN(m_threads_lock);
-      for (std::size_t i = 0; i < threads_count; ++i)
+      for (std::size_t i = 0; i < m_threads_count; ++i)
       {
+        io_shard *shard = i < threads_count ? nullptr : m_shards[i - threads_count].get();
         boost::shared_ptr<boost::thread> thread(new boost::thread(
-          attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this)));
+          attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this, shard)));
           _note("Run server thread name: " << m_thread_name_prefix);
         m_threads.push_back(thread);
       }
@@ -1241,35 +1378,43 @@ POP_WARNINGS
     connections_.clear();
     connections_mutex.unlock();
     io_context_.stop();
+    for (auto &shard: m_shards)
+      shard->io_context.stop();
     CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::send_stop_signal()", void());
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  void boosted_tcp_server<t_protocol_handler>::handle_accept_ipv4(const boost::system::error_code& e)
+  void boosted_tcp_server<t_protocol_handler>::start_accept(bool ipv6, io_shard *shard, epee::net_utils::ssl_support_t ssl_support)
   {
-    this->handle_accept(e, false);
-  }
-  //---------------------------------------------------------------------------------
-  template<class t_protocol_handler>
-  void boosted_tcp_server<t_protocol_handler>::handle_accept_ipv6(const boost::system::error_code& e)
-  {
-    this->handle_accept(e, true);
+    boost::asio::ip::tcp::acceptor* current_acceptor = &acceptor_;
+    connection_ptr* current_new_connection = &new_connection_;
+    if (shard)
+    {
+      current_acceptor = &shard->acceptor;
+      current_new_connection = &shard->new_connection;
+    }
+    else if (ipv6)
+    {
+      current_acceptor = &acceptor_ipv6;
+      current_new_connection = &new_connection_ipv6;
+    }
+
+    *current_new_connection = make_connection(shard, ssl_support);
+    current_acceptor->async_accept((*current_new_connection)->socket(),
+        boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
+          boost::asio::placeholders::error, ipv6, shard));
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  void boosted_tcp_server<t_protocol_handler>::handle_accept(const boost::system::error_code& e, bool ipv6)
+  void boosted_tcp_server<t_protocol_handler>::handle_accept(const boost::system::error_code& e, bool ipv6, io_shard *shard)
   {
     MDEBUG("handle_accept");
 
-    boost::asio::ip::tcp::acceptor* current_acceptor = &acceptor_;
     connection_ptr* current_new_connection = &new_connection_;
-    auto accept_function_pointer = &boosted_tcp_server<t_protocol_handler>::handle_accept_ipv4;
-    if (ipv6)
-    {
-      current_acceptor = &acceptor_ipv6;
+    if (shard)
+      current_new_connection = &shard->new_connection;
+    else if (ipv6)
       current_new_connection = &new_connection_ipv6;
-      accept_function_pointer = &boosted_tcp_server<t_protocol_handler>::handle_accept_ipv6;
-    }
 
     try
     {
@@ -1287,10 +1432,7 @@ POP_WARNINGS
         (*current_new_connection)->setRpcStation(); // hopefully this is not needed actually
       }
       connection_ptr conn(std::move((*current_new_connection)));
-      (*current_new_connection).reset(new connection<t_protocol_handler>(io_context_, m_state, m_connection_type, conn->get_ssl_support()));
-      current_acceptor->async_accept((*current_new_connection)->socket(),
-          boost::bind(accept_function_pointer, this,
-            boost::asio::placeholders::error));
+      start_accept(ipv6, shard, conn->get_ssl_support());
 
       boost::asio::socket_base::keep_alive opt(true);
       conn->socket().set_option(opt);
@@ -1305,6 +1447,7 @@ POP_WARNINGS
         conn->cancel();
         return;
       }
+      track_connection(conn, true);
       conn->save_dbg_log();
       return;
     }
@@ -1322,10 +1465,7 @@ POP_WARNINGS
     assert(m_state != nullptr); // always set in constructor
     _erro("Some problems at accept: " << e.message() << ", connections_count = " << m_state->sock_count);
     misc_utils::sleep_no_w(100);
-    (*current_new_connection).reset(new connection<t_protocol_handler>(io_context_, m_state, m_connection_type, (*current_new_connection)->get_ssl_support()));
-    current_acceptor->async_accept((*current_new_connection)->socket(),
-        boost::bind(accept_function_pointer, this,
-          boost::asio::placeholders::error));
+    start_accept(ipv6, shard, (*current_new_connection)->get_ssl_support());
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
@@ -1425,7 +1565,7 @@ POP_WARNINGS
     {
       // Handshake
       MDEBUG("Handshaking SSL...");
-      if (!new_connection_l->handshake(boost::asio::ssl::stream_base::client, io_context_))
+      if (!new_connection_l->handshake(boost::asio::ssl::stream_base::client, static_cast<boost::asio::io_context&>(sock_.get_executor().context())))
       {
         if (ssl_support == epee::net_utils::ssl_support_t::e_ssl_support_autodetect)
         {
@@ -1451,7 +1591,7 @@ POP_WARNINGS
   {
     TRY_ENTRY();
 
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_context_, m_state, m_connection_type, ssl_support) );
+    connection_ptr new_connection_l = make_connection(nullptr, ssl_support);
     connections_mutex.lock();
     connections_.insert(new_connection_l);
     MDEBUG("connections_ size now " << connections_.size());
@@ -1551,6 +1691,7 @@ POP_WARNINGS
     bool r = new_connection_l->start(false, 1 < m_threads_count);
     if (r)
     {
+      track_connection(new_connection_l, false);
       new_connection_l->get_context(conn_context);
       //new_connection_l.reset(new connection<t_protocol_handler>(io_context_, m_config, m_sock_count, m_pfilter));
     }
@@ -1571,7 +1712,7 @@ POP_WARNINGS
   bool boosted_tcp_server<t_protocol_handler>::connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeout, const t_callback &cb, const std::string& bind_ip, epee::net_utils::ssl_support_t ssl_support)
   {
     TRY_ENTRY();    
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_context_, m_state, m_connection_type, ssl_support) );
+    connection_ptr new_connection_l = make_connection(nullptr, ssl_support);
     connections_mutex.lock();
     connections_.insert(new_connection_l);
     MDEBUG("connections_ size now " << connections_.size());
@@ -1645,7 +1786,7 @@ POP_WARNINGS
       }
     }
     
-    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(io_context_));
+    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(sock_.get_executor()));
     //start deadline
     sh_deadline->expires_from_now(boost::posix_time::milliseconds(conn_timeout));
     sh_deadline->async_wait([=](const boost::system::error_code& error)
@@ -1679,6 +1820,7 @@ POP_WARNINGS
             bool r = new_connection_l->start(false, 1 < m_threads_count);
             if (r)
             {
+              track_connection(new_connection_l, false);
               new_connection_l->get_context(conn_context);
               cb(conn_context, ec_);
             }
@@ -30,6 +30,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 #include <boost/utility/string_ref.hpp>
+#include <functional>
 #include <string>
 #include <utility>
 
@@ -194,6 +195,9 @@ namespace net_utils
 			http_header_info    m_header_info;
 			int                 m_http_ver_hi;// OUT paramter only
 			int                 m_http_ver_lo;// OUT paramter only
+			// server side only: if set, the body is sent with chunked transfer encoding,
+			// one chunk per call; returns false when there is nothing more to send
+			std::function<bool(std::string&)> m_body_stream;
 
 			void clear()
 			{
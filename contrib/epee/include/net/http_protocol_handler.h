@@ -130,6 +130,9 @@ namespace net_utils
 
 			//major function 
 			inline bool handle_request_and_send_response(const http::http_request_info& query_info);
+			bool send_body_stream();
+			bool send_body_chunk();
+			void end_body_stream();
 
 
 			std::string get_not_found_response_body(const std::string& URI);
@@ -144,6 +147,7 @@ namespace net_utils
 			config_type& m_config;
 			bool m_want_close;
 			size_t m_newlines;
+			std::function<bool(std::string&)> m_body_stream; // set while a streamed body is being sent
 		protected:
 			i_service_endpoint* m_psnd_hndlr; 
 			t_connection_context& m_conn_context;
@@ -231,6 +231,20 @@ namespace net_utils
 		//LOG_PRINT_L0("HTTP_RECV: " << ptr << "\r\n" << buf);
 		//file_io_utils::save_string_to_file(string_tools::get_current_module_folder() + "/" + boost::lexical_cast<std::string>(ptr), std::string((const char*)ptr, cb));
 
+		if (m_body_stream)
+		{
+			// pipelined request: handled once the streamed response is complete, and held
+			// only up to what a request line and header may take, so it can't grow meanwhile
+			if (m_cache.size() + buf.size() > HTTP_MAX_URI_LEN + HTTP_MAX_HEADER_LEN)
+			{
+				LOG_ERROR_CC(m_conn_context, "simple_http_connection_handler::handle_recv: Too much data pipelined during a streamed response");
+				m_state = http_state_error;
+				return false;
+			}
+			m_cache += buf;
+			return true;
+		}
+
 		bool res = handle_buff_in(buf);
 		if(m_want_close/*m_state == http_state_connection_close || m_state == http_state_error*/)
 			return false;
@@ -249,7 +263,7 @@ namespace net_utils
 			m_cache.swap(buf);
 
 		m_is_stop_handling = false;
-		while(!m_is_stop_handling)
+		while(!m_is_stop_handling && !m_body_stream)
 		{
 			switch(m_state)
 			{
@@ -597,10 +611,88 @@ namespace net_utils
 			response_data += response.m_body;
 
 		m_psnd_hndlr->do_send(byte_slice{std::move(response_data)});
+		if (response.m_body_stream && query_info.m_http_method != http::http_method_head)
+		{
+			m_body_stream = std::move(response.m_body_stream);
+			const auto next = [this]() {
+				if (send_body_chunk())
+					return true;
+				end_body_stream();
+				return false;
+			};
+			if (m_psnd_hndlr->send_when_drained(next))
+				return res; // send_done is called when the body is complete
+			res = send_body_stream() && res;
+		}
 		m_psnd_hndlr->send_done();
 		return res;
 	}
 	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::send_body_stream()
+	{
+		// for endpoints that cannot tell when their queue drains, the whole body is queued at once
+		while (send_body_chunk())
+			;
+		return !m_want_close;
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::send_body_chunk()
+	{
+		// Queues the next chunk; returns false once the body is complete or has failed.
+		// On failure the terminating chunk is not sent, so the client sees a truncated
+		// body rather than a complete one.
+		std::string chunk;
+		bool more;
+		try
+		{
+			while ((more = m_body_stream(chunk)) && chunk.empty())
+				;
+		}
+		catch (const std::exception &e)
+		{
+			LOG_ERROR_CC(m_conn_context, "Failed to stream response body: " << e.what());
+			m_body_stream = nullptr;
+			m_want_close = true;
+			return false;
+		}
+		std::string data;
+		if (more)
+		{
+			data = string_tools::to_string_hex(chunk.size()) + "\r\n";
+			data += chunk;
+			data += "\r\n";
+		}
+		else
+		{
+			data = "0\r\n\r\n";
+		}
+		if (!m_psnd_hndlr->do_send(byte_slice{std::move(data)}))
+			m_want_close = true;
+		if (!more || m_want_close)
+		{
+			m_body_stream = nullptr;
+			return false;
+		}
+		return true;
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	void simple_http_connection_handler<t_connection_context>::end_body_stream()
+	{
+		if (m_want_close)
+		{
+			m_psnd_hndlr->close();
+			return;
+		}
+		m_psnd_hndlr->send_done();
+		// picks up requests pipelined behind the streamed one, and "Connection: close"
+		std::string buf;
+		if (!handle_buff_in(buf) || m_want_close)
+			m_psnd_hndlr->close();
+	}
+	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::handle_request(const http::http_request_info& query_info, http_response_info& response)
 	{
@@ -636,9 +728,11 @@ namespace net_utils
 	{
 		std::string buf = "HTTP/1.1 ";
 		buf += boost::lexical_cast<std::string>(response.m_response_code) + " " + response.m_response_comment + "\r\n" +
-			"Server: Epee-based\r\n"
-			"Content-Length: ";
-		buf += boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
+			"Server: Epee-based\r\n";
+		if (response.m_body_stream)
+			buf += "Transfer-Encoding: chunked\r\n";
+		else
+			buf += "Content-Length: " + boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
 
 		if(!response.m_mime_tipe.empty())
 		{
@@ -86,6 +86,35 @@
 
 #define MAP_URI_AUTO_JON2(s_pattern, callback_f, command_type) MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, true)
 
+// as MAP_URI_AUTO_JON2, but the handler class provides get_response_cache_token(),
+// get_cached_response(uri, request, token, body) and cache_response(uri, request, token, body)
+#define MAP_URI_AUTO_JON2_CACHED(s_pattern, callback_f, command_type) \
+    else if(query_info.m_URI == s_pattern) \
+    { \
+      handled = true; \
+      boost::value_initialized<command_type::request> req; \
+      bool parse_res = epee::serialization::load_t_from_json(static_cast<command_type::request&>(req), query_info.m_body); \
+      CHECK_AND_ASSERT_MES(parse_res, false, "Failed to parse json: \r\n" << query_info.m_body); \
+      std::string cache_key; \
+      epee::serialization::store_t_to_binary(static_cast<command_type::request&>(req), cache_key); \
+      const auto cache_token = get_response_cache_token(); \
+      response_info.m_mime_tipe = "application/json"; \
+      response_info.m_header_info.m_content_type = " application/json"; \
+      if(get_cached_response(s_pattern, cache_key, cache_token, response_info.m_body)) \
+        return true; \
+      boost::value_initialized<command_type::response> resp;\
+      MINFO(m_conn_context << "calling " << s_pattern); \
+      if(!callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp), &m_conn_context)) \
+      { \
+        MERROR(m_conn_context << "Failed to " << #callback_f << "()"); \
+        response_info.m_response_code = 500; \
+        response_info.m_response_comment = "Internal Server Error"; \
+        return true; \
+      } \
+      epee::serialization::store_t_to_json(static_cast<command_type::response&>(resp), response_info.m_body); \
+      cache_response(s_pattern, cache_key, cache_token, response_info.m_body); \
+    }
+
 #define MAP_URI_AUTO_BIN2(s_pattern, callback_f, command_type) \
     else if(query_info.m_URI == s_pattern) \
     { \
@@ -112,6 +141,26 @@
       MDEBUG( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms"); \
     }
 
+#define MAP_URI_AUTO_BIN_STREAM2(s_pattern, callback_f, command_type) \
+    else if(query_info.m_URI == s_pattern) \
+    { \
+      handled = true; \
+      boost::value_initialized<command_type::request> req; \
+      bool parse_res = epee::serialization::load_t_from_binary(static_cast<command_type::request&>(req), epee::strspan<uint8_t>(query_info.m_body)); \
+      CHECK_AND_ASSERT_MES(parse_res, false, "Failed to parse bin body data, body size=" << query_info.m_body.size()); \
+      MINFO(m_conn_context << "calling " << s_pattern); \
+      if(!callback_f(static_cast<command_type::request&>(req), response_info.m_body_stream, &m_conn_context)) \
+      { \
+        MERROR(m_conn_context << "Failed to " << #callback_f << "()"); \
+        response_info.m_body_stream = nullptr; \
+        response_info.m_response_code = 500; \
+        response_info.m_response_comment = "Internal Server Error"; \
+        return true; \
+      } \
+      response_info.m_mime_tipe = " application/octet-stream"; \
+      response_info.m_header_info.m_content_type = " application/octet-stream"; \
+    }
+
 #define CHAIN_URI_MAP2(callback) else {callback(query_info, response_info, m_conn_context);handled = true;}
 
 #define END_URI_MAP2() return handled;}
@@ -193,6 +242,40 @@
 
 #define MAP_JON_RPC_WE(method_name, callback_f, command_type) MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, true)
 
+// as MAP_JON_RPC_WE, with the response cache hooks of MAP_URI_AUTO_JON2_CACHED,
+// keyed on the params only: the cache holds the result, which is wrapped with the
+// id of each request, so ids neither defeat the cache nor fill it
+#define MAP_JON_RPC_WE_CACHED(method_name, callback_f, command_type) \
+    else if(callback_name == method_name) \
+{ \
+  PREPARE_OBJECTS_FROM_JSON(command_type) \
+  std::string cache_key; \
+  epee::serialization::store_t_to_binary(req.params, cache_key); \
+  const auto cache_token = get_response_cache_token(); \
+  std::string result_json; \
+  response_info.m_mime_tipe = "application/json"; \
+  response_info.m_header_info.m_content_type = " application/json"; \
+  if(get_cached_response(method_name, cache_key, cache_token, result_json)) \
+  { \
+    response_info.m_body = epee::json_rpc::make_response_body(req.id, result_json); \
+    return true; \
+  } \
+  epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
+  fail_resp.jsonrpc = "2.0"; \
+  fail_resp.id = req.id; \
+  MINFO(m_conn_context << "Calling RPC method " << method_name); \
+  if(!callback_f(req.params, resp.result, fail_resp.error, &m_conn_context)) \
+  { \
+    epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+    return true; \
+  } \
+  epee::serialization::store_t_to_json(resp.result, result_json, 1); \
+  response_info.m_body = epee::json_rpc::make_response_body(req.id, result_json); \
+  MDEBUG(query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/" << epee::misc_utils::get_tick_count()-ticks1 << "ms"); \
+  cache_response(method_name, cache_key, cache_token, result_json); \
+  return true;\
+}
+
 #define MAP_JON_RPC_WERI(method_name, callback_f, command_type) \
     else if(callback_name == method_name) \
 { \
@@ -2,9 +2,11 @@
 #define	JSONRPC_STRUCTS_H
 
 #include <string>
+#include <sstream>
 #include <cstdint>
 #include "serialization/keyvalue_serialization.h"
 #include "storages/portable_storage_base.h"
+#include "storages/portable_storage_to_json.h"
 
 namespace epee 
 {
@@ -104,6 +106,19 @@ namespace epee
     };
 
     typedef response<dummy_result, error> error_response;
+
+    // The json of a successful response with the given id, from its result already
+    // stored with store_t_to_json at indent 1. The layout is the one store_t_to_json
+    // gives the whole response, so a result can be kept apart from the id it was asked with.
+    inline std::string make_response_body(const epee::serialization::storage_entry& id, const std::string& result_json)
+    {
+      const std::string indent = epee::serialization::make_indent(1);
+      std::stringstream ss;
+      ss << "{\r\n" << indent << "\"id\": ";
+      epee::serialization::dump_as_json(ss, id, 1, true);
+      ss << ",\r\n" << indent << "\"jsonrpc\": \"2.0\",\r\n" << indent << "\"result\": " << result_json << "\r\n}";
+      return ss.str();
+    }
   }
 }
 
@@ -411,6 +411,11 @@ public:
       return false;
     }
 
+    // large bodies (block spans) arrive in many reads: grow the buffer by what
+    // was actually received so far, up to the announced size, rather than by
+    // small steps, so a peer can't make us allocate much more than it sent
+    if(m_state == stream_state_body && m_cache_in_buffer.size() + cb < m_current_head.m_cb)
+      m_cache_in_buffer.reserve(std::min<size_t>(m_current_head.m_cb - m_cache_in_buffer.size(), 2 * (m_cache_in_buffer.size() + cb)));
     m_cache_in_buffer.append((const char*)ptr, cb);
 
     bool is_continue = true;
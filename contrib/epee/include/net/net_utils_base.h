@@ -32,6 +32,7 @@
 #include <boost/uuid/uuid.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/address_v6.hpp>
+#include <functional>
 #include <typeinfo>
 #include <type_traits>
 #include "byte_slice.h"
@@ -450,6 +451,9 @@ namespace net_utils
     //protect from deletion connection object(with protocol instance) during external call "invoke"
     virtual bool add_ref()=0;
     virtual bool release()=0;
+    //calls f from the connection's strand each time everything queued so far has been written,
+    //until f returns false; returns false if the endpoint cannot do this
+    virtual bool send_when_drained(std::function<bool()> f) { return false; }
   protected:
     virtual ~i_service_endpoint() noexcept(false) {}
 	};
@@ -207,6 +207,8 @@ namespace epee
         LOG_ERROR("Failed to load_from_binary in notify " << command);
         return -1;
       }
+      // the storage only lives to fill in_struct, so blobs can be moved instead of copied
+      strg.set_move_values(true);
       boost::value_initialized<t_in_type> in_struct;
       if (!static_cast<t_in_type&>(in_struct).load(strg))
       {
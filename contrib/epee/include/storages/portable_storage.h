@@ -54,7 +54,7 @@ namespace epee
       typedef epee::serialization::harray  harray;
       typedef storage_entry meta_entry;
 
-      portable_storage(){}
+      portable_storage(): m_move_values(false) {}
       virtual ~portable_storage(){}
       hsection   open_section(const std::string& section_name,  hsection hparent_section, bool create_if_notexist = false);
       template<class t_value>
@@ -81,6 +81,9 @@ namespace epee
       //------------------------------------------------------------------------
       //delete entry (section, value or array)
       bool        delete_entry(const std::string& pentry_name, hsection hparent_section = nullptr);
+      //when set, string values are moved out of the storage by get_value/get_*_value instead of copied,
+      //which is only valid if each value is read at most once (eg, when loading a single struct)
+      void        set_move_values(bool move_values) { m_move_values = move_values; }
 
       //-------------------------------------------------------------------------------
       bool		store_to_binary(binarybuffer& target);
@@ -93,6 +96,7 @@ namespace epee
 
     private:
       section m_root;
+      bool m_move_values;
       hsection	get_root_section() {return &m_root;}
       storage_entry* find_storage_entry(const std::string& pentry_name, hsection psection);
       template<class entry_type>
@@ -203,13 +207,19 @@ namespace epee
       CATCH_ENTRY("portable_storage::open_section", nullptr);
     }
     //---------------------------------------------------------------------------------------------------------------
+    template<class to_type>
+    void move_t(std::string& from, to_type& to) { convert_t(from, to); }
+    inline void move_t(std::string& from, std::string& to) { to = std::move(from); }
+
     template<class to_type>
     struct get_value_visitor: boost::static_visitor<void>
     {
       to_type& m_target;
-      get_value_visitor(to_type& target):m_target(target){}
+      bool m_move;
+      get_value_visitor(to_type& target, bool move = false):m_target(target), m_move(move){}
       template<class from_type>
       void operator()(const from_type& v){convert_t(v, m_target);}
+      void operator()(std::string& v){if (m_move) move_t(v, m_target); else convert_t(v, m_target);}
     };
 
     template<class t_value>
@@ -222,7 +232,7 @@ namespace epee
       if(!pentry)
         return false;
 
-      get_value_visitor<t_value> gvv(val);
+      get_value_visitor<t_value> gvv(val, m_move_values);
       boost::apply_visitor(gvv, *pentry);
       return true;
       //CATCH_ENTRY("portable_storage::template<>get_value", false);
@@ -299,7 +309,8 @@ namespace epee
     struct get_first_value_visitor: boost::static_visitor<bool>
     {
       to_type& m_target;
-      get_first_value_visitor(to_type& target):m_target(target){}
+      bool m_move;
+      get_first_value_visitor(to_type& target, bool move = false):m_target(target), m_move(move){}
       template<class from_type>
       bool operator()(const array_entry_t<from_type>& a)
       {
@@ -309,6 +320,14 @@ namespace epee
         convert_t(*pv, m_target);
         return true;
       }
+      bool operator()(array_entry_t<std::string>& a)
+      {
+        std::string* pv = a.get_first_val();
+        if(!pv)
+          return false;
+        if (m_move) move_t(*pv, m_target); else convert_t(*pv, m_target);
+        return true;
+      }
     };
     //---------------------------------------------------------------------------------------------------------------
     template<class t_value>
@@ -324,7 +343,7 @@ namespace epee
         return nullptr;
       array_entry& ar_entry = boost::get<array_entry>(*pentry);
       
-      get_first_value_visitor<t_value> gfv(target);
+      get_first_value_visitor<t_value> gfv(target, m_move_values);
       if(!boost::apply_visitor(gfv, ar_entry))
         return nullptr;
       return &ar_entry;
@@ -335,7 +354,8 @@ namespace epee
     struct get_next_value_visitor: boost::static_visitor<bool>
     {
       to_type& m_target;
-      get_next_value_visitor(to_type& target):m_target(target){}
+      bool m_move;
+      get_next_value_visitor(to_type& target, bool move = false):m_target(target), m_move(move){}
       template<class from_type>
       bool operator()(const array_entry_t<from_type>& a)
       {
@@ -346,6 +366,14 @@ namespace epee
         convert_t(*pv, m_target);
         return true;
       }
+      bool operator()(array_entry_t<std::string>& a)
+      {
+        std::string* pv = a.get_next_val();
+        if(!pv)
+          return false;
+        if (m_move) move_t(*pv, m_target); else convert_t(*pv, m_target);
+        return true;
+      }
     };
 
 
@@ -356,7 +384,7 @@ namespace epee
       //TRY_ENTRY();
       CHECK_AND_ASSERT(hval_array, false);
       array_entry& ar_entry = *hval_array;
-      get_next_value_visitor<t_value> gnv(target);
+      get_next_value_visitor<t_value> gnv(target, m_move_values);
       if(!boost::apply_visitor(gnv, ar_entry))
         return false;
       return true;
@@ -96,5 +96,21 @@ void buffer::append(const void *data, size_t sz)
   NET_BUFFER_LOG("storage now " << offset << "/" << storage.size() << "/" << storage.capacity());
 }
 
+void buffer::reserve(size_t sz)
+{
+  CHECK_AND_ASSERT_THROW_MES(size() < std::numeric_limits<size_t>::max() - sz, "Too much data to reserve");
+  if (storage.capacity() - storage.size() >= sz)
+    return;
+
+  NET_BUFFER_LOG("reserving " << sz << " after " << size());
+  std::vector<uint8_t> new_storage;
+  new_storage.reserve(size() + sz);
+  new_storage.resize(size());
+  if (size() > 0)
+    memcpy(new_storage.data(), storage.data() + offset, storage.size() - offset);
+  offset = 0;
+  std::swap(storage, new_storage);
+}
+
 }
 }
@@ -55,6 +55,11 @@ const command_line::arg_descriptor<bool> arg_db_salvage  = {
 , "Try to salvage a blockchain database if it seems corrupted"
 , false
 };
+const command_line::arg_descriptor<bool> arg_db_compress_txs  = {
+  "db-compress-txs"
+, "Store transaction blobs compressed (requires zstd support, converts an existing database on first use)"
+, false
+};
 const command_line::arg_descriptor<uint32_t> arg_db_readers  = {
   "db-readers"
 , "Number of database readers to use"
@@ -75,6 +80,7 @@ void BlockchainDB::init_options(boost::program_options::options_description& des
 {
   command_line::add_arg(desc, arg_db_sync_mode);
   command_line::add_arg(desc, arg_db_salvage);
+  command_line::add_arg(desc, arg_db_compress_txs);
   command_line::add_arg(desc, arg_db_readers);
   command_line::add_arg(desc, arg_pop_blocks);
 }
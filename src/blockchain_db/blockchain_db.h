@@ -107,6 +107,7 @@ typedef std::pair<crypto::hash, uint64_t> tx_out_index;
 
 extern const command_line::arg_descriptor<std::string> arg_db_sync_mode;
 extern const command_line::arg_descriptor<bool, false> arg_db_salvage;
+extern const command_line::arg_descriptor<bool> arg_db_compress_txs;
 extern const command_line::arg_descriptor<uint32_t> arg_db_readers;
 extern const command_line::arg_descriptor<uint32_t> arg_pop_blocks;
 
@@ -166,11 +167,142 @@ struct txpool_tx_meta_t
   uint8_t padding[76]; // till 192 bytes
 };
 
+/**
+ * @brief counters for one compressed transaction table
+ */
+struct tx_compression_table_stats
+{
+  uint64_t encoded_records = 0;    //!< records written since open
+  uint64_t encoded_raw_bytes = 0;  //!< bytes before compression
+  uint64_t encoded_bytes = 0;      //!< bytes actually stored
+  uint64_t decoded_records = 0;    //!< records read since open
+  uint64_t decoded_bytes = 0;      //!< stored bytes read
+  uint64_t decoded_raw_bytes = 0;  //!< bytes after decompression
+  uint64_t decode_time_ns = 0;     //!< total time spent decompressing
+};
+
+/**
+ * @brief transaction blob compression settings and counters
+ */
+struct tx_compression_stats
+{
+  std::string method;                  //!< "none" or the codec name
+  bool pruned_dictionary = false;      //!< whether txs_pruned uses a trained dictionary
+  bool prunable_dictionary = false;    //!< whether txs_prunable uses a trained dictionary
+  tx_compression_table_stats pruned;
+  tx_compression_table_stats prunable;
+};
+
+/**
+ * @brief progress of a running pruning pass
+ */
+struct pruning_progress
+{
+  bool running = false;
+  std::string phase;                   //!< "starting", "pruning" or "checking"
+  uint64_t done = 0;                   //!< transactions processed in this phase
+  uint64_t total = 0;                  //!< transactions to process in this phase
+  uint64_t elapsed_ms = 0;             //!< time since the pass started
+  uint64_t eta_seconds = 0;            //!< estimated time left in this phase, 0 if unknown
+};
+
+/**
+ * @brief progress of a compacting database snapshot
+ */
+struct db_snapshot_status
+{
+  bool running = false;                //!< a snapshot is being written
+  bool finished = false;               //!< a snapshot was started and has ended
+  bool success = false;                //!< the last snapshot completed
+  std::string path;                    //!< destination folder
+  std::string error;                   //!< why the last snapshot failed
+  uint64_t max_bytes_per_second = 0;   //!< write rate limit, 0 for none
+  uint64_t source_size = 0;            //!< database file size when the snapshot started
+  uint64_t estimated_size = 0;         //!< upper bound on the snapshot size
+  uint64_t bytes_written = 0;
+  uint64_t elapsed_ms = 0;
+};
+
+/**
+ * @brief latency histogram, with buckets at powers of ten microseconds
+ *
+ * Bucket i counts samples under 10^(i+1) microseconds, the last bucket
+ * counts everything else.
+ */
+struct db_latency_histogram
+{
+  static constexpr size_t num_buckets = 8;
+  uint64_t count = 0;
+  uint64_t total_us = 0;
+  uint64_t max_us = 0;
+  uint64_t buckets[num_buckets] = {};
+};
+
+/**
+ * @brief size and operation counters for one database table
+ */
+struct db_table_stats
+{
+  std::string name;
+  uint64_t entries = 0;
+  uint64_t size = 0;                   //!< bytes in branch, leaf and overflow pages
+  uint64_t depth = 0;
+  uint64_t lookups = 0;                //!< keyed gets and cursor positioning
+  uint64_t misses = 0;                 //!< lookups and steps which found nothing
+  uint64_t cursor_steps = 0;           //!< relative cursor moves
+  uint64_t bytes_read = 0;             //!< key and data bytes returned
+  uint64_t writes = 0;
+  uint64_t bytes_written = 0;
+  uint64_t deletes = 0;
+};
+
+/**
+ * @brief database instrumentation, counted since the process started
+ */
+struct db_stats
+{
+  uint64_t map_size = 0;
+  uint64_t used_size = 0;
+  uint64_t page_size = 0;
+  uint64_t readers = 0;
+  uint64_t max_readers = 0;
+  uint64_t resizes = 0;                //!< map resizes, by this process or detected
+  uint64_t resize_time_ms = 0;
+  uint64_t major_page_faults = 0;      //!< process wide, an estimate of reads hitting the disk
+  uint64_t minor_page_faults = 0;
+  std::vector<db_table_stats> tables;
+  db_latency_histogram read_txn;       //!< time read txns are held
+  db_latency_histogram write_txn;      //!< time from write txn start to commit
+  db_latency_histogram commit;         //!< time spent committing
+};
+
+/**
+ * @brief block header fields which can be read without parsing the block blob
+ */
+struct block_header_info
+{
+  uint64_t height;
+  uint8_t major_version;
+  uint8_t minor_version;
+  uint64_t timestamp;
+  uint32_t nonce;
+  crypto::hash prev_id;
+  crypto::hash hash;
+  crypto::hash miner_tx_hash;
+  uint64_t reward;                     //!< sum of the miner transaction outputs
+  uint64_t weight;
+  uint64_t long_term_weight;
+  uint64_t num_txes;                   //!< number of transactions, excluding the miner transaction
+  uint64_t difficulty;
+  difficulty_type_128 cumulative_difficulty;
+};
+
 #define DBF_SAFE       1
 #define DBF_FAST       2
 #define DBF_FASTEST    4
 #define DBF_RDONLY     8
 #define DBF_SALVAGE 0x10
+#define DBF_COMPRESS 0x20
 
 /***********************************
  * Exception Definitions
@@ -1129,6 +1261,23 @@ public:
    */
   virtual std::vector<crypto::hash> get_hashes_range(const uint64_t& h1, const uint64_t& h2) const = 0;
 
+  /**
+   * @brief fetch a list of block headers
+   *
+   * The subclass should return the header fields of the blocks with heights
+   * starting at h1 and ending at h2, inclusively, without deserializing
+   * the block blobs.
+   *
+   * If the height range requested goes past the end of the blockchain,
+   * the subclass should throw BLOCK_DNE.
+   *
+   * @param h1 the start height
+   * @param h2 the end height
+   *
+   * @return a vector of block headers
+   */
+  virtual std::vector<block_header_info> get_block_headers_range(const uint64_t& h1, const uint64_t& h2) const = 0;
+
   /**
    * @brief fetch the top block's hash
    *
@@ -1594,6 +1743,12 @@ public:
    */
   virtual bool check_pruning() = 0;
 
+  /**
+   * @brief get the progress of the pruning pass in progress, if any
+   * @return the pruning progress
+   */
+  virtual pruning_progress get_pruning_progress() const = 0;
+
   /**
    * @brief get the max block size
    */
@@ -1811,6 +1966,48 @@ public:
    */
   virtual uint64_t get_database_size() const = 0;
 
+  /**
+   * @brief get transaction blob compression settings and counters
+   *
+   * Counters cover the records encoded and decoded since the database
+   * was opened.
+   *
+   * @return the compression stats
+   */
+  virtual tx_compression_stats get_tx_compression_stats() const = 0;
+
+  /**
+   * @brief start writing a compacted copy of the database in the background
+   *
+   * The copy is a consistent snapshot of the database as of the moment it
+   * starts, and is written to a new database file in the given folder while
+   * the database stays in use.
+   *
+   * If a snapshot is already running, or the destination already holds a
+   * database, the subclass should throw DB_ERROR.
+   *
+   * The caller must make sure no write txn is in progress, as the subclass
+   * may need to grow the database first.
+   *
+   * @param path the destination folder, created if needed
+   * @param max_bytes_per_second write rate limit, 0 for none
+   */
+  virtual void start_snapshot(const std::string& path, uint64_t max_bytes_per_second) = 0;
+
+  /**
+   * @brief get the progress of the current or last snapshot
+   *
+   * @return the snapshot status
+   */
+  virtual db_snapshot_status get_snapshot_status() const = 0;
+
+  /**
+   * @brief get table sizes, operation counters and txn latencies
+   *
+   * @return the database statistics
+   */
+  virtual db_stats get_db_stats() const = 0;
+
   // TODO: this should perhaps be (or call) a series of functions which
   // progressively update through version updates
   /**
@@ -33,15 +33,21 @@
 #include <boost/circular_buffer.hpp>
 #include <memory>  // std::unique_ptr
 #include <cstring>  // memcpy
+#ifndef _WIN32
+#include <unistd.h>  // pipe
+#include <sys/resource.h>  // getrusage
+#endif
 
 #include "string_tools.h"
 #include "file_io_utils.h"
 #include "common/util.h"
 #include "common/pruning.h"
+#include "common/threadpool.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_basic/random_numbers.h"
 #include "crypto/crypto.h"
 #include "profile_tools.h"
+#include "misc_language.h"
 #include "ringct/rctOps.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -57,7 +63,10 @@ using namespace crypto;
 
 // Increase when the DB changes in a non backward compatible way, and there
 // is no automatic conversion, so that a full resync is needed.
-#define VERSION 4
+#define VERSION 6
+
+// free map space made before a snapshot starts, since a resize while it runs has to cancel it
+#define SNAPSHOT_MAP_HEADROOM (4ULL << 30)
 
 namespace
 {
@@ -181,6 +190,7 @@ namespace
  * blocks           block ID     block blob
  * block_heights    block hash   block height
  * block_info       block ID     {block metadata}
+ * block_headers    block ID     {fixed size block header fields}
  *
  * txs_pruned       txn ID       pruned txn blob
  * txs_prunable     txn ID       prunable txn blob
@@ -206,10 +216,14 @@ namespace
  * (DUPFIXED saves 8 bytes per record.)
  *
  * The output_amounts table doesn't use a dummy key, but uses DUPSORT.
+ *
+ * When the tx_compression property is set, txs_pruned and txs_prunable
+ * records are encoded by lmdb_tx_compression (see tx_compression.h).
  */
 const char* const LMDB_BLOCKS = "blocks";
 const char* const LMDB_BLOCK_HEIGHTS = "block_heights";
 const char* const LMDB_BLOCK_INFO = "block_info";
+const char* const LMDB_BLOCK_HEADERS = "block_headers";
 
 const char* const LMDB_TXS = "txs";
 const char* const LMDB_TXS_PRUNED = "txs_pruned";
@@ -242,12 +256,140 @@ const std::string lmdb_error(const std::string& error_string, int mdb_res)
   return full_string;
 }
 
+// Operation counters, per table handle. They are kept for the whole process,
+// like the txn counters in mdb_txn_safe, and read by get_db_stats.
+struct lmdb_table_counters
+{
+  std::atomic<uint64_t> lookups;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> cursor_steps;
+  std::atomic<uint64_t> bytes_read;
+  std::atomic<uint64_t> writes;
+  std::atomic<uint64_t> bytes_written;
+  std::atomic<uint64_t> deletes;
+};
+
+struct lmdb_latency_histogram
+{
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> total_us;
+  std::atomic<uint64_t> max_us;
+  std::atomic<uint64_t> buckets[cryptonote::db_latency_histogram::num_buckets];
+
+  void add(std::chrono::steady_clock::duration duration)
+  {
+    const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    size_t bucket = 0;
+    for (uint64_t bound = 10; us >= bound && bucket + 1 < cryptonote::db_latency_histogram::num_buckets; bound *= 10)
+      ++bucket;
+    count.fetch_add(1, std::memory_order_relaxed);
+    total_us.fetch_add(us, std::memory_order_relaxed);
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = max_us.load(std::memory_order_relaxed);
+    while (us > max && !max_us.compare_exchange_weak(max, us, std::memory_order_relaxed));
+  }
+
+  void get(cryptonote::db_latency_histogram &h) const
+  {
+    h.count = count;
+    h.total_us = total_us;
+    h.max_us = max_us;
+    for (size_t i = 0; i < cryptonote::db_latency_histogram::num_buckets; ++i)
+      h.buckets[i] = buckets[i];
+  }
+};
+
+constexpr MDB_dbi LMDB_MAX_COUNTED_DBS = 32;
+
+struct lmdb_counters_t
+{
+  lmdb_table_counters tables[LMDB_MAX_COUNTED_DBS];
+  lmdb_table_counters other;
+  std::atomic<uint64_t> resizes;
+  std::atomic<uint64_t> resize_time_ms;
+  lmdb_latency_histogram read_txn;
+  lmdb_latency_histogram write_txn;
+  lmdb_latency_histogram commit;
+} lmdb_counters;
+
+inline lmdb_table_counters &table_counters(MDB_dbi dbi)
+{
+  return dbi < LMDB_MAX_COUNTED_DBS ? lmdb_counters.tables[dbi] : lmdb_counters.other;
+}
+
 inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi, const std::string& error_string)
 {
   if (auto res = mdb_dbi_open(txn, name, flags, &dbi))
     throw0(cryptonote::DB_OPEN_FAILURE((lmdb_error(error_string + " : ", res) + std::string(" - you may want to start with --db-salvage")).c_str()));
 }
 
+inline void count_read(lmdb_table_counters &c, int ret, const MDB_val *key, const MDB_val *data)
+{
+  if (ret == 0)
+    c.bytes_read.fetch_add((key ? key->mv_size : 0) + (data ? data->mv_size : 0), std::memory_order_relaxed);
+  else if (ret == MDB_NOTFOUND)
+    c.misses.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline int lmdb_get(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data)
+{
+  const int ret = mdb_get(txn, dbi, key, data);
+  lmdb_table_counters &c = table_counters(dbi);
+  c.lookups.fetch_add(1, std::memory_order_relaxed);
+  count_read(c, ret, NULL, data);
+  return ret;
+}
+
+inline int lmdb_cursor_get(MDB_cursor *cursor, MDB_val *key, MDB_val *data, MDB_cursor_op op)
+{
+  const int ret = mdb_cursor_get(cursor, key, data, op);
+  lmdb_table_counters &c = table_counters(mdb_cursor_dbi(cursor));
+  switch (op)
+  {
+    case MDB_FIRST: case MDB_LAST: case MDB_SET: case MDB_SET_KEY: case MDB_SET_RANGE:
+    case MDB_GET_BOTH: case MDB_GET_BOTH_RANGE:
+      c.lookups.fetch_add(1, std::memory_order_relaxed);
+      break;
+    default:
+      c.cursor_steps.fetch_add(1, std::memory_order_relaxed);
+      break;
+  }
+  count_read(c, ret, key, data);
+  return ret;
+}
+
+inline int lmdb_put(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data, unsigned int flags)
+{
+  const int ret = mdb_put(txn, dbi, key, data, flags);
+  lmdb_table_counters &c = table_counters(dbi);
+  c.writes.fetch_add(1, std::memory_order_relaxed);
+  c.bytes_written.fetch_add(key->mv_size + data->mv_size, std::memory_order_relaxed);
+  return ret;
+}
+
+inline int lmdb_cursor_put(MDB_cursor *cursor, MDB_val *key, MDB_val *data, unsigned int flags)
+{
+  const int ret = mdb_cursor_put(cursor, key, data, flags);
+  lmdb_table_counters &c = table_counters(mdb_cursor_dbi(cursor));
+  c.writes.fetch_add(1, std::memory_order_relaxed);
+  c.bytes_written.fetch_add(key->mv_size + data->mv_size, std::memory_order_relaxed);
+  return ret;
+}
+
+inline int lmdb_del(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data)
+{
+  const int ret = mdb_del(txn, dbi, key, data);
+  table_counters(dbi).deletes.fetch_add(1, std::memory_order_relaxed);
+  return ret;
+}
+
+inline int lmdb_cursor_del(MDB_cursor *cursor, unsigned int flags)
+{
+  const int ret = mdb_cursor_del(cursor, flags);
+  table_counters(mdb_cursor_dbi(cursor)).deletes.fetch_add(1, std::memory_order_relaxed);
+  return ret;
+}
+
 
 }  // anonymous namespace
 
@@ -329,6 +471,7 @@ mdb_txn_safe::~mdb_txn_safe()
   LOG_PRINT_L3("mdb_txn_safe: destructor");
   if (m_tinfo != nullptr)
   {
+    lmdb_counters.read_txn.add(std::chrono::steady_clock::now() - m_tinfo->m_ti_start);
     mdb_txn_reset(m_tinfo->m_ti_rtxn);
     memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
   } else if (m_txn != nullptr)
@@ -365,12 +508,19 @@ void mdb_txn_safe::commit(std::string message)
     message = "Failed to commit a transaction to the db";
   }
 
+  const auto commit_start = std::chrono::steady_clock::now();
   if (auto result = mdb_txn_commit(m_txn))
   {
     m_txn = nullptr;
     throw0(DB_ERROR(lmdb_error(message + ": ", result).c_str()));
   }
   m_txn = nullptr;
+  const auto commit_end = std::chrono::steady_clock::now();
+  lmdb_counters.commit.add(commit_end - commit_start);
+  // txns begun directly with mdb_txn_begin, as by the migrations, are not timed
+  if (m_start != std::chrono::steady_clock::time_point())
+    lmdb_counters.write_txn.add(commit_end - m_start);
+  m_start = std::chrono::steady_clock::time_point();
 }
 
 void mdb_txn_safe::abort()
@@ -412,6 +562,7 @@ void lmdb_resized(MDB_env *env)
   mdb_txn_safe::prevent_new_txns();
 
   MGINFO("LMDB map resize detected.");
+  ++lmdb_counters.resizes;
 
   MDB_envinfo mei;
 
@@ -442,6 +593,14 @@ inline int lmdb_txn_begin(MDB_env *env, MDB_txn *parent, unsigned int flags, MDB
   return res;
 }
 
+inline int lmdb_txn_begin(MDB_env *env, MDB_txn *parent, unsigned int flags, mdb_txn_safe &txn)
+{
+  const int res = lmdb_txn_begin(env, parent, flags, &txn.m_txn);
+  if (!res)
+    txn.m_start = std::chrono::steady_clock::now();
+  return res;
+}
+
 inline int lmdb_txn_renew(MDB_txn *txn)
 {
   int res = mdb_txn_renew(txn);
@@ -501,6 +660,20 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 
   new_mapsize += (new_mapsize % mst.ms_psize);
 
+  // A resize has to wait for the snapshot's read txn, and would block every
+  // other txn until the copy is done. The map was grown before the copy
+  // started, so if that was not enough the snapshot gives way: it is
+  // cancelled, or on Windows, where the copy can't be interrupted, waited for.
+  if (m_snapshot_copying)
+  {
+    MWARNING("Cancelling the running snapshot, the LMDB map needs to grow");
+    m_snapshot_stop = true;
+    boost::unique_lock<boost::mutex> lock(m_snapshot_mutex);
+    while (m_snapshot_copying)
+      m_snapshot_done.wait(lock);
+  }
+
+  const auto resize_start = std::chrono::steady_clock::now();
   mdb_txn_safe::prevent_new_txns();
 
   if (m_write_txn != nullptr)
@@ -524,6 +697,9 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
   MGINFO("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB");
 
   mdb_txn_safe::allow_new_txns();
+
+  ++lmdb_counters.resizes;
+  lmdb_counters.resize_time_ms += std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - resize_start).count();
 }
 
 // threshold_size is used for batch transactions
@@ -689,13 +865,13 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, uint64_t l
   CURSOR(block_heights)
   blk_height bh = {blk_hash, m_height};
   MDB_val_set(val_h, bh);
-  if (mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH) == 0)
+  if (lmdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH) == 0)
     throw1(BLOCK_EXISTS("Attempting to add block that's already in the db"));
 
   if (m_height > 0)
   {
     MDB_val_set(parent_key, blk.prev_id);
-    int result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &parent_key, MDB_GET_BOTH);
+    int result = lmdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &parent_key, MDB_GET_BOTH);
     if (result)
     {
       LOG_PRINT_L3("m_height: " << m_height);
@@ -713,11 +889,12 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, uint64_t l
 
   CURSOR(blocks)
   CURSOR(block_info)
+  CURSOR(block_headers)
 
   // this call to mdb_cursor_put will change height()
   cryptonote::blobdata block_blob(block_to_blob(blk));
   MDB_val_sized(blob, block_blob);
-  result = mdb_cursor_put(m_cur_blocks, &key, &blob, MDB_APPEND);
+  result = lmdb_cursor_put(m_cur_blocks, &key, &blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block blob to db transaction: ", result).c_str()));
 
@@ -735,7 +912,7 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, uint64_t l
   {
     uint64_t last_height = m_height-1;
     MDB_val_set(h, last_height);
-    if ((result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
+    if ((result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
         throw1(BLOCK_DNE(lmdb_error("Failed to get block info: ", result).c_str()));
     const mdb_block_info *bi_prev = (const mdb_block_info*)h.mv_data;
     bi.bi_cum_rct += bi_prev->bi_cum_rct;
@@ -744,11 +921,29 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, uint64_t l
   bi.bi_long_term_block_weight = long_term_block_weight;
 
   MDB_val_set(val, bi);
-  result = mdb_cursor_put(m_cur_block_info, (MDB_val *)&zerokval, &val, MDB_APPENDDUP);
+  result = lmdb_cursor_put(m_cur_block_info, (MDB_val *)&zerokval, &val, MDB_APPENDDUP);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block info to db transaction: ", result).c_str()));
 
-  result = mdb_cursor_put(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, 0);
+  mdb_block_header hd;
+  memset(&hd, 0, sizeof(hd));
+  hd.hd_height = m_height;
+  hd.hd_timestamp = blk.timestamp;
+  for (const tx_out &out: blk.miner_tx.vout)
+    hd.hd_reward += out.amount;
+  hd.hd_num_txes = blk.tx_hashes.size();
+  hd.hd_prev_id = blk.prev_id;
+  hd.hd_miner_tx_hash = get_transaction_hash(blk.miner_tx);
+  hd.hd_nonce = blk.nonce;
+  hd.hd_major_version = blk.major_version;
+  hd.hd_minor_version = blk.minor_version;
+
+  MDB_val_set(val_hd, hd);
+  result = lmdb_cursor_put(m_cur_block_headers, (MDB_val *)&zerokval, &val_hd, MDB_APPENDDUP);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to add block header to db transaction: ", result).c_str()));
+
+  result = lmdb_cursor_put(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block height by hash to db transaction: ", result).c_str()));
 
@@ -769,11 +964,12 @@ void BlockchainLMDB::remove_block()
 
   mdb_txn_cursors *m_cursors = &m_wcursors;
   CURSOR(block_info)
+  CURSOR(block_headers)
   CURSOR(block_heights)
   CURSOR(blocks)
   MDB_val_copy<uint64_t> k(m_height - 1);
   MDB_val h = k;
-  if ((result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
+  if ((result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
       throw1(BLOCK_DNE(lmdb_error("Attempting to remove block that's not in the db: ", result).c_str()));
 
   // must use h now; deleting from m_block_info will invalidate it
@@ -781,16 +977,22 @@ void BlockchainLMDB::remove_block()
   blk_height bh = {bi->bi_hash, 0};
   h.mv_data = (void *)&bh;
   h.mv_size = sizeof(bh);
-  if ((result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
+  if ((result = lmdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
       throw1(DB_ERROR(lmdb_error("Failed to locate block height by hash for removal: ", result).c_str()));
-  if ((result = mdb_cursor_del(m_cur_block_heights, 0)))
+  if ((result = lmdb_cursor_del(m_cur_block_heights, 0)))
       throw1(DB_ERROR(lmdb_error("Failed to add removal of block height by hash to db transaction: ", result).c_str()));
 
-  if ((result = mdb_cursor_del(m_cur_blocks, 0)))
+  if ((result = lmdb_cursor_del(m_cur_blocks, 0)))
       throw1(DB_ERROR(lmdb_error("Failed to add removal of block to db transaction: ", result).c_str()));
 
-  if ((result = mdb_cursor_del(m_cur_block_info, 0)))
+  if ((result = lmdb_cursor_del(m_cur_block_info, 0)))
       throw1(DB_ERROR(lmdb_error("Failed to add removal of block info to db transaction: ", result).c_str()));
+
+  h = k;
+  if ((result = lmdb_cursor_get(m_cur_block_headers, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
+      throw1(DB_ERROR(lmdb_error("Failed to locate block header for removal: ", result).c_str()));
+  if ((result = lmdb_cursor_del(m_cur_block_headers, 0)))
+      throw1(DB_ERROR(lmdb_error("Failed to add removal of block header to db transaction: ", result).c_str()));
 }
 
 uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, const std::pair<transaction, blobdata>& txp, const crypto::hash& tx_hash, const crypto::hash& tx_prunable_hash)
@@ -811,7 +1013,7 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
 
   MDB_val_set(val_tx_id, tx_id);
   MDB_val_set(val_h, tx_hash);
-  result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH);
+  result = lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH);
   if (result == 0) {
     txindex *tip = (txindex *)val_h.mv_data;
     throw1(TX_EXISTS(std::string("Attempting to add transaction that's already in the db (tx id ").append(boost::lexical_cast<std::string>(tip->data.tx_id)).append(")").c_str()));
@@ -829,7 +1031,7 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
   val_h.mv_size = sizeof(ti);
   val_h.mv_data = (void *)&ti;
 
-  result = mdb_cursor_put(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, 0);
+  result = lmdb_cursor_put(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add tx data to db transaction: ", result).c_str()));
 
@@ -849,20 +1051,23 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
   if (unprunable_size > blob.size())
     throw0(DB_ERROR("pruned tx size is larger than tx size"));
 
+  std::string encoded_blob;
   MDB_val pruned_blob = {unprunable_size, (void*)blob.data()};
-  result = mdb_cursor_put(m_cur_txs_pruned, &val_tx_id, &pruned_blob, MDB_APPEND);
+  pruned_blob = m_tx_compression.encode(txc_pruned, pruned_blob, encoded_blob);
+  result = lmdb_cursor_put(m_cur_txs_pruned, &val_tx_id, &pruned_blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add pruned tx blob to db transaction: ", result).c_str()));
 
   MDB_val prunable_blob = {blob.size() - unprunable_size, (void*)(blob.data() + unprunable_size)};
-  result = mdb_cursor_put(m_cur_txs_prunable, &val_tx_id, &prunable_blob, MDB_APPEND);
+  prunable_blob = m_tx_compression.encode(txc_prunable, prunable_blob, encoded_blob);
+  result = lmdb_cursor_put(m_cur_txs_prunable, &val_tx_id, &prunable_blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add prunable tx blob to db transaction: ", result).c_str()));
 
   if (get_blockchain_pruning_seed())
   {
     MDB_val_set(val_height, m_height);
-    result = mdb_cursor_put(m_cur_txs_prunable_tip, &val_tx_id, &val_height, 0);
+    result = lmdb_cursor_put(m_cur_txs_prunable_tip, &val_tx_id, &val_height, 0);
     if (result)
       throw0(DB_ERROR(lmdb_error("Failed to add prunable tx id to db transaction: ", result).c_str()));
   }
@@ -870,7 +1075,7 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
   if (tx.version > 1)
   {
     MDB_val_set(val_prunable_hash, tx_prunable_hash);
-    result = mdb_cursor_put(m_cur_txs_prunable_hash, &val_tx_id, &val_prunable_hash, MDB_APPEND);
+    result = lmdb_cursor_put(m_cur_txs_prunable_hash, &val_tx_id, &val_prunable_hash, MDB_APPEND);
     if (result)
       throw0(DB_ERROR(lmdb_error("Failed to add prunable tx prunable hash to db transaction: ", result).c_str()));
   }
@@ -897,62 +1102,62 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash& tx_hash, const
 
   MDB_val_set(val_h, tx_hash);
 
-  if (mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH))
+  if (lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &val_h, MDB_GET_BOTH))
       throw1(TX_DNE("Attempting to remove transaction that isn't in the db"));
   txindex *tip = (txindex *)val_h.mv_data;
   MDB_val_set(val_tx_id, tip->data.tx_id);
 
-  if ((result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, NULL, MDB_SET)))
+  if ((result = lmdb_cursor_get(m_cur_txs_pruned, &val_tx_id, NULL, MDB_SET)))
       throw1(DB_ERROR(lmdb_error("Failed to locate pruned tx for removal: ", result).c_str()));
-  result = mdb_cursor_del(m_cur_txs_pruned, 0);
+  result = lmdb_cursor_del(m_cur_txs_pruned, 0);
   if (result)
       throw1(DB_ERROR(lmdb_error("Failed to add removal of pruned tx to db transaction: ", result).c_str()));
 
-  result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, NULL, MDB_SET);
+  result = lmdb_cursor_get(m_cur_txs_prunable, &val_tx_id, NULL, MDB_SET);
   if (result == 0)
   {
-      result = mdb_cursor_del(m_cur_txs_prunable, 0);
+      result = lmdb_cursor_del(m_cur_txs_prunable, 0);
       if (result)
           throw1(DB_ERROR(lmdb_error("Failed to add removal of prunable tx to db transaction: ", result).c_str()));
   }
   else if (result != MDB_NOTFOUND)
       throw1(DB_ERROR(lmdb_error("Failed to locate prunable tx for removal: ", result).c_str()));
 
-  result = mdb_cursor_get(m_cur_txs_prunable_tip, &val_tx_id, NULL, MDB_SET);
+  result = lmdb_cursor_get(m_cur_txs_prunable_tip, &val_tx_id, NULL, MDB_SET);
   if (result && result != MDB_NOTFOUND)
       throw1(DB_ERROR(lmdb_error("Failed to locate tx id for removal: ", result).c_str()));
   if (result == 0)
   {
-    result = mdb_cursor_del(m_cur_txs_prunable_tip, 0);
+    result = lmdb_cursor_del(m_cur_txs_prunable_tip, 0);
     if (result)
         throw1(DB_ERROR(lmdb_error("Error adding removal of tx id to db transaction", result).c_str()));
   }
 
   if (tx.version > 1)
   {
-    if ((result = mdb_cursor_get(m_cur_txs_prunable_hash, &val_tx_id, NULL, MDB_SET)))
+    if ((result = lmdb_cursor_get(m_cur_txs_prunable_hash, &val_tx_id, NULL, MDB_SET)))
         throw1(DB_ERROR(lmdb_error("Failed to locate prunable hash tx for removal: ", result).c_str()));
-    result = mdb_cursor_del(m_cur_txs_prunable_hash, 0);
+    result = lmdb_cursor_del(m_cur_txs_prunable_hash, 0);
     if (result)
         throw1(DB_ERROR(lmdb_error("Failed to add removal of prunable hash tx to db transaction: ", result).c_str()));
   }
 
   remove_tx_outputs(tip->data.tx_id, tx);
 
-  result = mdb_cursor_get(m_cur_tx_outputs, &val_tx_id, NULL, MDB_SET);
+  result = lmdb_cursor_get(m_cur_tx_outputs, &val_tx_id, NULL, MDB_SET);
   if (result == MDB_NOTFOUND)
     LOG_PRINT_L1("tx has no outputs to remove: " << tx_hash);
   else if (result)
     throw1(DB_ERROR(lmdb_error("Failed to locate tx outputs for removal: ", result).c_str()));
   if (!result)
   {
-    result = mdb_cursor_del(m_cur_tx_outputs, 0);
+    result = lmdb_cursor_del(m_cur_tx_outputs, 0);
     if (result)
       throw1(DB_ERROR(lmdb_error("Failed to add removal of tx outputs to db transaction: ", result).c_str()));
   }
 
   // Don't delete the tx_indices entry until the end, after we're done with val_tx_id
-  if (mdb_cursor_del(m_cur_tx_indices, 0))
+  if (lmdb_cursor_del(m_cur_tx_indices, 0))
       throw1(DB_ERROR("Failed to add removal of tx index to db transaction"));
 }
 
@@ -981,14 +1186,14 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash& tx_hash,
   outtx ot = {m_num_outputs, tx_hash, local_index};
   MDB_val_set(vot, ot);
 
-  result = mdb_cursor_put(m_cur_output_txs, (MDB_val *)&zerokval, &vot, MDB_APPENDDUP);
+  result = lmdb_cursor_put(m_cur_output_txs, (MDB_val *)&zerokval, &vot, MDB_APPENDDUP);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add output tx hash to db transaction: ", result).c_str()));
 
   outkey ok;
   MDB_val data;
   MDB_val_copy<uint64_t> val_amount(tx_output.amount);
-  result = mdb_cursor_get(m_cur_output_amounts, &val_amount, &data, MDB_SET);
+  result = lmdb_cursor_get(m_cur_output_amounts, &val_amount, &data, MDB_SET);
   if (!result)
     {
       mdb_size_t num_elems = 0;
@@ -1016,7 +1221,7 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash& tx_hash,
   }
   data.mv_data = &ok;
 
-  if ((result = mdb_cursor_put(m_cur_output_amounts, &val_amount, &data, MDB_APPENDDUP)))
+  if ((result = lmdb_cursor_put(m_cur_output_amounts, &val_amount, &data, MDB_APPENDDUP)))
       throw0(DB_ERROR(lmdb_error("Failed to add output pubkey to db transaction: ", result).c_str()));
 
   return ok.amount_index;
@@ -1040,7 +1245,7 @@ void BlockchainLMDB::add_tx_amount_output_indices(const uint64_t tx_id,
   v.mv_size = sizeof(uint64_t) * num_outputs;
   // LOG_PRINT_L1("tx_outputs[tx_hash] size: " << v.mv_size);
 
-  result = mdb_cursor_put(m_cur_tx_outputs, &k_tx_id, &v, MDB_APPEND);
+  result = lmdb_cursor_put(m_cur_tx_outputs, &k_tx_id, &v, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(std::string("Failed to add <tx hash, amount output index array> to db transaction: ").append(mdb_strerror(result)).c_str()));
 }
@@ -1079,7 +1284,7 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t& out_in
   MDB_val_set(k, amount);
   MDB_val_set(v, out_index);
 
-  auto result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+  auto result = lmdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
   if (result == MDB_NOTFOUND)
     throw1(OUTPUT_DNE("Attempting to get an output index by amount and amount index, but amount not found"));
   else if (result)
@@ -1087,7 +1292,7 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t& out_in
 
   const pre_rct_outkey *ok = (const pre_rct_outkey *)v.mv_data;
   MDB_val_set(otxk, ok->output_id);
-  result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &otxk, MDB_GET_BOTH);
+  result = lmdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &otxk, MDB_GET_BOTH);
   if (result == MDB_NOTFOUND)
   {
     throw0(DB_ERROR("Unexpected: global output index not found in m_output_txs"));
@@ -1096,12 +1301,12 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t& out_in
   {
     throw1(DB_ERROR(lmdb_error("Error adding removal of output tx to db transaction", result).c_str()));
   }
-  result = mdb_cursor_del(m_cur_output_txs, 0);
+  result = lmdb_cursor_del(m_cur_output_txs, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error(std::string("Error deleting output index ").append(boost::lexical_cast<std::string>(out_index).append(": ")).c_str(), result).c_str()));
 
   // now delete the amount
-  result = mdb_cursor_del(m_cur_output_amounts, 0);
+  result = lmdb_cursor_del(m_cur_output_amounts, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error(std::string("Error deleting amount for output index ").append(boost::lexical_cast<std::string>(out_index).append(": ")).c_str(), result).c_str()));
 }
@@ -1118,7 +1323,7 @@ void BlockchainLMDB::prune_outputs(uint64_t amount)
 
   MDB_val v;
   MDB_val_set(k, amount);
-  int result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
+  int result = lmdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
   if (result == MDB_NOTFOUND)
     return;
   if (result)
@@ -1135,7 +1340,7 @@ void BlockchainLMDB::prune_outputs(uint64_t amount)
     const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
     output_ids.push_back(okp->output_id);
     MDEBUG("output id " << okp->output_id);
-    result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_NEXT_DUP);
+    result = lmdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_NEXT_DUP);
     if (result == MDB_NOTFOUND)
       break;
     if (result)
@@ -1144,17 +1349,17 @@ void BlockchainLMDB::prune_outputs(uint64_t amount)
   if (output_ids.size() != num_elems)
     throw0(DB_ERROR("Unexpected number of outputs"));
 
-  result = mdb_cursor_del(m_cur_output_amounts, MDB_NODUPDATA);
+  result = lmdb_cursor_del(m_cur_output_amounts, MDB_NODUPDATA);
   if (result)
     throw0(DB_ERROR(lmdb_error("Error deleting outputs: ", result).c_str()));
 
   for (uint64_t output_id: output_ids)
   {
     MDB_val_set(v, output_id);
-    result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+    result = lmdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
     if (result)
       throw0(DB_ERROR(lmdb_error("Error looking up output: ", result).c_str()));
-    result = mdb_cursor_del(m_cur_output_txs, 0);
+    result = lmdb_cursor_del(m_cur_output_txs, 0);
     if (result)
       throw0(DB_ERROR(lmdb_error("Error deleting output: ", result).c_str()));
   }
@@ -1169,7 +1374,7 @@ void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
   CURSOR(spent_keys)
 
   MDB_val k = {sizeof(k_image), (void *)&k_image};
-  if (auto result = mdb_cursor_put(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_NODUPDATA)) {
+  if (auto result = lmdb_cursor_put(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_NODUPDATA)) {
     if (result == MDB_KEYEXIST)
       throw1(KEY_IMAGE_EXISTS("Attempting to add spent key image that's already in the db"));
     else
@@ -1186,12 +1391,12 @@ void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
   CURSOR(spent_keys)
 
   MDB_val k = {sizeof(k_image), (void *)&k_image};
-  auto result = mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH);
+  auto result = lmdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH);
   if (result != 0 && result != MDB_NOTFOUND)
       throw1(DB_ERROR(lmdb_error("Error finding spent key to remove", result).c_str()));
   if (!result)
   {
-    result = mdb_cursor_del(m_cur_spent_keys, 0);
+    result = lmdb_cursor_del(m_cur_spent_keys, 0);
     if (result)
         throw1(DB_ERROR(lmdb_error("Error adding removal of key image to db transaction", result).c_str()));
   }
@@ -1224,6 +1429,10 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
   m_batch_active = false;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_pruning = false;
+  m_pruning_done = 0;
+  m_snapshot_stop = false;
+  m_snapshot_copying = false;
 
   // reset may also need changing when initialize things here
 
@@ -1344,6 +1553,21 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags, uint3
 
   lmdb_db_open(txn, LMDB_BLOCK_INFO, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_info, "Failed to open db handle for m_block_info");
   lmdb_db_open(txn, LMDB_BLOCK_HEIGHTS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_heights, "Failed to open db handle for m_block_heights");
+  // block_headers was added in version 6. An older database opened read-only will
+  // not have it, and is rejected by the version check below.
+  if (mdb_flags & MDB_RDONLY)
+  {
+    result = mdb_dbi_open(txn, LMDB_BLOCK_HEADERS, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED, &m_block_headers);
+    if (result && result != MDB_NOTFOUND)
+      throw0(DB_OPEN_FAILURE(lmdb_error("Failed to open db handle for m_block_headers: ", result).c_str()));
+    if (result == 0)
+      mdb_set_dupsort(txn, m_block_headers, compare_uint64);
+  }
+  else
+  {
+    lmdb_db_open(txn, LMDB_BLOCK_HEADERS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_headers, "Failed to open db handle for m_block_headers");
+    mdb_set_dupsort(txn, m_block_headers, compare_uint64);
+  }
 
   lmdb_db_open(txn, LMDB_TXS, MDB_INTEGERKEY | MDB_CREATE, m_txs, "Failed to open db handle for m_txs");
   lmdb_db_open(txn, LMDB_TXS_PRUNED, MDB_INTEGERKEY | MDB_CREATE, m_txs_pruned, "Failed to open db handle for m_txs_pruned");
@@ -1408,7 +1632,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags, uint3
 
   MDB_val_str(k, "version");
   MDB_val v;
-  auto get_result = mdb_get(txn, m_properties, &k, &v);
+  auto get_result = lmdb_get(txn, m_properties, &k, &v);
   if (get_result == MDB_SUCCESS)
   {
     const uint32_t db_version = *(const uint32_t*)v.mv_data;
@@ -1429,12 +1653,13 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags, uint3
         return;
       }
 
-      //migration only exists between v3 and v4 databases
-      if (db_version == 3)
+      //migrations exist from v3 databases onwards
+      if (db_version >= 3)
       {
         txn.commit();
         m_open = true;
         migrate(db_version);
+        init_tx_compression(db_flags & DBF_COMPRESS);
         return;
       }
       else
@@ -1461,7 +1686,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags, uint3
     {
       MDB_val_str(k, "version");
       MDB_val_copy<uint32_t> v(VERSION);
-      auto put_result = mdb_put(txn, m_properties, &k, &v, 0);
+      auto put_result = lmdb_put(txn, m_properties, &k, &v, 0);
       if (put_result != MDB_SUCCESS)
       {
         txn.abort();
@@ -1480,6 +1705,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags, uint3
   m_block_cache_height.store(0, std::memory_order_release);
 
   m_open = true;
+  init_tx_compression(db_flags & DBF_COMPRESS);
   // from here, init should be finished
 }
 
@@ -1494,6 +1720,12 @@ void BlockchainLMDB::close()
   this->sync();
   m_tinfo.reset();
 
+  if (m_snapshot_thread.joinable())
+  {
+    m_snapshot_stop = true;
+    m_snapshot_thread.join();
+  }
+
   // FIXME: not yet thread safe!!!  Use with care.
   mdb_env_close(m_env);
 
@@ -1538,6 +1770,8 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_blocks: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_block_info, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_block_info: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_block_headers, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_block_headers: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_block_heights, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_block_heights: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_txs_pruned, 0))
@@ -1567,8 +1801,9 @@ void BlockchainLMDB::reset()
   // init with current version
   MDB_val_str(k, "version");
   MDB_val_copy<uint32_t> v(VERSION);
-  if (auto result = mdb_put(txn, m_properties, &k, &v, 0))
+  if (auto result = lmdb_put(txn, m_properties, &k, &v, 0))
     throw0(DB_ERROR(lmdb_error("Failed to write version to database: ", result).c_str()));
+  m_tx_compression.save(txn, m_properties);
 
   txn.commit();
   m_cum_size = 0;
@@ -1693,14 +1928,14 @@ void BlockchainLMDB::add_txpool_tx(const crypto::hash &txid, const cryptonote::b
 
   MDB_val k = {sizeof(txid), (void *)&txid};
   MDB_val v = {sizeof(meta), (void *)&meta};
-  if (auto result = mdb_cursor_put(m_cur_txpool_meta, &k, &v, MDB_NODUPDATA)) {
+  if (auto result = lmdb_cursor_put(m_cur_txpool_meta, &k, &v, MDB_NODUPDATA)) {
     if (result == MDB_KEYEXIST)
       throw1(DB_ERROR("Attempting to add txpool tx metadata that's already in the db"));
     else
       throw1(DB_ERROR(lmdb_error("Error adding txpool tx metadata to db transaction: ", result).c_str()));
   }
   MDB_val_sized(blob_val, blob);
-  if (auto result = mdb_cursor_put(m_cur_txpool_blob, &k, &blob_val, MDB_NODUPDATA)) {
+  if (auto result = lmdb_cursor_put(m_cur_txpool_blob, &k, &blob_val, MDB_NODUPDATA)) {
     if (result == MDB_KEYEXIST)
       throw1(DB_ERROR("Attempting to add txpool tx blob that's already in the db"));
     else
@@ -1719,14 +1954,14 @@ void BlockchainLMDB::update_txpool_tx(const crypto::hash &txid, const txpool_tx_
 
   MDB_val k = {sizeof(txid), (void *)&txid};
   MDB_val v;
-  auto result = mdb_cursor_get(m_cur_txpool_meta, &k, &v, MDB_SET);
+  auto result = lmdb_cursor_get(m_cur_txpool_meta, &k, &v, MDB_SET);
   if (result != 0)
     throw1(DB_ERROR(lmdb_error("Error finding txpool tx meta to update: ", result).c_str()));
-  result = mdb_cursor_del(m_cur_txpool_meta, 0);
+  result = lmdb_cursor_del(m_cur_txpool_meta, 0);
   if (result)
     throw1(DB_ERROR(lmdb_error("Error adding removal of txpool tx metadata to db transaction: ", result).c_str()));
   v = MDB_val({sizeof(meta), (void *)&meta});
-  if ((result = mdb_cursor_put(m_cur_txpool_meta, &k, &v, MDB_NODUPDATA)) != 0) {
+  if ((result = lmdb_cursor_put(m_cur_txpool_meta, &k, &v, MDB_NODUPDATA)) != 0) {
     if (result == MDB_KEYEXIST)
       throw1(DB_ERROR("Attempting to add txpool tx metadata that's already in the db"));
     else
@@ -1763,7 +1998,7 @@ uint64_t BlockchainLMDB::get_txpool_tx_count(bool include_unrelayed_txes) const
     MDB_cursor_op op = MDB_FIRST;
     while (1)
     {
-      result = mdb_cursor_get(m_cur_txpool_meta, &k, &v, op);
+      result = lmdb_cursor_get(m_cur_txpool_meta, &k, &v, op);
       op = MDB_NEXT;
       if (result == MDB_NOTFOUND)
         break;
@@ -1788,7 +2023,7 @@ bool BlockchainLMDB::txpool_has_tx(const crypto::hash& txid) const
   RCURSOR(txpool_meta)
 
   MDB_val k = {sizeof(txid), (void *)&txid};
-  auto result = mdb_cursor_get(m_cur_txpool_meta, &k, NULL, MDB_SET);
+  auto result = lmdb_cursor_get(m_cur_txpool_meta, &k, NULL, MDB_SET);
   if (result != 0 && result != MDB_NOTFOUND)
     throw1(DB_ERROR(lmdb_error("Error finding txpool tx meta: ", result).c_str()));
   TXN_POSTFIX_RDONLY();
@@ -1805,21 +2040,21 @@ void BlockchainLMDB::remove_txpool_tx(const crypto::hash& txid)
   CURSOR(txpool_blob)
 
   MDB_val k = {sizeof(txid), (void *)&txid};
-  auto result = mdb_cursor_get(m_cur_txpool_meta, &k, NULL, MDB_SET);
+  auto result = lmdb_cursor_get(m_cur_txpool_meta, &k, NULL, MDB_SET);
   if (result != 0 && result != MDB_NOTFOUND)
     throw1(DB_ERROR(lmdb_error("Error finding txpool tx meta to remove: ", result).c_str()));
   if (!result)
   {
-    result = mdb_cursor_del(m_cur_txpool_meta, 0);
+    result = lmdb_cursor_del(m_cur_txpool_meta, 0);
     if (result)
       throw1(DB_ERROR(lmdb_error("Error adding removal of txpool tx metadata to db transaction: ", result).c_str()));
   }
-  result = mdb_cursor_get(m_cur_txpool_blob, &k, NULL, MDB_SET);
+  result = lmdb_cursor_get(m_cur_txpool_blob, &k, NULL, MDB_SET);
   if (result != 0 && result != MDB_NOTFOUND)
     throw1(DB_ERROR(lmdb_error("Error finding txpool tx blob to remove: ", result).c_str()));
   if (!result)
   {
-    result = mdb_cursor_del(m_cur_txpool_blob, 0);
+    result = lmdb_cursor_del(m_cur_txpool_blob, 0);
     if (result)
       throw1(DB_ERROR(lmdb_error("Error adding removal of txpool tx blob to db transaction: ", result).c_str()));
   }
@@ -1835,7 +2070,7 @@ bool BlockchainLMDB::get_txpool_tx_meta(const crypto::hash& txid, txpool_tx_meta
 
   MDB_val k = {sizeof(txid), (void *)&txid};
   MDB_val v;
-  auto result = mdb_cursor_get(m_cur_txpool_meta, &k, &v, MDB_SET);
+  auto result = lmdb_cursor_get(m_cur_txpool_meta, &k, &v, MDB_SET);
   if (result == MDB_NOTFOUND)
       return false;
   if (result != 0)
@@ -1856,7 +2091,7 @@ bool BlockchainLMDB::get_txpool_tx_blob(const crypto::hash& txid, cryptonote::bl
 
   MDB_val k = {sizeof(txid), (void *)&txid};
   MDB_val v;
-  auto result = mdb_cursor_get(m_cur_txpool_blob, &k, &v, MDB_SET);
+  auto result = lmdb_cursor_get(m_cur_txpool_blob, &k, &v, MDB_SET);
   if (result == MDB_NOTFOUND)
     return false;
   if (result != 0)
@@ -1884,7 +2119,7 @@ uint32_t BlockchainLMDB::get_blockchain_pruning_seed() const
   RCURSOR(properties)
   MDB_val_str(k, "pruning_seed");
   MDB_val v;
-  int result = mdb_cursor_get(m_cur_properties, &k, &v, MDB_SET);
+  int result = lmdb_cursor_get(m_cur_properties, &k, &v, MDB_SET);
   if (result == MDB_NOTFOUND)
     return 0;
   if (result)
@@ -1897,19 +2132,163 @@ uint32_t BlockchainLMDB::get_blockchain_pruning_seed() const
   return pruning_seed;
 }
 
-static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id)
+bool BlockchainLMDB::is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id) const
 {
   MDB_val v;
-  int ret = mdb_cursor_get(c_txs_pruned, tx_id, &v, MDB_SET);
+  int ret = lmdb_cursor_get(c_txs_pruned, tx_id, &v, MDB_SET);
   if (ret)
     throw0(DB_ERROR(lmdb_error("Failed to find transaction pruned data: ", ret).c_str()));
   if (v.mv_size == 0)
     throw0(DB_ERROR("Invalid transaction pruned data"));
-  return cryptonote::is_v1_tx(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size});
+  if (!m_tx_compression.enabled())
+    return cryptonote::is_v1_tx(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size});
+  cryptonote::blobdata bd;
+  m_tx_compression.decode(txc_pruned, v, bd);
+  return cryptonote::is_v1_tx(bd);
 }
 
 enum { prune_mode_prune, prune_mode_update, prune_mode_check };
 
+struct prune_range_result
+{
+  std::vector<std::pair<uint64_t, uint64_t>> tip_txes; // tx id, block height
+  std::vector<uint64_t> prunable_txes;
+  size_t n_records = 0;
+  size_t n_prunable_records = 0;
+  uint64_t n_bytes = 0;
+  std::string error;
+};
+
+void BlockchainLMDB::set_pruning_phase(const char *phase, uint64_t total)
+{
+  boost::lock_guard<boost::mutex> lock(m_pruning_mutex);
+  m_pruning_progress.phase = phase;
+  m_pruning_progress.total = total;
+  m_pruning_done = 0;
+  m_pruning_phase_start = std::chrono::steady_clock::now();
+  MINFO("Pruning phase: " << phase);
+}
+
+pruning_progress BlockchainLMDB::get_pruning_progress() const
+{
+  boost::lock_guard<boost::mutex> lock(m_pruning_mutex);
+  pruning_progress progress = m_pruning_progress;
+  if (!progress.running)
+    return progress;
+  const auto now = std::chrono::steady_clock::now();
+  progress.done = std::min<uint64_t>(m_pruning_done, progress.total);
+  progress.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_pruning_start).count();
+  if (progress.done > 0 && progress.total > progress.done)
+  {
+    const uint64_t phase_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_pruning_phase_start).count();
+    progress.eta_seconds = phase_ms * (progress.total - progress.done) / progress.done / 1000;
+  }
+  return progress;
+}
+
+// runs on a threadpool thread, with its own read txn, over the transactions whose hash has
+// its most significant 32 bit word (as compare_hash32 orders them) in [hash_begin, hash_end)
+void BlockchainLMDB::prune_classify_range(int mode, uint32_t pruning_seed, uint64_t blockchain_height, uint64_t hash_begin, uint64_t hash_end,
+    prune_range_result &range)
+{
+  try
+  {
+    TXN_PREFIX_RDONLY();
+    RCURSOR(tx_indices);
+    RCURSOR(txs_pruned);
+    RCURSOR(txs_prunable);
+    RCURSOR(txs_prunable_tip);
+
+    crypto::hash first = crypto::null_hash;
+    const uint32_t first_word = hash_begin;
+    memcpy(first.data + sizeof(first) - sizeof(first_word), &first_word, sizeof(first_word));
+    MDB_val_set(vi, first);
+    MDB_cursor_op op = MDB_GET_BOTH_RANGE;
+    for (;; ++m_pruning_done)
+    {
+      int result = lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &vi, op);
+      op = MDB_NEXT_DUP;
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", result).c_str()));
+      txindex ti;
+      memcpy(&ti, vi.mv_data, sizeof(ti));
+      uint32_t word;
+      memcpy(&word, ti.key.data + sizeof(ti.key) - sizeof(word), sizeof(word));
+      if (word >= hash_end)
+        break;
+
+      ++range.n_records;
+      const uint64_t tx_id = ti.data.tx_id, block_height = ti.data.block_id;
+      MDB_val_set(kp, tx_id);
+      MDB_val v;
+      if (block_height + CRYPTONOTE_PRUNING_TIP_BLOCKS >= blockchain_height)
+      {
+        if (mode == prune_mode_check)
+        {
+          MDB_val_set(vp, block_height);
+          int result = lmdb_cursor_get(m_cur_txs_prunable_tip, &kp, &vp, MDB_SET);
+          if (result && result != MDB_NOTFOUND)
+            throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
+          if (result == MDB_NOTFOUND)
+            MERROR("Transaction not found in prunable tip table for height " << block_height << "/" << blockchain_height <<
+                ", seed " << epee::string_tools::to_string_hex(pruning_seed));
+        }
+        else
+        {
+          range.tip_txes.push_back(std::make_pair(tx_id, block_height));
+        }
+      }
+      if (!tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) && !is_v1_tx(m_cur_txs_pruned, &kp))
+      {
+        int result = lmdb_cursor_get(m_cur_txs_prunable, &kp, &v, MDB_SET);
+        if (result && result != MDB_NOTFOUND)
+          throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
+        if (mode == prune_mode_check)
+        {
+          if (result != MDB_NOTFOUND)
+            MERROR("Prunable data found for pruned height " << block_height << "/" << blockchain_height <<
+                ", seed " << epee::string_tools::to_string_hex(pruning_seed));
+        }
+        else
+        {
+          ++range.n_prunable_records;
+          if (result == MDB_NOTFOUND)
+          {
+            MDEBUG("Already pruned at height " << block_height << "/" << blockchain_height);
+          }
+          else
+          {
+            MDEBUG("Pruning at height " << block_height << "/" << blockchain_height);
+            range.prunable_txes.push_back(tx_id);
+            range.n_bytes += kp.mv_size + v.mv_size;
+          }
+        }
+      }
+      else
+      {
+        if (mode == prune_mode_check)
+        {
+          MDB_val_set(kp2, tx_id);
+          int result = lmdb_cursor_get(m_cur_txs_prunable, &kp2, &v, MDB_SET);
+          if (result && result != MDB_NOTFOUND)
+            throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
+          if (result == MDB_NOTFOUND)
+            MERROR("Prunable data not found for unpruned height " << block_height << "/" << blockchain_height <<
+                ", seed " << epee::string_tools::to_string_hex(pruning_seed));
+        }
+      }
+    }
+
+    TXN_POSTFIX_RDONLY();
+  }
+  catch (const std::exception &e)
+  {
+    range.error = e.what();
+  }
+}
+
 bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -1921,6 +2300,28 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
     throw0(DB_ERROR("Pruning seed not in range"));
   check_open();
 
+  // the periodic tip table update is cheap, and is skipped while a full pass runs
+  bool expected = false;
+  if (!m_pruning.compare_exchange_strong(expected, true))
+  {
+    if (mode == prune_mode_update)
+      return true;
+    throw0(DB_ERROR("Blockchain pruning is already in progress"));
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(m_pruning_mutex);
+    m_pruning_progress = pruning_progress();
+    m_pruning_progress.running = mode != prune_mode_update;
+    m_pruning_progress.phase = "starting";
+    m_pruning_start = m_pruning_phase_start = std::chrono::steady_clock::now();
+  }
+  m_pruning_done = 0;
+  const auto pruning_guard = epee::misc_utils::create_scope_leave_handler([this](){
+    boost::lock_guard<boost::mutex> lock(m_pruning_mutex);
+    m_pruning_progress = pruning_progress();
+    m_pruning = false;
+  });
+
   TIME_MEASURE_START(t);
 
   size_t n_total_records = 0, n_prunable_records = 0, n_pruned_records = 0, commit_counter = 0;
@@ -1938,7 +2339,7 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
 
   MDB_val_str(k, "pruning_seed");
   MDB_val v;
-  result = mdb_get(txn, m_properties, &k, &v);
+  result = lmdb_get(txn, m_properties, &k, &v);
   bool prune_tip_table = false;
   if (result == MDB_NOTFOUND)
   {
@@ -1955,7 +2356,7 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
     pruning_seed = tools::make_pruning_seed(pruning_seed, CRYPTONOTE_PRUNING_LOG_STRIPES);
     v.mv_data = &pruning_seed;
     v.mv_size = sizeof(pruning_seed);
-    result = mdb_put(txn, m_properties, &k, &v, 0);
+    result = lmdb_put(txn, m_properties, &k, &v, 0);
     if (result)
       throw0(DB_ERROR("Failed to save pruning seed"));
     prune_tip_table = false;
@@ -2002,7 +2403,7 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
     MDB_cursor_op op = MDB_FIRST;
     while (1)
     {
-      int ret = mdb_cursor_get(c_txs_prunable_tip, &k, &v, op);
+      int ret = lmdb_cursor_get(c_txs_prunable_tip, &k, &v, op);
       op = MDB_NEXT;
       if (ret == MDB_NOTFOUND)
         break;
@@ -2017,7 +2418,7 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
         if (!tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) && !is_v1_tx(c_txs_pruned, &k))
         {
           ++n_prunable_records;
-          result = mdb_cursor_get(c_txs_prunable, &k, &v, MDB_SET);
+          result = lmdb_cursor_get(c_txs_prunable, &k, &v, MDB_SET);
           if (result == MDB_NOTFOUND)
             MDEBUG("Already pruned at height " << block_height << "/" << blockchain_height);
           else if (result)
@@ -2028,12 +2429,12 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
             ++n_pruned_records;
             ++commit_counter;
             n_bytes += k.mv_size + v.mv_size;
-            result = mdb_cursor_del(c_txs_prunable, 0);
+            result = lmdb_cursor_del(c_txs_prunable, 0);
             if (result)
               throw0(DB_ERROR(lmdb_error("Failed to delete transaction prunable data: ", result).c_str()));
           }
         }
-        result = mdb_cursor_del(c_txs_prunable_tip, 0);
+        result = lmdb_cursor_del(c_txs_prunable_tip, 0);
         if (result)
           throw0(DB_ERROR(lmdb_error("Failed to delete transaction tip data: ", result).c_str()));
 
@@ -2060,117 +2461,99 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
   }
   else
   {
-    MDB_cursor *c_tx_indices;
-    result = mdb_cursor_open(txn, m_tx_indices, &c_tx_indices);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
-    MDB_cursor_op op = MDB_FIRST;
-    while (1)
-    {
-      int ret = mdb_cursor_get(c_tx_indices, &k, &v, op);
-      op = MDB_NEXT;
-      if (ret == MDB_NOTFOUND)
-        break;
-      if (ret)
-        throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
+    // Classify the transactions in parallel, outside of any write txn, each task walking
+    // its own slice of tx_indices by hash. The results are written and committed a window
+    // of slices at a time, so memory use does not grow with the size of the chain.
+    if ((result = mdb_stat(txn, m_txs_pruned, &db_stats)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_txs_pruned: ", result).c_str()));
+    const uint64_t n_txes = db_stats.ms_entries;
+    mdb_cursor_close(c_txs_prunable_tip);
+    mdb_cursor_close(c_txs_prunable);
+    mdb_cursor_close(c_txs_pruned);
+    txn.commit();
 
-      ++n_total_records;
-      //const txindex *ti = (const txindex *)v.mv_data;
-      txindex ti;
-      memcpy(&ti, v.mv_data, sizeof(ti));
-      const uint64_t block_height = ti.data.block_id;
-      if (block_height + CRYPTONOTE_PRUNING_TIP_BLOCKS >= blockchain_height)
-      {
-        MDB_val_set(kp, ti.data.tx_id);
-        MDB_val_set(vp, block_height);
-        if (mode == prune_mode_check)
-        {
-          result = mdb_cursor_get(c_txs_prunable_tip, &kp, &vp, MDB_SET);
-          if (result && result != MDB_NOTFOUND)
-            throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
-          if (result == MDB_NOTFOUND)
-            MERROR("Transaction not found in prunable tip table for height " << block_height << "/" << blockchain_height <<
-                ", seed " << epee::string_tools::to_string_hex(pruning_seed));
-        }
-        else
-        {
-          result = mdb_cursor_put(c_txs_prunable_tip, &kp, &vp, 0);
-          if (result && result != MDB_NOTFOUND)
-            throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
-        }
-      }
-      MDB_val_set(kp, ti.data.tx_id);
-      if (!tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) && !is_v1_tx(c_txs_pruned, &kp))
+    static const uint64_t txes_per_range = 16384;
+    const uint64_t n_ranges = std::max<uint64_t>(1, std::min<uint64_t>((n_txes + txes_per_range - 1) / txes_per_range, 1 << 20));
+    set_pruning_phase(mode == prune_mode_check ? "checking" : "pruning", n_txes);
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::priority_scope priority(tools::threadpool::priority_low);
+    tools::threadpool::waiter waiter;
+    const uint64_t window = 2 * std::max(1u, tpool.get_max_concurrency());
+    std::vector<prune_range_result> ranges;
+    for (uint64_t first = 0; first < n_ranges; first += window)
+    {
+      ranges.clear();
+      ranges.resize(std::min(window, n_ranges - first));
+      for (size_t i = 0; i < ranges.size(); ++i)
       {
-        result = mdb_cursor_get(c_txs_prunable, &kp, &v, MDB_SET);
-        if (result && result != MDB_NOTFOUND)
-          throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
-        if (mode == prune_mode_check)
-        {
-          if (result != MDB_NOTFOUND)
-            MERROR("Prunable data found for pruned height " << block_height << "/" << blockchain_height <<
-                ", seed " << epee::string_tools::to_string_hex(pruning_seed));
-        }
-        else
-        {
-          ++n_prunable_records;
-          if (result == MDB_NOTFOUND)
-            MDEBUG("Already pruned at height " << block_height << "/" << blockchain_height);
-          else
-          {
-            MDEBUG("Pruning at height " << block_height << "/" << blockchain_height);
-            ++n_pruned_records;
-            n_bytes += kp.mv_size + v.mv_size;
-            result = mdb_cursor_del(c_txs_prunable, 0);
-            if (result)
-              throw0(DB_ERROR(lmdb_error("Failed to delete transaction prunable data: ", result).c_str()));
-            ++commit_counter;
-          }
-        }
+        const uint64_t begin = ((first + i) << 32) / n_ranges, end = ((first + i + 1) << 32) / n_ranges;
+        tpool.submit(&waiter, [this, mode, pruning_seed, blockchain_height, begin, end, &ranges, i]() {
+          prune_classify_range(mode, pruning_seed, blockchain_height, begin, end, ranges[i]);
+        }, true);
       }
-      else
+      waiter.wait(&tpool);
+      for (const prune_range_result &range: ranges)
       {
-        if (mode == prune_mode_check)
-        {
-          MDB_val_set(kp, ti.data.tx_id);
-          result = mdb_cursor_get(c_txs_prunable, &kp, &v, MDB_SET);
-          if (result && result != MDB_NOTFOUND)
-            throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
-          if (result == MDB_NOTFOUND)
-            MERROR("Prunable data not found for unpruned height " << block_height << "/" << blockchain_height <<
-                ", seed " << epee::string_tools::to_string_hex(pruning_seed));
-        }
+        if (!range.error.empty())
+          throw0(DB_ERROR(range.error.c_str()));
+        n_total_records += range.n_records;
+        n_prunable_records += range.n_prunable_records;
+        n_bytes += range.n_bytes;
       }
 
-      if (mode != prune_mode_check && commit_counter >= 4096)
+      for (size_t i = 0; mode != prune_mode_check && i < ranges.size(); ++i)
       {
-        MDEBUG("Committing txn at checkpoint...");
-        txn.commit();
+        prune_range_result &range = ranges[i];
         result = mdb_txn_begin(m_env, NULL, 0, txn);
         if (result)
           throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-        result = mdb_cursor_open(txn, m_txs_pruned, &c_txs_pruned);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
         result = mdb_cursor_open(txn, m_txs_prunable, &c_txs_prunable);
         if (result)
           throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
         result = mdb_cursor_open(txn, m_txs_prunable_tip, &c_txs_prunable_tip);
         if (result)
           throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable_tip: ", result).c_str()));
-        result = mdb_cursor_open(txn, m_tx_indices, &c_tx_indices);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
-        MDB_val val;
-        val.mv_size = sizeof(ti);
-        val.mv_data = (void *)&ti;
-        result = mdb_cursor_get(c_tx_indices, (MDB_val*)&zerokval, &val, MDB_GET_BOTH);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to restore cursor for tx_indices: ", result).c_str()));
-        commit_counter = 0;
+        for (const auto &e: range.tip_txes)
+        {
+          MDB_val_set(kp, e.first);
+          MDB_val_set(vp, e.second);
+          result = lmdb_cursor_put(c_txs_prunable_tip, &kp, &vp, 0);
+          if (result && result != MDB_KEYEXIST)
+            throw0(DB_ERROR(lmdb_error("Error adding transaction prunable tip data: ", result).c_str()));
+        }
+        for (uint64_t tx_id: range.prunable_txes)
+        {
+          MDB_val_set(kp, tx_id);
+          result = lmdb_cursor_get(c_txs_prunable, &kp, &v, MDB_SET);
+          if (result && result != MDB_NOTFOUND)
+            throw0(DB_ERROR(lmdb_error("Error looking for transaction prunable data: ", result).c_str()));
+          if (result == 0)
+          {
+            ++n_pruned_records;
+            result = lmdb_cursor_del(c_txs_prunable, 0);
+            if (result)
+              throw0(DB_ERROR(lmdb_error("Failed to delete transaction prunable data: ", result).c_str()));
+          }
+        }
+        mdb_cursor_close(c_txs_prunable_tip);
+        mdb_cursor_close(c_txs_prunable);
+        txn.commit();
+        range = prune_range_result();
       }
     }
-    mdb_cursor_close(c_tx_indices);
+
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    result = mdb_cursor_open(txn, m_txs_pruned, &c_txs_pruned);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
+    result = mdb_cursor_open(txn, m_txs_prunable, &c_txs_prunable);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+    result = mdb_cursor_open(txn, m_txs_prunable_tip, &c_txs_prunable_tip);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable_tip: ", result).c_str()));
   }
 
   if ((result = mdb_stat(txn, m_txs_prunable, &db_stats)))
@@ -2224,7 +2607,7 @@ bool BlockchainLMDB::for_all_txpool_txes(std::function<bool(const crypto::hash&,
   MDB_cursor_op op = MDB_FIRST;
   while (1)
   {
-    int result = mdb_cursor_get(m_cur_txpool_meta, &k, &v, op);
+    int result = lmdb_cursor_get(m_cur_txpool_meta, &k, &v, op);
     op = MDB_NEXT;
     if (result == MDB_NOTFOUND)
       break;
@@ -2240,7 +2623,7 @@ bool BlockchainLMDB::for_all_txpool_txes(std::function<bool(const crypto::hash&,
     if (include_blob)
     {
       MDB_val b;
-      result = mdb_cursor_get(m_cur_txpool_blob, &k, &b, MDB_SET);
+      result = lmdb_cursor_get(m_cur_txpool_blob, &k, &b, MDB_SET);
       if (result == MDB_NOTFOUND)
         throw0(DB_ERROR("Failed to find txpool tx blob to match metadata"));
       if (result)
@@ -2275,7 +2658,7 @@ bool BlockchainLMDB::for_all_alt_blocks(std::function<bool(const crypto::hash&,
   MDB_cursor_op op = MDB_FIRST;
   while (1)
   {
-    int result = mdb_cursor_get(m_cur_alt_blocks, &k, &v, op);
+    int result = lmdb_cursor_get(m_cur_alt_blocks, &k, &v, op);
     op = MDB_NEXT;
     if (result == MDB_NOTFOUND)
       break;
@@ -2314,7 +2697,7 @@ bool BlockchainLMDB::block_exists(const crypto::hash& h, uint64_t *height) const
 
   bool ret = false;
   MDB_val_set(key, h);
-  auto get_result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
     LOG_PRINT_L3("Block with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
@@ -2352,7 +2735,7 @@ uint64_t BlockchainLMDB::get_block_height(const crypto::hash& h) const
   RCURSOR(block_heights);
 
   MDB_val_set(key, h);
-  auto get_result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
     throw1(BLOCK_DNE("Attempted to retrieve non-existent block height"));
   else if (get_result)
@@ -2400,7 +2783,7 @@ void BlockchainLMDB::build_block_cache(uint64_t height)
   for(uint64_t index = m_block_cache.size(); index < height; ++index)
   {
     MDB_val_set(query, index);
-    err = mdb_cursor_get(cur, (MDB_val*)&zerokval, &query, MDB_GET_BOTH); check_error(err);
+    err = lmdb_cursor_get(cur, (MDB_val*)&zerokval, &query, MDB_GET_BOTH); check_error(err);
     bi = (mdb_block_info*)query.mv_data;
     m_block_cache.push_back(*bi);
   }
@@ -2488,7 +2871,7 @@ void BlockchainLMDB::get_cna_v3_data(char *salt, uint64_t height, uint32_t seed)
     //block hash
     r = mt.next(1, (uint32_t)(height - 1));
     MDB_val_set(rh1, r);
-    err = mdb_cursor_get(cur, (MDB_val*)&zerokval, &rh1, MDB_GET_BOTH); check_error(err);
+    err = lmdb_cursor_get(cur, (MDB_val*)&zerokval, &rh1, MDB_GET_BOTH); check_error(err);
     bi = (mdb_block_info*)rh1.mv_data;
     std::memcpy(blob_data, bi->bi_hash.data, 32);
 
@@ -2507,28 +2890,28 @@ void BlockchainLMDB::get_cna_v3_data(char *salt, uint64_t height, uint32_t seed)
       w = mt.next(r - 5, r + 5);
 
       MDB_val_set(rx, x);
-      err = mdb_cursor_get(cur, (MDB_val*)&zerokval, &rx, MDB_GET_BOTH); check_error(err);
+      err = lmdb_cursor_get(cur, (MDB_val*)&zerokval, &rx, MDB_GET_BOTH); check_error(err);
       bi = (mdb_block_info*)rx.mv_data;
       t = (uint32_t)bi->bi_timestamp;
       std::memcpy(blob_data + a, &t, 4);
       a += 4;
 
       MDB_val_set(ry, y);
-      err = mdb_cursor_get(cur, (MDB_val*)&zerokval, &ry, MDB_GET_BOTH); check_error(err);
+      err = lmdb_cursor_get(cur, (MDB_val*)&zerokval, &ry, MDB_GET_BOTH); check_error(err);
       bi = (mdb_block_info*)ry.mv_data;
       t = (uint32_t)bi->bi_diff_lo;
       std::memcpy(blob_data + a, &t, 4);
       a += 4;
 
       MDB_val_set(rz, z);
-      err = mdb_cursor_get(cur, (MDB_val*)&zerokval, &rz, MDB_GET_BOTH); check_error(err);
+      err = lmdb_cursor_get(cur, (MDB_val*)&zerokval, &rz, MDB_GET_BOTH); check_error(err);
       bi = (mdb_block_info*)rz.mv_data;
       t = (uint32_t)(bi->bi_coins >> 32U);
       std::memcpy(blob_data + b, &t, 4);
       b += 4;
 
       MDB_val_set(rw, w);
-      err = mdb_cursor_get(cur, (MDB_val*)&zerokval, &rw, MDB_GET_BOTH); check_error(err);
+      err = lmdb_cursor_get(cur, (MDB_val*)&zerokval, &rw, MDB_GET_BOTH); check_error(err);
       bi = (mdb_block_info*)rw.mv_data;
       t = (uint32_t)bi->bi_coins;
       std::memcpy(blob_data + b, &t, 4);
@@ -2538,7 +2921,7 @@ void BlockchainLMDB::get_cna_v3_data(char *salt, uint64_t height, uint32_t seed)
     //block hash
     r = mt.next(1, (uint32_t)(height - 1));
     MDB_val_set(rh4, r);
-    err = mdb_cursor_get(cur, (MDB_val*)&zerokval, &rh4, MDB_GET_BOTH); check_error(err);
+    err = lmdb_cursor_get(cur, (MDB_val*)&zerokval, &rh4, MDB_GET_BOTH); check_error(err);
     bi = (mdb_block_info*)rh4.mv_data;
     std::memcpy(blob_data + 96, bi->bi_hash.data, 32);
 
@@ -2706,7 +3089,7 @@ cryptonote::blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t&
 
   MDB_val_copy<uint64_t> key(height);
   MDB_val result;
-  auto get_result = mdb_cursor_get(m_cur_blocks, &key, &result, MDB_SET);
+  auto get_result = lmdb_cursor_get(m_cur_blocks, &key, &result, MDB_SET);
   if (get_result == MDB_NOTFOUND)
   {
     throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
@@ -2731,7 +3114,7 @@ uint64_t BlockchainLMDB::get_block_timestamp(const uint64_t& height) const
   RCURSOR(block_info);
 
   MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
     throw0(BLOCK_DNE(std::string("Attempt to get timestamp from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- timestamp not in db").c_str()));
@@ -2781,7 +3164,7 @@ std::vector<uint64_t> BlockchainLMDB::get_block_cumulative_rct_outputs(const std
       if (height == prev_height + 1)
       {
         MDB_val k2;
-        result = mdb_cursor_get(m_cur_block_info, &k2, &v, MDB_NEXT_MULTIPLE);
+        result = lmdb_cursor_get(m_cur_block_info, &k2, &v, MDB_NEXT_MULTIPLE);
         range_begin = ((const mdb_block_info*)v.mv_data)->bi_height;
         range_end = range_begin + v.mv_size / sizeof(mdb_block_info); // whole records please
         if (height < range_begin || height >= range_end)
@@ -2791,7 +3174,7 @@ std::vector<uint64_t> BlockchainLMDB::get_block_cumulative_rct_outputs(const std
       {
         v.mv_size = sizeof(uint64_t);
         v.mv_data = (void*)&height;
-        result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+        result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
         range_begin = height;
         range_end = range_begin + 1;
       }
@@ -2831,7 +3214,7 @@ size_t BlockchainLMDB::get_block_weight(const uint64_t& height) const
   RCURSOR(block_info);
 
   MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
     throw0(BLOCK_DNE(std::string("Attempt to get block size from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
@@ -2874,7 +3257,7 @@ std::vector<uint64_t> BlockchainLMDB::get_block_info_64bit_fields(uint64_t start
       if (range_end > 0)
       {
         MDB_val k2;
-        result = mdb_cursor_get(m_cur_block_info, &k2, &v, MDB_NEXT_MULTIPLE);
+        result = lmdb_cursor_get(m_cur_block_info, &k2, &v, MDB_NEXT_MULTIPLE);
         range_begin = ((const mdb_block_info*)v.mv_data)->bi_height;
         range_end = range_begin + v.mv_size / sizeof(mdb_block_info); // whole records please
         if (height < range_begin || height >= range_end)
@@ -2884,7 +3267,7 @@ std::vector<uint64_t> BlockchainLMDB::get_block_info_64bit_fields(uint64_t start
       {
         v.mv_size = sizeof(uint64_t);
         v.mv_data = (void*)&height;
-        result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+        result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
         range_begin = height;
         range_end = range_begin + 1;
       }
@@ -2908,7 +3291,7 @@ uint64_t BlockchainLMDB::get_max_block_size()
   RCURSOR(properties)
   MDB_val_str(k, "max_block_size");
   MDB_val v;
-  int result = mdb_cursor_get(m_cur_properties, &k, &v, MDB_SET);
+  int result = lmdb_cursor_get(m_cur_properties, &k, &v, MDB_SET);
   if (result == MDB_NOTFOUND)
     return std::numeric_limits<uint64_t>::max();
   if (result)
@@ -2931,7 +3314,7 @@ void BlockchainLMDB::add_max_block_size(uint64_t sz)
 
   MDB_val_str(k, "max_block_size");
   MDB_val v;
-  int result = mdb_cursor_get(m_cur_properties, &k, &v, MDB_SET);
+  int result = lmdb_cursor_get(m_cur_properties, &k, &v, MDB_SET);
   if (result && result != MDB_NOTFOUND)
     throw0(DB_ERROR(lmdb_error("Failed to retrieve max block size: ", result).c_str()));
   uint64_t max_block_size = 0;
@@ -2945,7 +3328,7 @@ void BlockchainLMDB::add_max_block_size(uint64_t sz)
     max_block_size = sz;
   v.mv_data = (void*)&max_block_size;
   v.mv_size = sizeof(max_block_size);
-  result = mdb_cursor_put(m_cur_properties, &k, &v, 0);
+  result = lmdb_cursor_put(m_cur_properties, &k, &v, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to set max_block_size: ", result).c_str()));
 }
@@ -2970,7 +3353,7 @@ difficulty_type_128 BlockchainLMDB::get_block_cumulative_difficulty(const uint64
   RCURSOR(block_info);
 
   MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
     throw0(BLOCK_DNE(std::string("Attempt to get cumulative difficulty from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- difficulty not in db").c_str()));
@@ -3012,7 +3395,7 @@ uint64_t BlockchainLMDB::get_block_already_generated_coins(const uint64_t& heigh
   RCURSOR(block_info);
 
   MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
     throw0(BLOCK_DNE(std::string("Attempt to get generated coins from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
@@ -3035,7 +3418,7 @@ uint64_t BlockchainLMDB::get_block_long_term_weight(const uint64_t& height) cons
   RCURSOR(block_info);
 
   MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
     throw0(BLOCK_DNE(std::string("Attempt to get block long term weight from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block info not in db").c_str()));
@@ -3058,7 +3441,7 @@ crypto::hash BlockchainLMDB::get_block_hash_from_height(const uint64_t& height)
   RCURSOR(block_info);
 
   MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
     throw0(BLOCK_DNE(std::string("Attempt to get hash from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- hash not in db").c_str()));
@@ -3100,25 +3483,94 @@ std::vector<crypto::hash> BlockchainLMDB::get_hashes_range(const uint64_t& h1, c
   return v;
 }
 
-crypto::hash BlockchainLMDB::top_block_hash(uint64_t *block_height) const
+std::vector<block_header_info> BlockchainLMDB::get_block_headers_range(const uint64_t& h1, const uint64_t& h2) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-  uint64_t m_height = height();
-  if (block_height)
-    *block_height = m_height - 1;
-  if (m_height != 0)
-  {
-    return get_block_hash_from_height(m_height - 1);
-  }
 
-  return null_hash;
-}
+  TXN_PREFIX_RDONLY();
+  RCURSOR(block_info);
+  RCURSOR(block_headers);
 
-block BlockchainLMDB::get_top_block() const
-{
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  check_open();
+  std::vector<block_header_info> ret;
+  if (h1 > h2)
+    return ret;
+  ret.reserve(h2 - h1 + 1);
+
+  difficulty_type_128 prev_cumulative_difficulty = 0;
+  if (h1 > 0)
+    prev_cumulative_difficulty = get_block_cumulative_difficulty(h1 - 1);
+
+  // both tables are keyed by height, so the whole range is a walk along the dups
+  MDB_val v_info, v_header;
+  MDB_val_set(k_info, h1);
+  MDB_val_set(k_header, h1);
+  v_info = k_info;
+  v_header = k_header;
+  MDB_cursor_op op = MDB_GET_BOTH;
+  for (uint64_t height = h1; height <= h2; ++height)
+  {
+    int result = lmdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v_info, op);
+    if (result == MDB_NOTFOUND)
+      throw0(BLOCK_DNE(std::string("Attempt to get block info from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block info not in db").c_str()));
+    else if (result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve block info from the db: ", result).c_str()));
+    result = lmdb_cursor_get(m_cur_block_headers, (MDB_val *)&zerokval, &v_header, op);
+    if (result == MDB_NOTFOUND)
+      throw0(BLOCK_DNE(std::string("Attempt to get block header from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block header not in db").c_str()));
+    else if (result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve block header from the db: ", result).c_str()));
+    op = MDB_NEXT_DUP;
+
+    const mdb_block_info *bi = (const mdb_block_info *)v_info.mv_data;
+    const mdb_block_header *hd = (const mdb_block_header *)v_header.mv_data;
+    if (bi->bi_height != height || hd->hd_height != height)
+      throw0(DB_ERROR(("Unexpected height in block info or header, expected " + std::to_string(height)).c_str()));
+
+    block_header_info info;
+    info.height = height;
+    info.major_version = hd->hd_major_version;
+    info.minor_version = hd->hd_minor_version;
+    info.timestamp = hd->hd_timestamp;
+    info.nonce = hd->hd_nonce;
+    info.prev_id = hd->hd_prev_id;
+    info.hash = bi->bi_hash;
+    info.miner_tx_hash = hd->hd_miner_tx_hash;
+    info.reward = hd->hd_reward;
+    info.weight = bi->bi_weight;
+    info.long_term_weight = bi->bi_long_term_block_weight;
+    info.num_txes = hd->hd_num_txes;
+    info.cumulative_difficulty = difficulty_type_128(bi->bi_diff_hi);
+    info.cumulative_difficulty <<= 64;
+    info.cumulative_difficulty |= bi->bi_diff_lo;
+    info.difficulty = (info.cumulative_difficulty - prev_cumulative_difficulty).convert_to<uint64_t>();
+    prev_cumulative_difficulty = info.cumulative_difficulty;
+    ret.push_back(info);
+  }
+
+  TXN_POSTFIX_RDONLY();
+  return ret;
+}
+
+crypto::hash BlockchainLMDB::top_block_hash(uint64_t *block_height) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  uint64_t m_height = height();
+  if (block_height)
+    *block_height = m_height - 1;
+  if (m_height != 0)
+  {
+    return get_block_hash_from_height(m_height - 1);
+  }
+
+  return null_hash;
+}
+
+block BlockchainLMDB::get_top_block() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
   uint64_t m_height = height();
 
   if (m_height != 0)
@@ -3155,7 +3607,7 @@ uint64_t BlockchainLMDB::num_outputs() const
 
   uint64_t num = 0;
   MDB_val k, v;
-  result = mdb_cursor_get(m_cur_output_txs, &k, &v, MDB_LAST);
+  result = lmdb_cursor_get(m_cur_output_txs, &k, &v, MDB_LAST);
   if (result == MDB_NOTFOUND)
     num = 0;
   else if (result == 0)
@@ -3178,7 +3630,7 @@ bool BlockchainLMDB::tx_exists(const crypto::hash& h) const
   bool tx_found = false;
 
   TIME_MEASURE_START(time1);
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
   if (get_result == 0)
     tx_found = true;
   else if (get_result != MDB_NOTFOUND)
@@ -3209,7 +3661,7 @@ bool BlockchainLMDB::tx_exists(const crypto::hash& h, uint64_t& tx_id) const
   MDB_val_set(v, h);
 
   TIME_MEASURE_START(time1);
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   TIME_MEASURE_FINISH(time1);
   time_tx_exists += time1;
   if (!get_result) {
@@ -3241,7 +3693,7 @@ uint64_t BlockchainLMDB::get_tx_unlock_time(const crypto::hash& h) const
   RCURSOR(tx_indices);
 
   MDB_val_set(v, h);
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
     throw1(TX_DNE(lmdb_error(std::string("tx data with hash ") + epee::string_tools::pod_to_hex(h) + " not found in db: ", get_result).c_str()));
   else if (get_result)
@@ -3265,15 +3717,15 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
 
   MDB_val_set(v, h);
   MDB_val result0, result1;
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   if (get_result == 0)
   {
     txindex *tip = (txindex *)v.mv_data;
     MDB_val_set(val_tx_id, tip->data.tx_id);
-    get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result0, MDB_SET);
+    get_result = lmdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result0, MDB_SET);
     if (get_result == 0)
     {
-      get_result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result1, MDB_SET);
+      get_result = lmdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result1, MDB_SET);
     }
   }
   if (get_result == MDB_NOTFOUND)
@@ -3281,8 +3733,9 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
-  bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
+  bd.clear();
+  m_tx_compression.decode(txc_pruned, result0, bd);
+  m_tx_compression.decode(txc_prunable, result1, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -3300,19 +3753,20 @@ bool BlockchainLMDB::get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobd
 
   MDB_val_set(v, h);
   MDB_val result;
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   if (get_result == 0)
   {
     txindex *tip = (txindex *)v.mv_data;
     MDB_val_set(val_tx_id, tip->data.tx_id);
-    get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result, MDB_SET);
+    get_result = lmdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result, MDB_SET);
   }
   if (get_result == MDB_NOTFOUND)
     return false;
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  bd.clear();
+  m_tx_compression.decode(txc_pruned, result, bd);
   TXN_POSTFIX_RDONLY();
 
   return true;
@@ -3329,19 +3783,20 @@ bool BlockchainLMDB::get_prunable_tx_blob(const crypto::hash& h, cryptonote::blo
 
   MDB_val_set(v, h);
   MDB_val result;
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   if (get_result == 0)
   {
     const txindex *tip = (const txindex *)v.mv_data;
     MDB_val_set(val_tx_id, tip->data.tx_id);
-    get_result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result, MDB_SET);
+    get_result = lmdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result, MDB_SET);
   }
   if (get_result == MDB_NOTFOUND)
     return false;
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  bd.clear();
+  m_tx_compression.decode(txc_prunable, result, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -3359,12 +3814,12 @@ bool BlockchainLMDB::get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::h
 
   MDB_val_set(v, tx_hash);
   MDB_val result, val_tx_prunable_hash;
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   if (get_result == 0)
   {
     txindex *tip = (txindex *)v.mv_data;
     MDB_val_set(val_tx_id, tip->data.tx_id);
-    get_result = mdb_cursor_get(m_cur_txs_prunable_hash, &val_tx_id, &result, MDB_SET);
+    get_result = lmdb_cursor_get(m_cur_txs_prunable_hash, &val_tx_id, &result, MDB_SET);
   }
   if (get_result == MDB_NOTFOUND)
     return false;
@@ -3418,7 +3873,7 @@ uint64_t BlockchainLMDB::get_tx_block_height(const crypto::hash& h) const
   RCURSOR(tx_indices);
 
   MDB_val_set(v, h);
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
     throw1(TX_DNE(std::string("tx_data_t with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str()));
@@ -3443,7 +3898,7 @@ uint64_t BlockchainLMDB::get_num_outputs(const uint64_t& amount) const
   MDB_val_copy<uint64_t> k(amount);
   MDB_val v;
   mdb_size_t num_elems = 0;
-  auto result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
+  auto result = lmdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
   if (result == MDB_SUCCESS)
   {
     mdb_cursor_count(m_cur_output_amounts, &num_elems);
@@ -3466,7 +3921,7 @@ output_data_t BlockchainLMDB::get_output_key_only(const uint64_t& amount, const
 
   MDB_val_set(k, amount);
   MDB_val_set(v, index);
-  auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
     throw1(OUTPUT_DNE(std::string("Attempting to get output pubkey by index, but key does not exist: amount " +
         std::to_string(amount) + ", index " + std::to_string(index)).c_str()));
@@ -3498,7 +3953,7 @@ tx_out_index BlockchainLMDB::get_output_tx_and_index_from_global(const uint64_t&
 
   MDB_val_set(v, output_id);
 
-  auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  auto get_result = lmdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
     throw1(OUTPUT_DNE("output with given index not in db"));
   else if (get_result)
@@ -3541,7 +3996,7 @@ std::vector<std::vector<uint64_t>> BlockchainLMDB::get_tx_amount_output_indices(
   MDB_cursor_op op = MDB_SET;
   while (n_txes-- > 0)
   {
-    int result = mdb_cursor_get(m_cur_tx_outputs, &k_tx_id, &v, op);
+    int result = lmdb_cursor_get(m_cur_tx_outputs, &k_tx_id, &v, op);
     if (result == MDB_NOTFOUND)
       LOG_PRINT_L0("WARNING: Unexpected: tx has no amount indices stored in "
           "tx_outputs, but it should have an empty entry even if it's a tx without "
@@ -3578,7 +4033,7 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
   RCURSOR(spent_keys);
 
   MDB_val k = {sizeof(img), (void *)&img};
-  ret = (mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH) == 0);
+  ret = (lmdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH) == 0);
 
   TXN_POSTFIX_RDONLY();
   return ret;
@@ -3599,7 +4054,7 @@ bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_ima
   MDB_cursor_op op = MDB_FIRST;
   while (1)
   {
-    int ret = mdb_cursor_get(m_cur_spent_keys, &k, &v, op);
+    int ret = lmdb_cursor_get(m_cur_spent_keys, &k, &v, op);
     op = MDB_NEXT;
     if (ret == MDB_NOTFOUND)
       break;
@@ -3640,7 +4095,7 @@ bool BlockchainLMDB::for_blocks_range(const uint64_t& h1, const uint64_t& h2, st
   }
   while (1)
   {
-    int ret = mdb_cursor_get(m_cur_blocks, &k, &v, op);
+    int ret = lmdb_cursor_get(m_cur_blocks, &k, &v, op);
     op = MDB_NEXT;
     if (ret == MDB_NOTFOUND)
       break;
@@ -3685,7 +4140,7 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
   MDB_cursor_op op = MDB_FIRST;
   while (1)
   {
-    int ret = mdb_cursor_get(m_cur_tx_indices, &k, &v, op);
+    int ret = lmdb_cursor_get(m_cur_tx_indices, &k, &v, op);
     op = MDB_NEXT;
     if (ret == MDB_NOTFOUND)
       break;
@@ -3696,14 +4151,14 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
     const crypto::hash hash = ti->key;
     k.mv_data = (void *)&ti->data.tx_id;
     k.mv_size = sizeof(ti->data.tx_id);
-    ret = mdb_cursor_get(m_cur_txs_pruned, &k, &v, MDB_SET);
+    ret = lmdb_cursor_get(m_cur_txs_pruned, &k, &v, MDB_SET);
     if (ret == MDB_NOTFOUND)
       break;
     if (ret)
       throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
     transaction tx;
     blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    m_tx_compression.decode(txc_pruned, v, bd);
     if (pruned)
     {
       if (!parse_and_validate_tx_base_from_blob(bd, tx))
@@ -3711,10 +4166,10 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
     }
     else
     {
-      ret = mdb_cursor_get(m_cur_txs_prunable, &k, &v, MDB_SET);
+      ret = lmdb_cursor_get(m_cur_txs_prunable, &k, &v, MDB_SET);
       if (ret)
         throw0(DB_ERROR(lmdb_error("Failed to get prunable tx data the db: ", ret).c_str()));
-      bd.append(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      m_tx_compression.decode(txc_prunable, v, bd);
       if (!parse_and_validate_tx_from_blob(bd, tx))
         throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
     }
@@ -3744,7 +4199,7 @@ bool BlockchainLMDB::for_all_outputs(std::function<bool(uint64_t amount, const c
   MDB_cursor_op op = MDB_FIRST;
   while (1)
   {
-    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+    int ret = lmdb_cursor_get(m_cur_output_amounts, &k, &v, op);
     op = MDB_NEXT;
     if (ret == MDB_NOTFOUND)
       break;
@@ -3779,7 +4234,7 @@ bool BlockchainLMDB::for_all_outputs(uint64_t amount, const std::function<bool(u
   MDB_cursor_op op = MDB_SET;
   while (1)
   {
-    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+    int ret = lmdb_cursor_get(m_cur_output_amounts, &k, &v, op);
     op = MDB_NEXT_DUP;
     if (ret == MDB_NOTFOUND)
       break;
@@ -3977,7 +4432,10 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
     ret = true;
   }
   if (ret)
+  {
     tinfo->m_ti_rflags.m_rf_txn = true;
+    tinfo->m_ti_start = std::chrono::steady_clock::now();
+  }
   *mtxn = tinfo->m_ti_rtxn;
   *mcur = &tinfo->m_ti_rcursors;
 
@@ -3989,6 +4447,7 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
 void BlockchainLMDB::block_rtxn_stop() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  lmdb_counters.read_txn.add(std::chrono::steady_clock::now() - m_tinfo->m_ti_start);
   mdb_txn_reset(m_tinfo->m_ti_rtxn);
   memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
 }
@@ -4074,6 +4533,7 @@ void BlockchainLMDB::block_wtxn_abort()
 void BlockchainLMDB::block_rtxn_abort() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  lmdb_counters.read_txn.add(std::chrono::steady_clock::now() - m_tinfo->m_ti_start);
   mdb_txn_reset(m_tinfo->m_ti_rtxn);
   memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
 }
@@ -4141,7 +4601,7 @@ void BlockchainLMDB::get_output_tx_and_index_from_global(const std::vector<uint6
   {
     MDB_val_set(v, output_id);
 
-    auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+    auto get_result = lmdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
     if (get_result == MDB_NOTFOUND)
       throw1(OUTPUT_DNE("output with given index not in db"));
     else if (get_result)
@@ -4175,7 +4635,7 @@ void BlockchainLMDB::get_output_key(const epee::span<const uint64_t> &amounts, c
     MDB_val_set(k, amount);
     MDB_val_set(v, offsets[i]);
 
-    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+    auto get_result = lmdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
     if (get_result == MDB_NOTFOUND)
     {
       if (allow_partial)
@@ -4226,7 +4686,7 @@ void BlockchainLMDB::get_output_tx_and_index(const uint64_t& amount, const std::
   {
     MDB_val_set(v, index);
 
-    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+    auto get_result = lmdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
     if (get_result == MDB_NOTFOUND)
       throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
     else if (get_result)
@@ -4262,7 +4722,7 @@ std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get
     MDB_cursor_op op = MDB_FIRST;
     while (1)
     {
-      int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+      int ret = lmdb_cursor_get(m_cur_output_amounts, &k, &v, op);
       op = MDB_NEXT_NODUP;
       if (ret == MDB_NOTFOUND)
         break;
@@ -4280,7 +4740,7 @@ std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get
     for (const auto &amount: amounts)
     {
       MDB_val_copy<uint64_t> k(amount);
-      int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
+      int ret = lmdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
       if (ret == MDB_NOTFOUND)
       {
         if (0 >= min_count)
@@ -4359,7 +4819,7 @@ bool BlockchainLMDB::get_output_distribution(uint64_t amount, uint64_t from_heig
   base = 0;
   while (1)
   {
-    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+    int ret = lmdb_cursor_get(m_cur_output_amounts, &k, &v, op);
     op = MDB_NEXT_DUP;
     if (ret == MDB_NOTFOUND)
       break;
@@ -4416,9 +4876,9 @@ void BlockchainLMDB::set_hard_fork_version(uint64_t height, uint8_t version)
   MDB_val_copy<uint64_t> val_key(height);
   MDB_val_copy<uint8_t> val_value(version);
   int result;
-  result = mdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, MDB_APPEND);
+  result = lmdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, MDB_APPEND);
   if (result == MDB_KEYEXIST)
-    result = mdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, 0);
+    result = lmdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, 0);
   if (result)
     throw1(DB_ERROR(lmdb_error("Error adding hard fork version to db transaction: ", result).c_str()));
 
@@ -4435,7 +4895,7 @@ uint8_t BlockchainLMDB::get_hard_fork_version(uint64_t height) const
 
   MDB_val_copy<uint64_t> val_key(height);
   MDB_val val_ret;
-  auto result = mdb_cursor_get(m_cur_hf_versions, &val_key, &val_ret, MDB_SET);
+  auto result = lmdb_cursor_get(m_cur_hf_versions, &val_key, &val_ret, MDB_SET);
   if (result == MDB_NOTFOUND || result)
     throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a hard fork version at height " + boost::lexical_cast<std::string>(height) + " from the db: ", result).c_str()));
 
@@ -4465,7 +4925,7 @@ void BlockchainLMDB::add_alt_block(const crypto::hash &blkid, const cryptonote::
   memcpy(val.get(), &data, sizeof(alt_block_data_t));
   memcpy(val.get() + sizeof(alt_block_data_t), blob.data(), blob.size());
   MDB_val v = {val_size, (void *)val.get()};
-  if (auto result = mdb_cursor_put(m_cur_alt_blocks, &k, &v, MDB_NODUPDATA)) {
+  if (auto result = lmdb_cursor_put(m_cur_alt_blocks, &k, &v, MDB_NODUPDATA)) {
     if (result == MDB_KEYEXIST)
       throw1(DB_ERROR("Attempting to add alternate block that's already in the db"));
     else
@@ -4483,7 +4943,7 @@ bool BlockchainLMDB::get_alt_block(const crypto::hash &blkid, alt_block_data_t *
 
   MDB_val_set(k, blkid);
   MDB_val v;
-  int result = mdb_cursor_get(m_cur_alt_blocks, &k, &v, MDB_SET);
+  int result = lmdb_cursor_get(m_cur_alt_blocks, &k, &v, MDB_SET);
   if (result == MDB_NOTFOUND)
     return false;
 
@@ -4512,10 +4972,10 @@ void BlockchainLMDB::remove_alt_block(const crypto::hash &blkid)
 
   MDB_val k = {sizeof(blkid), (void *)&blkid};
   MDB_val v;
-  int result = mdb_cursor_get(m_cur_alt_blocks, &k, &v, MDB_SET);
+  int result = lmdb_cursor_get(m_cur_alt_blocks, &k, &v, MDB_SET);
   if (result)
     throw0(DB_ERROR(lmdb_error("Error locating alternate block " + epee::string_tools::pod_to_hex(blkid) + " in the db: ", result).c_str()));
-  result = mdb_cursor_del(m_cur_alt_blocks, 0);
+  result = lmdb_cursor_del(m_cur_alt_blocks, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error("Error deleting alternate block " + epee::string_tools::pod_to_hex(blkid) + " from the db: ", result).c_str()));
 }
@@ -4578,6 +5038,284 @@ uint64_t BlockchainLMDB::get_database_size() const
   return size;
 }
 
+db_stats BlockchainLMDB::get_db_stats() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  db_stats stats;
+  MDB_envinfo mei;
+  mdb_env_info(m_env, &mei);
+  MDB_stat mst;
+  mdb_env_stat(m_env, &mst);
+  stats.map_size = mei.me_mapsize;
+  stats.used_size = mst.ms_psize * mei.me_last_pgno;
+  stats.page_size = mst.ms_psize;
+  stats.readers = mei.me_numreaders;
+  stats.max_readers = mei.me_maxreaders;
+  stats.resizes = lmdb_counters.resizes;
+  stats.resize_time_ms = lmdb_counters.resize_time_ms;
+#ifndef _WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+  {
+    stats.major_page_faults = usage.ru_majflt;
+    stats.minor_page_faults = usage.ru_minflt;
+  }
+#endif
+  lmdb_counters.read_txn.get(stats.read_txn);
+  lmdb_counters.write_txn.get(stats.write_txn);
+  lmdb_counters.commit.get(stats.commit);
+
+  const std::pair<const char*, MDB_dbi> tables[] = {
+    {LMDB_BLOCKS, m_blocks},
+    {LMDB_BLOCK_HEIGHTS, m_block_heights},
+    {LMDB_BLOCK_INFO, m_block_info},
+    {LMDB_BLOCK_HEADERS, m_block_headers},
+    {LMDB_TXS_PRUNED, m_txs_pruned},
+    {LMDB_TXS_PRUNABLE, m_txs_prunable},
+    {LMDB_TXS_PRUNABLE_HASH, m_txs_prunable_hash},
+    {LMDB_TXS_PRUNABLE_TIP, m_txs_prunable_tip},
+    {LMDB_TX_INDICES, m_tx_indices},
+    {LMDB_TX_OUTPUTS, m_tx_outputs},
+    {LMDB_OUTPUT_TXS, m_output_txs},
+    {LMDB_OUTPUT_AMOUNTS, m_output_amounts},
+    {LMDB_SPENT_KEYS, m_spent_keys},
+    {LMDB_TXPOOL_META, m_txpool_meta},
+    {LMDB_TXPOOL_BLOB, m_txpool_blob},
+    {LMDB_ALT_BLOCKS, m_alt_blocks},
+    {LMDB_HF_VERSIONS, m_hf_versions},
+    {LMDB_PROPERTIES, m_properties},
+  };
+
+  TXN_PREFIX_RDONLY();
+  for (const auto &table: tables)
+  {
+    db_table_stats ts;
+    ts.name = table.first;
+    MDB_stat db_stats;
+    if (mdb_stat(m_txn, table.second, &db_stats) == 0)
+    {
+      ts.entries = db_stats.ms_entries;
+      ts.size = (db_stats.ms_branch_pages + db_stats.ms_leaf_pages + db_stats.ms_overflow_pages) * db_stats.ms_psize;
+      ts.depth = db_stats.ms_depth;
+    }
+    const lmdb_table_counters &c = table_counters(table.second);
+    ts.lookups = c.lookups;
+    ts.misses = c.misses;
+    ts.cursor_steps = c.cursor_steps;
+    ts.bytes_read = c.bytes_read;
+    ts.writes = c.writes;
+    ts.bytes_written = c.bytes_written;
+    ts.deletes = c.deletes;
+    stats.tables.push_back(std::move(ts));
+  }
+  TXN_POSTFIX_RDONLY();
+
+  return stats;
+}
+
+tx_compression_stats BlockchainLMDB::get_tx_compression_stats() const
+{
+  tx_compression_stats stats;
+  m_tx_compression.get_stats(stats);
+  return stats;
+}
+
+void BlockchainLMDB::start_snapshot(const std::string& path, uint64_t max_bytes_per_second)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  boost::unique_lock<boost::mutex> lock(m_snapshot_mutex);
+  if (m_snapshot_status.running)
+    throw0(DB_ERROR(("A snapshot to " + m_snapshot_status.path + " is already in progress").c_str()));
+  if (m_snapshot_thread.joinable())
+    m_snapshot_thread.join();
+
+  const boost::filesystem::path folder(path);
+  boost::system::error_code ec;
+  if (boost::filesystem::exists(folder / CRYPTONOTE_BLOCKCHAINDATA_FILENAME, ec))
+    throw0(DB_ERROR(("Snapshot destination " + path + " already contains a database").c_str()));
+  if (!boost::filesystem::is_directory(folder, ec) && !boost::filesystem::create_directories(folder, ec))
+    throw0(DB_ERROR(("Failed to create snapshot destination " + path + ": " + ec.message()).c_str()));
+  if (boost::filesystem::equivalent(folder, boost::filesystem::path(m_folder), ec))
+    throw0(DB_ERROR("Snapshot destination must not be the database folder"));
+
+  MDB_envinfo mei;
+  MDB_stat mst;
+  mdb_env_info(m_env, &mei);
+  mdb_env_stat(m_env, &mst);
+
+  // the caller holds off writers, so the map can be grown here
+  const uint64_t size_used = mst.ms_psize * mei.me_last_pgno;
+  if (mei.me_mapsize - size_used < SNAPSHOT_MAP_HEADROOM)
+  {
+    MGINFO("Growing the LMDB map before the snapshot");
+    do_resize(SNAPSHOT_MAP_HEADROOM);
+    mdb_env_info(m_env, &mei);
+  }
+
+  m_snapshot_status = db_snapshot_status();
+  m_snapshot_status.running = true;
+  m_snapshot_status.path = path;
+  m_snapshot_status.max_bytes_per_second = max_bytes_per_second;
+  m_snapshot_status.source_size = get_database_size();
+  // the compacted copy omits free pages, so it is at most the pages in use
+  m_snapshot_status.estimated_size = (mei.me_last_pgno + 1) * (uint64_t)mst.ms_psize;
+  m_snapshot_stop = false;
+  m_snapshot_copying = true;
+
+  MGINFO("Starting compacted snapshot of the blockchain database to " << path);
+  m_snapshot_thread = boost::thread([this, path]() { snapshot_thread(path); });
+}
+
+db_snapshot_status BlockchainLMDB::get_snapshot_status() const
+{
+  boost::unique_lock<boost::mutex> lock(m_snapshot_mutex);
+  return m_snapshot_status;
+}
+
+void BlockchainLMDB::snapshot_thread(const std::string& folder)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  const boost::filesystem::path filename = boost::filesystem::path(folder) / CRYPTONOTE_BLOCKCHAINDATA_FILENAME;
+  std::string error;
+
+  TIME_MEASURE_START(t);
+  {
+    // The copy holds a read txn for its whole duration, which a map resize
+    // must wait for, so count it with the other active txns. Our own resizes
+    // cancel it first (see do_resize).
+    mdb_txn_safe copy_guard;
+#ifdef _WIN32
+    // no pipes to throttle through here, let LMDB write the file directly
+    int result = mdb_env_copy2(m_env, folder.c_str(), MDB_CP_COMPACT);
+    if (result)
+      error = lmdb_error("Failed to copy the database: ", result);
+    else
+    {
+      uint64_t size = 0;
+      epee::file_io_utils::get_file_size(filename.string(), size);
+      boost::unique_lock<boost::mutex> lock(m_snapshot_mutex);
+      m_snapshot_status.bytes_written = size;
+    }
+#else
+    // LMDB writes the compacted copy into a pipe, and we write it out from
+    // the other end, which lets us count and throttle the writes.
+    const std::string tmp_filename = filename.string() + ".tmp";
+    int fds[2];
+    if (pipe(fds))
+      error = std::string("Failed to create pipe: ") + strerror(errno);
+    else
+    {
+      int result = 0;
+      boost::thread copier([this, &fds, &result]() {
+        result = mdb_env_copyfd2(m_env, fds[1], MDB_CP_COMPACT);
+        ::close(fds[1]);
+      });
+      error = snapshot_write(fds[0], tmp_filename);
+      // closing early makes the copier fail with EPIPE, the daemon ignores SIGPIPE
+      ::close(fds[0]);
+      copier.join();
+      if (error.empty() && result)
+        error = lmdb_error("Failed to copy the database: ", result);
+    }
+    boost::system::error_code ec;
+    if (error.empty())
+    {
+      boost::filesystem::rename(tmp_filename, filename, ec);
+      if (ec)
+        error = "Failed to rename " + tmp_filename + ": " + ec.message();
+    }
+    if (!error.empty())
+      boost::filesystem::remove(tmp_filename, ec);
+#endif
+  }
+  TIME_MEASURE_FINISH(t);
+
+  boost::unique_lock<boost::mutex> lock(m_snapshot_mutex);
+  m_snapshot_copying = false;
+  m_snapshot_done.notify_all();
+  m_snapshot_status.running = false;
+  m_snapshot_status.finished = true;
+  m_snapshot_status.success = error.empty();
+  m_snapshot_status.error = error;
+  m_snapshot_status.elapsed_ms = t;
+  if (error.empty())
+    MGINFO("Blockchain database snapshot written to " << filename.string() << " in " << t << " ms, " <<
+        m_snapshot_status.source_size << " bytes compacted to " << m_snapshot_status.bytes_written << " bytes");
+  else
+    MERROR("Blockchain database snapshot failed: " << error);
+}
+
+std::string BlockchainLMDB::snapshot_write(int fd, const std::string& filename)
+{
+#ifdef _WIN32
+  return "Not supported";
+#else
+  FILE *f = fopen(filename.c_str(), "wb");
+  if (!f)
+    return "Failed to open " + filename + ": " + strerror(errno);
+  std::unique_ptr<FILE, int(*)(FILE*)> file_closer(f, fclose);
+
+  uint64_t max_rate;
+  {
+    boost::unique_lock<boost::mutex> lock(m_snapshot_mutex);
+    max_rate = m_snapshot_status.max_bytes_per_second;
+  }
+
+  std::vector<char> buffer(1024 * 1024);
+  uint64_t written = 0, estimated_size = 0;
+  const auto start = std::chrono::steady_clock::now();
+  auto last_report = start;
+  while (true)
+  {
+    if (m_snapshot_stop)
+      return "Snapshot cancelled";
+    const ssize_t r = read(fd, buffer.data(), buffer.size());
+    if (r < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return std::string("Failed to read the database copy: ") + strerror(errno);
+    }
+    if (r == 0)
+      break;
+    if (fwrite(buffer.data(), 1, r, f) != (size_t)r)
+      return "Failed to write " + filename + ": " + strerror(errno);
+    written += r;
+    {
+      boost::unique_lock<boost::mutex> lock(m_snapshot_mutex);
+      m_snapshot_status.bytes_written = written;
+      m_snapshot_status.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+      estimated_size = m_snapshot_status.estimated_size;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_report >= std::chrono::seconds(30))
+    {
+      last_report = now;
+      MGINFO("Blockchain database snapshot: " << written / (1024 * 1024) << " MB written (up to " <<
+          (estimated_size ? std::min<uint64_t>(100, written * 100 / estimated_size) : 0) << "% done)");
+    }
+
+    // sleep until we're back under the rate limit, the copier blocks on the pipe meanwhile
+    if (max_rate)
+    {
+      const auto due = start + std::chrono::microseconds(written * 1000000 / max_rate);
+      if (due > now)
+        boost::this_thread::sleep_for(boost::chrono::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(due - now).count()));
+    }
+  }
+
+  if (fflush(f) || fsync(fileno(f)))
+    return "Failed to flush " + filename + ": " + strerror(errno);
+  file_closer.reset();
+  return std::string();
+#endif
+}
+
 void BlockchainLMDB::fixup()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -4601,7 +5339,7 @@ void BlockchainLMDB::fixup()
     result = mdb_cursor_open(txn, 1, &c_cur); \
     if (result) \
       throw0(DB_ERROR(lmdb_error("Failed to open a cursor for " name ": ", result).c_str())); \
-    result = mdb_cursor_get(c_cur, &k, NULL, MDB_SET_KEY); \
+    result = lmdb_cursor_get(c_cur, &k, NULL, MDB_SET_KEY); \
     if (result) \
       throw0(DB_ERROR(lmdb_error("Failed to get DB record for " name ": ", result).c_str())); \
     ptr = (char *)k.mv_data; \
@@ -4683,7 +5421,7 @@ void BlockchainLMDB::migrate_3_4()
         }
       }
       MDB_val_set(k, i);
-      result = mdb_cursor_get(c_old, &k, &v, MDB_SET);
+      result = lmdb_cursor_get(c_old, &k, &v, MDB_SET);
       if (result == MDB_NOTFOUND) {
         txn.commit();
         break;
@@ -4711,13 +5449,13 @@ void BlockchainLMDB::migrate_3_4()
       MDB_val nv;
       nv.mv_data = (void*)pruned.data();
       nv.mv_size = pruned.size();
-      result = mdb_cursor_put(c_cur0, (MDB_val *)&k, &nv, 0);
+      result = lmdb_cursor_put(c_cur0, (MDB_val *)&k, &nv, 0);
       if (result)
         throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_pruned: ", result).c_str()));
 
       nv.mv_data = (void*)(bd.data() + pruned.size());
       nv.mv_size = bd.size() - pruned.size();
-      result = mdb_cursor_put(c_cur1, (MDB_val *)&k, &nv, 0);
+      result = lmdb_cursor_put(c_cur1, (MDB_val *)&k, &nv, 0);
       if (result)
         throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_prunable: ", result).c_str()));
 
@@ -4725,12 +5463,12 @@ void BlockchainLMDB::migrate_3_4()
       {
         crypto::hash prunable_hash = get_transaction_prunable_hash(tx);
         MDB_val_set(val_prunable_hash, prunable_hash);
-        result = mdb_cursor_put(c_cur2, (MDB_val *)&k, &val_prunable_hash, 0);
+        result = lmdb_cursor_put(c_cur2, (MDB_val *)&k, &val_prunable_hash, 0);
         if (result)
           throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_prunable_hash: ", result).c_str()));
       }
 
-      result = mdb_cursor_del(c_old, 0);
+      result = lmdb_cursor_del(c_old, 0);
       if (result)
         throw0(DB_ERROR(lmdb_error("Failed to delete a record from txs: ", result).c_str()));
 
@@ -4812,7 +5550,7 @@ void BlockchainLMDB::migrate_3_4()
           i = db_stats.ms_entries;
         }
       }
-      result = mdb_cursor_get(c_old, &k, &v, MDB_NEXT);
+      result = lmdb_cursor_get(c_old, &k, &v, MDB_NEXT);
       if (result == MDB_NOTFOUND) {
         txn.commit();
         break;
@@ -4837,7 +5575,7 @@ void BlockchainLMDB::migrate_3_4()
       {
         MDB_val_copy<uint64_t> kb(bi.bi_height);
         MDB_val vb;
-        result = mdb_cursor_get(c_blocks, &kb, &vb, MDB_SET);
+        result = lmdb_cursor_get(c_blocks, &kb, &vb, MDB_SET);
         if (result)
           throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
         if (vb.mv_size == 0)
@@ -4862,14 +5600,14 @@ void BlockchainLMDB::migrate_3_4()
       bi.bi_long_term_block_weight = long_term_block_weight;
 
       MDB_val_set(nv, bi);
-      result = mdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
+      result = lmdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
       if (result)
         throw0(DB_ERROR(lmdb_error("Failed to put a record into block_infn: ", result).c_str()));
       /* we delete the old records immediately, so the overall DB and mapsize should not grow.
        * This is a little slower than just letting mdb_drop() delete it all at the end, but
        * it saves a significant amount of disk space.
        */
-      result = mdb_cursor_del(c_old, 0);
+      result = lmdb_cursor_del(c_old, 0);
       if (result)
         throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_info: ", result).c_str()));
       i++;
@@ -4901,7 +5639,7 @@ void BlockchainLMDB::migrate_3_4()
   result = mdb_txn_begin(m_env, NULL, 0, txn);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-  result = mdb_put(txn, m_properties, &vk, &v, 0);
+  result = lmdb_put(txn, m_properties, &vk, &v, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
   txn.commit();
@@ -4909,12 +5647,349 @@ void BlockchainLMDB::migrate_3_4()
   MGINFO_YELLOW("Database migration complete");
 }
 
-void BlockchainLMDB::migrate(const uint32_t oldversion)
+void BlockchainLMDB::migrate_4_5()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val v;
+
+  // Version 5 adds optional compressed storage for txs_pruned and txs_prunable.
+  // Existing records are left as they are unless compression is requested, but
+  // older versions must not open a database which may contain compressed records.
+  MGINFO_YELLOW("Migrating blockchain from DB version 4 to 5 - Please wait");
+
+  uint32_t version = 5;
+  v.mv_data = (void *)&version;
+  v.mv_size = sizeof(version);
+  MDB_val_str(vk, "version");
+  result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  result = lmdb_put(txn, m_properties, &vk, &v, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+  txn.commit();
+
+  MGINFO_YELLOW("Database migration complete");
+}
+
+void BlockchainLMDB::migrate_5_6()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  uint64_t i;
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val k, v;
+
+  MGINFO_YELLOW("Migrating blockchain from DB version 5 to 6 - Please wait");
+
+  MINFO("Building block header index.");
+  do {
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+    MDB_stat db_stats;
+    if ((result = mdb_stat(txn, m_blocks, &db_stats)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+    const uint64_t blockchain_height = db_stats.ms_entries;
+    txn.commit();
+
+    MDB_cursor *c_blocks, *c_headers;
+    i = 0;
+    while(1) {
+      if (!(i % 1000)) {
+        if (i) {
+          LOGIF(el::Level::Info) {
+            std::cout << i << " / " << blockchain_height << "  \r" << std::flush;
+          }
+          txn.commit();
+        }
+        if (need_resize())
+        {
+          LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
+          do_resize();
+        }
+        result = mdb_txn_begin(m_env, NULL, 0, txn);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_blocks, &c_blocks);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for blocks: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_block_headers, &c_headers);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_headers: ", result).c_str()));
+        if (!i) {
+          // resume an interrupted migration
+          result = mdb_stat(txn, m_block_headers, &db_stats);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to query m_block_headers: ", result).c_str()));
+          i = db_stats.ms_entries;
+          if (i >= blockchain_height) {
+            txn.commit();
+            break;
+          }
+        }
+        k.mv_size = sizeof(i);
+        k.mv_data = (void *)&i;
+        result = lmdb_cursor_get(c_blocks, &k, &v, MDB_SET);
+      }
+      else
+        result = lmdb_cursor_get(c_blocks, &k, &v, MDB_NEXT);
+      if (result == MDB_NOTFOUND) {
+        txn.commit();
+        break;
+      }
+      else if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from blocks: ", result).c_str()));
+
+      const uint64_t height = *(const uint64_t*)k.mv_data;
+      if (height != i)
+        throw0(DB_ERROR("Bad height in blocks record"));
+      block b;
+      if (!parse_and_validate_block_from_blob(blobdata((const char*)v.mv_data, v.mv_size), b))
+        throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+
+      mdb_block_header hd;
+      memset(&hd, 0, sizeof(hd));
+      hd.hd_height = height;
+      hd.hd_timestamp = b.timestamp;
+      for (const tx_out &out: b.miner_tx.vout)
+        hd.hd_reward += out.amount;
+      hd.hd_num_txes = b.tx_hashes.size();
+      hd.hd_prev_id = b.prev_id;
+      hd.hd_miner_tx_hash = get_transaction_hash(b.miner_tx);
+      hd.hd_nonce = b.nonce;
+      hd.hd_major_version = b.major_version;
+      hd.hd_minor_version = b.minor_version;
+
+      MDB_val_set(nv, hd);
+      result = lmdb_cursor_put(c_headers, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into block_headers: ", result).c_str()));
+      i++;
+    }
+  } while(0);
+
+  LOG_PRINT_L1(i << " block headers indexed");
+
+  uint32_t version = 6;
+  v.mv_data = (void *)&version;
+  v.mv_size = sizeof(version);
+  MDB_val_str(vk, "version");
+  result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  result = lmdb_put(txn, m_properties, &vk, &v, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+  txn.commit();
+
+  MGINFO_YELLOW("Database migration complete");
+}
+
+void BlockchainLMDB::init_tx_compression(bool compress)
 {
-  if (oldversion == 3)
-    migrate_3_4();
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  const bool read_only = is_read_only();
+
+  mdb_txn_safe txn;
+  if (auto result = lmdb_txn_begin(m_env, NULL, read_only ? MDB_RDONLY : 0, txn))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  m_tx_compression.load(txn, m_properties);
+  MDB_val_str(k, "tx_compression_progress");
+  MDB_val v;
+  int result = lmdb_get(txn, m_properties, &k, &v);
+  if (result && result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to read tx compression progress: ", result).c_str()));
+  const bool interrupted = result == 0;
+  txn.commit();
+
+  if (interrupted)
+  {
+    if (read_only)
+      throw0(DB_ERROR("Transaction storage conversion was interrupted, open the database read-write to finish it"));
+    convert_tx_compression();
+  }
+  else if (compress && !m_tx_compression.enabled())
+  {
+    if (!lmdb_tx_compression::supported())
+      MWARNING("This build does not include zstd support, transactions will be stored uncompressed");
+    else if (read_only)
+      MWARNING("Cannot convert a read-only database to compressed transaction storage");
+    else
+      convert_tx_compression();
+  }
+
+  if (m_tx_compression.enabled())
+    MINFO("Transaction blobs are stored compressed (pruned dictionary: " << m_tx_compression.has_dictionary(txc_pruned) <<
+        ", prunable dictionary: " << m_tx_compression.has_dictionary(txc_prunable) << ")");
+}
+
+void BlockchainLMDB::convert_tx_compression()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  // enough samples for dictionary training, without reading the whole table
+  static const uint64_t max_training_samples = 8192;
+  uint64_t i = 0, n_txes = 0;
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val k, v;
+
+  TIME_MEASURE_START(t);
+
+  result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_stat db_stats;
+  if ((result = mdb_stat(txn, m_txs_pruned, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_txs_pruned: ", result).c_str()));
+  n_txes = db_stats.ms_entries;
+
+  MDB_val_str(pk, "tx_compression_progress");
+  result = lmdb_get(txn, m_properties, &pk, &v);
+  if (result == 0)
+  {
+    if (v.mv_size != sizeof(i))
+      throw0(DB_ERROR("Unexpected size for tx compression progress"));
+    memcpy(&i, v.mv_data, sizeof(i));
+    txn.abort();
+    MGINFO_YELLOW("Resuming conversion to compressed transaction storage at " << i << " / " << n_txes << " - Please wait");
+  }
+  else if (result == MDB_NOTFOUND)
+  {
+    MGINFO_YELLOW("Converting transaction storage to compressed format - Please wait");
+
+    const MDB_dbi dbis[txc_num_tables] = { m_txs_pruned, m_txs_prunable };
+    std::vector<std::string> samples[txc_num_tables];
+    const uint64_t step = std::max<uint64_t>(1, n_txes / max_training_samples);
+    for (int table = 0; table < txc_num_tables; ++table)
+    {
+      MDB_cursor *c_cur;
+      result = mdb_cursor_open(txn, dbis[table], &c_cur);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx data: ", result).c_str()));
+      for (uint64_t tx_id = 0; tx_id < n_txes; tx_id += step)
+      {
+        MDB_val_set(sk, tx_id);
+        result = lmdb_cursor_get(c_cur, &sk, &v, MDB_SET);
+        if (result == MDB_NOTFOUND)
+          continue;
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to read tx data: ", result).c_str()));
+        if (v.mv_size)
+          samples[table].push_back(std::string((const char*)v.mv_data, v.mv_size));
+      }
+      mdb_cursor_close(c_cur);
+    }
+
+    m_tx_compression.set_method(lmdb_tx_compression::method_zstd);
+    for (int table = 0; table < txc_num_tables; ++table)
+      m_tx_compression.train((tx_compression_table)table, samples[table]);
+    m_tx_compression.save(txn, m_properties);
+    MDB_val_set(pv, i);
+    result = lmdb_put(txn, m_properties, &pk, &pv, 0);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to save tx compression progress: ", result).c_str()));
+    txn.commit();
+  }
   else
-    throw0(DB_ERROR("No migration path for your DB version. A full resync is required"));
+    throw0(DB_ERROR(lmdb_error("Failed to read tx compression progress: ", result).c_str()));
+
+  MDB_cursor *c_pruned, *c_prunable;
+  std::string buffer;
+  uint64_t raw_bytes = 0, stored_bytes = 0;
+  bool done = false;
+  while (!done)
+  {
+    if (need_resize())
+    {
+      LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
+      do_resize();
+    }
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    result = mdb_cursor_open(txn, m_txs_pruned, &c_pruned);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
+    result = mdb_cursor_open(txn, m_txs_prunable, &c_prunable);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+
+    for (size_t batch = 0; batch < 1000; ++batch, ++i)
+    {
+      k.mv_size = sizeof(i);
+      k.mv_data = (void *)&i;
+      result = lmdb_cursor_get(c_pruned, &k, &v, MDB_SET);
+      if (result == MDB_NOTFOUND)
+      {
+        done = true;
+        break;
+      }
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from txs_pruned: ", result).c_str()));
+      raw_bytes += v.mv_size;
+      MDB_val nv = m_tx_compression.encode(txc_pruned, v, buffer);
+      stored_bytes += nv.mv_size;
+      result = lmdb_cursor_put(c_pruned, &k, &nv, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_pruned: ", result).c_str()));
+
+      result = lmdb_cursor_get(c_prunable, &k, &v, MDB_SET);
+      if (result == MDB_NOTFOUND)
+        continue;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from txs_prunable: ", result).c_str()));
+      raw_bytes += v.mv_size;
+      nv = m_tx_compression.encode(txc_prunable, v, buffer);
+      stored_bytes += nv.mv_size;
+      result = lmdb_cursor_put(c_prunable, &k, &nv, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_prunable: ", result).c_str()));
+    }
+
+    if (done)
+    {
+      result = lmdb_del(txn, m_properties, &pk, NULL);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to delete tx compression progress: ", result).c_str()));
+    }
+    else
+    {
+      MDB_val_set(pv, i);
+      result = lmdb_put(txn, m_properties, &pk, &pv, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to save tx compression progress: ", result).c_str()));
+    }
+    mdb_cursor_close(c_prunable);
+    mdb_cursor_close(c_pruned);
+    txn.commit();
+
+    LOGIF(el::Level::Info) {
+      std::cout << i << " / " << n_txes << "  \r" << std::flush;
+    }
+  }
+
+  TIME_MEASURE_FINISH(t);
+  MGINFO_YELLOW("Transaction storage conversion complete in " << t << " ms: " << raw_bytes << " bytes stored in " << stored_bytes <<
+      " bytes (" << (stored_bytes ? raw_bytes / (double)stored_bytes : 1.0) << ":1)");
+}
+
+void BlockchainLMDB::migrate(const uint32_t oldversion)
+{
+  switch(oldversion) {
+  case 3:
+    migrate_3_4(); /* FALLTHRU */
+  case 4:
+    migrate_4_5(); /* FALLTHRU */
+  case 5:
+    migrate_5_6(); /* FALLTHRU */
+  default:
+    break;
+  }
 }
 
 }  // namespace cryptonote
@@ -28,12 +28,14 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <vector>
 
 #include "syncobj.h"
 #include "blockchain_db/blockchain_db.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
+#include "blockchain_db/lmdb/tx_compression.h"
 #include <boost/thread/tss.hpp>
 
 #include <lmdb.h>
@@ -68,6 +70,20 @@ typedef struct mdb_block_info_4
 
 typedef mdb_block_info_4 mdb_block_info;
 
+typedef struct mdb_block_header
+{
+  uint64_t hd_height;
+  uint64_t hd_timestamp;
+  uint64_t hd_reward;
+  uint64_t hd_num_txes;
+  crypto::hash hd_prev_id;
+  crypto::hash hd_miner_tx_hash;
+  uint32_t hd_nonce;
+  uint8_t hd_major_version;
+  uint8_t hd_minor_version;
+  uint8_t hd_padding[2];
+} mdb_block_header;
+
 typedef struct txindex {
     crypto::hash key;
     tx_data_t data;
@@ -78,6 +94,7 @@ typedef struct mdb_txn_cursors
   MDB_cursor *m_txc_blocks;
   MDB_cursor *m_txc_block_heights;
   MDB_cursor *m_txc_block_info;
+  MDB_cursor *m_txc_block_headers;
 
   MDB_cursor *m_txc_output_txs;
   MDB_cursor *m_txc_output_amounts;
@@ -105,6 +122,7 @@ typedef struct mdb_txn_cursors
 #define m_cur_blocks	m_cursors->m_txc_blocks
 #define m_cur_block_heights	m_cursors->m_txc_block_heights
 #define m_cur_block_info	m_cursors->m_txc_block_info
+#define m_cur_block_headers	m_cursors->m_txc_block_headers
 #define m_cur_output_txs	m_cursors->m_txc_output_txs
 #define m_cur_output_amounts	m_cursors->m_txc_output_amounts
 #define m_cur_txs	m_cursors->m_txc_txs
@@ -127,6 +145,7 @@ typedef struct mdb_rflags
   bool m_rf_blocks;
   bool m_rf_block_heights;
   bool m_rf_block_info;
+  bool m_rf_block_headers;
   bool m_rf_output_txs;
   bool m_rf_output_amounts;
   bool m_rf_txs;
@@ -149,6 +168,7 @@ typedef struct mdb_threadinfo
   MDB_txn *m_ti_rtxn;	// per-thread read txn
   mdb_txn_cursors m_ti_rcursors;	// per-thread read cursors
   mdb_rflags m_ti_rflags;	// per-thread read state
+  std::chrono::steady_clock::time_point m_ti_start;	// when the read txn was started or renewed
 
   ~mdb_threadinfo();
 } mdb_threadinfo;
@@ -187,12 +207,14 @@ struct mdb_txn_safe
   MDB_txn* m_txn;
   bool m_batch_txn = false;
   bool m_check;
+  std::chrono::steady_clock::time_point m_start; // set when begun with lmdb_txn_begin, for the txn latency stats
   static std::atomic<uint64_t> num_active_txns;
 
   // could use a mutex here, but this should be sufficient.
   static std::atomic_flag creation_gate;
 };
 
+struct prune_range_result;
 
 // If m_batch_active is set, a batch transaction exists beyond this class, such
 // as a batch import with verification enabled, or possibly (later) a batch
@@ -276,6 +298,8 @@ public:
 
   virtual std::vector<crypto::hash> get_hashes_range(const uint64_t& h1, const uint64_t& h2) const;
 
+  virtual std::vector<block_header_info> get_block_headers_range(const uint64_t& h1, const uint64_t& h2) const;
+
   virtual crypto::hash top_block_hash(uint64_t *block_height = NULL) const;
 
   virtual block get_top_block() const;
@@ -326,6 +350,7 @@ public:
   virtual bool prune_blockchain(uint32_t pruning_seed = 0);
   virtual bool update_pruning();
   virtual bool check_pruning();
+  virtual pruning_progress get_pruning_progress() const;
 
   virtual void add_alt_block(const crypto::hash &blkid, const cryptonote::alt_block_data_t &data, const cryptonote::blobdata &blob);
   virtual bool get_alt_block(const crypto::hash &blkid, alt_block_data_t *data, cryptonote::blobdata *blob);
@@ -444,11 +469,24 @@ private:
   inline void check_open() const;
 
   bool prune_worker(int mode, uint32_t pruning_seed);
+  void prune_classify_range(int mode, uint32_t pruning_seed, uint64_t blockchain_height, uint64_t hash_begin, uint64_t hash_end,
+      prune_range_result &range);
+  void set_pruning_phase(const char *phase, uint64_t total);
 
   virtual bool is_read_only() const;
 
   virtual uint64_t get_database_size() const;
 
+  virtual tx_compression_stats get_tx_compression_stats() const;
+
+  virtual void start_snapshot(const std::string& path, uint64_t max_bytes_per_second);
+  virtual db_snapshot_status get_snapshot_status() const;
+
+  virtual db_stats get_db_stats() const;
+
+  void snapshot_thread(const std::string& folder);
+  std::string snapshot_write(int fd, const std::string& filename);
+
   std::vector<uint64_t> get_block_info_64bit_fields(uint64_t start_height, size_t count, off_t offset) const;
 
   uint64_t get_max_block_size();
@@ -460,6 +498,13 @@ private:
   // migrate from older DB version to current
   void migrate(const uint32_t oldversion);
   void migrate_3_4();
+  void migrate_4_5();
+  void migrate_5_6();
+
+  // load tx blob compression settings, and convert the tx tables if needed
+  void init_tx_compression(bool compress);
+  void convert_tx_compression();
+  bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id) const;
 
   void cleanup_batch();
 
@@ -469,6 +514,7 @@ private:
   MDB_dbi m_blocks;
   MDB_dbi m_block_heights;
   MDB_dbi m_block_info;
+  MDB_dbi m_block_headers;
 
   MDB_dbi m_txs;
   MDB_dbi m_txs_pruned;
@@ -493,6 +539,8 @@ private:
 
   MDB_dbi m_properties;
 
+  lmdb_tx_compression m_tx_compression;
+
   mutable uint64_t m_cum_size;	// used in batch size estimation
   mutable unsigned int m_cum_count;
   std::string m_folder;
@@ -510,6 +558,20 @@ private:
   std::atomic<uint64_t> m_block_cache_height;
   mutable epee::critical_section m_block_cache_lock;
 
+  std::atomic<bool> m_pruning;
+  std::atomic<uint64_t> m_pruning_done;
+  mutable boost::mutex m_pruning_mutex;
+  pruning_progress m_pruning_progress;
+  std::chrono::steady_clock::time_point m_pruning_start;
+  std::chrono::steady_clock::time_point m_pruning_phase_start;
+
+  boost::thread m_snapshot_thread;
+  std::atomic<bool> m_snapshot_stop;
+  std::atomic<bool> m_snapshot_copying;
+  mutable boost::mutex m_snapshot_mutex;
+  boost::condition_variable m_snapshot_done;
+  db_snapshot_status m_snapshot_status;
+
 
 #if defined(__arm__)
   // force a value so it can compile with 32-bit ARM
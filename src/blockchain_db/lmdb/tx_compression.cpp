@@ -0,0 +1,366 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "tx_compression.h"
+
+#include <cstring>
+#include <boost/thread/tss.hpp>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+#include "misc_log_ex.h"
+#include "profile_tools.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db.lmdb"
+
+namespace
+{
+  const char* const PROP_TX_COMPRESSION = "tx_compression";
+  const char* const PROP_DICT[cryptonote::txc_num_tables] = { "txs_pruned_dict", "txs_prunable_dict" };
+
+  // per record tags, only used when compression is enabled
+  const uint8_t TAG_RAW = 0;
+  const uint8_t TAG_ZSTD = 1;
+
+  const int COMPRESSION_LEVEL = 3;
+  const size_t MAX_DICT_SIZE = 64 * 1024;
+  const size_t MIN_TRAINING_SAMPLES = 64;
+
+  template <typename T>
+  inline void throw0(const T &e)
+  {
+    LOG_PRINT_L0(e.what());
+    throw e;
+  }
+
+#ifdef HAVE_ZSTD
+  struct dctx_holder
+  {
+    dctx_holder(): dctx(ZSTD_createDCtx()) {}
+    ~dctx_holder() { ZSTD_freeDCtx(dctx); }
+    ZSTD_DCtx *dctx;
+  };
+
+  // decompression contexts are not thread safe, readers each get their own
+  ZSTD_DCtx *get_thread_dctx()
+  {
+    static boost::thread_specific_ptr<dctx_holder> holder;
+    if (!holder.get())
+      holder.reset(new dctx_holder());
+    if (!holder->dctx)
+      throw0(cryptonote::DB_ERROR("Failed to create zstd decompression context"));
+    return holder->dctx;
+  }
+#endif
+
+  void put_property(MDB_txn *txn, MDB_dbi properties, const char *name, const void *data, size_t size)
+  {
+    MDB_val k = {strlen(name) + 1, (void*)name};
+    MDB_val v = {size, (void*)data};
+    int result = mdb_put(txn, properties, &k, &v, 0);
+    if (result)
+      throw0(cryptonote::DB_ERROR((std::string("Failed to save ") + name + ": " + mdb_strerror(result)).c_str()));
+  }
+
+  void del_property(MDB_txn *txn, MDB_dbi properties, const char *name)
+  {
+    MDB_val k = {strlen(name) + 1, (void*)name};
+    int result = mdb_del(txn, properties, &k, NULL);
+    if (result && result != MDB_NOTFOUND)
+      throw0(cryptonote::DB_ERROR((std::string("Failed to delete ") + name + ": " + mdb_strerror(result)).c_str()));
+  }
+}
+
+namespace cryptonote
+{
+
+lmdb_tx_compression::lmdb_tx_compression():
+  m_method(method_none),
+  m_cctx(NULL)
+{
+  for (int i = 0; i < txc_num_tables; ++i)
+  {
+    m_cdict[i] = NULL;
+    m_ddict[i] = NULL;
+  }
+}
+
+lmdb_tx_compression::~lmdb_tx_compression()
+{
+  free_contexts();
+}
+
+bool lmdb_tx_compression::supported()
+{
+#ifdef HAVE_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+void lmdb_tx_compression::free_contexts()
+{
+#ifdef HAVE_ZSTD
+  ZSTD_freeCCtx((ZSTD_CCtx*)m_cctx);
+  for (int i = 0; i < txc_num_tables; ++i)
+  {
+    ZSTD_freeCDict((ZSTD_CDict*)m_cdict[i]);
+    ZSTD_freeDDict((ZSTD_DDict*)m_ddict[i]);
+  }
+#endif
+  m_cctx = NULL;
+  for (int i = 0; i < txc_num_tables; ++i)
+  {
+    m_cdict[i] = NULL;
+    m_ddict[i] = NULL;
+  }
+}
+
+void lmdb_tx_compression::create_contexts()
+{
+  free_contexts();
+  if (m_method == method_none)
+    return;
+#ifdef HAVE_ZSTD
+  m_cctx = ZSTD_createCCtx();
+  if (!m_cctx)
+    throw0(DB_ERROR("Failed to create zstd compression context"));
+  for (int i = 0; i < txc_num_tables; ++i)
+  {
+    if (m_dict[i].empty())
+      continue;
+    m_cdict[i] = ZSTD_createCDict(m_dict[i].data(), m_dict[i].size(), COMPRESSION_LEVEL);
+    m_ddict[i] = ZSTD_createDDict(m_dict[i].data(), m_dict[i].size());
+    if (!m_cdict[i] || !m_ddict[i])
+      throw0(DB_ERROR((std::string("Failed to load compression dictionary for ") + PROP_DICT[i]).c_str()));
+  }
+#else
+  throw0(DB_ERROR("The database uses compressed transaction storage, but this build does not include zstd support"));
+#endif
+}
+
+void lmdb_tx_compression::set_method(uint32_t method)
+{
+  if (method != method_none && method != method_zstd)
+    throw0(DB_ERROR(("Unknown transaction compression method: " + std::to_string(method)).c_str()));
+  if (method == method_none)
+  {
+    for (int i = 0; i < txc_num_tables; ++i)
+      m_dict[i].clear();
+  }
+  m_method = method;
+  create_contexts();
+}
+
+void lmdb_tx_compression::load(MDB_txn *txn, MDB_dbi properties)
+{
+  MDB_val k = {strlen(PROP_TX_COMPRESSION) + 1, (void*)PROP_TX_COMPRESSION};
+  MDB_val v;
+  int result = mdb_get(txn, properties, &k, &v);
+  uint32_t method = method_none;
+  if (result == 0)
+  {
+    if (v.mv_size != sizeof(method))
+      throw0(DB_ERROR("Unexpected size for the tx_compression property"));
+    memcpy(&method, v.mv_data, sizeof(method));
+  }
+  else if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR((std::string("Failed to read the tx_compression property: ") + mdb_strerror(result)).c_str()));
+
+  for (int i = 0; i < txc_num_tables; ++i)
+  {
+    m_dict[i].clear();
+    MDB_val kd = {strlen(PROP_DICT[i]) + 1, (void*)PROP_DICT[i]};
+    result = mdb_get(txn, properties, &kd, &v);
+    if (result == 0)
+      m_dict[i].assign((const char*)v.mv_data, v.mv_size);
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR((std::string("Failed to read ") + PROP_DICT[i] + ": " + mdb_strerror(result)).c_str()));
+  }
+
+  set_method(method);
+}
+
+void lmdb_tx_compression::save(MDB_txn *txn, MDB_dbi properties) const
+{
+  if (m_method == method_none)
+    del_property(txn, properties, PROP_TX_COMPRESSION);
+  else
+    put_property(txn, properties, PROP_TX_COMPRESSION, &m_method, sizeof(m_method));
+  for (int i = 0; i < txc_num_tables; ++i)
+  {
+    if (m_dict[i].empty())
+      del_property(txn, properties, PROP_DICT[i]);
+    else
+      put_property(txn, properties, PROP_DICT[i], m_dict[i].data(), m_dict[i].size());
+  }
+}
+
+bool lmdb_tx_compression::train(tx_compression_table table, const std::vector<std::string> &samples)
+{
+#ifdef HAVE_ZSTD
+  if (samples.size() < MIN_TRAINING_SAMPLES)
+  {
+    MINFO("Not enough samples to train a dictionary for " << PROP_DICT[table] << ": " << samples.size());
+    return false;
+  }
+  std::string buffer;
+  std::vector<size_t> sizes;
+  sizes.reserve(samples.size());
+  for (const std::string &s: samples)
+  {
+    buffer += s;
+    sizes.push_back(s.size());
+  }
+  std::string dict(MAX_DICT_SIZE, '\0');
+  const size_t dict_size = ZDICT_trainFromBuffer(&dict[0], dict.size(), buffer.data(), sizes.data(), sizes.size());
+  if (ZDICT_isError(dict_size))
+  {
+    MINFO("Failed to train a dictionary for " << PROP_DICT[table] << ": " << ZDICT_getErrorName(dict_size));
+    return false;
+  }
+  dict.resize(dict_size);
+  m_dict[table] = std::move(dict);
+  create_contexts();
+  MINFO("Trained a " << dict_size << " byte dictionary for " << PROP_DICT[table] << " from " << samples.size() << " records");
+  return true;
+#else
+  return false;
+#endif
+}
+
+MDB_val lmdb_tx_compression::encode(tx_compression_table table, const MDB_val &raw, std::string &buffer)
+{
+  if (m_method == method_none || raw.mv_size == 0)
+    return raw;
+
+  table_counters &counters = m_counters[table];
+  ++counters.encoded_records;
+  counters.encoded_raw_bytes += raw.mv_size;
+
+#ifdef HAVE_ZSTD
+  const size_t bound = ZSTD_compressBound(raw.mv_size);
+  buffer.resize(1 + bound);
+  size_t csize;
+  if (m_cdict[table])
+    csize = ZSTD_compress_usingCDict((ZSTD_CCtx*)m_cctx, &buffer[1], bound, raw.mv_data, raw.mv_size, (const ZSTD_CDict*)m_cdict[table]);
+  else
+    csize = ZSTD_compressCCtx((ZSTD_CCtx*)m_cctx, &buffer[1], bound, raw.mv_data, raw.mv_size, COMPRESSION_LEVEL);
+  if (ZSTD_isError(csize))
+    throw0(DB_ERROR((std::string("Failed to compress transaction data: ") + ZSTD_getErrorName(csize)).c_str()));
+  if (csize < raw.mv_size)
+  {
+    buffer[0] = TAG_ZSTD;
+    buffer.resize(1 + csize);
+    counters.encoded_bytes += buffer.size();
+    return MDB_val{buffer.size(), (void*)buffer.data()};
+  }
+#endif
+
+  buffer.resize(1 + raw.mv_size);
+  buffer[0] = TAG_RAW;
+  memcpy(&buffer[1], raw.mv_data, raw.mv_size);
+  counters.encoded_bytes += buffer.size();
+  return MDB_val{buffer.size(), (void*)buffer.data()};
+}
+
+void lmdb_tx_compression::decode(tx_compression_table table, const MDB_val &stored, std::string &out) const
+{
+  const char *data = (const char*)stored.mv_data;
+  if (m_method == method_none || stored.mv_size == 0)
+  {
+    out.append(data, stored.mv_size);
+    return;
+  }
+
+  const table_counters &counters = m_counters[table];
+  const size_t out_start = out.size();
+  TIME_MEASURE_NS_START(decode_time);
+
+  const uint8_t tag = data[0];
+  if (tag == TAG_RAW)
+  {
+    out.append(data + 1, stored.mv_size - 1);
+  }
+  else if (tag == TAG_ZSTD)
+  {
+#ifdef HAVE_ZSTD
+    const unsigned long long raw_size = ZSTD_getFrameContentSize(data + 1, stored.mv_size - 1);
+    if (raw_size == ZSTD_CONTENTSIZE_ERROR || raw_size == ZSTD_CONTENTSIZE_UNKNOWN)
+      throw0(DB_ERROR("Invalid compressed transaction data"));
+    const size_t offset = out.size();
+    out.resize(offset + raw_size);
+    ZSTD_DCtx *dctx = get_thread_dctx();
+    size_t dsize;
+    if (m_ddict[table])
+      dsize = ZSTD_decompress_usingDDict(dctx, &out[offset], raw_size, data + 1, stored.mv_size - 1, (const ZSTD_DDict*)m_ddict[table]);
+    else
+      dsize = ZSTD_decompressDCtx(dctx, &out[offset], raw_size, data + 1, stored.mv_size - 1);
+    if (ZSTD_isError(dsize) || dsize != raw_size)
+      throw0(DB_ERROR("Failed to decompress transaction data"));
+#else
+    throw0(DB_ERROR("Compressed transaction data found, but this build does not include zstd support"));
+#endif
+  }
+  else
+  {
+    throw0(DB_ERROR(("Unknown transaction data encoding: " + std::to_string(tag)).c_str()));
+  }
+
+  TIME_MEASURE_NS_FINISH(decode_time);
+  ++counters.decoded_records;
+  counters.decoded_bytes += stored.mv_size;
+  counters.decoded_raw_bytes += out.size() - out_start;
+  counters.decode_time_ns += decode_time;
+}
+
+void lmdb_tx_compression::get_stats(tx_compression_stats &stats) const
+{
+  stats.method = m_method == method_zstd ? "zstd" : "none";
+  stats.pruned_dictionary = has_dictionary(txc_pruned);
+  stats.prunable_dictionary = has_dictionary(txc_prunable);
+  tx_compression_table_stats *tables[txc_num_tables] = { &stats.pruned, &stats.prunable };
+  for (int i = 0; i < txc_num_tables; ++i)
+  {
+    const table_counters &c = m_counters[i];
+    tables[i]->encoded_records = c.encoded_records;
+    tables[i]->encoded_raw_bytes = c.encoded_raw_bytes;
+    tables[i]->encoded_bytes = c.encoded_bytes;
+    tables[i]->decoded_records = c.decoded_records;
+    tables[i]->decoded_bytes = c.decoded_bytes;
+    tables[i]->decoded_raw_bytes = c.decoded_raw_bytes;
+    tables[i]->decode_time_ns = c.decode_time_ns;
+  }
+}
+
+}  // namespace cryptonote
@@ -0,0 +1,115 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <lmdb.h>
+
+#include "blockchain_db/blockchain_db.h"
+
+namespace cryptonote
+{
+
+enum tx_compression_table
+{
+  txc_pruned = 0,
+  txc_prunable = 1,
+  txc_num_tables
+};
+
+/* Record codec for the txs_pruned and txs_prunable tables.
+ *
+ * When compression is off, records are stored as they always were. When it
+ * is on, every non empty record starts with a one byte tag: 0 means the rest
+ * is the raw blob (used when compression would not save space, which is the
+ * common case for signature data), 1 means the rest is a zstd frame. Each
+ * table may have its own dictionary, trained from a sample of its records
+ * when an existing database is converted.
+ *
+ * Settings and dictionaries live in the properties table, so that tools that
+ * copy or read the tables directly can decode records with load().
+ */
+class lmdb_tx_compression
+{
+public:
+  enum method_t : uint32_t
+  {
+    method_none = 0,
+    method_zstd = 1,
+  };
+
+  lmdb_tx_compression();
+  ~lmdb_tx_compression();
+
+  // whether this build can read and write compressed records
+  static bool supported();
+
+  void load(MDB_txn *txn, MDB_dbi properties);
+  void save(MDB_txn *txn, MDB_dbi properties) const;
+
+  bool enabled() const { return m_method != method_none; }
+  uint32_t method() const { return m_method; }
+  void set_method(uint32_t method);
+  bool has_dictionary(tx_compression_table table) const { return !m_dict[table].empty(); }
+
+  // train a dictionary from sample records; returns false if the samples do not allow it
+  bool train(tx_compression_table table, const std::vector<std::string> &samples);
+
+  // encode may only be called from the writer thread, decode is thread safe
+  MDB_val encode(tx_compression_table table, const MDB_val &raw, std::string &buffer);
+  void decode(tx_compression_table table, const MDB_val &stored, std::string &out) const;
+
+  void get_stats(tx_compression_stats &stats) const;
+
+private:
+  struct table_counters
+  {
+    std::atomic<uint64_t> encoded_records{0};
+    std::atomic<uint64_t> encoded_raw_bytes{0};
+    std::atomic<uint64_t> encoded_bytes{0};
+    mutable std::atomic<uint64_t> decoded_records{0};
+    mutable std::atomic<uint64_t> decoded_bytes{0};
+    mutable std::atomic<uint64_t> decoded_raw_bytes{0};
+    mutable std::atomic<uint64_t> decode_time_ns{0};
+  };
+
+  void free_contexts();
+  void create_contexts();
+
+  uint32_t m_method;
+  std::string m_dict[txc_num_tables];
+  void *m_cctx;
+  void *m_cdict[txc_num_tables];
+  void *m_ddict[txc_num_tables];
+  table_counters m_counters[txc_num_tables];
+};
+
+}  // namespace cryptonote
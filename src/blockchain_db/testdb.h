@@ -87,6 +87,7 @@ public:
   virtual crypto::hash get_block_hash_from_height(const uint64_t& height) const override { return crypto::hash(); }
   virtual std::vector<cryptonote::block> get_blocks_range(const uint64_t& h1, const uint64_t& h2) const override { return std::vector<cryptonote::block>(); }
   virtual std::vector<crypto::hash> get_hashes_range(const uint64_t& h1, const uint64_t& h2) const override { return std::vector<crypto::hash>(); }
+  virtual std::vector<cryptonote::block_header_info> get_block_headers_range(const uint64_t& h1, const uint64_t& h2) const override { return std::vector<cryptonote::block_header_info>(); }
   virtual crypto::hash top_block_hash(uint64_t *block_height = NULL) const override { if (block_height) *block_height = 0; return crypto::hash(); }
   virtual cryptonote::block get_top_block() const override { return cryptonote::block(); }
   virtual uint64_t height() const override { return 1; }
@@ -133,6 +134,10 @@ public:
   virtual bool get_txpool_tx_meta(const crypto::hash& txid, cryptonote::txpool_tx_meta_t &meta) const override { return false; }
   virtual bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd) const override { return false; }
   virtual uint64_t get_database_size() const override { return 0; }
+  virtual cryptonote::tx_compression_stats get_tx_compression_stats() const override { return cryptonote::tx_compression_stats(); }
+  virtual void start_snapshot(const std::string& path, uint64_t max_bytes_per_second) override {}
+  virtual cryptonote::db_snapshot_status get_snapshot_status() const override { return cryptonote::db_snapshot_status(); }
+  virtual cryptonote::db_stats get_db_stats() const override { return cryptonote::db_stats(); }
   virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid) const override { return ""; }
   virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const cryptonote::txpool_tx_meta_t&, const cryptonote::blobdata*)>, bool include_blob = false, bool include_unrelayed_txes = false) const override { return false; }
 
@@ -153,6 +158,7 @@ public:
   virtual bool prune_blockchain(uint32_t pruning_seed = 0) override { return true; }
   virtual bool update_pruning() override { return true; }
   virtual bool check_pruning() override { return true; }
+  virtual cryptonote::pruning_progress get_pruning_progress() const override { return cryptonote::pruning_progress(); }
   virtual void prune_outputs(uint64_t amount) override {}
 
   virtual uint64_t get_max_block_size() override { return 100000000; }
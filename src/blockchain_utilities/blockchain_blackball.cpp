@@ -40,6 +40,7 @@
 #include "cryptonote_core/cryptonote_core.h"
 #include "cryptonote_core/blockchain.h"
 #include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
 #include "wallet/ringdb.h"
 #include "version.h"
 
@@ -334,6 +335,17 @@ static std::vector<uint64_t> decompress_ring(const std::string &s)
   return ring;
 }
 
+static void load_tx_compression(MDB_txn *txn, lmdb_tx_compression &tx_compression)
+{
+  MDB_dbi dbi;
+  int dbr = mdb_dbi_open(txn, "properties", 0, &dbi);
+  if (dbr == MDB_NOTFOUND)
+    return;
+  if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  mdb_set_compare(txn, dbi, BlockchainLMDB::compare_string);
+  tx_compression.load(txn, dbi);
+}
+
 static bool for_all_transactions(const std::string &filename, uint64_t &start_idx, uint64_t &n_txes, const std::function<bool(const cryptonote::transaction_prefix&)> &f)
 {
   MDB_env *env;
@@ -347,7 +359,7 @@ static bool for_all_transactions(const std::string &filename, uint64_t &start_id
 
   dbr = mdb_env_create(&env);
   if (dbr) throw std::runtime_error("Failed to create LDMB environment: " + std::string(mdb_strerror(dbr)));
-  dbr = mdb_env_set_maxdbs(env, 2);
+  dbr = mdb_env_set_maxdbs(env, 3);
   if (dbr) throw std::runtime_error("Failed to set max env dbs: " + std::string(mdb_strerror(dbr)));
   const std::string actual_filename = filename;
   dbr = mdb_env_open(env, actual_filename.c_str(), 0, 0664);
@@ -359,6 +371,9 @@ static bool for_all_transactions(const std::string &filename, uint64_t &start_id
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
   tx_active = true;
 
+  lmdb_tx_compression tx_compression;
+  load_tx_compression(txn, tx_compression);
+
   dbr = mdb_dbi_open(txn, "txs_pruned", MDB_INTEGERKEY, &dbi);
   if (dbr)
     dbr = mdb_dbi_open(txn, "txs", MDB_INTEGERKEY, &dbi);
@@ -392,7 +407,7 @@ static bool for_all_transactions(const std::string &filename, uint64_t &start_id
 
     cryptonote::transaction_prefix tx;
     blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    tx_compression.decode(txc_pruned, v, bd);
     std::stringstream ss;
     ss << bd;
     binary_archive<false> ba(ss);
@@ -428,7 +443,7 @@ static bool for_all_transactions(const std::string &filename, const uint64_t &st
 
   dbr = mdb_env_create(&env);
   if (dbr) throw std::runtime_error("Failed to create LDMB environment: " + std::string(mdb_strerror(dbr)));
-  dbr = mdb_env_set_maxdbs(env, 3);
+  dbr = mdb_env_set_maxdbs(env, 4);
   if (dbr) throw std::runtime_error("Failed to set max env dbs: " + std::string(mdb_strerror(dbr)));
   const std::string actual_filename = filename;
   dbr = mdb_env_open(env, actual_filename.c_str(), 0, 0664);
@@ -440,6 +455,9 @@ static bool for_all_transactions(const std::string &filename, const uint64_t &st
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
   tx_active = true;
 
+  lmdb_tx_compression tx_compression;
+  load_tx_compression(txn, tx_compression);
+
   dbr = mdb_dbi_open(txn, "blocks", MDB_INTEGERKEY, &dbi_blocks);
   if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
   dbr = mdb_dbi_open(txn, "txs_pruned", MDB_INTEGERKEY, &dbi_txs);
@@ -501,7 +519,8 @@ static bool for_all_transactions(const std::string &filename, const uint64_t &st
       if (start_idx <= tx_idx++)
       {
         cryptonote::transaction_prefix tx;
-        bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+        bd.clear();
+        tx_compression.decode(txc_pruned, v, bd);
         CHECK_AND_ASSERT_MES(parse_and_validate_tx_prefix_from_blob(bd, tx), false, "Failed to parse transaction from blob");
         if (!f(last_block && i == b.tx_hashes.size() - 1, height, tx))
         {
@@ -535,13 +554,15 @@ static uint64_t find_first_diverging_transaction(const std::string &first_filena
   uint64_t n_txes[2];
   MDB_val k;
   MDB_val v[2];
+  lmdb_tx_compression tx_compression[2];
+  blobdata bd[2];
 
   epee::misc_utils::auto_scope_leave_caller txn_dtor[2];
   for (int i = 0; i < 2; ++i)
   {
     dbr = mdb_env_create(&env[i]);
     if (dbr) throw std::runtime_error("Failed to create LDMB environment: " + std::string(mdb_strerror(dbr)));
-    dbr = mdb_env_set_maxdbs(env[i], 2);
+    dbr = mdb_env_set_maxdbs(env[i], 3);
     if (dbr) throw std::runtime_error("Failed to set max env dbs: " + std::string(mdb_strerror(dbr)));
     const std::string actual_filename = i ? second_filename : first_filename;
     dbr = mdb_env_open(env[i], actual_filename.c_str(), 0, 0664);
@@ -553,6 +574,8 @@ static uint64_t find_first_diverging_transaction(const std::string &first_filena
     txn_dtor[i] = epee::misc_utils::create_scope_leave_handler([&, i](){if (tx_active[i]) mdb_txn_abort(txn[i]);});
     tx_active[i] = true;
 
+    load_tx_compression(txn[i], tx_compression[i]);
+
     dbr = mdb_dbi_open(txn[i], "txs_pruned", MDB_INTEGERKEY, &dbi[i]);
     if (dbr)
       dbr = mdb_dbi_open(txn[i], "txs", MDB_INTEGERKEY, &dbi[i]);
@@ -578,7 +601,12 @@ static uint64_t find_first_diverging_transaction(const std::string &first_filena
     if (dbr) throw std::runtime_error("Failed to query transaction: " + std::string(mdb_strerror(dbr)));
     dbr = mdb_cursor_get(cur[1], &k, &v[1], MDB_SET);
     if (dbr) throw std::runtime_error("Failed to query transaction: " + std::string(mdb_strerror(dbr)));
-    if (v[0].mv_size == v[1].mv_size && !memcmp(v[0].mv_data, v[1].mv_data, v[0].mv_size))
+    for (int i = 0; i < 2; ++i)
+    {
+      bd[i].clear();
+      tx_compression[i].decode(txc_pruned, v[i], bd[i]);
+    }
+    if (bd[0] == bd[1])
       lo = mid + 1;
     else
       hi = mid - 1;
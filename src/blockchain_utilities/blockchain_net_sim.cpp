@@ -0,0 +1,548 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/thread/thread.hpp>
+#include "common/command_line.h"
+#include "common/util.h"
+#include "cryptonote_basic/account.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "misc_language.h"
+#include "p2p/net_node.h"
+#include "version.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+namespace
+{
+  typedef std::chrono::steady_clock sim_clock;
+
+  struct link_shape
+  {
+    std::chrono::microseconds latency;
+    uint64_t bandwidth; // bytes per second, 0 for unlimited
+  };
+
+  /* One accepted connection, forwarded to a node through a link with the
+     given latency and bandwidth in each direction. Data read from one side is
+     queued with the time the shaped link would deliver it, and written to the
+     other side at that time. All links run on a single thread. */
+  class shaped_link: public std::enable_shared_from_this<shaped_link>
+  {
+  public:
+    shaped_link(boost::asio::io_context &io_context, const link_shape &shape, std::atomic<uint64_t> &bytes)
+      : m_client(io_context), m_server(io_context), m_shape(shape), m_bytes(bytes), m_closed(false),
+        m_up(io_context, m_client, m_server), m_down(io_context, m_server, m_client)
+    {}
+
+    boost::asio::ip::tcp::socket &client() { return m_client; }
+
+    void start(const boost::asio::ip::tcp::endpoint &target)
+    {
+      auto self = shared_from_this();
+      m_server.async_connect(target, [self](const boost::system::error_code &ec) {
+        if (ec)
+          return self->close();
+        self->read(self->m_up);
+        self->read(self->m_down);
+      });
+    }
+
+  private:
+    static constexpr const size_t max_queued = 4 * 1024 * 1024;
+
+    struct pipe
+    {
+      pipe(boost::asio::io_context &io_context, boost::asio::ip::tcp::socket &from, boost::asio::ip::tcp::socket &to)
+        : from(from), to(to), timer(io_context), queued(0), reading(false), writing(false), link_free(sim_clock::now())
+      {}
+
+      boost::asio::ip::tcp::socket &from;
+      boost::asio::ip::tcp::socket &to;
+      boost::asio::steady_timer timer;
+      std::array<char, 16384> buffer;
+      std::deque<std::pair<sim_clock::time_point, std::string>> queue;
+      size_t queued;
+      bool reading;
+      bool writing;
+      sim_clock::time_point link_free; // when the link is done sending what is queued
+    };
+
+    void read(pipe &p)
+    {
+      if (p.reading || m_closed || p.queued > max_queued)
+        return;
+      p.reading = true;
+      auto self = shared_from_this();
+      p.from.async_read_some(boost::asio::buffer(p.buffer), [self, &p](const boost::system::error_code &ec, size_t bytes) {
+        p.reading = false;
+        if (ec)
+          return self->close();
+        self->enqueue(p, bytes);
+        self->read(p);
+      });
+    }
+
+    void enqueue(pipe &p, size_t bytes)
+    {
+      const sim_clock::time_point now = sim_clock::now();
+      p.link_free = std::max(p.link_free, now);
+      if (m_shape.bandwidth)
+        p.link_free += std::chrono::microseconds(bytes * 1000000 / m_shape.bandwidth);
+      p.queue.emplace_back(p.link_free + m_shape.latency, std::string(p.buffer.data(), bytes));
+      p.queued += bytes;
+      m_bytes += bytes;
+      write(p);
+    }
+
+    void write(pipe &p)
+    {
+      if (p.writing || p.queue.empty() || m_closed)
+        return;
+      p.writing = true;
+      auto self = shared_from_this();
+      p.timer.expires_at(p.queue.front().first);
+      p.timer.async_wait([self, &p](const boost::system::error_code &ec) {
+        if (ec)
+          return self->close();
+        boost::asio::async_write(p.to, boost::asio::buffer(p.queue.front().second), [self, &p](const boost::system::error_code &ec, size_t bytes) {
+          p.writing = false;
+          if (ec)
+            return self->close();
+          p.queued -= bytes;
+          p.queue.pop_front();
+          self->read(p);
+          self->write(p);
+        });
+      });
+    }
+
+    void close()
+    {
+      if (m_closed)
+        return;
+      m_closed = true;
+      boost::system::error_code ignored;
+      m_client.close(ignored);
+      m_server.close(ignored);
+      m_up.timer.cancel();
+      m_down.timer.cancel();
+    }
+
+    boost::asio::ip::tcp::socket m_client;
+    boost::asio::ip::tcp::socket m_server;
+    const link_shape m_shape;
+    std::atomic<uint64_t> &m_bytes;
+    bool m_closed;
+    pipe m_up;
+    pipe m_down;
+  };
+
+  //! Listens on an ephemeral loopback port and forwards connections to a node.
+  class link_listener
+  {
+  public:
+    link_listener(boost::asio::io_context &io_context, uint16_t target_port, const link_shape &shape, std::atomic<uint64_t> &bytes)
+      : m_io_context(io_context), m_acceptor(io_context, {boost::asio::ip::address_v4::loopback(), 0}),
+        m_target(boost::asio::ip::address_v4::loopback(), target_port), m_shape(shape), m_bytes(bytes)
+    {
+      accept();
+    }
+
+    uint16_t port() const { return m_acceptor.local_endpoint().port(); }
+
+  private:
+    void accept()
+    {
+      auto link = std::make_shared<shaped_link>(m_io_context, m_shape, m_bytes);
+      m_acceptor.async_accept(link->client(), [this, link](const boost::system::error_code &ec) {
+        if (ec == boost::asio::error::operation_aborted)
+          return;
+        if (!ec)
+          link->start(m_target);
+        accept();
+      });
+    }
+
+    boost::asio::io_context &m_io_context;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    const boost::asio::ip::tcp::endpoint m_target;
+    const link_shape m_shape;
+    std::atomic<uint64_t> &m_bytes;
+  };
+
+  struct sim_node
+  {
+    typedef t_cryptonote_protocol_handler<core> protocol_t;
+    typedef nodetool::node_server<protocol_t> p2p_t;
+
+    sim_node(): m_core(nullptr), m_protocol(m_core, nullptr, false), m_p2p(m_protocol) {}
+
+    bool init(const std::vector<std::string> &args, const test_options &options)
+    {
+      po::options_description desc;
+      core::init_options(desc);
+      p2p_t::init_options(desc);
+      po::variables_map vm;
+      const bool r = command_line::handle_error_helper(desc, [&]()
+      {
+        po::store(po::command_line_parser(args).options(desc).run(), vm);
+        po::notify(vm);
+        return true;
+      });
+      if (!r)
+        return false;
+
+      if (!m_core.init(vm, &options))
+        return false;
+      if (!m_protocol.init(vm) || !m_p2p.init(vm))
+      {
+        m_core.deinit();
+        return false;
+      }
+      m_protocol.set_p2p_endpoint(&m_p2p);
+      m_core.set_cryptonote_protocol(&m_protocol);
+      return true;
+    }
+
+    void start()
+    {
+      m_thread = boost::thread([this]() { m_p2p.run(); });
+    }
+
+    void stop()
+    {
+      m_p2p.send_stop_signal();
+      if (m_thread.joinable())
+        m_thread.join();
+      m_p2p.deinit();
+      m_protocol.deinit();
+      m_protocol.set_p2p_endpoint(nullptr);
+      m_core.deinit();
+      m_core.set_cryptonote_protocol(nullptr);
+    }
+
+    core m_core;
+    protocol_t m_protocol;
+    p2p_t m_p2p;
+    boost::thread m_thread;
+  };
+
+  bool mine_block(sim_node &node, const account_public_address &address, sim_clock::time_point *found = nullptr)
+  {
+    block b;
+    uint64_t diffic, height, expected_reward;
+    if (!node.m_core.get_block_template(b, address, diffic, height, expected_reward, blobdata()))
+    {
+      MERROR("Failed to get a block template");
+      return false;
+    }
+    // difficulty is fixed to 1, so any nonce will do
+    if (found)
+      *found = sim_clock::now();
+    block_verification_context bvc = AUTO_VAL_INIT(bvc);
+    if (!node.m_core.handle_block_found(b, bvc) || !bvc.m_added_to_main_chain)
+    {
+      MERROR("Failed to add block at height " << height);
+      return false;
+    }
+    return true;
+  }
+
+  double percentile(std::vector<double> values, double p)
+  {
+    if (values.empty())
+      return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min<size_t>(values.size() - 1, values.size() * p / 100)];
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  uint32_t log_level = 0;
+
+  tools::on_startup();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<uint32_t> arg_nodes  = {"nodes", "Number of nodes", 4};
+  const command_line::arg_descriptor<uint32_t> arg_peers  = {"peers", "Outgoing connections per node", 2};
+  const command_line::arg_descriptor<uint64_t> arg_blocks  = {"blocks", "Blocks the first node mines before the others sync from it", 200};
+  const command_line::arg_descriptor<uint64_t> arg_relay_blocks  = {"relay-blocks", "Blocks mined once synced to measure propagation", 20};
+  const command_line::arg_descriptor<uint64_t> arg_block_interval  = {"block-interval-ms", "Interval between relayed blocks", 1000};
+  const command_line::arg_descriptor<uint64_t> arg_latency  = {"latency-ms", "One way latency of each link", 50};
+  const command_line::arg_descriptor<uint64_t> arg_bandwidth  = {"bandwidth", "Bandwidth of each link in each direction in kB/s, 0 for unlimited", 0};
+  const command_line::arg_descriptor<uint16_t> arg_base_port  = {"base-port", "P2P port of the first node, the others use the following ones", 48080};
+  const command_line::arg_descriptor<uint32_t> arg_seed  = {"seed", "Seed for the random topology", 0};
+  const command_line::arg_descriptor<uint64_t> arg_sync_timeout  = {"sync-timeout", "Seconds to wait for the nodes to sync", 600};
+  const command_line::arg_descriptor<std::vector<std::string>> arg_node_option  = {"node-option", "Option passed to every node, e.g. --node-option=--p2p-io-shards=2"};
+
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_nodes);
+  command_line::add_arg(desc_cmd_sett, arg_peers);
+  command_line::add_arg(desc_cmd_sett, arg_blocks);
+  command_line::add_arg(desc_cmd_sett, arg_relay_blocks);
+  command_line::add_arg(desc_cmd_sett, arg_block_interval);
+  command_line::add_arg(desc_cmd_sett, arg_latency);
+  command_line::add_arg(desc_cmd_sett, arg_bandwidth);
+  command_line::add_arg(desc_cmd_sett, arg_base_port);
+  command_line::add_arg(desc_cmd_sett, arg_seed);
+  command_line::add_arg(desc_cmd_sett, arg_sync_timeout);
+  command_line::add_arg(desc_cmd_sett, arg_node_option);
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    auto parser = po::command_line_parser(argc, argv).options(desc_options);
+    po::store(parser.run(), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Nerva '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << "Runs several nodes in this process, connected through loopback links with" << ENDL;
+    std::cout << "simulated latency and bandwidth, and measures sync and block relay." << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("nerva-blockchain-net-sim.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+
+  const uint32_t n_nodes = command_line::get_arg(vm, arg_nodes);
+  const uint32_t n_peers = std::min(command_line::get_arg(vm, arg_peers), n_nodes - 1);
+  const uint64_t n_blocks = command_line::get_arg(vm, arg_blocks);
+  const uint64_t n_relay_blocks = command_line::get_arg(vm, arg_relay_blocks);
+  const std::chrono::milliseconds block_interval(command_line::get_arg(vm, arg_block_interval));
+  const uint16_t base_port = command_line::get_arg(vm, arg_base_port);
+  const uint64_t sync_timeout = command_line::get_arg(vm, arg_sync_timeout);
+  if (n_nodes < 2)
+  {
+    std::cerr << "At least two nodes are needed" << std::endl;
+    return 1;
+  }
+
+  link_shape shape;
+  shape.latency = std::chrono::milliseconds(command_line::get_arg(vm, arg_latency));
+  shape.bandwidth = command_line::get_arg(vm, arg_bandwidth) * 1024;
+
+  // each node i > 0 first connects to a node before it, so the graph is connected
+  std::mt19937 rng(command_line::get_arg(vm, arg_seed));
+  std::vector<std::vector<uint32_t>> out_peers(n_nodes);
+  for (uint32_t i = 0; i < n_nodes; ++i)
+  {
+    if (i > 0)
+      out_peers[i].push_back(std::uniform_int_distribution<uint32_t>(0, i - 1)(rng));
+    while (out_peers[i].size() < n_peers)
+    {
+      const uint32_t j = std::uniform_int_distribution<uint32_t>(0, n_nodes - 1)(rng);
+      if (j != i && std::find(out_peers[i].begin(), out_peers[i].end(), j) == out_peers[i].end())
+        out_peers[i].push_back(j);
+    }
+  }
+
+  boost::asio::io_context links_io_context;
+  auto links_work = boost::asio::make_work_guard(links_io_context);
+  std::atomic<uint64_t> bytes(0);
+  std::vector<std::unique_ptr<link_listener>> listeners;
+
+  const boost::filesystem::path data_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("nerva-net-sim-%%%%-%%%%");
+  uint8_t hf_version = 1;
+  for (const auto &hf: config::hard_forks)
+    hf_version = std::max<uint8_t>(hf_version, hf.version);
+  const std::pair<uint8_t, uint64_t> hard_forks[] = {std::make_pair(1, 0), std::make_pair(hf_version, 1), std::make_pair(0, 0)};
+  const test_options options = {hard_forks, CRYPTONOTE_LONG_TERM_BLOCK_WEIGHT_WINDOW_SIZE};
+
+  std::vector<std::unique_ptr<sim_node>> nodes;
+  boost::thread links_thread;
+  // stop whatever was started and remove the nodes' data on every way out
+  auto cleanup = epee::misc_utils::create_scope_leave_handler([&]() {
+    for (auto &node: nodes)
+      node->stop();
+    links_work.reset();
+    links_io_context.stop();
+    if (links_thread.joinable())
+      links_thread.join();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(data_dir, ec);
+  });
+
+  for (uint32_t i = 0; i < n_nodes; ++i)
+  {
+    std::vector<std::string> args = {
+      "--data-dir=" + (data_dir / std::to_string(i)).string(),
+      "--fixed-difficulty=1",
+      "--disable-dns-checkpoints",
+      "--check-updates=disabled",
+      "--db-sync-mode=fastest:async:1000",
+      "--p2p-bind-ip=127.0.0.1",
+      "--p2p-bind-port=" + std::to_string(base_port + i),
+      "--no-igd",
+      "--hide-my-port",
+      "--allow-local-ip",
+      "--out-peers=" + std::to_string(n_peers),
+      // the rate limits are global, they would be shared by all the nodes
+      "--limit-rate-up=1048576",
+      "--limit-rate-down=1048576",
+    };
+    for (const uint32_t j: out_peers[i])
+    {
+      listeners.emplace_back(new link_listener(links_io_context, base_port + j, shape, bytes));
+      args.push_back("--add-exclusive-node=127.0.0.1:" + std::to_string(listeners.back()->port()));
+    }
+    for (const std::string &option: command_line::get_arg(vm, arg_node_option))
+      args.push_back(option);
+
+    std::unique_ptr<sim_node> node(new sim_node());
+    if (!node->init(args, options))
+    {
+      std::cerr << "Failed to initialize node " << i << std::endl;
+      return 1;
+    }
+    nodes.push_back(std::move(node));
+  }
+  links_thread = boost::thread([&links_io_context]() { links_io_context.run(); });
+
+  account_base miner;
+  miner.generate();
+  const account_public_address &address = miner.get_keys().m_account_address;
+
+  LOG_PRINT_L0("Mining " << n_blocks << " blocks on node 0");
+  for (uint64_t n = 0; n < n_blocks; ++n)
+    if (!mine_block(*nodes[0], address))
+      return 1;
+  const uint64_t sync_height = nodes[0]->m_core.get_current_blockchain_height();
+
+  auto all_at = [&](uint64_t height) {
+    for (const auto &node: nodes)
+      if (node->m_core.get_current_blockchain_height() < height)
+        return false;
+    return true;
+  };
+
+  LOG_PRINT_L0("Starting " << n_nodes << " nodes");
+  const sim_clock::time_point sync_start = sim_clock::now();
+  for (auto &node: nodes)
+    node->start();
+  while (!all_at(sync_height) && sim_clock::now() - sync_start < std::chrono::seconds(sync_timeout))
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+  const double sync_seconds = std::chrono::duration<double>(sim_clock::now() - sync_start).count();
+  const bool synced = all_at(sync_height);
+  const uint64_t sync_bytes = bytes;
+
+  std::vector<double> delays;
+  uint64_t missed = 0;
+  if (synced)
+  {
+    LOG_PRINT_L0("Relaying " << n_relay_blocks << " blocks");
+    for (uint64_t n = 0; n < n_relay_blocks; ++n)
+    {
+      const uint64_t height = nodes[0]->m_core.get_current_blockchain_height() + 1;
+      sim_clock::time_point found;
+      if (!mine_block(*nodes[0], address, &found))
+        break;
+      std::vector<bool> seen(n_nodes, false);
+      size_t left = n_nodes - 1;
+      while (left && sim_clock::now() - found < block_interval * 10)
+      {
+        for (uint32_t i = 1; i < n_nodes; ++i)
+        {
+          if (!seen[i] && nodes[i]->m_core.get_current_blockchain_height() >= height)
+          {
+            seen[i] = true;
+            --left;
+            delays.push_back(std::chrono::duration<double, std::milli>(sim_clock::now() - found).count());
+          }
+        }
+        boost::this_thread::sleep_for(boost::chrono::microseconds(500));
+      }
+      missed += left;
+      const sim_clock::time_point next = found + block_interval;
+      if (sim_clock::now() < next)
+        boost::this_thread::sleep_for(boost::chrono::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(next - sim_clock::now()).count()));
+    }
+  }
+  const uint64_t relay_bytes = bytes - sync_bytes;
+
+  cleanup.reset();
+
+  std::cout << boost::format("%u nodes, %u outgoing peers each, %u ms latency, %s per link")
+    % n_nodes % n_peers % command_line::get_arg(vm, arg_latency)
+    % (shape.bandwidth ? tools::get_human_readable_bytes(shape.bandwidth) + "/s" : std::string("unlimited")) << std::endl;
+  if (!synced)
+  {
+    std::cout << boost::format("Sync: timed out after %.1f s") % sync_seconds << std::endl;
+    return 1;
+  }
+  std::cout << boost::format("Sync: %u blocks to %u nodes in %.2f s, %.1f blocks/s, %s relayed")
+    % n_blocks % (n_nodes - 1) % sync_seconds % (n_blocks / sync_seconds) % tools::get_human_readable_bytes(sync_bytes) << std::endl;
+  if (!delays.empty())
+  {
+    std::cout << boost::format("Relay: %u blocks, propagation p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms, %u missed, %s relayed")
+      % ((delays.size() + missed) / (n_nodes - 1)) % percentile(delays, 50) % percentile(delays, 90) % percentile(delays, 99)
+      % percentile(delays, 100) % missed % tools::get_human_readable_bytes(relay_bytes) << std::endl;
+  }
+
+  return 0;
+
+  CATCH_ENTRY("Net sim error", 1);
+}
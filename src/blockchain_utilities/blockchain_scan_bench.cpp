@@ -0,0 +1,224 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <chrono>
+#include <iostream>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include "common/command_line.h"
+#include "common/threadpool.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "blockchain_db/blockchain_db.h"
+#include "version.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+namespace
+{
+  typedef std::chrono::steady_clock bench_clock;
+
+  void report(const char *name, size_t count, bench_clock::time_point start)
+  {
+    const double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    std::cout << boost::format("%-40s %10.0f derivations/s (%.3f s)") % name % (seconds > 0 ? count / seconds : 0.0) % seconds << std::endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  uint32_t log_level = 0;
+
+  tools::on_startup();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<uint64_t> arg_blocks  = {"blocks", "Take tx pubkeys from this many blocks below the top of the chain", 1000};
+  const command_line::arg_descriptor<unsigned> arg_repeat  = {"repeat", "Derive each tx pubkey this many times", 1};
+
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_stagenet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_blocks);
+  command_line::add_arg(desc_cmd_sett, arg_repeat);
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    auto parser = po::command_line_parser(argc, argv).options(desc_options);
+    po::store(parser.run(), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "NERVA '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("nerva-blockchain-scan-bench.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+
+  LOG_PRINT_L0("Starting...");
+
+  std::string opt_data_dir = command_line::get_arg(vm, cryptonote::arg_data_dir);
+  const uint64_t opt_blocks = command_line::get_arg(vm, arg_blocks);
+  const unsigned opt_repeat = std::max(1u, command_line::get_arg(vm, arg_repeat));
+
+  BlockchainDB *db = new_db();
+  if (db == NULL)
+  {
+    LOG_ERROR("Failed to initialize a database");
+    throw std::runtime_error("Failed to initialize a database");
+  }
+
+  const std::string filename = (boost::filesystem::path(opt_data_dir) / db->get_db_name()).string();
+  LOG_PRINT_L0("Loading blockchain from folder " << filename << " ...");
+
+  try
+  {
+    db->open(filename, DBF_RDONLY);
+  }
+  catch (const std::exception& e)
+  {
+    LOG_PRINT_L0("Error opening database: " << e.what());
+    return 1;
+  }
+
+  // the tx pubkeys a wallet would derive with its view key when scanning these blocks
+  std::vector<crypto::public_key> pkeys;
+  const uint64_t db_height = db->height();
+  const uint64_t block_start = db_height > opt_blocks ? db_height - opt_blocks : 0;
+  for (uint64_t h = block_start; h < db_height; ++h)
+  {
+    cryptonote::block blk;
+    if (!cryptonote::parse_and_validate_block_from_blob(db->get_block_blob_from_height(h), blk))
+    {
+      LOG_PRINT_L0("Bad block from db");
+      return 1;
+    }
+    std::vector<cryptonote::transaction_prefix> txes(1, blk.miner_tx);
+    for (const crypto::hash &txid: blk.tx_hashes)
+    {
+      cryptonote::blobdata bd;
+      cryptonote::transaction tx;
+      if (!db->get_pruned_tx_blob(txid, bd) || !cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
+      {
+        LOG_PRINT_L0("Bad tx from db: " << txid);
+        return 1;
+      }
+      txes.push_back(tx);
+    }
+    for (const cryptonote::transaction_prefix &tx: txes)
+    {
+      const crypto::public_key pkey = cryptonote::get_tx_pub_key_from_extra(tx);
+      if (pkey != crypto::null_pkey)
+        pkeys.push_back(pkey);
+      for (const crypto::public_key &additional: cryptonote::get_additional_tx_pub_keys_from_extra(tx))
+        pkeys.push_back(additional);
+    }
+  }
+  db->close();
+  delete db;
+
+  std::vector<crypto::public_key> all_pkeys;
+  all_pkeys.reserve(pkeys.size() * opt_repeat);
+  for (unsigned i = 0; i < opt_repeat; ++i)
+    all_pkeys.insert(all_pkeys.end(), pkeys.begin(), pkeys.end());
+  if (all_pkeys.empty())
+  {
+    LOG_PRINT_L0("No tx pubkeys found");
+    return 1;
+  }
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const size_t n = all_pkeys.size();
+  std::cout << n << " tx pubkeys from " << db_height - block_start << " blocks, " << tpool.get_max_concurrency() << " threads" << std::endl;
+
+  crypto::public_key view_pkey;
+  crypto::secret_key view_skey;
+  crypto::generate_keys(view_pkey, view_skey);
+
+  std::vector<crypto::key_derivation> expected(n), derivations(n);
+  std::unique_ptr<bool[]> valid(new bool[n]);
+
+  bench_clock::time_point start = bench_clock::now();
+  for (size_t i = 0; i < n; ++i)
+    valid[i] = crypto::generate_key_derivation(all_pkeys[i], view_skey, expected[i]);
+  report("generate_key_derivation", n, start);
+
+  // as the wallet does for software devices, without a lock around the derivations
+  tools::threadpool::waiter waiter;
+  static constexpr size_t batch_size = 64;
+  start = bench_clock::now();
+  for (size_t i = 0; i < n; i += batch_size)
+  {
+    tpool.submit(&waiter, [&, i]() {
+      for (size_t j = i; j < std::min(i + batch_size, n); ++j)
+        crypto::generate_key_derivation(all_pkeys[j], view_skey, derivations[j]);
+    }, true);
+  }
+  waiter.wait(&tpool);
+  report("generate_key_derivation, threaded", n, start);
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (valid[i] && memcmp(&derivations[i], &expected[i], sizeof(expected[i])))
+    {
+      LOG_PRINT_L0("Derivation mismatch for tx pubkey " << all_pkeys[i]);
+      return 1;
+    }
+  }
+
+  return 0;
+
+  CATCH_ENTRY("Scan benchmark error", 1);
+}
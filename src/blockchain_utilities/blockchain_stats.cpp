@@ -313,6 +313,21 @@ skip:
       break;
   }
 
+  const tx_compression_stats cstats = db->get_tx_compression_stats();
+  if (cstats.method != "none")
+  {
+    std::cout << ENDL << ENDL << "# COMPRESSION" << ENDL;
+    std::cout << "Table\tMethod\tDictionary\tRecords\tStoredBytes\tRawBytes\tRatio\tDecodeMB/s" << ENDL;
+    const auto print_table = [&cstats](const char *name, bool dictionary, const tx_compression_table_stats &s) {
+      const double ratio = s.decoded_bytes ? s.decoded_raw_bytes / (double)s.decoded_bytes : 0.0;
+      const double mbps = s.decode_time_ns ? s.decoded_raw_bytes * 1e3 / (double)s.decode_time_ns : 0.0;
+      std::cout << name << "\t" << cstats.method << "\t" << (dictionary ? "yes" : "no") << "\t" << s.decoded_records
+          << "\t" << s.decoded_bytes << "\t" << s.decoded_raw_bytes << "\t" << ratio << "\t" << mbps << ENDL;
+    };
+    print_table("pruned", cstats.pruned_dictionary, cstats.pruned);
+    print_table("prunable", cstats.prunable_dictionary, cstats.prunable);
+  }
+
   core_storage->deinit();
   return 0;
 
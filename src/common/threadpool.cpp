@@ -32,18 +32,22 @@
 #include "cryptonote_config.h"
 #include "common/util.h"
 
-static __thread int depth = 0;
 static __thread bool is_leaf = false;
+static __thread tools::threadpool *worker_pool = NULL;
+static __thread size_t worker_index = 0;
+static __thread tools::threadpool::priority current_priority = tools::threadpool::priority_normal;
 
 namespace tools
 {
-threadpool::threadpool(unsigned int max_threads) : running(true), active(0) {
+threadpool::threadpool(unsigned int max_threads) : pending(0), running(true) {
   boost::thread::attributes attrs;
   attrs.set_stack_size(THREAD_STACK_SIZE);
   max = max_threads ? max_threads : tools::get_max_concurrency();
-  size_t i = max ? max - 1 : 0;
-  while(i--) {
-    threads.push_back(boost::thread(attrs, boost::bind(&threadpool::run, this, false)));
+  size_t n = max ? max - 1 : 0;
+  for (size_t i = 0; i <= n; ++i)
+    queues.emplace_back(new task_queue());
+  for (size_t i = 0; i < n; ++i) {
+    threads.push_back(boost::thread(attrs, boost::bind(&threadpool::run, this, i)));
   }
 }
 
@@ -67,33 +71,67 @@ threadpool::~threadpool() {
   }
 }
 
+threadpool::priority_scope::priority_scope(priority p) : prev(current_priority) {
+  current_priority = p;
+}
+
+threadpool::priority_scope::~priority_scope() {
+  current_priority = prev;
+}
+
 void threadpool::submit(waiter *obj, std::function<void()> f, bool leaf) {
   CHECK_AND_ASSERT_THROW_MES(!is_leaf, "A leaf routine is using a thread pool");
-  boost::unique_lock<boost::mutex> lock(mutex);
-  if (!leaf && ((active == max && !queue.empty()) || depth > 0)) {
-    // if all available threads are already running
-    // and there's work waiting, just run in current thread
-    lock.unlock();
-    ++depth;
+  if (threads.empty()) {
+    // no workers, run in current thread
     is_leaf = leaf;
     f();
-    --depth;
     is_leaf = false;
-  } else {
-    if (obj)
-      obj->inc();
-    if (leaf)
-      queue.push_front({obj, f, leaf});
+    return;
+  }
+
+  if (obj)
+    obj->inc();
+
+  // workers push to their own queue, others to the shared one
+  const bool own = worker_pool == this;
+  task_queue &q = *queues[own ? worker_index : queues.size() - 1];
+  const priority prio = current_priority;
+  // counted before it is visible, so a worker never sleeps while it is queued
+  ++pending;
+  {
+    const boost::unique_lock<boost::mutex> lock(q.mutex);
+    // leaves go where they will be picked up first
+    if (leaf && !own)
+      q.tasks[prio].push_front({obj, std::move(f), leaf, prio, std::chrono::steady_clock::now()});
     else
-      queue.push_back({obj, f, leaf});
-    has_work.notify_one();
+      q.tasks[prio].push_back({obj, std::move(f), leaf, prio, std::chrono::steady_clock::now()});
   }
+  ++stat[prio].queued;
+  ++stat[prio].submitted;
+
+  const boost::unique_lock<boost::mutex> lock(mutex);
+  has_work.notify_one();
 }
 
 unsigned int threadpool::get_max_concurrency() const {
   return max;
 }
 
+threadpool::stats threadpool::get_stats() const {
+  stats s;
+  s.threads = max;
+  for (size_t i = 0; i < priority_count; ++i) {
+    s.priorities[i].queued = stat[i].queued;
+    s.priorities[i].submitted = stat[i].submitted;
+    s.priorities[i].completed = stat[i].completed;
+    s.priorities[i].stolen = stat[i].stolen;
+    s.priorities[i].wait_us = stat[i].wait_us;
+    s.priorities[i].max_wait_us = stat[i].max_wait_us;
+    s.priorities[i].run_us = stat[i].run_us;
+  }
+  return s;
+}
+
 threadpool::waiter::~waiter()
 {
   try
@@ -114,8 +152,23 @@ threadpool::waiter::~waiter()
 }
 
 void threadpool::waiter::wait(threadpool *tpool) {
-  if (tpool)
-    tpool->run(true);
+  if (tpool) {
+    // help with queued work while our tasks are not all done, but only with
+    // tasks at least as urgent as ours, so that e.g. block verification does
+    // not end up running a background job inline
+    const size_t self = worker_pool == tpool ? worker_index : tpool->queues.size() - 1;
+    entry e;
+    while (true) {
+      {
+        const boost::unique_lock<boost::mutex> lock(mt);
+        if (!num)
+          return;
+      }
+      if (!tpool->take(self, current_priority, e))
+        break;
+      tpool->execute(e, self);
+    }
+  }
   boost::unique_lock<boost::mutex> lock(mt);
   while(num)
     cv.wait(lock);
@@ -133,32 +186,80 @@ void threadpool::waiter::dec() {
     cv.notify_all();
 }
 
-void threadpool::run(bool flush) {
-  boost::unique_lock<boost::mutex> lock(mutex);
-  while (running) {
-    entry e;
-    while(queue.empty() && running)
-    {
-      if (flush)
-        return;
-      has_work.wait(lock);
+bool threadpool::take(size_t self, priority lowest, entry &e) {
+  if (!pending)
+    return false;
+  const size_t shared = queues.size() - 1;
+  for (size_t p = 0; p <= lowest; ++p) {
+    // own tasks newest first, keeping their data in cache
+    if (self != shared) {
+      task_queue &q = *queues[self];
+      const boost::unique_lock<boost::mutex> lock(q.mutex);
+      if (!q.tasks[p].empty()) {
+        e = std::move(q.tasks[p].back());
+        q.tasks[p].pop_back();
+        --pending;
+        return true;
+      }
     }
-    if (!running) break;
-
-    active++;
-    e = queue.front();
-    queue.pop_front();
-    lock.unlock();
-    ++depth;
-    is_leaf = e.leaf;
-    e.f();
-    --depth;
-    is_leaf = false;
+    // then submissions from outside the pool, then steal the oldest task of another worker;
+    // a thread outside the pool has no queue of its own and helps with the shared one
+    for (size_t n = 0; n < queues.size(); ++n) {
+      const size_t i = n == 0 ? shared : (self + n) % queues.size();
+      if (n != 0 && i == shared)
+        continue;
+      task_queue &q = *queues[i];
+      const boost::unique_lock<boost::mutex> lock(q.mutex);
+      if (!q.tasks[p].empty()) {
+        e = std::move(q.tasks[p].front());
+        q.tasks[p].pop_front();
+        --pending;
+        if (i != shared)
+          ++stat[p].stolen;
+        return true;
+      }
+    }
+  }
+  return false;
+}
 
-    if (e.wo)
-      e.wo->dec();
-    lock.lock();
-    active--;
+void threadpool::execute(entry &e, size_t self) {
+  const auto start = std::chrono::steady_clock::now();
+  const uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(start - e.queued).count();
+  counters &c = stat[e.prio];
+  --c.queued;
+  c.wait_us += wait_us;
+  uint64_t max_wait_us = c.max_wait_us;
+  while (wait_us > max_wait_us && !c.max_wait_us.compare_exchange_weak(max_wait_us, wait_us));
+
+  const priority prev_priority = current_priority;
+  is_leaf = e.leaf;
+  current_priority = e.prio;
+  e.f();
+  current_priority = prev_priority;
+  is_leaf = false;
+
+  c.run_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  ++c.completed;
+  if (e.wo)
+    e.wo->dec();
+  e.f = nullptr;
+}
+
+void threadpool::run(size_t self) {
+  worker_pool = this;
+  worker_index = self;
+  entry e;
+  while (true) {
+    if (take(self, priority(priority_count - 1), e)) {
+      execute(e, self);
+      continue;
+    }
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!pending && running)
+      has_work.wait(lock);
+    if (!running)
+      break;
   }
 }
 }
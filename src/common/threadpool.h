@@ -31,8 +31,12 @@
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <utility>
 #include <vector>
 #include <deque>
@@ -52,6 +56,40 @@ public:
     return new threadpool(max_threads);
   }
 
+  // Tasks of a higher priority class are always picked before queued tasks
+  // of a lower one. Tasks inherit the priority of the thread submitting them.
+  enum priority
+  {
+    priority_high = 0,   // block and block tx verification
+    priority_normal,     // everything else
+    priority_low,        // background maintenance
+    priority_count
+  };
+
+  // Sets the priority of tasks submitted by the current thread
+  // while in scope.
+  class priority_scope {
+    priority prev;
+    public:
+    explicit priority_scope(priority p);
+    ~priority_scope();
+  };
+
+  struct priority_stats {
+    uint64_t queued;
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t stolen;       // run by a worker other than the one it was queued on
+    uint64_t wait_us;      // total time between submit and start
+    uint64_t max_wait_us;
+    uint64_t run_us;       // total run time
+  };
+
+  struct stats {
+    unsigned int threads;
+    priority_stats priorities[priority_count];
+  };
+
   // The waiter lets the caller know when all of its
   // tasks are completed.
   class waiter {
@@ -73,6 +111,8 @@ public:
 
   unsigned int get_max_concurrency() const;
 
+  stats get_stats() const;
+
   ~threadpool();
 
   private:
@@ -81,15 +121,35 @@ public:
       waiter *wo;
       std::function<void()> f;
       bool leaf;
+      priority prio;
+      std::chrono::steady_clock::time_point queued;
     } entry;
-    std::deque<entry> queue;
+    // One per worker, owned end is the back, thieves take from the front.
+    // The last one receives tasks submitted from outside the pool.
+    struct task_queue {
+      boost::mutex mutex;
+      std::deque<entry> tasks[priority_count];
+    };
+    struct counters {
+      std::atomic<uint64_t> queued{0};
+      std::atomic<uint64_t> submitted{0};
+      std::atomic<uint64_t> completed{0};
+      std::atomic<uint64_t> stolen{0};
+      std::atomic<uint64_t> wait_us{0};
+      std::atomic<uint64_t> max_wait_us{0};
+      std::atomic<uint64_t> run_us{0};
+    };
+    std::vector<std::unique_ptr<task_queue>> queues;
+    counters stat[priority_count];
+    std::atomic<size_t> pending;
     boost::condition_variable has_work;
     boost::mutex mutex;
     std::vector<boost::thread> threads;
-    unsigned int active;
     unsigned int max;
     bool running;
-    void run(bool flush = false);
+    bool take(size_t self, priority lowest, entry &e);
+    void execute(entry &e, size_t self);
+    void run(size_t self);
 };
 
 }
@@ -32,10 +32,12 @@
 #pragma once
 #include <unordered_set>
 #include <atomic>
+#include <chrono>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include "net/net_utils_base.h"
 #include "copyable_atomic.h"
 #include "crypto/hash.h"
+#include "cryptonote_basic/blobdatatype.h"
 
 namespace cryptonote
 {
@@ -44,7 +46,9 @@ namespace cryptonote
   {
     cryptonote_connection_context(): m_state(state_before_handshake), m_remote_blockchain_height(0), m_last_response_height(0),
         m_last_request_time(boost::date_time::not_a_date_time), m_callback_request_count(0),
-        m_last_known_hash(crypto::null_hash), m_pruning_seed(0), m_rpc_port(0), m_anchor(false), m_num_requested(0) {}
+        m_last_known_hash(crypto::null_hash), m_pruning_seed(0), m_rpc_port(0), m_anchor(false), m_num_requested(0),
+        m_span_bandwidth(0), m_span_rtt_us(0), m_tx_reconciliation(false),
+        m_fluff_txs(), m_flush_time(std::chrono::steady_clock::time_point::max()), m_fluff_pad(false) {}
 
     enum state
     {
@@ -67,6 +71,12 @@ namespace cryptonote
     uint16_t m_rpc_port;
     bool m_anchor;
     size_t m_num_requested;
+    double m_span_bandwidth; // bytes per second, measured over past spans
+    uint64_t m_span_rtt_us; // lower envelope of span round trip times
+    epee::copyable_atomic m_tx_reconciliation; // txes are announced by set reconciliation, not flooded
+    std::vector<blobdata> m_fluff_txs; // txes waiting to be flooded in a single notification
+    std::chrono::steady_clock::time_point m_flush_time; // when m_fluff_txs is sent, max() if empty
+    bool m_fluff_pad; // pad the next flooded notification
   };
 
   inline std::string get_protocol_state_string(cryptonote_connection_context::state s)
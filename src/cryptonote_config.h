@@ -103,6 +103,8 @@
 #define BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT                          10000
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT                              20
 #define BLOCKS_SYNCHRONIZING_MAX_COUNT                                  2048
+#define BLOCKS_SYNCHRONIZING_MIN_COUNT                                  4
+#define BLOCKS_SYNCHRONIZING_TARGET_SPAN_TIME                           5 // seconds per span request, when adaptive
 
 #define CRYPTONOTE_MEMPOOL_TX_LIVETIME                                  (86400 * 3)
 #define CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME                   604800
@@ -134,7 +136,13 @@
 #define P2P_DEFAULT_LIMIT_RATE_DOWN                                     8192
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                                  0x01
-#define P2P_SUPPORT_FLAGS                                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_COMPACT_BLOCKS                                 0x02
+#define P2P_SUPPORT_FLAG_TX_RECONCILIATION                              0x04
+#define P2P_SUPPORT_FLAGS                                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_COMPACT_BLOCKS | P2P_SUPPORT_FLAG_TX_RECONCILIATION)
+
+#define TX_RECONCILIATION_INTERVAL                                      2 // seconds
+#define TX_RECONCILIATION_TIMEOUT                                       10 // seconds, then the set is flooded
+#define TX_RECONCILIATION_MAX_CELLS                                     30000
 
 #define RPC_IP_FAILS_BEFORE_BLOCK                                       3
 
@@ -169,6 +177,8 @@
 #define CRYPTONOTE_NOISE_BYTES                                          3*1024
 #define CRYPTONOTE_NOISE_CHANNELS                                       2 
 
+#define CRYPTONOTE_DANDELIONPP_FLUSH_AVERAGE                            5 // seconds, average delay before a batch of fluffed txes is sent
+
 #define CRYPTONOTE_MAX_FRAGMENTS                                        20
 
 #define DONATION_ADDR "NV1aMtARDQjK8j7XeoQ66S7XQe5ZS8CX92XqXmJxSZMpSDf2i11NQyqgHzghmRsDHR1LwYv3bEnE3VoqqbmyRdrR2MMBfdXvY"
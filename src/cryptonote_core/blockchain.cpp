@@ -3783,6 +3783,15 @@ bool Blockchain::update_blockchain_pruning()
   return m_db->update_pruning();
 }
 //------------------------------------------------------------------
+void Blockchain::start_db_snapshot(const std::string &path, uint64_t max_bytes_per_second)
+{
+  m_tx_pool.lock();
+  epee::misc_utils::auto_scope_leave_caller unlocker = epee::misc_utils::create_scope_leave_handler([&](){m_tx_pool.unlock();});
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  m_db->start_snapshot(path, max_bytes_per_second);
+}
+//------------------------------------------------------------------
 bool Blockchain::check_blockchain_pruning()
 {
   m_tx_pool.lock();
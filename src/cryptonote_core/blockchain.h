@@ -975,6 +975,7 @@ namespace cryptonote
     bool prune_blockchain(uint32_t pruning_seed = 0);
     bool update_blockchain_pruning();
     bool check_blockchain_pruning();
+    void start_db_snapshot(const std::string &path, uint64_t max_bytes_per_second);
 
     void lock();
     void unlock();
@@ -114,6 +114,16 @@ namespace cryptonote
   , "Set maximum size of block download queue in bytes (0 for default)"
   , 0
   };
+  const command_line::arg_descriptor<bool> arg_tx_reconciliation  = {
+    "tx-reconciliation"
+  , "Announce transactions to incoming peers which support it by periodic set reconciliation rather than flooding them"
+  , false
+  };
+  const command_line::arg_descriptor<size_t> arg_block_download_spill_size  = {
+    "block-download-spill-size"
+  , "Size in bytes of a file in the data directory where downloaded blocks are kept when the block download queue is full (0 to disable)"
+  , 0
+  };
   const command_line::arg_descriptor<bool> arg_sync_pruned_blocks  = {
     "sync-pruned-blocks"
   , "Allow syncing from nodes with only pruned blocks"
@@ -328,6 +338,8 @@ namespace cryptonote
     command_line::add_arg(desc, arg_offline);
     command_line::add_arg(desc, arg_disable_dns_checkpoints);
     command_line::add_arg(desc, arg_block_download_max_size);
+    command_line::add_arg(desc, arg_block_download_spill_size);
+    command_line::add_arg(desc, arg_tx_reconciliation);
     command_line::add_arg(desc, arg_sync_pruned_blocks);
     command_line::add_arg(desc, arg_max_txpool_weight);
     command_line::add_arg(desc, arg_pad_transactions);
@@ -476,6 +488,7 @@ namespace cryptonote
 
     std::string db_sync_mode = command_line::get_arg(vm, cryptonote::arg_db_sync_mode);
     bool db_salvage = command_line::get_arg(vm, cryptonote::arg_db_salvage) != 0;
+    bool db_compress_txs = command_line::get_arg(vm, cryptonote::arg_db_compress_txs);
     bool fast_sync = command_line::get_arg(vm, arg_fast_block_sync) != 0;
     uint32_t db_readers = command_line::get_arg(vm, cryptonote::arg_db_readers);
     uint64_t blocks_threads = command_line::get_arg(vm, arg_prep_blocks_threads);
@@ -611,6 +624,8 @@ namespace cryptonote
 
       if (db_salvage)
         db_flags |= DBF_SALVAGE;
+      if (db_compress_txs)
+        db_flags |= DBF_COMPRESS;
 
       db->open(filename, db_flags, db_readers);
 
@@ -968,6 +983,7 @@ namespace cryptonote
 
     tvc.resize(tx_blobs.size());
     tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::priority_scope priority(keeped_by_block ? tools::threadpool::priority_high : tools::threadpool::priority_normal);
     tools::threadpool::waiter waiter;
     std::vector<tx_blob_entry>::const_iterator it = tx_blobs.begin();
     for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
@@ -1159,9 +1175,6 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   size_t core::get_block_sync_size(uint64_t height) const
   {
-    if (block_sync_size == 0)
-      return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT;
-
     return block_sync_size;
   }
   //-----------------------------------------------------------------------------------------------
@@ -1493,6 +1506,7 @@ namespace cryptonote
   bool core::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks_entry, std::vector<block> &blocks)
   {
     m_incoming_tx_lock.lock();
+    tools::threadpool::priority_scope priority(tools::threadpool::priority_high);
     if (!m_blockchain_storage.prepare_handle_incoming_blocks(blocks_entry, blocks))
     {
       cleanup_handle_incoming_blocks(false);
@@ -1519,6 +1533,7 @@ namespace cryptonote
     TRY_ENTRY();
 
     bvc = {};
+    tools::threadpool::priority_scope priority(tools::threadpool::priority_high);
 
     if (!check_incoming_block_size(block_blob))
     {
@@ -1578,6 +1593,11 @@ namespace cryptonote
     return m_mempool.get_transactions_count();
   }
   //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_pool_cookie() const
+  {
+    return m_mempool.cookie();
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::have_block(const crypto::hash& id) const
   {
     return m_blockchain_storage.have_block(id);
@@ -64,6 +64,8 @@ namespace cryptonote
   extern const command_line::arg_descriptor<uint64_t> arg_fixed_difficulty;
   extern const command_line::arg_descriptor<bool> arg_offline;
   extern const command_line::arg_descriptor<size_t> arg_block_download_max_size;
+  extern const command_line::arg_descriptor<size_t> arg_block_download_spill_size;
+  extern const command_line::arg_descriptor<bool> arg_tx_reconciliation;
   extern const command_line::arg_descriptor<bool> arg_sync_pruned_blocks;
   extern const command_line::arg_descriptor<bool> arg_track_block_recvd_times;
 
@@ -501,6 +503,13 @@ namespace cryptonote
       */
      size_t get_pool_transactions_count() const;
 
+     /**
+      * @copydoc tx_memory_pool::cookie
+      *
+      * @note see tx_memory_pool::cookie
+      */
+     uint64_t get_pool_cookie() const;
+
      /**
       * @copydoc Blockchain::get_total_transactions
       *
@@ -739,7 +748,8 @@ namespace cryptonote
      /**
       * @brief get the number of blocks to sync in one go
       *
-      * @return the number of blocks to sync in one go
+      * @return the number of blocks to sync in one go, or 0 if spans
+      * should be sized from each peer's measured throughput
       */
      size_t get_block_sync_size(uint64_t height) const;
 
@@ -31,9 +31,16 @@
 
 #include <vector>
 #include <unordered_map>
+#include <map>
+#include <fstream>
+#include <string.h>
 #include <boost/uuid/nil_generator.hpp>
 #include <boost/uuid/uuid_io.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include "string_tools.h"
+#include "storages/portable_storage_template_helper.h"
 #include "cryptonote_protocol_defs.h"
 #include "common/pruning.h"
 #include "block_queue.h"
@@ -41,15 +48,171 @@
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "cn.block_queue"
 
+namespace
+{
+  struct spilled_blocks
+  {
+    std::vector<cryptonote::block_complete_entry> blocks;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(blocks)
+    END_KV_SERIALIZE_MAP()
+  };
+}
+
 namespace cryptonote
 {
 
+// Downloaded spans which are not next in line may be moved to a file backed
+// mapping when the queue holds more than memory_threshold bytes. Space is
+// handed out first fit from a list of free ranges, which are merged with
+// their neighbours when a spilled span is released.
+struct block_queue::spill_area
+{
+  std::string filename;
+  boost::interprocess::file_mapping mapping;
+  boost::interprocess::mapped_region region;
+  size_t capacity;
+  size_t memory_threshold;
+  std::map<size_t, size_t> free_ranges; // offset -> size
+
+  bool allocate(size_t size, size_t &offset);
+  void release(size_t offset, size_t size);
+  size_t get_largest_free_range() const;
+};
+
+bool block_queue::spill_area::allocate(size_t size, size_t &offset)
+{
+  for (auto i = free_ranges.begin(); i != free_ranges.end(); ++i)
+  {
+    if (i->second < size)
+      continue;
+    offset = i->first;
+    const size_t left = i->second - size;
+    free_ranges.erase(i);
+    if (left > 0)
+      free_ranges.emplace(offset + size, left);
+    return true;
+  }
+  return false;
+}
+
+void block_queue::spill_area::release(size_t offset, size_t size)
+{
+  auto i = free_ranges.emplace(offset, size).first;
+  auto next = std::next(i);
+  if (next != free_ranges.end() && i->first + i->second == next->first)
+  {
+    i->second += next->second;
+    free_ranges.erase(next);
+  }
+  if (i != free_ranges.begin())
+  {
+    auto prev = std::prev(i);
+    if (prev->first + prev->second == i->first)
+    {
+      prev->second += i->second;
+      free_ranges.erase(i);
+    }
+  }
+}
+
+size_t block_queue::spill_area::get_largest_free_range() const
+{
+  size_t largest = 0;
+  for (const auto &r: free_ranges)
+    largest = std::max(largest, r.second);
+  return largest;
+}
+
+block_queue::block_queue()
+{
+}
+
+block_queue::~block_queue()
+{
+  if (spill)
+  {
+    const std::string filename = spill->filename;
+    spill.reset();
+    boost::system::error_code ec;
+    boost::filesystem::remove(filename, ec);
+  }
+}
+
+bool block_queue::enable_spill(const std::string &filename, size_t capacity, size_t memory_threshold)
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  CHECK_AND_ASSERT_MES(!spill, false, "Spill area already enabled");
+  CHECK_AND_ASSERT_MES(capacity > 0, false, "Invalid spill area size");
+  try
+  {
+    std::ofstream(filename, std::ios::binary | std::ios::trunc);
+    boost::filesystem::resize_file(filename, capacity);
+    std::unique_ptr<spill_area> area(new spill_area());
+    area->filename = filename;
+    area->mapping = boost::interprocess::file_mapping(filename.c_str(), boost::interprocess::read_write);
+    area->region = boost::interprocess::mapped_region(area->mapping, boost::interprocess::read_write, 0, capacity);
+    area->capacity = capacity;
+    area->memory_threshold = memory_threshold;
+    area->free_ranges.emplace(0, capacity);
+    spill = std::move(area);
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to create block queue spill area " << filename << ": " << e.what());
+    boost::system::error_code ec;
+    boost::filesystem::remove(filename, ec);
+    return false;
+  }
+  MINFO("Block queue spill area: " << filename << ", " << capacity << " bytes");
+  return true;
+}
+
+size_t block_queue::get_spill_room() const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  return spill ? spill->get_largest_free_range() : 0;
+}
+
+size_t block_queue::get_memory_size() const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  size_t size = 0;
+  for (const auto &span: blocks)
+    if (span.spill_size == 0)
+      size += span.size;
+  return size;
+}
+
+bool block_queue::spill_span(span &s)
+{
+  spilled_blocks sb;
+  sb.blocks = std::move(s.blocks);
+  std::string blob;
+  size_t offset;
+  if (!epee::serialization::store_t_to_binary(sb, blob) || blob.empty() || !spill->allocate(blob.size(), offset))
+  {
+    s.blocks = std::move(sb.blocks);
+    return false;
+  }
+  memcpy((uint8_t*)spill->region.get_address() + offset, blob.data(), blob.size());
+  s.spill_offset = offset;
+  s.spill_size = blob.size();
+  MDEBUG("Spilled span " << s.start_block_height << " (" << s.nblocks << " blocks, " << blob.size() << " bytes) at offset " << s.spill_offset);
+  return true;
+}
+
 void block_queue::add_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, float rate, size_t size)
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
   std::vector<crypto::hash> hashes;
   bool has_hashes = remove_span(height, &hashes);
-  blocks.insert(span(height, std::move(bcel), connection_id, rate, size));
+  span s(height, std::move(bcel), connection_id, rate, size);
+  // the next span is about to be used, keep it in memory
+  if (spill && !blocks.empty() && height > blocks.begin()->start_block_height && get_memory_size() + size > spill->memory_threshold)
+    spill_span(s);
+  blocks.insert(std::move(s));
   if (has_hashes)
   {
     for (const crypto::hash &h: hashes)
@@ -75,14 +238,14 @@ void block_queue::flush_spans(const boost::uuids::uuid &connection_id, bool all)
   while (i != blocks.end())
   {
     block_map::iterator j = i++;
-    if (j->connection_id == connection_id && (all || j->blocks.size() == 0))
+    if (j->connection_id == connection_id && (all || !j->filled()))
     {
       erase_block(j);
     }
   }
 }
 
-void block_queue::erase_block(block_map::iterator j)
+void block_queue::erase_block(block_map::iterator j, bool release_spill)
 {
   CHECK_AND_ASSERT_THROW_MES(j != blocks.end(), "Invalid iterator");
   for (const crypto::hash &h: j->hashes)
@@ -90,6 +253,8 @@ void block_queue::erase_block(block_map::iterator j)
     requested_hashes.erase(h);
     have_blocks.erase(h);
   }
+  if (release_spill && j->spill_size > 0 && spill)
+    spill->release(j->spill_offset, j->spill_size);
   blocks.erase(j);
 }
 
@@ -100,7 +265,7 @@ void block_queue::flush_stale_spans(const std::set<boost::uuids::uuid> &live_con
   while (i != blocks.end())
   {
     block_map::iterator j = i++;
-    if (j->blocks.empty() && live_connections.find(j->connection_id) == live_connections.end())
+    if (!j->filled() && live_connections.find(j->connection_id) == live_connections.end())
     {
       erase_block(j);
     }
@@ -160,7 +325,7 @@ uint64_t block_queue::get_next_needed_height(uint64_t blockchain_height) const
   {
     if (span.start_block_height + span.nblocks - 1 < blockchain_height)
       continue;
-    if (span.start_block_height != last_needed_height || (first && span.blocks.empty()))
+    if (span.start_block_height != last_needed_height || (first && !span.filled()))
       return last_needed_height;
     last_needed_height = span.start_block_height + span.nblocks;
     first = false;
@@ -173,7 +338,7 @@ void block_queue::print() const
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
   MDEBUG("Block queue has " << blocks.size() << " spans");
   for (const auto &span: blocks)
-    MDEBUG("  " << span.start_block_height << " - " << (span.start_block_height+span.nblocks-1) << " (" << span.nblocks << ") - " << (span.blocks.empty() ? "scheduled" : "filled    ") << "  " << span.connection_id << " (" << ((unsigned)(span.rate*10/1024.f))/10.f << " kB/s)");
+    MDEBUG("  " << span.start_block_height << " - " << (span.start_block_height+span.nblocks-1) << " (" << span.nblocks << ") - " << (!span.filled() ? "scheduled" : "filled    ") << "  " << span.connection_id << " (" << ((unsigned)(span.rate*10/1024.f))/10.f << " kB/s)");
 }
 
 std::string block_queue::get_overview(uint64_t blockchain_height) const
@@ -194,7 +359,7 @@ std::string block_queue::get_overview(uint64_t blockchain_height) const
     {
       if (expected < i->start_block_height)
         s += std::string(std::max((uint64_t)1, (i->start_block_height - expected) / (i->nblocks ? i->nblocks : 1)), '_');
-      s += i->blocks.empty() ? "." : i->start_block_height == blockchain_height ? "m" : "o";
+      s += !i->filled() ? "." : i->start_block_height == blockchain_height ? "m" : "o";
       expected = i->start_block_height + i->nblocks;
     }
     ++i;
@@ -310,7 +475,7 @@ std::pair<uint64_t, uint64_t> block_queue::get_next_span_if_scheduled(std::vecto
   block_map::const_iterator i = blocks.begin();
   if (i == blocks.end())
     return std::make_pair(0, 0);
-  if (!i->blocks.empty())
+  if (i->filled())
     return std::make_pair(0, 0);
   hashes = i->hashes;
   connection_id = i->connection_id;
@@ -324,7 +489,7 @@ void block_queue::reset_next_span_time(boost::posix_time::ptime t)
   CHECK_AND_ASSERT_THROW_MES(!blocks.empty(), "No next span to reset time");
   block_map::iterator i = blocks.begin();
   CHECK_AND_ASSERT_THROW_MES(i != blocks.end(), "No next span to reset time");
-  CHECK_AND_ASSERT_THROW_MES(i->blocks.empty(), "Next span is not empty");
+  CHECK_AND_ASSERT_THROW_MES(!i->filled(), "Next span is not empty");
   (boost::posix_time::ptime&)i->time = t; // sod off, time doesn't influence sorting
 }
 
@@ -336,7 +501,7 @@ void block_queue::set_span_hashes(uint64_t start_height, const boost::uuids::uui
     if (i->start_block_height == start_height && i->connection_id == connection_id)
     {
       span s = *i;
-      erase_block(i);
+      erase_block(i, false);
       s.hashes = std::move(hashes);
       for (const crypto::hash &h: s.hashes)
         requested_hashes.insert(h);
@@ -354,10 +519,18 @@ bool block_queue::get_next_span(uint64_t &height, std::vector<cryptonote::block_
   block_map::const_iterator i = blocks.begin();
   for (; i != blocks.end(); ++i)
   {
-    if (!filled || !i->blocks.empty())
+    if (!filled || i->filled())
     {
       height = i->start_block_height;
-      bcel = i->blocks;
+      if (i->spill_size > 0)
+      {
+        spilled_blocks sb;
+        const epee::span<const uint8_t> blob((const uint8_t*)spill->region.get_address() + i->spill_offset, i->spill_size);
+        CHECK_AND_ASSERT_MES(epee::serialization::load_t_from_binary(sb, blob), false, "Failed to read spilled span " << i->start_block_height);
+        bcel = std::move(sb.blocks);
+      }
+      else
+        bcel = i->blocks;
       connection_id = i->connection_id;
       return true;
     }
@@ -375,7 +548,7 @@ bool block_queue::has_next_span(const boost::uuids::uuid &connection_id, bool &f
     return false;
   if (i->connection_id != connection_id)
     return false;
-  filled = !i->blocks.empty();
+  filled = i->filled();
   time = i->time;
   return true;
 }
@@ -390,7 +563,7 @@ bool block_queue::has_next_span(uint64_t height, bool &filled, boost::posix_time
     return false;
   if (i->start_block_height > height)
     return false;
-  filled = !i->blocks.empty();
+  filled = i->filled();
   time = i->time;
   connection_id = i->connection_id;
   return true;
@@ -413,7 +586,7 @@ size_t block_queue::get_num_filled_spans_prefix() const
     return 0;
   block_map::const_iterator i = blocks.begin();
   size_t size = 0;
-  while (i != blocks.end() && !i->blocks.empty())
+  while (i != blocks.end() && i->filled())
   {
     ++i;
     ++size;
@@ -426,7 +599,7 @@ size_t block_queue::get_num_filled_spans() const
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
   size_t size = 0;
   for (const auto &span: blocks)
-  if (!span.blocks.empty())
+  if (span.filled())
     ++size;
   return size;
 }
@@ -466,7 +639,7 @@ float block_queue::get_speed(const boost::uuids::uuid &connection_id) const
   std::unordered_map<boost::uuids::uuid, float, boost::hash<boost::uuids::uuid>> speeds;
   for (const auto &span: blocks)
   {
-    if (span.blocks.empty())
+    if (!span.filled())
       continue;
     // note that the average below does not average over the whole set, but over the
     // previous pseudo average and the latest rate: this gives much more importance
@@ -502,7 +675,7 @@ float block_queue::get_download_rate(const boost::uuids::uuid &connection_id) co
   float conn_rate = -1.f;
   for (const auto &span: blocks)
   {
-    if (span.blocks.empty())
+    if (!span.filled())
       continue;
     if (span.connection_id != connection_id)
       continue;
@@ -31,6 +31,7 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <set>
@@ -58,17 +59,25 @@ namespace cryptonote
       float rate;
       size_t size;
       boost::posix_time::ptime time;
+      size_t spill_offset; // where the blocks are in the spill area, if spill_size is not 0
+      size_t spill_size;
 
       span(uint64_t start_block_height, std::vector<cryptonote::block_complete_entry> blocks, const boost::uuids::uuid &connection_id, float rate, size_t size):
-        start_block_height(start_block_height), blocks(std::move(blocks)), connection_id(connection_id), nblocks(this->blocks.size()), rate(rate), size(size), time() {}
+        start_block_height(start_block_height), blocks(std::move(blocks)), connection_id(connection_id), nblocks(this->blocks.size()), rate(rate), size(size), time(), spill_offset(0), spill_size(0) {}
       span(uint64_t start_block_height, uint64_t nblocks, const boost::uuids::uuid &connection_id, boost::posix_time::ptime time):
-        start_block_height(start_block_height), connection_id(connection_id), nblocks(nblocks), rate(0.0f), size(0), time(time) {}
+        start_block_height(start_block_height), connection_id(connection_id), nblocks(nblocks), rate(0.0f), size(0), time(time), spill_offset(0), spill_size(0) {}
 
       bool operator<(const span &s) const { return start_block_height < s.start_block_height; }
+      bool filled() const { return !blocks.empty() || spill_size > 0; }
     };
     typedef std::set<span> block_map;
 
   public:
+    block_queue();
+    ~block_queue();
+
+    bool enable_spill(const std::string &filename, size_t capacity, size_t memory_threshold);
+    size_t get_spill_room() const;
     void add_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, float rate, size_t size);
     void add_blocks(uint64_t height, uint64_t nblocks, const boost::uuids::uuid &connection_id, boost::posix_time::ptime time = boost::date_time::min_date_time);
     void flush_spans(const boost::uuids::uuid &connection_id, bool all = false);
@@ -88,6 +97,7 @@ namespace cryptonote
     bool has_next_span(const boost::uuids::uuid &connection_id, bool &filled, boost::posix_time::ptime &time) const;
     bool has_next_span(uint64_t height, bool &filled, boost::posix_time::ptime &time, boost::uuids::uuid &connection_id) const;
     size_t get_data_size() const;
+    size_t get_memory_size() const;
     size_t get_num_filled_spans_prefix() const;
     size_t get_num_filled_spans() const;
     crypto::hash get_last_known_hash(const boost::uuids::uuid &connection_id) const;
@@ -99,10 +109,14 @@ namespace cryptonote
     bool have(const crypto::hash &hash) const;
 
   private:
-    void erase_block(block_map::iterator j);
+    struct spill_area;
+
+    void erase_block(block_map::iterator j, bool release_spill = true);
     inline bool requested_internal(const crypto::hash &hash) const;
+    bool spill_span(span &s);
 
   private:
+    std::unique_ptr<spill_area> spill;
     block_map blocks;
     mutable boost::recursive_mutex mutex;
     std::unordered_set<crypto::hash> requested_hashes;
@@ -35,6 +35,7 @@
 #include "serialization/keyvalue_serialization.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "cryptonote_basic/blobdatatype.h"
+#include "int-util.h"
 
 namespace cryptonote
 {
@@ -346,5 +347,141 @@ namespace cryptonote
     };
     typedef epee::misc_utils::struct_init<request_t> request;
   }; 
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  // A block whose tx hashes are replaced by short ids, salted per relay so
+  // that collisions can not be precomputed. Txes the sender expects its
+  // peers to miss are sent whole. When the receiver can not rebuild the
+  // block from its pool, it asks for the missing txes by index with
+  // NOTIFY_REQUEST_FLUFFY_MISSING_TX, and gets a NOTIFY_NEW_FLUFFY_BLOCK.
+  struct NOTIFY_NEW_COMPACT_BLOCK
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 10;
+    const static size_t SHORT_ID_SIZE = 6;
+
+    struct request_t
+    {
+      blobdata block; // without its tx hashes
+      crypto::hash block_hash;
+      uint64_t nonce;
+      std::string short_ids; // SHORT_ID_SIZE bytes per tx not prefilled, in block order
+      std::vector<uint64_t> prefilled_tx_indices;
+      std::vector<blobdata> prefilled_txs;
+      uint64_t current_blockchain_height;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block)
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_hash)
+        KV_SERIALIZE(nonce)
+        KV_SERIALIZE(short_ids)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(prefilled_tx_indices)
+        KV_SERIALIZE(prefilled_txs)
+        KV_SERIALIZE(current_blockchain_height)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    static crypto::hash short_id_key(const crypto::hash &block_hash, uint64_t nonce)
+    {
+      char data[sizeof(crypto::hash) + sizeof(uint64_t)];
+      memcpy(data, &block_hash, sizeof(crypto::hash));
+      nonce = SWAP64LE(nonce);
+      memcpy(data + sizeof(crypto::hash), &nonce, sizeof(uint64_t));
+      return crypto::cn_fast_hash(data, sizeof(data));
+    }
+
+    static uint64_t short_id(const crypto::hash &key, const crypto::hash &txid)
+    {
+      crypto::hash data[2] = {key, txid};
+      const crypto::hash h = crypto::cn_fast_hash(data, sizeof(data));
+      uint64_t id = 0;
+      for (size_t i = 0; i < SHORT_ID_SIZE; ++i)
+        id |= ((uint64_t)(uint8_t)h.data[i]) << (8 * i);
+      return id;
+    }
+
+    static void append_short_id(std::string &short_ids, uint64_t id)
+    {
+      for (size_t i = 0; i < SHORT_ID_SIZE; ++i)
+        short_ids.push_back((char)((id >> (8 * i)) & 0xff));
+    }
+
+    static uint64_t read_short_id(const std::string &short_ids, size_t index)
+    {
+      uint64_t id = 0;
+      for (size_t i = 0; i < SHORT_ID_SIZE; ++i)
+        id |= ((uint64_t)(uint8_t)short_ids[index * SHORT_ID_SIZE + i]) << (8 * i);
+      return id;
+    }
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  // Instead of flooding txes to a peer supporting P2P_SUPPORT_FLAG_TX_RECONCILIATION,
+  // a node may collect their ids and periodically send a tx_sketch of them, keyed
+  // by a random nonce. The peer subtracts a sketch of the txes it held back for
+  // this node, answers with the ids it does not have in its pool, and sends the
+  // txes only it had. If the sketch could not be decoded, both sides flood their
+  // set instead.
+  struct NOTIFY_TX_RECONCILIATION_SKETCH
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request_t
+    {
+      uint64_t nonce;
+      std::string sketch;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(nonce)
+        KV_SERIALIZE(sketch)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    static crypto::hash short_id_key(uint64_t nonce)
+    {
+      nonce = SWAP64LE(nonce);
+      return crypto::cn_fast_hash(&nonce, sizeof(nonce));
+    }
+
+    static uint64_t short_id(const crypto::hash &key, const crypto::hash &txid)
+    {
+      crypto::hash data[2] = {key, txid};
+      const crypto::hash h = crypto::cn_fast_hash(data, sizeof(data));
+      uint64_t id;
+      memcpy(&id, h.data, sizeof(id));
+      return SWAP64LE(id);
+    }
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_TX_RECONCILIATION_RESPONSE
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 12;
+
+    struct request_t
+    {
+      uint64_t nonce;
+      bool failed;
+      std::vector<uint64_t> missing; // short ids of the txes to send
+      uint64_t held; // txes the responder held back and subtracted
+      uint64_t difference; // ids decoded from the sketch
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(nonce)
+        KV_SERIALIZE(failed)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(missing)
+        KV_SERIALIZE(held)
+        KV_SERIALIZE(difference)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
     
 }
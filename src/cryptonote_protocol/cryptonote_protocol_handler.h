@@ -36,7 +36,9 @@
 #pragma once
 
 #include <boost/program_options/variables_map.hpp>
+#include <map>
 #include <string>
+#include <unordered_set>
 
 #include "math_helper.h"
 #include "storages/levin_abstract_invoke2.h"
@@ -93,6 +95,9 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)			
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)						
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &cryptonote_protocol_handler::handle_notify_new_compact_block)
+      HANDLE_NOTIFY_T2(NOTIFY_TX_RECONCILIATION_SKETCH, &cryptonote_protocol_handler::handle_notify_tx_reconciliation_sketch)
+      HANDLE_NOTIFY_T2(NOTIFY_TX_RECONCILIATION_RESPONSE, &cryptonote_protocol_handler::handle_notify_tx_reconciliation_response)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -128,6 +133,9 @@ namespace cryptonote
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context);
+    int handle_notify_tx_reconciliation_sketch(int command, NOTIFY_TX_RECONCILIATION_SKETCH::request& arg, cryptonote_connection_context& context);
+    int handle_notify_tx_reconciliation_response(int command, NOTIFY_TX_RECONCILIATION_RESPONSE::request& arg, cryptonote_connection_context& context);
 		
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
@@ -148,6 +156,9 @@ namespace cryptonote
     int try_add_next_blocks(cryptonote_connection_context &context);
     void notify_new_stripe(cryptonote_connection_context &context, uint32_t stripe);
     size_t skip_unneeded_hashes(cryptonote_connection_context& context, bool check_block_queue) const;
+    bool make_compact_block(const NOTIFY_NEW_BLOCK::request& arg, NOTIFY_NEW_COMPACT_BLOCK::request& compact);
+    bool reconcile_txs();
+    void send_pool_txs(const std::vector<crypto::hash>& txids, const boost::uuids::uuid& connection_id);
 
     t_core& m_core;
 
@@ -175,8 +186,31 @@ namespace cryptonote
     std::ofstream m_track_block_recvd_times_fstream;
     boost::mutex m_track_block_recvd_times_mutex;
 
+    // txes of the last relayed block that were not in our pool, prefilled in compact blocks
+    boost::mutex m_compact_prefill_mutex;
+    crypto::hash m_compact_prefill_block;
+    std::unordered_set<crypto::hash> m_compact_prefill_txes;
+
+    // txes held back from peers we reconcile with, rather than flood. Both sides
+    // of the connection hold txes, the side the peer connected to sends sketches
+    struct tx_reconciliation_set
+    {
+      bool initiator = false; // we send the sketches
+      std::vector<crypto::hash> pending;
+      std::vector<crypto::hash> in_flight; // sent in the sketch with this nonce
+      uint64_t nonce = 0;
+      time_t sent_time = 0; // last sketch sent, or received if not initiator
+      size_t remote_held = 0; // txes the peer held back for us in the last round
+      double q = 0.25; // part of the smaller set found to differ in past rounds
+    };
+    std::atomic<bool> m_tx_reconciliation;
+    epee::math_helper::once_a_time_seconds<TX_RECONCILIATION_INTERVAL> m_tx_reconciliation_interval;
+    boost::mutex m_tx_reconciliation_mutex;
+    std::map<boost::uuids::uuid, tx_reconciliation_set> m_tx_reconciliation_sets;
+
     boost::mutex m_buffer_mutex;
     double get_avg_block_size();
+    size_t get_span_size(const cryptonote_connection_context &context);
     boost::circular_buffer<size_t> m_avg_buffer = boost::circular_buffer<size_t>(10);
 
     template<class t_parameter>
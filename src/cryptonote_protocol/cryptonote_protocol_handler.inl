@@ -40,6 +40,7 @@
 #include "profile_tools.h"
 #include "net/network_throttle-detail.hpp"
 #include "common/pruning.h"
+#include "tx_sketch.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.cn"
@@ -82,7 +83,9 @@ namespace cryptonote
                                                                                                               m_syncronized_connections_count(0),
                                                                                                               m_synchronized(offline),
                                                                                                               m_stopping(false),
-                                                                                                              m_no_sync(false)
+                                                                                                              m_no_sync(false),
+                                                                                                              m_tx_reconciliation(false),
+                                                                                                              m_compact_prefill_block(crypto::null_hash)
 
   {
     if(!m_p2p)
@@ -104,7 +107,16 @@ namespace cryptonote
     m_sync_download_objects_size = 0;
 
     m_block_download_max_size = command_line::get_arg(vm, cryptonote::arg_block_download_max_size);
+    const size_t spill_size = command_line::get_arg(vm, cryptonote::arg_block_download_spill_size);
+    if (spill_size > 0)
+    {
+      const std::string filename = command_line::get_arg(vm, cryptonote::arg_data_dir) + "/block_queue.spill";
+      const size_t memory_threshold = m_block_download_max_size ? m_block_download_max_size : BLOCK_QUEUE_SIZE_THRESHOLD;
+      if (!m_block_queue.enable_spill(filename, spill_size, memory_threshold))
+        MERROR("Failed to enable block download spill file, downloaded blocks will be kept in memory");
+    }
     m_sync_pruned_blocks = command_line::get_arg(vm, cryptonote::arg_sync_pruned_blocks);
+    m_tx_reconciliation = command_line::get_arg(vm, cryptonote::arg_tx_reconciliation);
     m_track_block_recvd_times = command_line::get_arg(vm, cryptonote::arg_track_block_recvd_times);
 
     if (m_track_block_recvd_times)
@@ -585,6 +597,7 @@ namespace cryptonote
         
       transaction tx;
       crypto::hash tx_hash;
+      std::vector<crypto::hash> not_in_pool;
 
       for(auto& tx_blob: arg.b.txs)
       {
@@ -651,6 +664,7 @@ namespace cryptonote
           if(!m_core.pool_has_tx(tx_hash))
           {
             MDEBUG("Incoming tx " << tx_hash << " not in pool, adding");
+            not_in_pool.push_back(tx_hash);
             cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);                        
             if(!m_core.handle_incoming_tx(tx_blob, tvc, true, true, false) || tvc.m_verifivation_failed)
             {
@@ -790,6 +804,15 @@ namespace cryptonote
         }
         if( bvc.m_added_to_main_chain )
         {
+          // our peers are likely to miss the same txes we did
+          if (!not_in_pool.empty())
+          {
+            boost::unique_lock<boost::mutex> lock(m_compact_prefill_mutex);
+            m_compact_prefill_block = get_block_hash(new_block);
+            m_compact_prefill_txes.clear();
+            m_compact_prefill_txes.insert(not_in_pool.begin(), not_in_pool.end());
+          }
+
           //TODO: Add here announce protocol usage
           NOTIFY_NEW_BLOCK::request reg_arg = AUTO_VAL_INIT(reg_arg);
           reg_arg.current_blockchain_height = arg.current_blockchain_height;
@@ -831,6 +854,125 @@ namespace cryptonote
         
     return 1;
   }  
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
+    const size_t n_short_ids = arg.short_ids.size() / NOTIFY_NEW_COMPACT_BLOCK::SHORT_ID_SIZE;
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_COMPACT_BLOCK " << arg.block_hash << " (height " << arg.current_blockchain_height << ", " << n_short_ids << " short ids, " << arg.prefilled_txs.size() << " prefilled txes)");
+
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    if(!is_synchronized() || m_no_sync) // can happen if a peer connection goes to normal but another thread still hasn't finished adding queued blocks
+    {
+      LOG_DEBUG_CC(context, "Received new block while syncing, ignored");
+      return 1;
+    }
+    if(m_core.have_block(arg.block_hash))
+      return 1;
+
+    block b;
+    const size_t n_txes = n_short_ids + arg.prefilled_txs.size();
+    if(!parse_and_validate_block_from_blob(arg.block, b) || !b.tx_hashes.empty()
+        || arg.short_ids.size() % NOTIFY_NEW_COMPACT_BLOCK::SHORT_ID_SIZE
+        || arg.prefilled_tx_indices.size() != arg.prefilled_txs.size()
+        || n_txes > CRYPTONOTE_MAX_TX_PER_BLOCK)
+    {
+      LOG_ERROR_CCONTEXT("sent invalid compact block " << arg.block_hash << ", dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    b.tx_hashes.resize(n_txes, crypto::null_hash);
+    std::vector<bool> prefilled(n_txes, false);
+    for(size_t i = 0; i < arg.prefilled_txs.size(); ++i)
+    {
+      const uint64_t tx_idx = arg.prefilled_tx_indices[i];
+      transaction tx;
+      if(tx_idx >= n_txes || (i > 0 && tx_idx <= arg.prefilled_tx_indices[i - 1]) || !parse_and_validate_tx_from_blob(arg.prefilled_txs[i], tx, b.tx_hashes[tx_idx]))
+      {
+        LOG_ERROR_CCONTEXT("sent compact block " << arg.block_hash << " with an invalid prefilled tx at index " << tx_idx << ", dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+      prefilled[tx_idx] = true;
+    }
+
+    // match short ids against the pool, ids shared by several pool txes can not be resolved
+    const crypto::hash key = NOTIFY_NEW_COMPACT_BLOCK::short_id_key(arg.block_hash, arg.nonce);
+    std::vector<crypto::hash> pool_tx_hashes;
+    m_core.get_pool_transaction_hashes(pool_tx_hashes, true);
+    std::unordered_map<uint64_t, crypto::hash> pool_short_ids;
+    std::unordered_set<uint64_t> collisions;
+    pool_short_ids.reserve(pool_tx_hashes.size());
+    for(const crypto::hash &tx_hash: pool_tx_hashes)
+    {
+      const uint64_t id = NOTIFY_NEW_COMPACT_BLOCK::short_id(key, tx_hash);
+      if(!pool_short_ids.emplace(id, tx_hash).second)
+        collisions.insert(id);
+    }
+
+    std::vector<uint64_t> need_tx_indices;
+    for(size_t tx_idx = 0, short_idx = 0; tx_idx < n_txes; ++tx_idx)
+    {
+      if(prefilled[tx_idx])
+        continue;
+      const uint64_t id = NOTIFY_NEW_COMPACT_BLOCK::read_short_id(arg.short_ids, short_idx++);
+      const auto it = pool_short_ids.find(id);
+      if(it == pool_short_ids.end() || collisions.count(id))
+        need_tx_indices.push_back(tx_idx);
+      else
+        b.tx_hashes[tx_idx] = it->second;
+    }
+
+    if(need_tx_indices.empty() && get_block_hash(b) != arg.block_hash)
+    {
+      // a short id matched the wrong pool tx, we can't tell which
+      MDEBUG("Compact block " << arg.block_hash << " did not rebuild to the right hash, requesting all its txes");
+      for(size_t tx_idx = 0; tx_idx < n_txes; ++tx_idx)
+        if(!prefilled[tx_idx])
+          need_tx_indices.push_back(tx_idx);
+    }
+
+    if(!need_tx_indices.empty())
+    {
+      // fall back to the fluffy path, the answer carries the full block and
+      // only the missing txes, so the prefilled ones have to be in the pool
+      MDEBUG("We are missing " << need_tx_indices.size() << " txes for compact block " << arg.block_hash);
+      for(size_t i = 0; i < arg.prefilled_txs.size(); ++i)
+      {
+        const crypto::hash &tx_hash = b.tx_hashes[arg.prefilled_tx_indices[i]];
+        if(m_core.pool_has_tx(tx_hash))
+          continue;
+        cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+        if(!m_core.handle_incoming_tx(arg.prefilled_txs[i], tvc, true, true, false) || tvc.m_verifivation_failed)
+        {
+          LOG_PRINT_CCONTEXT_L1("Compact block " << arg.block_hash << " has a prefilled tx that failed verification, dropping connection");
+          drop_connection(context, false, false);
+          return 1;
+        }
+      }
+      // the answer is matched against the requested objects when there are any,
+      // and it carries txes we could not name, so none may be left over
+      context.m_requested_objects.clear();
+      NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing_tx_req;
+      missing_tx_req.block_hash = arg.block_hash;
+      missing_tx_req.current_blockchain_height = arg.current_blockchain_height;
+      missing_tx_req.missing_tx_indices = std::move(need_tx_indices);
+      MLOG_P2P_MESSAGE("-->>NOTIFY_REQUEST_FLUFFY_MISSING_TX: missing_tx_indices.size()=" << missing_tx_req.missing_tx_indices.size() );
+      post_notify<NOTIFY_REQUEST_FLUFFY_MISSING_TX>(missing_tx_req, context);
+      return 1;
+    }
+
+    MDEBUG("Rebuilt compact block " << arg.block_hash << " from the pool");
+    NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
+    fluffy_arg.current_blockchain_height = arg.current_blockchain_height;
+    fluffy_arg.b.block = t_serializable_object_to_blob(b);
+    fluffy_arg.b.txs.reserve(arg.prefilled_txs.size());
+    for(auto &tx_blob: arg.prefilled_txs)
+      fluffy_arg.b.txs.push_back({std::move(tx_blob), crypto::null_hash});
+    return handle_notify_new_fluffy_block(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffy_arg, context);
+  }
   //------------------------------------------------------------------------------------------------------------------------  
   template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context)
@@ -924,6 +1066,131 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_tx_reconciliation_sketch(int command, NOTIFY_TX_RECONCILIATION_SKETCH::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_TX_RECONCILIATION_SKETCH (" << arg.sketch.size() << " bytes)");
+    if(context.m_state != cryptonote_connection_context::state_normal || context.m_remote_address.get_zone() != epee::net_utils::zone::public_)
+      return 1;
+
+    tx_sketch remote;
+    if (!remote.load(arg.sketch, TX_RECONCILIATION_MAX_CELLS))
+    {
+      LOG_ERROR_CCONTEXT("sent invalid tx reconciliation sketch, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // from now on, hold back txes for this peer too rather than flood them,
+    // they take part in the next round
+    std::vector<crypto::hash> held;
+    if (m_tx_reconciliation && !context.m_is_income)
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_reconciliation_mutex);
+      tx_reconciliation_set &set = m_tx_reconciliation_sets[context.m_connection_id];
+      context.m_tx_reconciliation = true;
+      held.swap(set.pending);
+      set.sent_time = time(NULL);
+    }
+
+    const crypto::hash key = NOTIFY_TX_RECONCILIATION_SKETCH::short_id_key(arg.nonce);
+    std::unordered_map<uint64_t, crypto::hash> held_ids;
+    tx_sketch local(remote.cells());
+    for (const crypto::hash &txid: held)
+    {
+      const uint64_t id = NOTIFY_TX_RECONCILIATION_SKETCH::short_id(key, txid);
+      if (held_ids.emplace(id, txid).second)
+        local.add(id);
+    }
+
+    NOTIFY_TX_RECONCILIATION_RESPONSE::request rsp;
+    rsp.nonce = arg.nonce;
+    rsp.held = held.size();
+    rsp.difference = 0;
+    std::vector<uint64_t> only_remote, only_local;
+    if (!remote.decode(local, only_remote, only_local))
+    {
+      MDEBUG(context << " failed to decode tx reconciliation sketch of " << remote.cells() << " cells");
+      rsp.failed = true;
+      post_notify<NOTIFY_TX_RECONCILIATION_RESPONSE>(rsp, context);
+      send_pool_txs(held, context.m_connection_id);
+      return 1;
+    }
+    rsp.failed = false;
+    rsp.difference = only_remote.size() + only_local.size();
+
+    // we ignore txes while syncing, see handle_notify_new_transactions
+    if (!only_remote.empty() && is_synchronized() && !m_no_sync)
+    {
+      std::vector<crypto::hash> pool;
+      m_core.get_pool_transaction_hashes(pool, true);
+      std::unordered_set<uint64_t> known;
+      known.reserve(pool.size());
+      for (const crypto::hash &txid: pool)
+        known.insert(NOTIFY_TX_RECONCILIATION_SKETCH::short_id(key, txid));
+      for (const uint64_t id: only_remote)
+        if (known.find(id) == known.end())
+          rsp.missing.push_back(id);
+    }
+    MDEBUG(context << " tx reconciliation: " << only_remote.size() << " txes offered, " << rsp.missing.size() << " requested, " << only_local.size() << " to send");
+    post_notify<NOTIFY_TX_RECONCILIATION_RESPONSE>(rsp, context);
+
+    std::vector<crypto::hash> txids;
+    for (const uint64_t id: only_local)
+      txids.push_back(held_ids[id]);
+    send_pool_txs(txids, context.m_connection_id);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_tx_reconciliation_response(int command, NOTIFY_TX_RECONCILIATION_RESPONSE::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_TX_RECONCILIATION_RESPONSE (" << arg.missing.size() << " txes requested)");
+
+    std::vector<crypto::hash> in_flight;
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_reconciliation_mutex);
+      const auto i = m_tx_reconciliation_sets.find(context.m_connection_id);
+      if (i == m_tx_reconciliation_sets.end() || !i->second.initiator || i->second.nonce != arg.nonce)
+      {
+        LOG_DEBUG_CC(context, "Unexpected tx reconciliation response, ignored");
+        return 1;
+      }
+      tx_reconciliation_set &set = i->second;
+      in_flight.swap(set.in_flight);
+      set.nonce = 0;
+
+      // learn how far apart the sets tend to be, to size the next sketch
+      set.remote_held = arg.held;
+      const size_t smaller = std::min<size_t>(in_flight.size(), arg.held);
+      const size_t apart = in_flight.size() > arg.held ? in_flight.size() - arg.held : arg.held - in_flight.size();
+      if (arg.failed)
+        set.q = 1.0;
+      else if (smaller > 0)
+        set.q = (set.q + std::max(0.0, std::min(1.0, (arg.difference - std::min<double>(arg.difference, apart)) / (double)smaller))) / 2;
+    }
+
+    if (arg.failed)
+    {
+      send_pool_txs(in_flight, context.m_connection_id);
+      return 1;
+    }
+
+    const crypto::hash key = NOTIFY_TX_RECONCILIATION_SKETCH::short_id_key(arg.nonce);
+    std::unordered_map<uint64_t, crypto::hash> ids;
+    for (const crypto::hash &txid: in_flight)
+      ids.emplace(NOTIFY_TX_RECONCILIATION_SKETCH::short_id(key, txid), txid);
+    std::vector<crypto::hash> txids;
+    for (const uint64_t id: arg.missing)
+    {
+      const auto i = ids.find(id);
+      if (i != ids.end())
+        txids.push_back(i->second);
+    }
+    send_pool_txs(txids, context.m_connection_id);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
   {
     MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTIONS (" << arg.txs.size() << " txes)");
@@ -1014,6 +1281,24 @@ namespace cryptonote
     return avg / m_avg_buffer.size();
   }
 
+  template<class t_core>
+  size_t t_cryptonote_protocol_handler<t_core>::get_span_size(const cryptonote_connection_context &context)
+  {
+    const size_t block_sync_size = m_core.get_block_sync_size(m_core.get_current_blockchain_height());
+    if (block_sync_size > 0)
+      return block_sync_size;
+    if (context.m_span_bandwidth <= 0)
+      return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT;
+
+    // size the span so it takes about the same time from any peer: the round
+    // trip is paid whatever the size, so only what is left goes to transfer
+    const double target = BLOCKS_SYNCHRONIZING_TARGET_SPAN_TIME;
+    const double transfer_time = std::max(target - context.m_span_rtt_us / 1e6, target / 4);
+    // peers refuse requests for more objects than they will serve in one go
+    const double nblocks = transfer_time * context.m_span_bandwidth / std::max(get_avg_block_size(), 1.0);
+    return std::max<double>(BLOCKS_SYNCHRONIZING_MIN_COUNT, std::min<double>(CURRENCY_PROTOCOL_MAX_OBJECT_REQUEST_COUNT, nblocks));
+  }
+
   template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_response_get_objects(int command, NOTIFY_RESPONSE_GET_OBJECTS::request& arg, cryptonote_connection_context& context)
   {
@@ -1037,9 +1322,25 @@ namespace cryptonote
       size += sizeof(element.data);
 
     size += sizeof(arg.current_blockchain_height);
+    if (!arg.blocks.empty())
     {
       CRITICAL_REGION_LOCAL(m_buffer_mutex);
-      m_avg_buffer.push_back(size);
+      m_avg_buffer.push_back(blocks_size / arg.blocks.size());
+    }
+    if (request_time != boost::date_time::not_a_date_time && !arg.blocks.empty())
+    {
+      // the part of the round trip that does not depend on size is taken as
+      // the lowest one seen lately, and the rest is what the link carried
+      const uint64_t elapsed_us = std::max<int64_t>((boost::posix_time::microsec_clock::universal_time() - request_time).total_microseconds(), 1);
+      const uint64_t transfer_us = elapsed_us - std::min(context.m_span_rtt_us, elapsed_us / 2);
+      const double bandwidth = blocks_size * 1e6 / transfer_us;
+      context.m_span_bandwidth = context.m_span_bandwidth > 0 ? context.m_span_bandwidth * 0.75 + bandwidth * 0.25 : bandwidth;
+      if (context.m_span_rtt_us == 0 || elapsed_us < context.m_span_rtt_us)
+        context.m_span_rtt_us = elapsed_us;
+      else
+        context.m_span_rtt_us += (elapsed_us - context.m_span_rtt_us) / 16;
+      MDEBUG(context << " span took " << elapsed_us / 1000 << " ms, bandwidth estimate " << (uint64_t)context.m_span_bandwidth
+          << " B/s, rtt estimate " << context.m_span_rtt_us / 1000 << " ms");
     }
     ++m_sync_spans_downloaded;
     m_sync_download_objects_size += size;
@@ -1184,7 +1485,7 @@ namespace cryptonote
       const boost::posix_time::time_duration dt = now - request_time;
       const float rate = size * 1e6 / (dt.total_microseconds() + 1);
       MDEBUG(context << " adding span: " << arg.blocks.size() << " at height " << start_height << ", " << dt.total_microseconds()/1e6 << " seconds, " << (rate/1024) << " kB/s, size now " << (m_block_queue.get_data_size() + blocks_size) / 1048576.f << " MB");
-      m_block_queue.add_blocks(start_height, arg.blocks, context.m_connection_id, rate, blocks_size);
+      m_block_queue.add_blocks(start_height, std::move(arg.blocks), context.m_connection_id, rate, blocks_size);
 
       const crypto::hash last_block_hash = cryptonote::get_block_hash(b);
       context.m_last_known_hash = last_block_hash;
@@ -1547,6 +1848,8 @@ skip:
     m_idle_peer_kicker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::kick_idle_peers, this));
     m_standby_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::check_standby_peers, this));
     m_sync_search_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::update_sync_search, this));
+    if (m_tx_reconciliation)
+      m_tx_reconciliation_interval.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::reconcile_txs, this));
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -1860,7 +2163,10 @@ skip:
         const uint32_t peer_stripe = tools::get_pruning_stripe(context.m_pruning_seed);
         const uint32_t local_stripe = tools::get_pruning_stripe(m_core.get_blockchain_pruning_seed());
         const size_t block_queue_size_threshold = m_block_download_max_size ? m_block_download_max_size : BLOCK_QUEUE_SIZE_THRESHOLD;
-        bool queue_proceed = nspans < BLOCK_QUEUE_NSPANS_THRESHOLD || size < block_queue_size_threshold;
+        // spilled spans do not count against memory, but only while the spill
+        // file can still take one more span of the usual size, with some slack
+        const bool spill_proceed = nspans > 0 && m_block_queue.get_spill_room() >= 2 * (size / nspans);
+        bool queue_proceed = nspans < BLOCK_QUEUE_NSPANS_THRESHOLD || m_block_queue.get_memory_size() < block_queue_size_threshold || spill_proceed;
         // get rid of blocks we already requested, or already have
         if (skip_unneeded_hashes(context, true) && context.m_needed_objects.empty() && context.m_num_requested == 0)
         {
@@ -1969,7 +2275,7 @@ skip:
       NOTIFY_REQUEST_GET_OBJECTS::request req;
       bool is_next = false;
       size_t count = 0;
-      const size_t count_limit = m_core.get_block_sync_size(m_core.get_current_blockchain_height());
+      const size_t count_limit = get_span_size(context);
       std::pair<uint64_t, uint64_t> span = std::make_pair(0, 0);
       if (force_next_span)
       {
@@ -2347,13 +2653,18 @@ skip:
     fluffy_arg.b = arg.b;
     fluffy_arg.b.txs = fluffy_txs;
 
-    // sort peers between fluffy ones and others
-    std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> fullConnections, fluffyConnections;
-    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    // sort peers between compact, fluffy ones and others
+    std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> fullConnections, fluffyConnections, compactConnections;
+    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections, &compactConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
     {
       if (peer_id && exclude_context.m_connection_id != context.m_connection_id && context.m_remote_address.get_zone() == epee::net_utils::zone::public_)
       {
-        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
+        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_COMPACT_BLOCKS))
+        {
+          LOG_DEBUG_CC(context, "PEER SUPPORTS COMPACT BLOCKS - RELAYING SHORT TX IDS");
+          compactConnections.push_back({context.m_remote_address.get_zone(), context.m_connection_id});
+        }
+        else if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
         {
           LOG_DEBUG_CC(context, "PEER SUPPORTS FLUFFY BLOCKS - RELAYING THIN/COMPACT WHATEVER BLOCK");
           fluffyConnections.push_back({context.m_remote_address.get_zone(), context.m_connection_id});
@@ -2367,7 +2678,22 @@ skip:
       return true;
     });
 
-    // send fluffy ones first, we want to encourage people to run that
+    // compact ones first, they are the smallest and quickest to rebuild
+    if (!compactConnections.empty())
+    {
+      NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+      if (make_compact_block(arg, compact_arg))
+      {
+        std::string compactBlob;
+        epee::serialization::store_t_to_binary(compact_arg, compactBlob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, epee::strspan<uint8_t>(compactBlob), std::move(compactConnections));
+      }
+      else
+      {
+        fluffyConnections.insert(fluffyConnections.end(), compactConnections.begin(), compactConnections.end());
+      }
+    }
+    // then fluffy ones, we want to encourage people to run that
     if (!fluffyConnections.empty())
     {
       std::string fluffyBlob;
@@ -2385,17 +2711,190 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::make_compact_block(const NOTIFY_NEW_BLOCK::request& arg, NOTIFY_NEW_COMPACT_BLOCK::request& compact)
+  {
+    block b;
+    if (!parse_and_validate_block_from_blob(arg.b.block, b, &compact.block_hash))
+    {
+      MERROR("Failed to parse block to relay as compact block");
+      return false;
+    }
+
+    std::unordered_set<crypto::hash> prefill;
+    {
+      boost::unique_lock<boost::mutex> lock(m_compact_prefill_mutex);
+      if (m_compact_prefill_block == compact.block_hash)
+        prefill.swap(m_compact_prefill_txes);
+    }
+    std::unordered_map<crypto::hash, const blobdata*> prefill_blobs;
+    if (!prefill.empty())
+    {
+      for (const auto &tx_blob: arg.b.txs)
+      {
+        transaction tx;
+        crypto::hash tx_hash;
+        if (parse_and_validate_tx_from_blob(tx_blob.blob, tx, tx_hash) && prefill.count(tx_hash))
+          prefill_blobs[tx_hash] = &tx_blob.blob;
+      }
+    }
+
+    compact.nonce = crypto::rand<uint64_t>();
+    compact.current_blockchain_height = arg.current_blockchain_height;
+    const crypto::hash key = NOTIFY_NEW_COMPACT_BLOCK::short_id_key(compact.block_hash, compact.nonce);
+    compact.short_ids.reserve(b.tx_hashes.size() * NOTIFY_NEW_COMPACT_BLOCK::SHORT_ID_SIZE);
+    for (size_t i = 0; i < b.tx_hashes.size(); ++i)
+    {
+      const auto it = prefill_blobs.find(b.tx_hashes[i]);
+      if (it != prefill_blobs.end())
+      {
+        compact.prefilled_tx_indices.push_back(i);
+        compact.prefilled_txs.push_back(*it->second);
+      }
+      else
+      {
+        NOTIFY_NEW_COMPACT_BLOCK::append_short_id(compact.short_ids, NOTIFY_NEW_COMPACT_BLOCK::short_id(key, b.tx_hashes[i]));
+      }
+    }
+    b.tx_hashes.clear();
+    compact.block = t_serializable_object_to_blob(b);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context)
   {
+    std::vector<crypto::hash> txids;
     for(auto& tx_blob : arg.txs)
+    {
       m_core.on_transaction_relayed(tx_blob);
+      if (m_tx_reconciliation)
+      {
+        cryptonote::transaction tx;
+        crypto::hash txid;
+        if (cryptonote::parse_and_validate_tx_from_blob(tx_blob, tx, txid))
+          txids.push_back(txid);
+      }
+    }
 
     // no check for success, so tell core they're relayed unconditionally
-    m_p2p->send_txs(std::move(arg.txs), exclude_context.m_remote_address.get_zone(), exclude_context.m_connection_id, m_core.pad_transactions());
+    const epee::net_utils::zone zone = m_p2p->send_txs(std::move(arg.txs), exclude_context.m_remote_address.get_zone(), exclude_context.m_connection_id, m_core.pad_transactions());
+
+    // the flood skips the peers we reconcile with, they get the txes in the next round
+    if (!txids.empty() && zone == epee::net_utils::zone::public_)
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_reconciliation_mutex);
+      for (auto &e: m_tx_reconciliation_sets)
+        if (e.first != exclude_context.m_connection_id)
+          e.second.pending.insert(e.second.pending.end(), txids.begin(), txids.end());
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::reconcile_txs()
+  {
+    std::vector<std::pair<boost::uuids::uuid, std::vector<crypto::hash>>> flood;
+    std::vector<std::pair<boost::uuids::uuid, std::string>> sketches;
+    const time_t now = time(NULL);
+    m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool
+    {
+      if (!peer_id || context.m_state != cryptonote_connection_context::state_normal)
+        return true;
+      if (!(support_flags & P2P_SUPPORT_FLAG_TX_RECONCILIATION) || context.m_remote_address.get_zone() != epee::net_utils::zone::public_)
+        return true;
+
+      boost::unique_lock<boost::mutex> lock(m_tx_reconciliation_mutex);
+
+      // peers we connected to send us the sketches, if they stop we flood what we held for them
+      if (!context.m_is_income)
+      {
+        const auto i = m_tx_reconciliation_sets.find(context.m_connection_id);
+        if (i != m_tx_reconciliation_sets.end() && !i->second.pending.empty() && now - i->second.sent_time >= TX_RECONCILIATION_TIMEOUT)
+        {
+          MDEBUG(context << " no tx reconciliation sketch received lately, sending " << i->second.pending.size() << " txes");
+          flood.emplace_back(context.m_connection_id, std::move(i->second.pending));
+          i->second.pending.clear();
+        }
+        return true;
+      }
+
+      tx_reconciliation_set &set = m_tx_reconciliation_sets[context.m_connection_id];
+      set.initiator = true;
+      context.m_tx_reconciliation = true;
+      if (set.nonce != 0)
+      {
+        if (now - set.sent_time < TX_RECONCILIATION_TIMEOUT)
+          return true;
+        MDEBUG(context << " tx reconciliation timed out, sending " << set.in_flight.size() << " txes");
+        flood.emplace_back(context.m_connection_id, std::move(set.in_flight));
+        set.in_flight.clear();
+        set.nonce = 0;
+      }
+      // the peer may hold txes for us even if we have none for it, so go on
+      // with empty rounds from time to time
+      if (set.pending.empty() && set.remote_held == 0 && now - set.sent_time < TX_RECONCILIATION_TIMEOUT / 2)
+        return true;
+
+      // txes both sides relayed cancel out, so size the sketch by how many
+      // are expected to differ rather than by the whole set
+      const size_t smaller = std::min(set.pending.size(), set.remote_held);
+      const size_t apart = set.pending.size() > set.remote_held ? set.pending.size() - set.remote_held : set.remote_held - set.pending.size();
+      const size_t cells = tx_sketch::cells_for(apart + (size_t)(set.q * smaller) + 1);
+      if (cells > TX_RECONCILIATION_MAX_CELLS)
+      {
+        // too far apart, flood ours and size the next round from scratch
+        flood.emplace_back(context.m_connection_id, std::move(set.pending));
+        set.pending.clear();
+        set.remote_held = 0;
+        set.q = 0.25;
+        return true;
+      }
+
+      NOTIFY_TX_RECONCILIATION_SKETCH::request req;
+      do req.nonce = crypto::rand<uint64_t>(); while (req.nonce == 0);
+      const crypto::hash key = NOTIFY_TX_RECONCILIATION_SKETCH::short_id_key(req.nonce);
+      tx_sketch sketch(cells);
+      for (const crypto::hash &txid: set.pending)
+        sketch.add(NOTIFY_TX_RECONCILIATION_SKETCH::short_id(key, txid));
+      req.sketch = sketch.store();
+
+      set.in_flight = std::move(set.pending);
+      set.pending.clear();
+      set.nonce = req.nonce;
+      set.sent_time = now;
+
+      std::string blob;
+      epee::serialization::store_t_to_binary(req, blob);
+      sketches.emplace_back(context.m_connection_id, std::move(blob));
+      return true;
+    });
+
+    for (auto &e: sketches)
+      m_p2p->relay_notify_to_list(NOTIFY_TX_RECONCILIATION_SKETCH::ID, epee::strspan<uint8_t>(e.second), {{epee::net_utils::zone::public_, e.first}});
+    for (const auto &e: flood)
+      send_pool_txs(e.second, e.first);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::send_pool_txs(const std::vector<crypto::hash>& txids, const boost::uuids::uuid& connection_id)
+  {
+    NOTIFY_NEW_TRANSACTIONS::request req;
+    for (const crypto::hash &txid: txids)
+    {
+      cryptonote::blobdata blob;
+      if (m_core.get_pool_transaction(txid, blob))
+        req.txs.push_back(std::move(blob));
+    }
+    if (req.txs.empty())
+      return;
+
+    std::string blob;
+    epee::serialization::store_t_to_binary(req, blob);
+    m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, epee::strspan<uint8_t>(blob), {{epee::net_utils::zone::public_, connection_id}});
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   std::string t_cryptonote_protocol_handler<t_core>::get_peers_overview() const
   {
     std::stringstream ss;
@@ -2509,6 +3008,11 @@ skip:
     }
 
     m_block_queue.flush_spans(context.m_connection_id, false);
+    if (context.m_tx_reconciliation)
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_reconciliation_mutex);
+      m_tx_reconciliation_sets.erase(context.m_connection_id);
+    }
     MLOG_PEER_STATE("closed");
   }
 
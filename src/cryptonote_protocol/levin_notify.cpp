@@ -34,9 +34,11 @@
 #include <boost/asio/post.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/system/system_error.hpp>
+#include <algorithm>
 #include <chrono>
 #include <deque>
 #include <stdexcept>
+#include <utility>
 
 #include "common/expect.h"
 #include "common/varint.h"
@@ -61,6 +63,13 @@ namespace levin
     constexpr const std::chrono::seconds noise_min_delay{CRYPTONOTE_NOISE_MIN_DELAY};
     constexpr const std::chrono::seconds noise_delay_range{CRYPTONOTE_NOISE_DELAY_RANGE};
 
+    /* Flooded txes are queued per connection and sent together after a random
+       delay, like the fluff phase of Dandelion++. Outgoing connections get a
+       shorter average delay so that txes spread first to peers this node
+       selected. */
+    constexpr const std::chrono::milliseconds fluff_average_in{std::chrono::seconds{CRYPTONOTE_DANDELIONPP_FLUSH_AVERAGE}};
+    constexpr const std::chrono::milliseconds fluff_average_out{fluff_average_in / 2};
+
     /*! Select a randomized duration from 0 to `range`. The precision will be to
         the systems `steady_clock`. As an example, supplying 3 seconds to this
         function will select a duration from [0, 3] seconds, and the increments
@@ -93,6 +102,12 @@ namespace levin
       return outs;
     }
 
+    //! \return A randomized flush delay with mean `average`.
+    std::chrono::steady_clock::duration random_fluff_delay(const std::chrono::milliseconds average)
+    {
+      return random_duration(2 * average);
+    }
+
     std::string make_tx_payload(std::vector<blobdata>&& txs, const bool pad)
     {
       NOTIFY_NEW_TRANSACTIONS::request request{};
@@ -195,10 +210,14 @@ namespace levin
         : p2p(std::move(p2p)),
           noise(std::move(noise_in)),
           next_epoch(io_context),
+          flush_txs(io_context),
           strand(io_context.get_executor()),
           map(),
           channels(),
+          flush_time(std::chrono::steady_clock::time_point::max()),
           connection_count(0),
+          fluff_messages(0),
+          fluff_txs(0),
           is_public(is_public)
       {
         for (std::size_t count = 0; !noise.empty() && count < CRYPTONOTE_NOISE_CHANNELS; ++count)
@@ -208,10 +227,14 @@ namespace levin
       const std::shared_ptr<connections> p2p;
       const epee::byte_slice noise; //!< `!empty()` means zone is using noise channels
       boost::asio::steady_timer next_epoch;
+      boost::asio::steady_timer flush_txs;
       boost::asio::strand<boost::asio::io_context::executor_type> strand;
       net::dandelionpp::connection_map map;//!< Tracks outgoing uuid's for noise channels or Dandelion++ stems
       std::deque<noise_channel> channels;  //!< Never touch after init; only update elements on `noise_channel.strand`
+      std::chrono::steady_clock::time_point flush_time; //!< Expiration of `flush_txs`, max() if not set; only use in strand
       std::atomic<std::size_t> connection_count; //!< Only update in strand, can be read at any time
+      std::atomic<std::uint64_t> fluff_messages; //!< Tx notifications sent by flooding
+      std::atomic<std::uint64_t> fluff_txs;      //!< Txes sent in `fluff_messages`
       const bool is_public;                      //!< Zone is public ipv4/ipv6 connections
     };
   } // detail
@@ -249,24 +272,100 @@ namespace levin
       }
     };
 
-    //! Sends a message to every active connection
-    class flood_notify
+    //! Sends the queued txes of every connection whose flush time expired.
+    struct fluff_flush
     {
       std::shared_ptr<detail::zone> zone_;
-      epee::byte_slice message_; // Requires manual copy
-      boost::uuids::uuid source_;
+      std::chrono::steady_clock::time_point flush_time_;
 
-    public:
-      explicit flood_notify(std::shared_ptr<detail::zone> zone, epee::byte_slice message, const boost::uuids::uuid& source)
-        : zone_(std::move(zone)), message_(message.clone()), source_(source)
-      {}
+      //! \pre Called within `zone->strand`.
+      static void queue(std::shared_ptr<detail::zone> zone, const std::chrono::steady_clock::time_point flush_time)
+      {
+        if (!zone)
+          return;
 
-      flood_notify(flood_notify&&) = default;
-      flood_notify(const flood_notify& source)
-        : zone_(source.zone_), message_(source.message_.clone()), source_(source.source_)
-      {}
+        assert(zone->strand.running_in_this_thread());
 
-      void operator()() const
+        detail::zone& alias = *zone;
+        alias.flush_time = flush_time;
+        alias.flush_txs.expires_at(flush_time);
+        alias.flush_txs.async_wait(
+          boost::asio::bind_executor(alias.strand, fluff_flush{std::move(zone), flush_time})
+        );
+      }
+
+      //! \pre Called within `zone_->strand`.
+      void operator()(const boost::system::error_code error)
+      {
+        if (!zone_ || !zone_->p2p)
+          return;
+
+        assert(zone_->strand.running_in_this_thread());
+
+        if (error)
+        {
+          if (error != boost::system::errc::operation_canceled)
+            throw boost::system::system_error{error, "fluff_flush timer failed"};
+
+          // a timer with an earlier expiration replaced this one
+          return;
+        }
+
+        struct pending
+        {
+          std::vector<blobdata> txs;
+          boost::uuids::uuid connection;
+          bool pad;
+        };
+
+        const auto now = std::chrono::steady_clock::now();
+        auto next_flush = std::chrono::steady_clock::time_point::max();
+        std::vector<pending> ready;
+        zone_->p2p->foreach_connection([now, &next_flush, &ready] (detail::p2p_context& context) {
+          if (context.m_fluff_txs.empty())
+            context.m_flush_time = std::chrono::steady_clock::time_point::max();
+          else if (context.m_flush_time <= now)
+          {
+            ready.push_back({std::move(context.m_fluff_txs), context.m_connection_id, context.m_fluff_pad});
+            context.m_fluff_txs.clear();
+            context.m_flush_time = std::chrono::steady_clock::time_point::max();
+            context.m_fluff_pad = false;
+          }
+          else
+            next_flush = std::min(next_flush, context.m_flush_time);
+          return true;
+        });
+
+        for (pending& entry : ready)
+        {
+          const std::size_t count = entry.txs.size();
+          const std::string payload = make_tx_payload(std::move(entry.txs), entry.pad);
+          epee::byte_slice message =
+            epee::levin::make_notify(NOTIFY_NEW_TRANSACTIONS::ID, epee::strspan<std::uint8_t>(payload));
+          if (zone_->p2p->send(std::move(message), entry.connection))
+          {
+            ++zone_->fluff_messages;
+            zone_->fluff_txs += count;
+          }
+        }
+
+        if (next_flush != std::chrono::steady_clock::time_point::max())
+          queue(std::move(zone_), next_flush);
+        else
+          zone_->flush_time = next_flush;
+      }
+    };
+
+    //! Queues txes for every active connection, to be sent by `fluff_flush`
+    struct flood_notify
+    {
+      std::shared_ptr<detail::zone> zone_;
+      std::vector<blobdata> txs_;
+      boost::uuids::uuid source_;
+      bool pad_;
+
+      //! \pre Called within `zone_->strand`.
+      void operator()()
       {
         if (!zone_ || !zone_->p2p)
           return;
@@ -279,19 +378,26 @@ namespace levin
            algorithm changes or the locking strategy within the levin config
            class changes. */
 
-        std::vector<boost::uuids::uuid> connections;
-        connections.reserve(connection_id_reserve_size);
-        zone_->p2p->foreach_connection([this, &connections] (detail::p2p_context& context) {
+        const auto now = std::chrono::steady_clock::now();
+        auto next_flush = std::chrono::steady_clock::time_point::max();
+        zone_->p2p->foreach_connection([this, now, &next_flush] (detail::p2p_context& context) {
           /* Only send to outgoing connections when "flooding" over i2p/tor.
              Otherwise this makes the tx linkable to a hidden service address,
-             making things linkable across connections. */
-          if (this->source_ != context.m_connection_id && (this->zone_->is_public || !context.m_is_income))
-            connections.emplace_back(context.m_connection_id);
+             making things linkable across connections. Peers reconciled with
+             get the txes from the protocol handler instead. */
+          if (this->source_ != context.m_connection_id && (this->zone_->is_public || !context.m_is_income) && !context.m_tx_reconciliation)
+          {
+            if (context.m_fluff_txs.empty())
+              context.m_flush_time = now + random_fluff_delay(context.m_is_income ? fluff_average_in : fluff_average_out);
+            next_flush = std::min(next_flush, context.m_flush_time);
+            context.m_fluff_pad |= this->pad_;
+            context.m_fluff_txs.insert(context.m_fluff_txs.end(), this->txs_.begin(), this->txs_.end());
+          }
           return true;
         });
 
-        for (const boost::uuids::uuid& connection : connections)
-          zone_->p2p->send(message_.clone(), connection);
+        if (next_flush < zone_->flush_time)
+          fluff_flush::queue(std::move(zone_), next_flush);
       }
     };
 
@@ -511,6 +617,14 @@ namespace levin
     return {!zone_->noise.empty(), CRYPTONOTE_NOISE_CHANNELS <= zone_->connection_count};
   }
 
+  notify::fluff_stats notify::get_fluff_stats() const noexcept
+  {
+    if (!zone_)
+      return {0, 0};
+
+    return {zone_->fluff_messages.load(), zone_->fluff_txs.load()};
+  }
+
   void notify::new_out_connection()
   {
     if (!zone_ || zone_->noise.empty() || CRYPTONOTE_NOISE_CHANNELS <= zone_->connection_count)
@@ -569,12 +683,8 @@ namespace levin
     }
     else
     {
-      const std::string payload = make_tx_payload(std::move(txs), pad_txs);
-      epee::byte_slice message =
-        epee::levin::make_notify(NOTIFY_NEW_TRANSACTIONS::ID, epee::strspan<std::uint8_t>(payload));
-
-      // traditional monero send technique
-      boost::asio::dispatch(zone_->strand, flood_notify{zone_, std::move(message), source});
+      // traditional monero send technique, batched per connection
+      boost::asio::dispatch(zone_->strand, flood_notify{zone_, std::move(txs), source, pad_txs});
     }
 
     return true;
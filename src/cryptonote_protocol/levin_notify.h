@@ -31,6 +31,7 @@
 
 #include <boost/asio/io_context.hpp>
 #include <boost/uuid/uuid.hpp>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -81,6 +82,12 @@ namespace levin
       bool connections_filled;
     };
 
+    struct fluff_stats
+    {
+      std::uint64_t messages; //!< Tx notifications flooded to peers
+      std::uint64_t txs;      //!< Txes carried by `messages`
+    };
+
     //! Construct an instance that cannot notify.
     notify() noexcept
       : zone_(nullptr)
@@ -100,6 +107,9 @@ namespace levin
     //! \return Status information for zone selection.
     status get_status() const noexcept;
 
+    //! \return Counts of flooded tx notifications and the txes in them.
+    fluff_stats get_fluff_stats() const noexcept;
+
     //! Probe for new outbound connection - skips if not needed.
     void new_out_connection();
 
@@ -113,7 +123,8 @@ namespace levin
         levin header. The message will be sent in a "discreet" manner if
         enabled - if `!noise.empty()` then the `command`/`payload` will be
         queued to send at the next available noise interval. Otherwise, a
-        standard Monero flood notification will be used.
+        standard Monero flood notification will be used, with the txes queued
+        per connection and sent in one message after a randomized delay.
 
         \note Eventually Dandelion++ stem sending will be used here when
           enabled.
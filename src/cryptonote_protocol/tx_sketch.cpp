@@ -0,0 +1,165 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include "int-util.h"
+#include "tx_sketch.h"
+
+namespace
+{
+  uint64_t mix(uint64_t x)
+  {
+    // splitmix64 finalizer
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  uint64_t check(uint64_t id)
+  {
+    return mix(id ^ 0x5851f42d4c957f2dull);
+  }
+
+  size_t cell_index(uint64_t id, size_t part, size_t part_cells)
+  {
+    return part * part_cells + mix(id + (part + 1) * 0x9e3779b97f4a7c15ull) % part_cells;
+  }
+}
+
+namespace cryptonote
+{
+  tx_sketch::tx_sketch(size_t cells)
+    : m_cells((cells + 2) / 3 * 3, cell{0, 0, 0})
+  {}
+
+  size_t tx_sketch::cells_for(size_t difference)
+  {
+    // small tables need proportionally more room to decode reliably
+    return (30 + difference * 5 / 2 + 2) / 3 * 3;
+  }
+
+  void tx_sketch::add(uint64_t id)
+  {
+    if (m_cells.empty())
+      return;
+    const size_t part_cells = m_cells.size() / 3;
+    const uint64_t c = check(id);
+    for (size_t part = 0; part < 3; ++part)
+    {
+      cell &e = m_cells[cell_index(id, part, part_cells)];
+      ++e.count;
+      e.ids ^= id;
+      e.checks ^= c;
+    }
+  }
+
+  std::string tx_sketch::store() const
+  {
+    std::string blob(m_cells.size() * cell_size, 0);
+    char *ptr = &blob[0];
+    for (const cell &e: m_cells)
+    {
+      const uint32_t count = SWAP32LE((uint32_t)e.count);
+      const uint64_t ids = SWAP64LE(e.ids), checks = SWAP64LE(e.checks);
+      memcpy(ptr, &count, 4);
+      memcpy(ptr + 4, &ids, 8);
+      memcpy(ptr + 12, &checks, 8);
+      ptr += cell_size;
+    }
+    return blob;
+  }
+
+  bool tx_sketch::load(const std::string &blob, size_t max_cells)
+  {
+    if (blob.size() % (3 * cell_size) || blob.size() / cell_size > max_cells)
+      return false;
+    m_cells.resize(blob.size() / cell_size);
+    const char *ptr = blob.data();
+    for (cell &e: m_cells)
+    {
+      uint32_t count;
+      memcpy(&count, ptr, 4);
+      memcpy(&e.ids, ptr + 4, 8);
+      memcpy(&e.checks, ptr + 12, 8);
+      e.count = (int32_t)SWAP32LE(count);
+      e.ids = SWAP64LE(e.ids);
+      e.checks = SWAP64LE(e.checks);
+      ptr += cell_size;
+    }
+    return true;
+  }
+
+  bool tx_sketch::decode(const tx_sketch &other, std::vector<uint64_t> &only_here, std::vector<uint64_t> &only_there) const
+  {
+    only_here.clear();
+    only_there.clear();
+    if (m_cells.size() != other.m_cells.size())
+      return false;
+
+    std::vector<cell> diff(m_cells);
+    for (size_t i = 0; i < diff.size(); ++i)
+    {
+      diff[i].count -= other.m_cells[i].count;
+      diff[i].ids ^= other.m_cells[i].ids;
+      diff[i].checks ^= other.m_cells[i].checks;
+    }
+
+    // peel cells holding a single id until none is left
+    const size_t part_cells = diff.size() / 3;
+    std::vector<size_t> pure;
+    for (size_t i = 0; i < diff.size(); ++i)
+      if ((diff[i].count == 1 || diff[i].count == -1) && diff[i].checks == check(diff[i].ids))
+        pure.push_back(i);
+    while (!pure.empty())
+    {
+      const size_t i = pure.back();
+      pure.pop_back();
+      const cell e = diff[i];
+      if ((e.count != 1 && e.count != -1) || e.checks != check(e.ids))
+        continue;
+      (e.count == 1 ? only_here : only_there).push_back(e.ids);
+      if (only_here.size() + only_there.size() > diff.size())
+        return false;
+      for (size_t part = 0; part < 3; ++part)
+      {
+        const size_t j = cell_index(e.ids, part, part_cells);
+        diff[j].count -= e.count;
+        diff[j].ids ^= e.ids;
+        diff[j].checks ^= e.checks;
+        if ((diff[j].count == 1 || diff[j].count == -1) && diff[j].checks == check(diff[j].ids))
+          pure.push_back(j);
+      }
+    }
+
+    for (const cell &e: diff)
+      if (e.count != 0 || e.ids != 0 || e.checks != 0)
+        return false;
+    return true;
+  }
+}
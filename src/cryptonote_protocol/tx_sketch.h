@@ -0,0 +1,77 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cryptonote
+{
+  /* Invertible Bloom lookup table over 64 bit short transaction ids, used to
+     reconcile the sets of transactions two peers would have announced to each
+     other. Each id is added to three cells, one in each third of the table.
+     Subtracting the peer's sketch leaves only the ids in one set and not the
+     other, which can then be listed as long as the table has a few cells
+     per differing id. */
+  class tx_sketch
+  {
+  public:
+    static constexpr const size_t cell_size = 4 + 8 + 8;
+
+    explicit tx_sketch(size_t cells = 0);
+
+    //! \return A number of cells likely to decode `difference` differing ids.
+    static size_t cells_for(size_t difference);
+
+    size_t cells() const noexcept { return m_cells.size(); }
+    void add(uint64_t id);
+
+    std::string store() const;
+    //! \return False if `blob` is not a sketch of at most `max_cells` cells.
+    bool load(const std::string &blob, size_t max_cells);
+
+    /*! Lists the ids which are only in `this` and those only in `other`, which
+        must have as many cells.
+
+        \return False if the difference was too large to be listed. */
+    bool decode(const tx_sketch &other, std::vector<uint64_t> &only_here, std::vector<uint64_t> &only_there) const;
+
+  private:
+    struct cell
+    {
+      int32_t count;
+      uint64_t ids;
+      uint64_t checks;
+    };
+
+    std::vector<cell> m_cells;
+  };
+}
@@ -146,6 +146,20 @@ bool t_command_parser_executor::print_net_stats(const std::vector<std::string>&
   return m_executor.print_net_stats();
 }
 
+bool t_command_parser_executor::print_db_stats(const std::vector<std::string>& args)
+{
+  if (!args.empty()) return false;
+
+  return m_executor.print_db_stats();
+}
+
+bool t_command_parser_executor::print_threadpool_stats(const std::vector<std::string>& args)
+{
+  if (!args.empty()) return false;
+
+  return m_executor.print_threadpool_stats();
+}
+
 bool t_command_parser_executor::print_blockchain_info(const std::vector<std::string>& args)
 {
   if(!args.size())
@@ -857,6 +871,29 @@ bool t_command_parser_executor::check_blockchain_pruning(const std::vector<std::
   return m_executor.check_blockchain_pruning();
 }
 
+bool t_command_parser_executor::snapshot_blockchain(const std::vector<std::string>& args)
+{
+  if (args.empty() || args.size() > 2)
+  {
+    std::cout << "Invalid syntax: One or two parameters expected. For more details, use the help command." << std::endl;
+    return true;
+  }
+
+  uint64_t max_mb_per_second = 0;
+  if (args.size() > 1 && !epee::string_tools::get_xtype_from_string(max_mb_per_second, args[1]))
+  {
+    std::cout << "Invalid syntax: the rate limit must be a number of MB per second. For more details, use the help command." << std::endl;
+    return true;
+  }
+
+  return m_executor.snapshot_blockchain(args[0], max_mb_per_second * 1024 * 1024);
+}
+
+bool t_command_parser_executor::snapshot_blockchain_status(const std::vector<std::string>& args)
+{
+  return m_executor.snapshot_blockchain_status();
+}
+
 bool t_command_parser_executor::set_bootstrap_daemon(const std::vector<std::string>& args)
 {
   const size_t args_count = args.size();
@@ -150,8 +150,16 @@ public:
 
   bool check_blockchain_pruning(const std::vector<std::string>& args);
 
+  bool snapshot_blockchain(const std::vector<std::string>& args);
+
+  bool snapshot_blockchain_status(const std::vector<std::string>& args);
+
   bool print_net_stats(const std::vector<std::string>& args);
 
+  bool print_db_stats(const std::vector<std::string>& args);
+
+  bool print_threadpool_stats(const std::vector<std::string>& args);
+
   bool set_bootstrap_daemon(const std::vector<std::string>& args);
 
   bool flush_cache(const std::vector<std::string>& args);
@@ -84,6 +84,16 @@ t_command_server::t_command_server(
     , std::bind(&t_command_parser_executor::print_net_stats, &m_parser, p::_1)
     , "Print network statistics."
     );
+  m_command_lookup.set_handler(
+      "print_db_stats"
+    , std::bind(&t_command_parser_executor::print_db_stats, &m_parser, p::_1)
+    , "Print blockchain database statistics: table sizes, operation counters and txn latencies."
+    );
+  m_command_lookup.set_handler(
+      "print_threadpool_stats"
+    , std::bind(&t_command_parser_executor::print_threadpool_stats, &m_parser, p::_1)
+    , "Print thread pool queue depths and task latencies per priority class."
+    );
   m_command_lookup.set_handler(
       "print_bc"
     , std::bind(&t_command_parser_executor::print_blockchain_info, &m_parser, p::_1)
@@ -334,6 +344,17 @@ t_command_server::t_command_server(
     , std::bind(&t_command_parser_executor::check_blockchain_pruning, &m_parser, p::_1)
     , "Check the blockchain pruning."
     );
+    m_command_lookup.set_handler(
+      "snapshot_blockchain"
+    , std::bind(&t_command_parser_executor::snapshot_blockchain, &m_parser, p::_1)
+    , "snapshot_blockchain <path> [<max_MB_per_second>]"
+    , "Write a compacted copy of the blockchain database to <path> in the background, optionally limiting the write rate."
+    );
+    m_command_lookup.set_handler(
+      "snapshot_blockchain_status"
+    , std::bind(&t_command_parser_executor::snapshot_blockchain_status, &m_parser, p::_1)
+    , "Show the progress of the current or last blockchain snapshot."
+    );
     m_command_lookup.set_handler(
       "set_bootstrap_daemon"
     , std::bind(&t_command_parser_executor::set_bootstrap_daemon, &m_parser, p::_1)
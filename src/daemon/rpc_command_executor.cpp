@@ -132,6 +132,18 @@ namespace {
     return std::string(buffer);
   }
 
+  void print_pruning_progress(cryptonote::pruning_progress_response const & progress)
+  {
+    std::stringstream ss;
+    ss << "Pruning in progress: " << progress.phase;
+    if (progress.total > 0)
+      ss << " " << progress.done << "/" << progress.total << " (" << (100.0 * progress.done / progress.total) << "%)";
+    ss << ", running for " << get_time_hms(progress.elapsed_ms / 1000);
+    if (progress.eta_seconds > 0)
+      ss << ", " << get_time_hms(progress.eta_seconds) << " left in this phase";
+    tools::success_msg_writer() << ss.str();
+  }
+
   std::string make_error(const std::string &base, const std::string &status)
   {
     if (status == CORE_RPC_STATUS_OK)
@@ -729,6 +741,116 @@ bool t_rpc_command_executor::print_net_stats()
     % percent
     % tools::get_human_readable_bytes(limit);
 
+  for (size_t i = 0; i < net_stats_res.io_shards.size(); ++i)
+  {
+    const auto &shard = net_stats_res.io_shards[i];
+    tools::msg_writer() << boost::format("io shard %u: %u connections, %u accepted, %u handlers run")
+      % i % shard.connections % shard.accepted % shard.handlers;
+  }
+
+  tools::msg_writer() << boost::format("Tx relay: %u txs in %u messages (%.2f txs per message)")
+    % net_stats_res.tx_relay_txs
+    % net_stats_res.tx_relay_messages
+    % (net_stats_res.tx_relay_messages ? net_stats_res.tx_relay_txs / (double)net_stats_res.tx_relay_messages : 0.0);
+
+  return true;
+}
+
+bool t_rpc_command_executor::print_db_stats()
+{
+  cryptonote::COMMAND_RPC_GET_DB_STATS::request req;
+  cryptonote::COMMAND_RPC_GET_DB_STATS::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "get_db_stats", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_get_db_stats(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << make_error(fail_message, res.status);
+      return true;
+    }
+  }
+
+  tools::success_msg_writer() << boost::format("Map size %s, %s used (%.1f%%), page size %u, %u/%u readers")
+    % tools::get_human_readable_bytes(res.map_size)
+    % tools::get_human_readable_bytes(res.used_size)
+    % (res.map_size ? 100.0 * res.used_size / res.map_size : 0.0)
+    % res.page_size
+    % res.readers
+    % res.max_readers;
+  tools::success_msg_writer() << boost::format("%u map resizes taking %u ms, %u major / %u minor page faults (whole process)")
+    % res.resizes
+    % res.resize_time_ms
+    % res.major_page_faults
+    % res.minor_page_faults;
+
+  tools::msg_writer() << boost::format("%-18s %12s %10s %5s %12s %12s %12s %10s %12s %10s %10s")
+    % "table" % "entries" % "size" % "depth" % "lookups" % "misses" % "steps" % "read" % "writes" % "written" % "deletes";
+  for (const auto &t: res.tables)
+  {
+    tools::msg_writer() << boost::format("%-18s %12u %10s %5u %12u %12u %12u %10s %12u %10s %10u")
+      % t.name % t.entries % tools::get_human_readable_bytes(t.size) % t.depth
+      % t.lookups % t.misses % t.cursor_steps % tools::get_human_readable_bytes(t.bytes_read)
+      % t.writes % tools::get_human_readable_bytes(t.bytes_written) % t.deletes;
+  }
+
+  const auto print_histogram = [](const char *name, const cryptonote::COMMAND_RPC_GET_DB_STATS::histogram &h) {
+    std::stringstream ss;
+    ss << name << ": " << h.count << ", average " << (h.count ? h.total_us / h.count : 0) << " us, max " << h.max_us << " us";
+    static const char *labels[] = {"<10us", "<100us", "<1ms", "<10ms", "<100ms", "<1s", "<10s", ">=10s"};
+    for (size_t i = 0; i < h.buckets.size() && i < sizeof(labels) / sizeof(labels[0]); ++i)
+      ss << (i == 0 ? " | " : ", ") << labels[i] << " " << h.buckets[i];
+    tools::msg_writer() << ss.str();
+  };
+  print_histogram("Read txns", res.read_txn);
+  print_histogram("Write txns", res.write_txn);
+  print_histogram("Commits", res.commit);
+
+  return true;
+}
+
+bool t_rpc_command_executor::print_threadpool_stats()
+{
+  cryptonote::COMMAND_RPC_GET_THREADPOOL_STATS::request req;
+  cryptonote::COMMAND_RPC_GET_THREADPOOL_STATS::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "get_threadpool_stats", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_get_threadpool_stats(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << make_error(fail_message, res.status);
+      return true;
+    }
+  }
+
+  tools::success_msg_writer() << boost::format("%u threads") % res.threads;
+  tools::msg_writer() << boost::format("%-8s %8s %12s %12s %10s %14s %14s %14s")
+    % "priority" % "queued" % "submitted" % "completed" % "stolen" % "avg wait us" % "max wait us" % "avg run us";
+  for (const auto &p: res.priorities)
+  {
+    tools::msg_writer() << boost::format("%-8s %8u %12u %12u %10u %14u %14u %14u")
+      % p.name % p.queued % p.submitted % p.completed % p.stolen
+      % (p.completed ? p.wait_us / p.completed : 0) % p.max_wait_us
+      % (p.completed ? p.run_us / p.completed : 0);
+  }
+
   return true;
 }
 
@@ -2276,6 +2398,8 @@ bool t_rpc_command_executor::sync_info()
     tools::success_msg_writer() << "Downloading at " << current_download << " kB/s";
     if (res.next_needed_pruning_seed)
       tools::success_msg_writer() << "Next needed pruning seed: " << res.next_needed_pruning_seed;
+    if (res.pruning.running)
+      print_pruning_progress(res.pruning);
 
     tools::success_msg_writer() << std::to_string(res.peers.size()) << " peers";
     for (const auto &p: res.peers)
@@ -2364,7 +2488,10 @@ bool t_rpc_command_executor::prune_blockchain()
         }
     }
 
-    tools::success_msg_writer() << "Blockchain pruned";
+    if (res.in_progress)
+      print_pruning_progress(res.progress);
+    else
+      tools::success_msg_writer() << "Blockchain pruned";
     return true;
 }
 
@@ -2393,7 +2520,11 @@ bool t_rpc_command_executor::check_blockchain_pruning()
         }
     }
 
-    if (res.pruning_seed)
+    if (res.in_progress)
+    {
+      print_pruning_progress(res.progress);
+    }
+    else if (res.pruning_seed)
     {
       tools::success_msg_writer() << "Blockchain is pruned";
     }
@@ -2404,6 +2535,90 @@ bool t_rpc_command_executor::check_blockchain_pruning()
     return true;
 }
 
+bool t_rpc_command_executor::snapshot_blockchain(const std::string &path, uint64_t max_bytes_per_second)
+{
+    cryptonote::COMMAND_RPC_SNAPSHOT_BLOCKCHAIN::request req;
+    cryptonote::COMMAND_RPC_SNAPSHOT_BLOCKCHAIN::response res;
+    std::string fail_message = "Unsuccessful";
+    epee::json_rpc::error error_resp;
+
+    req.path = path;
+    req.max_bytes_per_second = max_bytes_per_second;
+    req.check = false;
+
+    if (m_is_rpc)
+    {
+        if (!m_rpc_client->json_rpc_request(req, res, "snapshot_blockchain", fail_message.c_str()))
+        {
+            return true;
+        }
+    }
+    else
+    {
+        if (!m_rpc_server->on_snapshot_blockchain(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+        {
+            tools::fail_msg_writer() << make_error(fail_message, res.status) << (error_resp.message.empty() ? "" : ": " + error_resp.message);
+            return true;
+        }
+    }
+
+    tools::success_msg_writer() << "Snapshot started, writing up to " << tools::get_human_readable_bytes(res.estimated_size) <<
+        " to " << res.path << ". Use snapshot_blockchain_status to follow its progress.";
+    return true;
+}
+
+bool t_rpc_command_executor::snapshot_blockchain_status()
+{
+    cryptonote::COMMAND_RPC_SNAPSHOT_BLOCKCHAIN::request req;
+    cryptonote::COMMAND_RPC_SNAPSHOT_BLOCKCHAIN::response res;
+    std::string fail_message = "Unsuccessful";
+    epee::json_rpc::error error_resp;
+
+    req.check = true;
+
+    if (m_is_rpc)
+    {
+        if (!m_rpc_client->json_rpc_request(req, res, "snapshot_blockchain", fail_message.c_str()))
+        {
+            return true;
+        }
+    }
+    else
+    {
+        if (!m_rpc_server->on_snapshot_blockchain(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+        {
+            tools::fail_msg_writer() << make_error(fail_message, res.status);
+            return true;
+        }
+    }
+
+    if (!res.running && !res.finished)
+    {
+        tools::msg_writer() << "No snapshot was started";
+        return true;
+    }
+
+    const uint64_t elapsed_seconds = res.elapsed_ms / 1000;
+    if (res.running)
+    {
+        const uint64_t percent = res.estimated_size ? std::min<uint64_t>(100, res.bytes_written * 100 / res.estimated_size) : 0;
+        tools::msg_writer() << "Snapshot to " << res.path << " in progress: " << tools::get_human_readable_bytes(res.bytes_written) <<
+            " of up to " << tools::get_human_readable_bytes(res.estimated_size) << " written (" << percent << "%), " <<
+            elapsed_seconds << " seconds elapsed" <<
+            (res.max_bytes_per_second ? ", limited to " + tools::get_human_readable_bytes(res.max_bytes_per_second) + "/s" : "");
+    }
+    else if (res.success)
+    {
+        tools::success_msg_writer() << "Snapshot written to " << res.path << " in " << elapsed_seconds << " seconds: database size " <<
+            tools::get_human_readable_bytes(res.source_size) << " before, " << tools::get_human_readable_bytes(res.bytes_written) << " after compaction";
+    }
+    else
+    {
+        tools::fail_msg_writer() << "Snapshot to " << res.path << " failed: " << res.error;
+    }
+    return true;
+}
+
 bool t_rpc_command_executor::set_bootstrap_daemon(
   const std::string &address,
   const std::string &username,
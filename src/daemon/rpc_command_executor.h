@@ -162,8 +162,16 @@ public:
 
   bool check_blockchain_pruning();
 
+  bool snapshot_blockchain(const std::string &path, uint64_t max_bytes_per_second);
+
+  bool snapshot_blockchain_status();
+
   bool print_net_stats();
 
+  bool print_db_stats();
+
+  bool print_threadpool_stats();
+
   bool set_bootstrap_daemon(
     const std::string &address,
     const std::string &username,
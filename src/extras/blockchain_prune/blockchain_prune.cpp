@@ -233,7 +233,7 @@ static void copy_table(MDB_env *env0, MDB_env *env1, const char *table, unsigned
   mdb_dbi_close(env0, dbi0);
 }
 
-static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id)
+static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id, const lmdb_tx_compression &tx_compression)
 {
   MDB_val v;
   int ret = mdb_cursor_get(c_txs_pruned, tx_id, &v, MDB_SET);
@@ -241,12 +241,16 @@ static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id)
     throw std::runtime_error("Failed to find transaction pruned data: " + std::string(mdb_strerror(ret)));
   if (v.mv_size == 0)
     throw std::runtime_error("Invalid transaction pruned data");
-  return cryptonote::is_v1_tx(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size});
+  if (!tx_compression.enabled())
+    return cryptonote::is_v1_tx(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size});
+  cryptonote::blobdata bd;
+  tx_compression.decode(txc_pruned, v, bd);
+  return cryptonote::is_v1_tx(bd);
 }
 
 static void prune(MDB_env *env0, MDB_env *env1)
 {
-  MDB_dbi dbi0_blocks, dbi0_txs_pruned, dbi0_txs_prunable, dbi0_tx_indices, dbi1_txs_prunable, dbi1_txs_prunable_tip, dbi1_properties;
+  MDB_dbi dbi0_blocks, dbi0_txs_pruned, dbi0_txs_prunable, dbi0_tx_indices, dbi0_properties, dbi1_txs_prunable, dbi1_txs_prunable_tip, dbi1_properties;
   MDB_txn *txn0, *txn1;
   MDB_cursor *cur0_txs_pruned, *cur0_txs_prunable, *cur0_tx_indices, *cur1_txs_prunable, *cur1_txs_prunable_tip;
   bool tx_active0 = false, tx_active1 = false;
@@ -284,6 +288,13 @@ static void prune(MDB_env *env0, MDB_env *env1)
   dbr = mdb_cursor_open(txn0, dbi0_tx_indices, &cur0_tx_indices);
   if (dbr) throw std::runtime_error("Failed to create LMDB cursor: " + std::string(mdb_strerror(dbr)));
 
+  // records are copied as they are, the properties table carries the compression settings
+  lmdb_tx_compression tx_compression;
+  dbr = mdb_dbi_open(txn0, "properties", 0, &dbi0_properties);
+  if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  mdb_set_compare(txn0, dbi0_properties, BlockchainLMDB::compare_string);
+  tx_compression.load(txn0, dbi0_properties);
+
   dbr = mdb_dbi_open(txn1, "txs_prunable", MDB_INTEGERKEY, &dbi1_txs_prunable);
   if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
   mdb_set_compare(txn1, dbi1_txs_prunable, BlockchainLMDB::compare_uint64);
@@ -343,7 +354,7 @@ static void prune(MDB_env *env0, MDB_env *env1)
       if (dbr) throw std::runtime_error("Failed to write prunable tx tip data: " + std::string(mdb_strerror(dbr)));
       bytes += kk.mv_size + vv.mv_size;
     }
-    if (tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) || is_v1_tx(cur0_txs_pruned, &kk))
+    if (tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) || is_v1_tx(cur0_txs_pruned, &kk, tx_compression))
     {
       MDB_val vv;
       dbr = mdb_cursor_get(cur0_txs_prunable, &kk, &vv, MDB_SET);
@@ -601,6 +612,7 @@ int main(int argc, char* argv[])
   open(env1, paths[1], db_flags, false);
   copy_table(env0, env1, "blocks", MDB_INTEGERKEY, MDB_APPEND);
   copy_table(env0, env1, "block_info", MDB_INTEGERKEY | MDB_DUPSORT| MDB_DUPFIXED, MDB_APPENDDUP, BlockchainLMDB::compare_uint64);
+  copy_table(env0, env1, "block_headers", MDB_INTEGERKEY | MDB_DUPSORT| MDB_DUPFIXED, MDB_APPENDDUP, BlockchainLMDB::compare_uint64);
   copy_table(env0, env1, "block_heights", MDB_INTEGERKEY | MDB_DUPSORT| MDB_DUPFIXED, 0, BlockchainLMDB::compare_hash32);
   //copy_table(env0, env1, "txs", MDB_INTEGERKEY);
   copy_table(env0, env1, "txs_pruned", MDB_INTEGERKEY, MDB_APPEND);
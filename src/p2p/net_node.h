@@ -240,6 +240,7 @@ namespace nodetool
         m_hide_my_port(false),
         m_igd(no_igd),
         m_offline(false),
+        m_io_shards(0),
         is_closing(false),
         m_minimum_version(0),
         m_min_version_override(false),
@@ -266,6 +267,8 @@ namespace nodetool
     size_t get_public_outgoing_connections_count();
     size_t get_public_white_peers_count();
     size_t get_public_gray_peers_count();
+    std::vector<typename net_server::io_shard_stats> get_public_io_shard_stats();
+    cryptonote::levin::notify::fluff_stats get_tx_fluff_stats() const;
     void get_public_peerlist(std::vector<peerlist_entry>& gray, std::vector<peerlist_entry>& white);
     void get_peerlist(std::vector<peerlist_entry>& gray, std::vector<peerlist_entry>& white);
 
@@ -447,6 +450,7 @@ namespace nodetool
     bool m_offline;
     bool m_use_ipv6;
     bool m_require_ipv4;
+    uint32_t m_io_shards;
     uint32_t m_minimum_version;
     bool m_min_version_override;
     std::atomic<bool> is_closing;
@@ -507,6 +511,7 @@ namespace nodetool
     extern const command_line::arg_descriptor<std::string, false, true, 2> arg_p2p_bind_port_ipv6;
     extern const command_line::arg_descriptor<bool>        arg_p2p_use_ipv6;
     extern const command_line::arg_descriptor<bool>        arg_p2p_ignore_ipv4;
+    extern const command_line::arg_descriptor<uint32_t>    arg_p2p_io_shards;
     extern const command_line::arg_descriptor<uint32_t>    arg_p2p_external_port;
     extern const command_line::arg_descriptor<bool>        arg_p2p_allow_local_ip;
     extern const command_line::arg_descriptor<std::vector<std::string> > arg_p2p_add_peer;
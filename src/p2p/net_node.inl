@@ -100,6 +100,7 @@ namespace nodetool
     command_line::add_arg(desc, arg_p2p_bind_port_ipv6, false);
     command_line::add_arg(desc, arg_p2p_use_ipv6);
     command_line::add_arg(desc, arg_p2p_ignore_ipv4);
+    command_line::add_arg(desc, arg_p2p_io_shards);
     command_line::add_arg(desc, arg_p2p_external_port);
     command_line::add_arg(desc, arg_p2p_allow_local_ip);
     command_line::add_arg(desc, arg_p2p_add_peer);
@@ -421,6 +422,7 @@ namespace nodetool
     m_offline = command_line::get_arg(vm, cryptonote::arg_offline);
     m_use_ipv6 = command_line::get_arg(vm, arg_p2p_use_ipv6);
     m_require_ipv4 = !command_line::get_arg(vm, arg_p2p_ignore_ipv4);
+    m_io_shards = command_line::get_arg(vm, arg_p2p_io_shards);
     public_zone.m_notifier = cryptonote::levin::notify{
       public_zone.m_net_server.get_io_context(), public_zone.m_net_server.get_config_shared(), nullptr, true
     };
@@ -717,6 +719,13 @@ namespace nodetool
     if (m_offline)
       return res;
 
+    // the other zones share the public zone's io_context, so only it is sharded
+    if (m_io_shards)
+    {
+      res = public_zone.m_net_server.enable_io_shards(m_io_shards);
+      CHECK_AND_ASSERT_MES(res, false, "Failed to enable p2p io shards");
+    }
+
     //try to bind
     m_ssl_support = epee::net_utils::ssl_support_t::e_ssl_support_disabled;
     for (auto& zone : m_network_zones)
@@ -806,6 +815,8 @@ namespace nodetool
     })); // lambda
 
     network_zone& public_zone = m_network_zones.at(epee::net_utils::zone::public_);
+    // idle handlers run on the main io_context, not on an io shard, so the blocking
+    // connects and handshakes of connections_maker never wait on their own thread
     public_zone.m_net_server.add_idle_handler(boost::bind(&node_server<t_payload_net_handler>::idle_worker, this), 1000);
     public_zone.m_net_server.add_idle_handler(boost::bind(&t_payload_net_handler::on_idle, &m_payload_handler), 1000);
 
@@ -1265,6 +1276,7 @@ namespace nodetool
       return false;
     }
 
+    const uint64_t handshake_start = epee::misc_utils::get_tick_count();
     res = do_handshake_with_peer(pi, *con, just_take_peerlist);
 
     if (!res)
@@ -1277,6 +1289,8 @@ namespace nodetool
       return false;
     }
 
+    zone.m_peerlist.record_peer_handshake(na, epee::misc_utils::get_tick_count() - handshake_start);
+
     if(just_take_peerlist)
     {
       zone.m_net_server.get_config_object().close(con->m_connection_id);
@@ -1337,6 +1351,7 @@ namespace nodetool
       return false;
     }
 
+    const uint64_t handshake_start = epee::misc_utils::get_tick_count();
     res = do_handshake_with_peer(pi, *con, true);
 
     if (!res)
@@ -1349,6 +1364,7 @@ namespace nodetool
       return false;
     }
 
+    zone.m_peerlist.record_peer_handshake(na, epee::misc_utils::get_tick_count() - handshake_start);
     zone.m_net_server.get_config_object().close(con->m_connection_id);
 
     LOG_DEBUG_CC(*con, "CONNECTION HANDSHAKED OK AND CLOSED.");
@@ -1361,8 +1377,13 @@ namespace nodetool
   template <class t_payload_net_handler>
   void nodetool::node_server<t_payload_net_handler>::record_addr_failed(const epee::net_utils::network_address &addr)
   {
-    CRITICAL_REGION_LOCAL(m_conn_fails_cache_lock);
-    m_conn_fails_cache[addr.host_str()] = time(NULL);
+    {
+      CRITICAL_REGION_LOCAL(m_conn_fails_cache_lock);
+      m_conn_fails_cache[addr.host_str()] = time(NULL);
+    }
+    const auto zone = m_network_zones.find(addr.get_zone());
+    if (zone != m_network_zones.end())
+      zone->second.m_peerlist.record_peer_failure(addr);
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
@@ -1445,6 +1466,8 @@ namespace nodetool
       }
 
       std::deque<size_t> filtered;
+      std::vector<double> scores;
+      size_t npreferred = 0;
       const size_t white_peers_count = zone.m_peerlist.get_white_peers_count();
       
       // Look more towards the top of last seen white peers but also consider the ones connected to longer ago. try_count = 5
@@ -1460,9 +1483,10 @@ namespace nodetool
       for (int step = 0; step < 2; ++step)
       {
         size_t idx = 0, skipped = 0;
+        scores.clear();
         bool skip_duplicate_class_B = step == 0;
         MDEBUG("try_count: " << try_count << ", step: " << step << ", limit: " << limit << ", classB: " << classB.size() << ", filtered size: " << filtered.size() << ", idx: " << idx << ", skipped: " << skipped << ", skip_duplicate_class_B: " << skip_duplicate_class_B << ", next_needed_pruning_stripe: " << next_needed_pruning_stripe);
-        zone.m_peerlist.foreach (use_white_list, [&classB, &filtered, &idx, &skipped, skip_duplicate_class_B, limit, next_needed_pruning_stripe](const peerlist_entry &pe){
+        zone.m_peerlist.foreach (use_white_list, [&zone, &classB, &filtered, &scores, &npreferred, &idx, &skipped, skip_duplicate_class_B, limit, next_needed_pruning_stripe, use_white_list](const peerlist_entry &pe){
           if (filtered.size() >= limit)
             return false;
           bool skip = false;
@@ -1477,7 +1501,12 @@ namespace nodetool
           else if (next_needed_pruning_stripe == 0 || pe.pruning_seed == 0)
             filtered.push_back(idx);
           else if (next_needed_pruning_stripe == tools::get_pruning_stripe(pe.pruning_seed))
+          {
             filtered.push_front(idx);
+            ++npreferred;
+          }
+          if (use_white_list)
+            scores.push_back(zone.m_peerlist.get_peer_score(pe.adr));
           ++idx;
           return true;
         });
@@ -1493,6 +1522,12 @@ namespace nodetool
       }
       if (use_white_list)
       {
+        // peers which served us best (fast sync, quick handshake, no failures) are tried first,
+        // the pick below being biased towards the front
+        const auto by_score = [&scores](size_t a, size_t b) { return scores[a] > scores[b]; };
+        std::stable_sort(filtered.begin(), filtered.begin() + npreferred, by_score);
+        std::stable_sort(filtered.begin() + npreferred, filtered.end(), by_score);
+
         // if using the white list, we first pick in the set of peers we've already been using earlier
         random_index = get_random_index_with_fixed_probability(std::min<uint64_t>(filtered.size() - 1, white_limit));
         CRITICAL_REGION_LOCAL(m_used_stripe_peers_mutex);
@@ -1796,6 +1831,28 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  std::vector<typename node_server<t_payload_net_handler>::net_server::io_shard_stats> node_server<t_payload_net_handler>::get_public_io_shard_stats()
+  {
+    auto public_zone = m_network_zones.find(epee::net_utils::zone::public_);
+    if (public_zone == m_network_zones.end())
+      return {};
+    return public_zone->second.m_net_server.get_io_shard_stats();
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  cryptonote::levin::notify::fluff_stats node_server<t_payload_net_handler>::get_tx_fluff_stats() const
+  {
+    cryptonote::levin::notify::fluff_stats total{0, 0};
+    for (const auto& network : m_network_zones)
+    {
+      const auto stats = network.second.m_notifier.get_fluff_stats();
+      total.messages += stats.messages;
+      total.txs += stats.txs;
+    }
+    return total;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   void node_server<t_payload_net_handler>::get_public_peerlist(std::vector<peerlist_entry>& gray, std::vector<peerlist_entry>& white)
   {
     auto public_zone = m_network_zones.find(epee::net_utils::zone::public_);
@@ -2537,6 +2594,8 @@ namespace nodetool
 
       zone.m_peerlist.remove_from_peer_anchor(na);
     }
+    if (!context.m_is_income)
+      zone.m_peerlist.record_peer_sync_rate(context.m_remote_address, static_cast<uint64_t>(context.m_span_bandwidth));
 
     m_payload_handler.on_connection_close(context);
 
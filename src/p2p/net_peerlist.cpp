@@ -30,6 +30,7 @@
 #include "net_peerlist.h"
 
 #include <algorithm>
+#include <cmath>
 #include <functional>
 #include <fstream>
 #include <iterator>
@@ -145,6 +146,17 @@ namespace nodetool
     save_peers(a, boost::range::join(elem.ours.white, elem.other.white));
     save_peers(a, boost::range::join(elem.ours.gray, elem.other.gray));
     save_peers(a, boost::range::join(elem.ours.anchor, elem.other.anchor));
+    save_peers(a, boost::range::join(elem.ours.quality, elem.other.quality));
+  }
+
+  template<typename Archive>
+  void load_quality(Archive& a, std::istream& src, peerlist_types& elem)
+  {
+    // files written before peer quality was recorded end after the anchors
+    if (src.good() && src.peek() != std::istream::traits_type::eof())
+      elem.quality = load_peers<peer_quality_entry>(a, 0);
+    else if (src.eof() && !src.fail())
+      src.clear();
   }
 
   boost::optional<peerlist_storage> peerlist_storage::open(std::istream& src, const bool new_format)
@@ -156,11 +168,13 @@ namespace nodetool
       {
         boost::archive::portable_binary_iarchive a{src};
         a >> out.m_types;
+        load_quality(a, src, out.m_types);
       }
       else
       {
         boost::archive::binary_iarchive a{src};
         a >> out.m_types;
+        load_quality(a, src, out.m_types);
       }
 
       if (src.good())
@@ -168,6 +182,7 @@ namespace nodetool
         std::sort(out.m_types.white.begin(), out.m_types.white.end(), by_zone{});
         std::sort(out.m_types.gray.begin(), out.m_types.gray.end(), by_zone{});
         std::sort(out.m_types.anchor.begin(), out.m_types.anchor.end(), by_zone{});
+        std::sort(out.m_types.quality.begin(), out.m_types.quality.end(), by_zone{});
         return {std::move(out)};
       }
     }
@@ -242,6 +257,7 @@ namespace nodetool
     out.white = do_take_zone(m_types.white, zone);
     out.gray = do_take_zone(m_types.gray, zone);
     out.anchor = do_take_zone(m_types.anchor, zone);
+    out.quality = do_take_zone(m_types.quality, zone);
     return out;
   }
 
@@ -255,6 +271,7 @@ namespace nodetool
     add_peers(m_peers_white.get<by_addr>(), std::move(peers.white));
     add_peers(m_peers_gray.get<by_addr>(), std::move(peers.gray));
     add_peers(m_peers_anchor.get<by_addr>(), std::move(peers.anchor));
+    add_peers(m_peers_quality.get<by_addr>(), std::move(peers.quality));
     m_allow_local_ip = allow_local_ip;
     return true;
   }
@@ -276,5 +293,89 @@ namespace nodetool
     copy_peers(peers.white, m_peers_white.get<by_addr>());
     copy_peers(peers.gray, m_peers_gray.get<by_addr>());
     copy_peers(peers.anchor, m_peers_anchor.get<by_addr>());
+    peers.quality.reserve(peers.quality.size() + m_peers_quality.size());
+    copy_peers(peers.quality, m_peers_quality.get<by_addr>());
+  }
+
+  peer_quality_entry peerlist_manager::get_peer_quality(const epee::net_utils::network_address& addr)
+  {
+    const auto it = m_peers_quality.get<by_addr>().find(addr);
+    if (it != m_peers_quality.get<by_addr>().end())
+      return *it;
+    peer_quality_entry pq{};
+    pq.adr = addr;
+    return pq;
+  }
+
+  void peerlist_manager::set_peer_quality(const peer_quality_entry& pq)
+  {
+    auto& by_addr_index = m_peers_quality.get<by_addr>();
+    const auto it = by_addr_index.find(pq.adr);
+    if (it != by_addr_index.end())
+    {
+      by_addr_index.replace(it, pq);
+      return;
+    }
+    by_addr_index.insert(pq);
+
+    // only keep records for peers we may still connect to
+    if (m_peers_quality.size() > P2P_LOCAL_WHITE_PEERLIST_LIMIT + P2P_LOCAL_GRAY_PEERLIST_LIMIT)
+    {
+      for (auto i = by_addr_index.begin(); i != by_addr_index.end(); )
+      {
+        if (i->adr != pq.adr && m_peers_white.get<by_addr>().count(i->adr) == 0 && m_peers_gray.get<by_addr>().count(i->adr) == 0)
+          i = by_addr_index.erase(i);
+        else
+          ++i;
+      }
+    }
+  }
+
+  void peerlist_manager::record_peer_handshake(const epee::net_utils::network_address& addr, uint32_t handshake_ms)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_quality_entry pq = get_peer_quality(addr);
+    handshake_ms = std::max<uint32_t>(handshake_ms, 1);
+    pq.handshake_ms = pq.handshake_ms ? (pq.handshake_ms * 3 + handshake_ms) / 4 : handshake_ms;
+    ++pq.handshakes;
+    pq.failures = 0;
+    set_peer_quality(pq);
+  }
+
+  void peerlist_manager::record_peer_sync_rate(const epee::net_utils::network_address& addr, uint64_t sync_rate)
+  {
+    if (sync_rate == 0)
+      return;
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_quality_entry pq = get_peer_quality(addr);
+    pq.sync_rate = pq.sync_rate ? (pq.sync_rate * 3 + sync_rate) / 4 : sync_rate;
+    set_peer_quality(pq);
+  }
+
+  void peerlist_manager::record_peer_failure(const epee::net_utils::network_address& addr)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_quality_entry pq = get_peer_quality(addr);
+    ++pq.failures;
+    pq.last_failure = time(NULL);
+    set_peer_quality(pq);
+  }
+
+  double peerlist_manager::get_peer_score(const epee::net_utils::network_address& addr)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    const auto it = m_peers_quality.get<by_addr>().find(addr);
+    if (it == m_peers_quality.get<by_addr>().end())
+      return 0.0;
+
+    // peers we know nothing about score 0: each doubling of the sync rate is worth
+    // a quarter second of handshake latency, or half a failed connection attempt
+    double score = 0.0;
+    if (it->sync_rate)
+      score += std::log2(1.0 + it->sync_rate / 1024.0);
+    if (it->handshake_ms)
+      score -= it->handshake_ms / 250.0;
+    score -= 2.0 * it->failures;
+    return score;
   }
 }
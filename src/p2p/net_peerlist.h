@@ -58,6 +58,7 @@ namespace nodetool
     std::vector<peerlist_entry> white;
     std::vector<peerlist_entry> gray;
     std::vector<anchor_peerlist_entry> anchor;
+    std::vector<peer_quality_entry> quality;
   };
 
   class peerlist_storage
@@ -121,6 +122,10 @@ namespace nodetool
     bool get_and_empty_anchor_peerlist(std::vector<anchor_peerlist_entry>& apl);
     bool remove_from_peer_anchor(const epee::net_utils::network_address& addr);
     bool remove_from_peer_white(const peerlist_entry& pe);
+    void record_peer_handshake(const epee::net_utils::network_address& addr, uint32_t handshake_ms);
+    void record_peer_sync_rate(const epee::net_utils::network_address& addr, uint64_t sync_rate);
+    void record_peer_failure(const epee::net_utils::network_address& addr);
+    double get_peer_score(const epee::net_utils::network_address& addr);
     
   private:
     struct by_time{};
@@ -181,9 +186,19 @@ namespace nodetool
       >
     > anchor_peers_indexed;
 
+    typedef boost::multi_index_container<
+      peer_quality_entry,
+      boost::multi_index::indexed_by<
+      // access by peer_quality_entry::adr
+      boost::multi_index::ordered_unique<boost::multi_index::tag<by_addr>, boost::multi_index::member<peer_quality_entry,epee::net_utils::network_address,&peer_quality_entry::adr> >
+      >
+    > peer_quality_indexed;
+
   private: 
     void trim_white_peerlist();
     void trim_gray_peerlist();
+    peer_quality_entry get_peer_quality(const epee::net_utils::network_address& addr);
+    void set_peer_quality(const peer_quality_entry& pq);
 
     friend class boost::serialization::access;
     epee::critical_section m_peerlist_lock;
@@ -194,6 +209,7 @@ namespace nodetool
     peers_indexed m_peers_gray;
     peers_indexed m_peers_white;
     anchor_peers_indexed m_peers_anchor;
+    peer_quality_indexed m_peers_quality;
   };
   //--------------------------------------------------------------------------------------------------
   inline void peerlist_manager::trim_gray_peerlist()
@@ -237,5 +237,16 @@ namespace boost
       a & pl.id;
       a & pl.first_seen;
     }
+
+    template <class Archive, class ver_type>
+    inline void serialize(Archive &a, nodetool::peer_quality_entry& pq, const ver_type ver)
+    {
+      a & pq.adr;
+      a & pq.handshake_ms;
+      a & pq.sync_rate;
+      a & pq.handshakes;
+      a & pq.failures;
+      a & pq.last_failure;
+    }
   }
 }
@@ -106,6 +106,27 @@ namespace nodetool
   };
   typedef anchor_peerlist_entry_base<epee::net_utils::network_address> anchor_peerlist_entry;
 
+  template<typename AddressType>
+  struct peer_quality_entry_base
+  {
+    AddressType adr;
+    uint32_t handshake_ms;    // smoothed handshake round trip, 0 if never measured
+    uint64_t sync_rate;       // smoothed block download rate in bytes/s, 0 if never measured
+    uint32_t handshakes;      // successful handshakes
+    uint32_t failures;        // connection failures since the last successful handshake
+    int64_t last_failure;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(adr)
+      KV_SERIALIZE(handshake_ms)
+      KV_SERIALIZE(sync_rate)
+      KV_SERIALIZE(handshakes)
+      KV_SERIALIZE(failures)
+      KV_SERIALIZE(last_failure)
+    END_KV_SERIALIZE_MAP()
+  };
+  typedef peer_quality_entry_base<epee::net_utils::network_address> peer_quality_entry;
+
   template<typename AddressType>
   struct connection_entry_base
   {
@@ -40,6 +40,7 @@ using namespace epee;
 #include "common/download.h"
 #include "common/util.h"
 #include "common/perf_timer.h"
+#include "common/threadpool.h"
 #include "int-util.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_basic/account.h"
@@ -154,6 +155,32 @@ namespace cryptonote
     return set_bootstrap_daemon(address, credentials);
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  rpc_response_cache::token core_rpc_server::get_response_cache_token()
+  {
+    // read from the db directly, so that cache hits never wait on the blockchain lock
+    return {m_core.get_blockchain_storage().get_db().top_block_hash(), m_core.get_pool_cookie()};
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_cached_response(const std::string &method, const std::string &request, const rpc_response_cache::token &token, std::string &body)
+  {
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_bootstrap_daemon_mutex);
+      if (m_should_use_bootstrap_daemon)
+        return false;
+    }
+    return m_response_cache.get(method, request, token, body);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::cache_response(const std::string &method, const std::string &request, const rpc_response_cache::token &token, const std::string &body)
+  {
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_bootstrap_daemon_mutex);
+      if (m_should_use_bootstrap_daemon)
+        return;
+    }
+    m_response_cache.put(method, request, token, body);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   boost::optional<std::string> core_rpc_server::get_random_public_node()
   {
     COMMAND_RPC_GET_PUBLIC_NODES::request request;
@@ -381,6 +408,11 @@ namespace cryptonote
       CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::m_lock_get_global_throttle_out);
       epee::net_utils::network_throttle_manager::get_global_throttle_out().get_stats(res.total_packets_out, res.total_bytes_out);
     }
+    for (const auto &shard: m_p2p.get_public_io_shard_stats())
+      res.io_shards.push_back({shard.connections, shard.accepted, shard.handlers});
+    const auto fluff = m_p2p.get_tx_fluff_stats();
+    res.tx_relay_messages = fluff.messages;
+    res.tx_relay_txs = fluff.txs;
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -426,52 +458,25 @@ namespace cryptonote
       return false;
     }
 
-    size_t pruned_size = 0, unpruned_size = 0, ntxes = 0;
+    size_t size = 0, ntxes = 0;
     res.blocks.reserve(bs.size());
     res.output_indices.reserve(bs.size());
     for(auto& bd: bs)
     {
       res.blocks.resize(res.blocks.size()+1);
-      res.blocks.back().pruned = req.prune;
-      res.blocks.back().block = bd.first.first;
-      pruned_size += bd.first.first.size();
-      unpruned_size += bd.first.first.size();
-      res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
+      res.output_indices.resize(res.output_indices.size()+1);
       ntxes += bd.second.size();
-      res.output_indices.back().indices.reserve(1 + bd.second.size());
-      if (req.no_miner_tx)
-        res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
-      res.blocks.back().txs.reserve(bd.second.size());
-      for (std::vector<std::pair<crypto::hash, cryptonote::blobdata>>::iterator i = bd.second.begin(); i != bd.second.end(); ++i)
+      if (!fill_block_complete_entry(bd, req.prune, req.no_miner_tx, res.blocks.back(), res.output_indices.back()))
       {
-        unpruned_size += i->second.size();
-        res.blocks.back().txs.push_back({std::move(i->second), crypto::null_hash});
-        i->second.clear();
-        i->second.shrink_to_fit();
-        pruned_size += res.blocks.back().txs.back().blob.size();
-      }
-
-      const size_t n_txes_to_lookup = bd.second.size() + (req.no_miner_tx ? 0 : 1);
-      if (n_txes_to_lookup > 0)
-      {
-        std::vector<std::vector<uint64_t>> indices;
-        bool r = m_core.get_tx_outputs_gindexs(req.no_miner_tx ? bd.second.front().first : bd.first.second, n_txes_to_lookup, indices);
-        if (!r)
-        {
-          res.status = "Failed";
-          return false;
-        }
-        if (indices.size() != n_txes_to_lookup || res.output_indices.back().indices.size() != (req.no_miner_tx ? 1 : 0))
-        {
-          res.status = "Failed";
-          return false;
-        }
-        for (size_t i = 0; i < indices.size(); ++i)
-          res.output_indices.back().indices.push_back({std::move(indices[i])});
+        res.status = "Failed";
+        return false;
       }
+      size += res.blocks.back().block.size();
+      for (const auto &tx: res.blocks.back().txs)
+        size += tx.blob.size();
     }
 
-    MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes, pruned size " << pruned_size << ", unpruned size " << unpruned_size);
+    MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes, size " << size);
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -502,6 +507,159 @@ namespace cryptonote
       return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::fill_block_complete_entry(std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>> &bd, bool prune, bool no_miner_tx, block_complete_entry &entry, COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices &output_indices)
+  {
+    entry.pruned = prune;
+    entry.block = std::move(bd.first.first);
+    output_indices.indices.reserve(1 + bd.second.size());
+    if (no_miner_tx)
+      output_indices.indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
+    entry.txs.reserve(bd.second.size());
+    for (std::vector<std::pair<crypto::hash, cryptonote::blobdata>>::iterator i = bd.second.begin(); i != bd.second.end(); ++i)
+    {
+      entry.txs.push_back({std::move(i->second), crypto::null_hash});
+      i->second.clear();
+      i->second.shrink_to_fit();
+    }
+
+    const size_t n_txes_to_lookup = bd.second.size() + (no_miner_tx ? 0 : 1);
+    if (n_txes_to_lookup > 0)
+    {
+      std::vector<std::vector<uint64_t>> indices;
+      bool r = m_core.get_tx_outputs_gindexs(no_miner_tx ? bd.second.front().first : bd.first.second, n_txes_to_lookup, indices);
+      if (!r)
+        return false;
+      if (indices.size() != n_txes_to_lookup || output_indices.indices.size() != (no_miner_tx ? 1 : 0))
+        return false;
+      for (size_t i = 0; i < indices.size(); ++i)
+        output_indices.indices.push_back({std::move(indices[i])});
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_blocks_stream(const COMMAND_RPC_GET_BLOCKS_STREAM::request& req, std::function<bool(std::string&)>& stream, const connection_context *ctx)
+  {
+    RPC_TRACKER(get_blocks_stream);
+
+    // blocks are read in small batches as the client drains the connection,
+    // so the full response is never held in memory at once
+    static const size_t blocks_per_batch = 20;
+    typedef std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > > blocks_t;
+
+    struct stream_state
+    {
+      bool prune;
+      bool no_miner_tx;
+      uint64_t next_height;
+      uint64_t remaining;
+      crypto::hash last_hash;
+      std::string pending;
+      bool done;
+    };
+    auto state = std::make_shared<stream_state>();
+    state->prune = req.prune;
+    state->no_miner_tx = req.no_miner_tx;
+    state->next_height = 0;
+    state->remaining = COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT;
+    state->last_hash = crypto::null_hash;
+    state->done = false;
+
+    // appends one frame per block, and the end frame once the cap or the top of the chain is reached
+    const auto append_blocks = [this](stream_state &s, blocks_t &bs, uint64_t current_height, std::string &out)
+    {
+      cryptonote::block b;
+      if (!parse_and_validate_block_from_blob(bs.back().first.first, b))
+        throw std::runtime_error("Failed to parse block at height " + std::to_string(s.next_height + bs.size() - 1));
+      s.last_hash = get_block_hash(b);
+      for (auto &bd: bs)
+      {
+        COMMAND_RPC_GET_BLOCKS_STREAM::block entry;
+        if (!fill_block_complete_entry(bd, s.prune, s.no_miner_tx, entry.block, entry.output_indices))
+          throw std::runtime_error("Failed to get output indices at height " + std::to_string(s.next_height));
+        COMMAND_RPC_GET_BLOCKS_STREAM::append_frame(out, static_cast<COMMAND_RPC_GET_BLOCKS_STREAM::block_t&>(entry));
+        ++s.next_height;
+        --s.remaining;
+      }
+      if (s.remaining == 0 || s.next_height >= current_height)
+      {
+        COMMAND_RPC_GET_BLOCKS_STREAM::append_end_frame(out);
+        s.done = true;
+      }
+    };
+
+    COMMAND_RPC_GET_BLOCKS_STREAM::header header;
+    header.untrusted = false;
+    bool use_bootstrap_daemon;
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_bootstrap_daemon_mutex);
+      use_bootstrap_daemon = m_bootstrap_daemon.get() != nullptr && m_should_use_bootstrap_daemon;
+    }
+    blocks_t bs;
+    if (use_bootstrap_daemon)
+    {
+      // not proxied, clients fall back to get_blocks.bin
+      header.status = CORE_RPC_STATUS_BUSY;
+    }
+    else if (!req.block_ids.empty() && m_core.get_tail_id() == req.block_ids.front())
+    {
+      header.start_height = 0;
+      header.current_height = m_core.get_current_blockchain_height();
+      header.status = CORE_RPC_STATUS_OK;
+    }
+    else
+    {
+      if (!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, header.current_height, header.start_height, req.prune, !req.no_miner_tx, blocks_per_batch))
+      {
+        add_host_fail(ctx);
+        return false;
+      }
+      header.status = CORE_RPC_STATUS_OK;
+      state->next_height = header.start_height;
+    }
+
+    COMMAND_RPC_GET_BLOCKS_STREAM::append_frame(state->pending, static_cast<COMMAND_RPC_GET_BLOCKS_STREAM::header_t&>(header));
+    if (bs.empty())
+    {
+      COMMAND_RPC_GET_BLOCKS_STREAM::append_end_frame(state->pending);
+      state->done = true;
+    }
+    else
+    {
+      append_blocks(*state, bs, header.current_height, state->pending);
+    }
+
+    stream = [this, state, append_blocks](std::string &chunk) -> bool
+    {
+      if (!state->pending.empty())
+      {
+        chunk = std::move(state->pending);
+        state->pending.clear();
+        return true;
+      }
+      if (state->done)
+        return false;
+
+      blocks_t bs;
+      uint64_t current_height = 0, start_height = 0;
+      const bool r = m_core.find_blockchain_supplement(state->next_height, std::list<crypto::hash>(), bs, current_height, start_height,
+          state->prune, !state->no_miner_tx, std::min<uint64_t>(blocks_per_batch, state->remaining));
+
+      // the chain was reorganized under us: end cleanly, the client asks again from its new top
+      cryptonote::block b;
+      if (r && !bs.empty() && (!parse_and_validate_block_from_blob(bs.front().first.first, b) || b.prev_id != state->last_hash))
+        bs.clear();
+      if (!r || bs.empty())
+      {
+        COMMAND_RPC_GET_BLOCKS_STREAM::append_end_frame(chunk);
+        state->done = true;
+        return true;
+      }
+      append_blocks(*state, bs, current_height, chunk);
+      return true;
+    };
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_blocks_by_height(const COMMAND_RPC_GET_BLOCKS_BY_HEIGHT::request& req, COMMAND_RPC_GET_BLOCKS_BY_HEIGHT::response& res, const connection_context *ctx)
   {
     RPC_TRACKER(get_blocks_by_height);
@@ -1862,6 +2020,38 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::fill_block_header_response(const block_header_info& header, bool orphan_status, block_header_response& response)
+  {
+    PERF_TIMER(fill_block_header_response);
+    response.major_version = header.major_version;
+    response.minor_version = header.minor_version;
+    response.timestamp = header.timestamp;
+    response.prev_hash = string_tools::pod_to_hex(header.prev_id);
+    response.nonce = header.nonce;
+    response.orphan_status = orphan_status;
+    response.height = header.height;
+    response.depth = m_core.get_current_blockchain_height() - header.height - 1;
+    response.hash = string_tools::pod_to_hex(header.hash);
+    response.difficulty = header.difficulty;
+    store_difficulty(header.cumulative_difficulty, response.cumulative_difficulty, response.cumulative_difficulty_top64);
+    response.reward = header.reward;
+    response.block_size = response.block_weight = header.weight;
+    response.num_txes = header.num_txes;
+    response.long_term_weight = header.long_term_weight;
+    response.miner_tx_hash = string_tools::pod_to_hex(header.miner_tx_hash);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::fill_pruning_progress(const pruning_progress& progress, pruning_progress_response& response)
+  {
+    response.running = progress.running;
+    response.phase = progress.phase;
+    response.done = progress.done;
+    response.total = progress.total;
+    response.elapsed_ms = progress.elapsed_ms;
+    response.eta_seconds = progress.eta_seconds;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   template <typename COMMAND_TYPE>
   bool core_rpc_server::use_bootstrap_daemon_if_necessary(const invoke_http_mode &mode, const std::string &command_name, const typename COMMAND_TYPE::request& req, typename COMMAND_TYPE::response& res, bool &r)
   {
@@ -2043,33 +2233,23 @@ namespace cryptonote
       error_resp.message = "Invalid start/end heights.";
       return false;
     }
-    for (uint64_t h = req.start_height; h <= req.end_height; ++h)
+    // served from the block header index, so no block blob needs to be parsed
+    std::vector<block_header_info> headers;
+    try
+    {
+      headers = m_core.get_blockchain_storage().get_db().get_block_headers_range(req.start_height, req.end_height);
+    }
+    catch (const std::exception &e)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+      error_resp.message = std::string("Internal error: can't get block headers: ") + e.what();
+      return false;
+    }
+    res.headers.reserve(headers.size());
+    for (const block_header_info &header: headers)
     {
-      crypto::hash block_hash = m_core.get_block_id_by_height(h);
-      block blk;
-      bool have_block = m_core.get_block_by_hash(block_hash, blk);
-      if (!have_block)
-      {
-        error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
-        error_resp.message = "Internal error: can't get block by height. Height = " + boost::lexical_cast<std::string>(h) + ". Hash = " + epee::string_tools::pod_to_hex(block_hash) + '.';
-        return false;
-      }
-      if (blk.miner_tx.vin.size() != 1 || blk.miner_tx.vin.front().type() != typeid(txin_gen))
-      {
-        error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
-        error_resp.message = "Internal error: coinbase transaction in the block has the wrong type";
-        return false;
-      }
-      uint64_t block_height = boost::get<txin_gen>(blk.miner_tx.vin.front()).height;
-      if (block_height != h)
-      {
-        error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
-        error_resp.message = "Internal error: coinbase transaction in the block has the wrong height";
-        return false;
-      }
       res.headers.push_back(block_header_response());
-      const bool restricted = m_restricted && ctx;
-      bool response_filled = fill_block_header_response(blk, false, block_height, block_hash, res.headers.back());
+      bool response_filled = fill_block_header_response(header, false, res.headers.back());
       if (!response_filled)
       {
         error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
@@ -2721,10 +2901,10 @@ namespace cryptonote
   {
     RPC_TRACKER(sync_info);
 
-    crypto::hash top_hash;
-    m_core.get_blockchain_top(res.height, top_hash);
-    ++res.height; // turn top block height into blockchain height
+    // does not take the blockchain lock, which a running prune holds
+    res.height = m_core.get_current_blockchain_height();
     res.target_height = m_core.get_target_blockchain_height();
+    fill_pruning_progress(m_core.get_blockchain_storage().get_db().get_pruning_progress(), res.pruning);
     res.next_needed_pruning_seed = m_p2p.get_payload_object().get_next_needed_pruning_stripe().second;
 
     for (const auto &c: m_p2p.get_payload_object().get_connections())
@@ -2853,6 +3033,18 @@ namespace cryptonote
   {
     RPC_TRACKER(prune_blockchain);
 
+    // a running prune holds the blockchain lock until it is done, report on it instead of queuing behind it
+    const pruning_progress progress = m_core.get_blockchain_storage().get_db().get_pruning_progress();
+    if (progress.running)
+    {
+      res.in_progress = true;
+      fill_pruning_progress(progress, res.progress);
+      res.pruning_seed = m_core.get_blockchain_pruning_seed();
+      res.pruned = res.pruning_seed != 0;
+      res.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+
     try
     {
       if (!(req.check ? m_core.check_blockchain_pruning() : m_core.prune_blockchain()))
@@ -2874,6 +3066,116 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_snapshot_blockchain(const COMMAND_RPC_SNAPSHOT_BLOCKCHAIN::request& req, COMMAND_RPC_SNAPSHOT_BLOCKCHAIN::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    RPC_TRACKER(snapshot_blockchain);
+
+    BlockchainDB &db = m_core.get_blockchain_storage().get_db();
+    if (!req.check)
+    {
+      if (req.path.empty())
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
+        error_resp.message = "No snapshot path given";
+        return false;
+      }
+      try
+      {
+        m_core.get_blockchain_storage().start_db_snapshot(req.path, req.max_bytes_per_second);
+      }
+      catch (const std::exception &e)
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+        error_resp.message = std::string("Failed to start snapshot: ") + e.what();
+        return false;
+      }
+    }
+
+    const db_snapshot_status status = db.get_snapshot_status();
+    res.running = status.running;
+    res.finished = status.finished;
+    res.success = status.success;
+    res.path = status.path;
+    res.error = status.error;
+    res.max_bytes_per_second = status.max_bytes_per_second;
+    res.source_size = status.source_size;
+    res.estimated_size = status.estimated_size;
+    res.bytes_written = status.bytes_written;
+    res.elapsed_ms = status.elapsed_ms;
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_db_stats(const COMMAND_RPC_GET_DB_STATS::request& req, COMMAND_RPC_GET_DB_STATS::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    RPC_TRACKER(get_db_stats);
+
+    db_stats stats;
+    try
+    {
+      stats = m_core.get_blockchain_storage().get_db().get_db_stats();
+    }
+    catch (const std::exception &e)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+      error_resp.message = std::string("Failed to get database statistics: ") + e.what();
+      return false;
+    }
+
+    res.map_size = stats.map_size;
+    res.used_size = stats.used_size;
+    res.page_size = stats.page_size;
+    res.readers = stats.readers;
+    res.max_readers = stats.max_readers;
+    res.resizes = stats.resizes;
+    res.resize_time_ms = stats.resize_time_ms;
+    res.major_page_faults = stats.major_page_faults;
+    res.minor_page_faults = stats.minor_page_faults;
+    res.tables.reserve(stats.tables.size());
+    for (const db_table_stats &t: stats.tables)
+      res.tables.push_back({t.name, t.entries, t.size, t.depth, t.lookups, t.misses, t.cursor_steps, t.bytes_read, t.writes, t.bytes_written, t.deletes});
+    const auto fill_histogram = [](const db_latency_histogram &h, COMMAND_RPC_GET_DB_STATS::histogram &out) {
+      out.count = h.count;
+      out.total_us = h.total_us;
+      out.max_us = h.max_us;
+      out.buckets.assign(h.buckets, h.buckets + db_latency_histogram::num_buckets);
+    };
+    fill_histogram(stats.read_txn, res.read_txn);
+    fill_histogram(stats.write_txn, res.write_txn);
+    fill_histogram(stats.commit, res.commit);
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_threadpool_stats(const COMMAND_RPC_GET_THREADPOOL_STATS::request& req, COMMAND_RPC_GET_THREADPOOL_STATS::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    RPC_TRACKER(get_threadpool_stats);
+
+    static const char *names[tools::threadpool::priority_count] = {"high", "normal", "low"};
+    const tools::threadpool::stats stats = tools::threadpool::getInstance().get_stats();
+    res.threads = stats.threads;
+    for (size_t i = 0; i < tools::threadpool::priority_count; ++i)
+    {
+      const tools::threadpool::priority_stats &p = stats.priorities[i];
+      res.priorities.push_back({names[i], p.queued, p.submitted, p.completed, p.stolen, p.wait_us, p.max_wait_us, p.run_us});
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_response_cache_stats(const COMMAND_RPC_GET_RESPONSE_CACHE_STATS::request& req, COMMAND_RPC_GET_RESPONSE_CACHE_STATS::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    RPC_TRACKER(get_response_cache_stats);
+
+    std::map<std::string, rpc_response_cache::method_stats> methods;
+    m_response_cache.get_stats(methods, res.entries, res.invalidations);
+    res.methods.reserve(methods.size());
+    for (const auto &m: methods)
+      res.methods.push_back({m.first, m.second.hits, m.second.misses});
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_flush_cache(const COMMAND_RPC_FLUSH_CACHE::request& req, COMMAND_RPC_FLUSH_CACHE::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
     RPC_TRACKER(flush_cache);
@@ -32,6 +32,7 @@
 #pragma once
 
 #include "string_tools.h"
+#include "storages/portable_storage_template_helper.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "cryptonote_basic/difficulty.h"
@@ -87,7 +88,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 3
-#define CORE_RPC_VERSION_MINOR 0
+#define CORE_RPC_VERSION_MINOR 7
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -189,6 +190,76 @@ namespace cryptonote
     typedef epee::misc_utils::struct_init<response_t> response;
   };
 
+  // Same request as get_blocks.bin, but the response is written as blocks are
+  // read, with chunked transfer encoding. The body is a sequence of frames,
+  // each a 4 byte little endian length followed by that many bytes of
+  // portable storage: one header, then one block per frame, then an empty
+  // frame. A body without the empty frame was cut short.
+  struct COMMAND_RPC_GET_BLOCKS_STREAM
+  {
+    typedef COMMAND_RPC_GET_BLOCKS_FAST::request request;
+
+    struct header_t: public rpc_response_base
+    {
+      uint64_t    start_height;
+      uint64_t    current_height;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_response_base)
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(current_height)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<header_t> header;
+
+    struct block_t
+    {
+      block_complete_entry block;
+      COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices output_indices;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block)
+        KV_SERIALIZE(output_indices)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<block_t> block;
+
+    template<typename T>
+    static void append_frame(std::string &out, T &value)
+    {
+      std::string payload;
+      epee::serialization::store_t_to_binary(value, payload);
+      append_frame_size(out, payload.size());
+      out += payload;
+    }
+
+    static void append_end_frame(std::string &out)
+    {
+      append_frame_size(out, 0);
+    }
+
+    // takes the next whole frame off the front of data, empty for the end frame
+    static bool read_frame(epee::span<const uint8_t> &data, epee::span<const uint8_t> &frame)
+    {
+      if (data.size() < 4)
+        return false;
+      const uint32_t size = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+      if (data.size() - 4 < size)
+        return false;
+      frame = {data.data() + 4, size};
+      data.remove_prefix(4 + size);
+      return true;
+    }
+
+  private:
+    static void append_frame_size(std::string &out, size_t size)
+    {
+      const uint32_t size32 = size;
+      for (int i = 0; i < 4; ++i)
+        out += (char)((size32 >> (8 * i)) & 0xff);
+    }
+  };
+
   struct COMMAND_RPC_GET_BLOCKS_BY_HEIGHT
   {
     struct request_t: public rpc_request_base
@@ -737,6 +808,19 @@ namespace cryptonote
     typedef epee::misc_utils::struct_init<request_t> request;
 
 
+    struct io_shard
+    {
+      uint64_t connections;
+      uint64_t accepted;
+      uint64_t handlers;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(connections)
+        KV_SERIALIZE(accepted)
+        KV_SERIALIZE(handlers)
+      END_KV_SERIALIZE_MAP()
+    };
+
     struct response_t: public rpc_response_base
     {
       uint64_t start_time;
@@ -744,6 +828,9 @@ namespace cryptonote
       uint64_t total_bytes_in;
       uint64_t total_packets_out;
       uint64_t total_bytes_out;
+      std::vector<io_shard> io_shards; // empty unless --p2p-io-shards is used
+      uint64_t tx_relay_messages;
+      uint64_t tx_relay_txs;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_response_base)
@@ -752,6 +839,9 @@ namespace cryptonote
         KV_SERIALIZE(total_bytes_in)
         KV_SERIALIZE(total_packets_out)
         KV_SERIALIZE(total_bytes_out)
+        KV_SERIALIZE(io_shards)
+        KV_SERIALIZE(tx_relay_messages)
+        KV_SERIALIZE(tx_relay_txs)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -2083,6 +2173,25 @@ namespace cryptonote
     typedef epee::misc_utils::struct_init<response_t> response;
   };
 
+  struct pruning_progress_response
+  {
+    bool running;
+    std::string phase;
+    uint64_t done;
+    uint64_t total;
+    uint64_t elapsed_ms;
+    uint64_t eta_seconds;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(running)
+      KV_SERIALIZE(phase)
+      KV_SERIALIZE(done)
+      KV_SERIALIZE(total)
+      KV_SERIALIZE(elapsed_ms)
+      KV_SERIALIZE(eta_seconds)
+    END_KV_SERIALIZE_MAP()
+  };
+
   struct COMMAND_RPC_SYNC_INFO
   {
     struct request_t: public rpc_request_base
@@ -2131,6 +2240,7 @@ namespace cryptonote
       std::list<peer> peers;
       std::list<span> spans;
       std::string overview;
+      pruning_progress_response pruning;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_response_base)
@@ -2140,6 +2250,7 @@ namespace cryptonote
         KV_SERIALIZE(peers)
         KV_SERIALIZE(spans)
         KV_SERIALIZE(overview)
+        KV_SERIALIZE(pruning)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -2264,11 +2375,238 @@ namespace cryptonote
     {
       bool pruned;
       uint32_t pruning_seed;
+      bool in_progress;
+      pruning_progress_response progress;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_response_base)
         KV_SERIALIZE(pruned)
         KV_SERIALIZE(pruning_seed)
+        KV_SERIALIZE(in_progress)
+        KV_SERIALIZE(progress)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
+  struct COMMAND_RPC_SNAPSHOT_BLOCKCHAIN
+  {
+    struct request_t: public rpc_request_base
+    {
+      std::string path;
+      uint64_t max_bytes_per_second;
+      bool check;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_request_base)
+        KV_SERIALIZE(path)
+        KV_SERIALIZE_OPT(max_bytes_per_second, (uint64_t)0)
+        KV_SERIALIZE_OPT(check, false)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct response_t: public rpc_response_base
+    {
+      bool running;
+      bool finished;
+      bool success;
+      std::string path;
+      std::string error;
+      uint64_t max_bytes_per_second;
+      uint64_t source_size;
+      uint64_t estimated_size;
+      uint64_t bytes_written;
+      uint64_t elapsed_ms;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_response_base)
+        KV_SERIALIZE(running)
+        KV_SERIALIZE(finished)
+        KV_SERIALIZE(success)
+        KV_SERIALIZE(path)
+        KV_SERIALIZE(error)
+        KV_SERIALIZE(max_bytes_per_second)
+        KV_SERIALIZE(source_size)
+        KV_SERIALIZE(estimated_size)
+        KV_SERIALIZE(bytes_written)
+        KV_SERIALIZE(elapsed_ms)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
+  struct COMMAND_RPC_GET_DB_STATS
+  {
+    struct request_t: public rpc_request_base
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_request_base)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct table
+    {
+      std::string name;
+      uint64_t entries;
+      uint64_t size;
+      uint64_t depth;
+      uint64_t lookups;
+      uint64_t misses;
+      uint64_t cursor_steps;
+      uint64_t bytes_read;
+      uint64_t writes;
+      uint64_t bytes_written;
+      uint64_t deletes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(entries)
+        KV_SERIALIZE(size)
+        KV_SERIALIZE(depth)
+        KV_SERIALIZE(lookups)
+        KV_SERIALIZE(misses)
+        KV_SERIALIZE(cursor_steps)
+        KV_SERIALIZE(bytes_read)
+        KV_SERIALIZE(writes)
+        KV_SERIALIZE(bytes_written)
+        KV_SERIALIZE(deletes)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct histogram
+    {
+      uint64_t count;
+      uint64_t total_us;
+      uint64_t max_us;
+      std::vector<uint64_t> buckets;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(count)
+        KV_SERIALIZE(total_us)
+        KV_SERIALIZE(max_us)
+        KV_SERIALIZE(buckets)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response_t: public rpc_response_base
+    {
+      uint64_t map_size;
+      uint64_t used_size;
+      uint64_t page_size;
+      uint64_t readers;
+      uint64_t max_readers;
+      uint64_t resizes;
+      uint64_t resize_time_ms;
+      uint64_t major_page_faults;
+      uint64_t minor_page_faults;
+      std::vector<table> tables;
+      histogram read_txn;
+      histogram write_txn;
+      histogram commit;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_response_base)
+        KV_SERIALIZE(map_size)
+        KV_SERIALIZE(used_size)
+        KV_SERIALIZE(page_size)
+        KV_SERIALIZE(readers)
+        KV_SERIALIZE(max_readers)
+        KV_SERIALIZE(resizes)
+        KV_SERIALIZE(resize_time_ms)
+        KV_SERIALIZE(major_page_faults)
+        KV_SERIALIZE(minor_page_faults)
+        KV_SERIALIZE(tables)
+        KV_SERIALIZE(read_txn)
+        KV_SERIALIZE(write_txn)
+        KV_SERIALIZE(commit)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
+  struct COMMAND_RPC_GET_THREADPOOL_STATS
+  {
+    struct request_t: public rpc_request_base
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_request_base)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct priority_class
+    {
+      std::string name;
+      uint64_t queued;
+      uint64_t submitted;
+      uint64_t completed;
+      uint64_t stolen;
+      uint64_t wait_us;
+      uint64_t max_wait_us;
+      uint64_t run_us;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(queued)
+        KV_SERIALIZE(submitted)
+        KV_SERIALIZE(completed)
+        KV_SERIALIZE(stolen)
+        KV_SERIALIZE(wait_us)
+        KV_SERIALIZE(max_wait_us)
+        KV_SERIALIZE(run_us)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response_t: public rpc_response_base
+    {
+      uint32_t threads;
+      std::vector<priority_class> priorities;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_response_base)
+        KV_SERIALIZE(threads)
+        KV_SERIALIZE(priorities)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
+  struct COMMAND_RPC_GET_RESPONSE_CACHE_STATS
+  {
+    struct request_t: public rpc_request_base
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_request_base)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct method
+    {
+      std::string name;
+      uint64_t hits;
+      uint64_t misses;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(hits)
+        KV_SERIALIZE(misses)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response_t: public rpc_response_base
+    {
+      uint64_t entries;
+      uint64_t invalidations;
+      std::vector<method> methods;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_response_base)
+        KV_SERIALIZE(entries)
+        KV_SERIALIZE(invalidations)
+        KV_SERIALIZE(methods)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -23,6 +23,18 @@ namespace rpc
 
       return {std::move(distribution), start_height, base};
     }
+
+    // cuts the (cumulative) distribution down to the heights from from_height on
+    void cut_distribution(std::uint64_t from_height, std::uint64_t &start_height, std::vector<std::uint64_t> &distribution, std::uint64_t &base)
+    {
+      if (from_height <= start_height)
+        return;
+      const std::size_t skip = std::min<std::uint64_t>(from_height - start_height, distribution.size());
+      if (skip > 0)
+        base = distribution[skip - 1];
+      distribution.erase(distribution.begin(), distribution.begin() + skip);
+      start_height = from_height;
+    }
   }
 
   boost::optional<output_distribution_data>
@@ -40,11 +52,26 @@ namespace rpc
       } d;
       const boost::unique_lock<boost::mutex> lock(d.mutex);
 
+      // wallets ask for the tail of the distribution they already have, with a
+      // from_height that moves on with the chain: cut it from the cached range,
+      // extended if needed, rather than replacing the cache with every tail
+      const bool tail = amount == 0 && d.cached && d.cached_from < from_height && from_height <= to_height;
+      const std::uint64_t requested_from_height = from_height;
+      if (tail)
+        from_height = d.cached_from;
+
       crypto::hash top_hash = crypto::null_hash;
       if (d.cached_to < blockchain_height)
         top_hash = get_hash(d.cached_to);
-      if (d.cached && amount == 0 && d.cached_from == from_height && d.cached_to == to_height && d.cached_top_hash == top_hash)
-        return process_distribution(cumulative, d.cached_start_height, d.cached_distribution, d.cached_base);
+      if (d.cached && amount == 0 && d.cached_from == from_height && d.cached_top_hash == top_hash && (d.cached_to == to_height || (tail && to_height < d.cached_to)))
+      {
+        std::uint64_t start_height = d.cached_start_height, base = d.cached_base;
+        std::vector<std::uint64_t> distribution = d.cached_distribution;
+        if (to_height < d.cached_to)
+          distribution.resize(distribution.size() - std::min<std::uint64_t>(d.cached_to - to_height, distribution.size()));
+        cut_distribution(requested_from_height, start_height, distribution, base);
+        return process_distribution(cumulative, start_height, std::move(distribution), base);
+      }
 
       std::vector<std::uint64_t> distribution;
       std::uint64_t start_height, base;
@@ -107,6 +134,7 @@ namespace rpc
         d.cached = true;
       }
 
+      cut_distribution(requested_from_height, start_height, distribution, base);
       return process_distribution(cumulative, start_height, std::move(distribution), base);
   }
 } // rpc
@@ -0,0 +1,125 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "rpc_response_cache.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "daemon.rpc"
+
+namespace cryptonote
+{
+  rpc_response_cache::rpc_response_cache(size_t max_entries, std::chrono::milliseconds max_age):
+    m_max_entries(max_entries),
+    m_max_age(max_age),
+    m_token({crypto::null_hash, 0}),
+    m_invalidations(0)
+  {
+  }
+
+  void rpc_response_cache::invalidate_if_stale(const token &t)
+  {
+    if (t == m_token)
+      return;
+    if (!m_entries.empty())
+      ++m_invalidations;
+    m_entries.clear();
+    m_lru.clear();
+    m_token = t;
+  }
+
+  void rpc_response_cache::erase(std::unordered_map<std::string, entry>::iterator i)
+  {
+    m_lru.erase(i->second.lru);
+    m_entries.erase(i);
+  }
+
+  bool rpc_response_cache::get(const std::string &method, const std::string &request, const token &t, std::string &body)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    invalidate_if_stale(t);
+    method_stats &stats = m_stats[method];
+    const auto i = m_entries.find(method + '\0' + request);
+    if (i == m_entries.end())
+    {
+      ++stats.misses;
+      return false;
+    }
+    if (std::chrono::steady_clock::now() - i->second.time > m_max_age)
+    {
+      erase(i);
+      ++stats.misses;
+      return false;
+    }
+    ++stats.hits;
+    m_lru.splice(m_lru.begin(), m_lru, i->second.lru);
+    body = i->second.body;
+    return true;
+  }
+
+  void rpc_response_cache::put(const std::string &method, const std::string &request, const token &t, const std::string &body)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    // the state may have moved on while the response was being built
+    if (t != m_token)
+      return;
+    const std::string key = method + '\0' + request;
+    auto i = m_entries.find(key);
+    if (i == m_entries.end())
+    {
+      while (!m_lru.empty() && m_entries.size() >= m_max_entries)
+        erase(m_entries.find(m_lru.back()));
+      if (m_max_entries == 0)
+        return;
+      m_lru.push_front(key);
+      i = m_entries.emplace(key, entry()).first;
+      i->second.lru = m_lru.begin();
+    }
+    else
+    {
+      m_lru.splice(m_lru.begin(), m_lru, i->second.lru);
+    }
+    i->second.body = body;
+    i->second.time = std::chrono::steady_clock::now();
+  }
+
+  void rpc_response_cache::clear()
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_lru.clear();
+  }
+
+  void rpc_response_cache::get_stats(std::map<std::string, method_stats> &methods, uint64_t &entries, uint64_t &invalidations) const
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    methods = m_stats;
+    entries = m_entries.size();
+    invalidations = m_invalidations;
+  }
+}
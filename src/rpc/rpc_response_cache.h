@@ -0,0 +1,99 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  /* Already serialized responses for read only RPC calls, keyed by method and
+   * serialized request. JSON-RPC calls are keyed by their params and keep only
+   * the result, so the request id is not part of the entry. All entries depend on the chain top and the txpool
+   * contents, and are dropped as soon as either changes. Entries are also
+   * bounded in age, since a few responses (eg, connection counts in get_info)
+   * change without either. When full, the least recently used entry makes
+   * room for a new one.
+   */
+  class rpc_response_cache
+  {
+  public:
+    struct token
+    {
+      crypto::hash top_hash;
+      uint64_t pool_cookie;
+
+      bool operator==(const token &other) const { return top_hash == other.top_hash && pool_cookie == other.pool_cookie; }
+      bool operator!=(const token &other) const { return !(*this == other); }
+    };
+
+    struct method_stats
+    {
+      uint64_t hits;
+      uint64_t misses;
+    };
+
+    rpc_response_cache(size_t max_entries = 1024, std::chrono::milliseconds max_age = std::chrono::milliseconds(1000));
+
+    bool get(const std::string &method, const std::string &request, const token &t, std::string &body);
+    void put(const std::string &method, const std::string &request, const token &t, const std::string &body);
+    void clear();
+
+    void get_stats(std::map<std::string, method_stats> &methods, uint64_t &entries, uint64_t &invalidations) const;
+
+  private:
+    struct entry
+    {
+      std::string body;
+      std::chrono::steady_clock::time_point time;
+      std::list<std::string>::iterator lru;
+    };
+
+    void invalidate_if_stale(const token &t);
+    void erase(std::unordered_map<std::string, entry>::iterator i);
+
+    mutable boost::mutex m_mutex;
+    const size_t m_max_entries;
+    const std::chrono::milliseconds m_max_age;
+    token m_token;
+    std::unordered_map<std::string, entry> m_entries;
+    std::list<std::string> m_lru; // keys, most recently used first
+    std::map<std::string, method_stats> m_stats;
+    uint64_t m_invalidations;
+  };
+}
@@ -29,6 +29,7 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <deque>
 #include <numeric>
 #include <tuple>
 #include <boost/format.hpp>
@@ -40,6 +41,7 @@
 #include <boost/asio/ip/address.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/preprocessor/stringize.hpp>
+#include <boost/thread/thread.hpp>
 #include <openssl/evp.h>
 #include "include_base_utils.h"
 using namespace epee;
@@ -130,6 +132,7 @@ using namespace cryptonote;
 #define SEGREGATION_FORK_VICINITY 1500 /* blocks */
 
 #define FIRST_REFRESH_GRANULARITY     1024
+#define DEFAULT_REFRESH_PIPELINE_DEPTH 3 // block batches requested from the daemon at any one time
 #define GAMMA_SHAPE 19.28
 #define GAMMA_SCALE (1/1.61)
 
@@ -138,6 +141,10 @@ using namespace cryptonote;
 
 #define DEFAULT_INACTIVITY_LOCK_TIMEOUT 90 // a minute and a half
 
+#define RCT_DISTRIBUTION_CACHE_MARGIN 10 // blocks below the wallet's top that are requested again with each distribution
+
+#define CACHE_JOURNAL_MIN_COMPACT_SIZE (1024 * 1024) // journal may grow to this size even for small wallets
+
 static const std::string MULTISIG_SIGNATURE_MAGIC = "SigMultisigPkV1";
 static const std::string MULTISIG_EXTRA_INFO_MAGIC = "MultisigxV1";
 
@@ -145,6 +152,30 @@ static const std::string ASCII_OUTPUT_MAGIC = "NervaAsciiDataV1";
 
 namespace
 {
+  // adds the current value of each touched key still in map, and the touched keys no longer in it
+  template<typename K, typename V>
+  void journal_cache_map(const std::unordered_map<K, V> &map, const std::unordered_set<K> &touched,
+      std::vector<std::pair<K, V>> &changed, std::vector<K> &erased)
+  {
+    for (const K &key: touched)
+    {
+      const auto i = map.find(key);
+      if (i == map.end())
+        erased.push_back(key);
+      else
+        changed.push_back(*i);
+    }
+  }
+
+  template<typename K, typename V>
+  void apply_cache_map(std::unordered_map<K, V> &map, const std::vector<std::pair<K, V>> &changed, const std::vector<K> &erased)
+  {
+    for (const K &key: erased)
+      map.erase(key);
+    for (const auto &e: changed)
+      map[e.first] = e.second;
+  }
+
   std::string get_default_ringdb_path()
   {
     boost::filesystem::path dir = tools::get_default_data_dir();
@@ -1079,6 +1110,7 @@ void wallet_device_callback::on_progress(const hw::device_progress& event)
 }
 
 wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
+  m_daemon_ssl_options(epee::net_utils::ssl_support_t::e_ssl_support_autodetect),
   m_multisig_rescan_info(NULL),
   m_multisig_rescan_k(NULL),
   m_upper_transaction_weight_limit(0),
@@ -1111,6 +1143,8 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
   m_ignore_outputs_above(MONEY_SUPPLY),
   m_ignore_outputs_below(0),
   m_track_uses(false),
+  m_cache_journal(false),
+  m_refresh_pipeline_depth(DEFAULT_REFRESH_PIPELINE_DEPTH),
   m_inactivity_lock_timeout(DEFAULT_INACTIVITY_LOCK_TIMEOUT),
   m_setup_background_mining(BackgroundMiningMaybe),
   m_is_initialized(false),
@@ -1252,6 +1286,7 @@ bool wallet2::set_daemon(std::string daemon_address, boost::optional<epee::net_u
   const bool changed = m_daemon_address != daemon_address;
   m_daemon_address = std::move(daemon_address);
   m_daemon_login = std::move(daemon_login);
+  m_daemon_ssl_options = ssl_options;
   m_trusted_daemon = trusted_daemon;
   if (changed)
     m_node_rpc_proxy.invalidate();
@@ -1265,6 +1300,7 @@ bool wallet2::init(std::string daemon_address, boost::optional<epee::net_utils::
   m_checkpoints.init_default_checkpoints(m_nettype);
   m_is_initialized = true;
   m_upper_transaction_weight_limit = upper_transaction_weight_limit;
+  m_proxy = proxy;
   if (proxy != boost::asio::ip::tcp::endpoint{})
     m_http_client.set_connector(net::socks::connector{std::move(proxy)});
   return set_daemon(daemon_address, daemon_login, trusted_daemon, std::move(ssl_options));
@@ -1470,6 +1506,7 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
       {
          const crypto::public_key &D = pkeys[index2.minor];
          m_subaddresses[D] = index2;
+         m_cache_journal_state.touch_subaddress(D);
       }
     }
     m_subaddress_labels.resize(index.major + 1, {"Untitled account"});
@@ -1487,6 +1524,7 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
     {
        const crypto::public_key &D = pkeys[index2.minor - begin];
        m_subaddresses[D] = index2;
+       m_cache_journal_state.touch_subaddress(D);
     }
     m_subaddress_labels[index.major].resize(index.minor + 1);
   }
@@ -1534,6 +1572,8 @@ void wallet2::set_spent(size_t idx, uint64_t height)
   LOG_PRINT_L2("Setting SPENT at " << height << ": ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
   td.m_spent = true;
   td.m_spent_height = height;
+  update_unspent_transfer_index(idx);
+  m_cache_journal_state.touch_transfer(idx);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::set_unspent(size_t idx)
@@ -1543,6 +1583,8 @@ void wallet2::set_unspent(size_t idx)
   LOG_PRINT_L2("Setting UNSPENT: ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
   td.m_spent = false;
   td.m_spent_height = 0;
+  update_unspent_transfer_index(idx);
+  m_cache_journal_state.touch_transfer(idx);
 }
 //----------------------------------------------------------------------------------------------------
 bool wallet2::is_spent(const transfer_details &td, bool strict) const
@@ -1564,11 +1606,54 @@ bool wallet2::is_spent(size_t idx, bool strict) const
   return is_spent(td, strict);
 }
 //----------------------------------------------------------------------------------------------------
+std::map<uint32_t, std::set<size_t>> wallet2::get_unspent_transfers(uint32_t subaddr_account) const
+{
+  boost::unique_lock<boost::mutex> lock(m_unspent_transfer_index_lock);
+  unspent_transfer_index &index = m_unspent_transfer_index;
+  if (!index.valid || index.transfers_size > m_transfers.size())
+  {
+    index.clear();
+    index.valid = true;
+  }
+  for (; index.transfers_size < m_transfers.size(); ++index.transfers_size)
+  {
+    const transfer_details &td = m_transfers[index.transfers_size];
+    if (!is_spent(td, true))
+      index.by_subaddr[td.m_subaddr_index.major][td.m_subaddr_index.minor].insert(index.transfers_size);
+  }
+
+  // a copy, the index may change as soon as the lock is released
+  auto i = index.by_subaddr.find(subaddr_account);
+  return i == index.by_subaddr.end() ? std::map<uint32_t, std::set<size_t>>() : i->second;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::update_unspent_transfer_index(size_t idx)
+{
+  boost::unique_lock<boost::mutex> lock(m_unspent_transfer_index_lock);
+  unspent_transfer_index &index = m_unspent_transfer_index;
+  // transfers not indexed yet are picked up with their current state on next use
+  if (!index.valid || idx >= index.transfers_size)
+    return;
+  const transfer_details &td = m_transfers[idx];
+  std::set<size_t> &indices = index.by_subaddr[td.m_subaddr_index.major][td.m_subaddr_index.minor];
+  if (is_spent(td, true))
+    indices.erase(idx);
+  else
+    indices.insert(idx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::invalidate_unspent_transfer_index()
+{
+  boost::unique_lock<boost::mutex> lock(m_unspent_transfer_index_lock);
+  m_unspent_transfer_index.clear();
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::freeze(size_t idx)
 {
   CHECK_AND_ASSERT_THROW_MES(idx < m_transfers.size(), "Invalid transfer_details index");
   transfer_details &td = m_transfers[idx];
   td.m_frozen = true;
+  m_cache_journal_state.touch_transfer(idx);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::thaw(size_t idx)
@@ -1576,6 +1661,7 @@ void wallet2::thaw(size_t idx)
   CHECK_AND_ASSERT_THROW_MES(idx < m_transfers.size(), "Invalid transfer_details index");
   transfer_details &td = m_transfers[idx];
   td.m_frozen = false;
+  m_cache_journal_state.touch_transfer(idx);
 }
 //----------------------------------------------------------------------------------------------------
 bool wallet2::frozen(size_t idx) const
@@ -2031,8 +2117,12 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
             td.m_frozen = false;
 	          set_unspent(m_transfers.size()-1);
             if (td.m_key_image_known)
+            {
 	            m_key_images[td.m_key_image] = m_transfers.size()-1;
+              m_cache_journal_state.touch_key_image(td.m_key_image);
+            }
 	          m_pub_keys[tx_scan_info[o].in_ephemeral.pub] = m_transfers.size()-1;
+            m_cache_journal_state.touch_pub_key(tx_scan_info[o].in_ephemeral.pub);
             if (output_tracker_cache)
               (*output_tracker_cache)[std::make_pair(tx.vout[o].amount, td.m_global_output_index)] = m_transfers.size() - 1;
             if (m_multisig)
@@ -2076,6 +2166,8 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           if (!pool)
           {
             transfer_details &td = m_transfers[kit->second];
+            invalidate_unspent_transfer_index();
+            m_cache_journal_state.touch_transfer(kit->second);
 	          td.m_block_height = height;
 	          td.m_internal_output_index = o;
 	          td.m_global_output_index = o_indices[o];
@@ -2150,6 +2242,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           //   2) the wallet set the highest amount among them to transfer_details::m_amount, and
           //   3) the wallet somehow spent that output with an amount smaller than the above amount, causing inconsistency
           td.m_amount = amount;
+          m_cache_journal_state.touch_transfer(it->second);
         }
       }
       else
@@ -2185,16 +2278,23 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
             size_t idx = i->second;
             THROW_WALLET_EXCEPTION_IF(idx >= m_transfers.size(), error::wallet_internal_error, "Output tracker cache index out of range");
             m_transfers[idx].m_uses.push_back(std::make_pair(height, txid));
+            m_cache_journal_state.touch_transfer(idx);
           }
         }
       }
-      else for (transfer_details &td: m_transfers)
+      else for (size_t idx = 0; idx < m_transfers.size(); ++idx)
       {
+        transfer_details &td = m_transfers[idx];
         if (amount != in_to_key.amount)
           continue;
         for (uint64_t offset: offsets)
+        {
           if (offset == td.m_global_output_index)
+          {
             td.m_uses.push_back(std::make_pair(height, txid));
+            m_cache_journal_state.touch_transfer(idx);
+          }
+        }
       }
     }
   }
@@ -2216,6 +2316,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
       THROW_WALLET_EXCEPTION_IF(i == m_confirmed_txs.end(), error::wallet_internal_error,
         "confirmed tx wasn't found: " + string_tools::pod_to_hex(txid));
       i->second.m_change = self_received;
+      m_cache_journal_state.touch_confirmed_tx(txid);
     }
   }
 
@@ -2305,7 +2406,10 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           m_callback->on_unconfirmed_money_received(height, txid, tx, payment.m_amount, payment.m_subaddr_index);
       }
       else
-        m_payments.emplace(payment_id, payment);
+      {
+        index_payment(*m_payments.emplace(payment_id, payment));
+        m_cache_journal_state.touch_payment(payment_id, payment);
+      }
       LOG_PRINT_L2("Payment found in " << (pool ? "pool" : "block") << ": " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_amount);
     }
     if (pool && all_same)
@@ -2329,7 +2433,12 @@ void wallet2::process_unconfirmed(const crypto::hash &txid, const cryptonote::tr
   if(unconf_it != m_unconfirmed_txs.end()) {
     if (store_tx_info()) {
       try {
-        m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+        auto entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+        if (entry.second)
+        {
+          index_confirmed_tx(*entry.first);
+          m_cache_journal_state.touch_confirmed_tx(txid);
+        }
       }
       catch (...) {
         // can fail if the tx has unexpected input types
@@ -2343,6 +2452,9 @@ void wallet2::process_unconfirmed(const crypto::hash &txid, const cryptonote::tr
 void wallet2::process_outgoing(const crypto::hash &txid, const cryptonote::transaction &tx, uint64_t height, uint64_t ts, uint64_t spent, uint64_t received, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices)
 {
   std::pair<std::unordered_map<crypto::hash, confirmed_transfer_details>::iterator, bool> entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details()));
+  m_cache_journal_state.touch_confirmed_tx(txid);
+  if (!entry.second)
+    unindex_confirmed_tx(txid, entry.first->second.m_block_height, entry.first->second.m_subaddr_account);
   // fill with the info we know, some info might already be there
   if (entry.second)
   {
@@ -2376,6 +2488,7 @@ void wallet2::process_outgoing(const crypto::hash &txid, const cryptonote::trans
   entry.first->second.m_block_height = height;
   entry.first->second.m_timestamp = ts;
   entry.first->second.m_unlock_time = tx.unlock_time;
+  index_confirmed_tx(*entry.first);
 
   add_rings(tx);
 }
@@ -2462,6 +2575,51 @@ void wallet2::parse_block_round(const cryptonote::blobdata &blob, cryptonote::bl
   error = !cryptonote::parse_and_validate_block_from_blob(blob, bl, bl_id);
 }
 //----------------------------------------------------------------------------------------------------
+static uint64_t elapsed_ns(const std::chrono::steady_clock::time_point &start)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+//----------------------------------------------------------------------------------------------------
+// a batch of blocks requested by explicit start height, ahead of the one the refresh loop is waiting for
+struct wallet2::refresh_prefetch
+{
+  uint64_t start_height;
+  uint64_t blocks_start_height = 0;
+  uint64_t current_height = 0;
+  std::vector<cryptonote::block_complete_entry> blocks;
+  std::vector<parsed_block> parsed_blocks;
+  std::vector<tx_cache_data> tx_cache;
+  bool error = false;
+  std::exception_ptr exception; // what the fetch threw, handed on to the refresh loop
+  // the fetch blocks on the daemon, so it gets its own thread rather than a threadpool slot
+  boost::thread thread;
+
+  ~refresh_prefetch() { wait(); }
+  void wait() { if (thread.joinable()) thread.join(); }
+};
+//----------------------------------------------------------------------------------------------------
+struct wallet2::refresh_pipeline
+{
+  size_t depth;
+  std::deque<std::unique_ptr<refresh_prefetch>> prefetches; // in start height order
+  uint64_t next_height = 0; // start height of the next prefetch
+  uint64_t stride = COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT - 1; // new blocks per response, from the last one
+  boost::mutex clients_lock;
+  std::vector<std::unique_ptr<epee::net_utils::http::http_simple_client>> clients; // idle connections for prefetches
+
+  std::atomic<uint64_t> fetch_ns{0}, parse_ns{0}, derive_ns{0};
+  uint64_t apply_ns = 0, stall_ns = 0;
+  uint64_t requests = 0, prefetched = 0, discarded = 0;
+
+  refresh_pipeline(size_t depth): depth(depth) {}
+  ~refresh_pipeline()
+  {
+    // prefetch threads refer to this object
+    for (auto &prefetch: prefetches)
+      prefetch->wait();
+  }
+};
+//----------------------------------------------------------------------------------------------------
 void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t &current_height)
 {
 
@@ -2510,24 +2668,17 @@ void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height,
   hashes = std::move(res.m_block_ids);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache)
+void wallet2::cache_parsed_blocks(uint64_t start_height, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const
 {
-  size_t current_index = start_height;
-  blocks_added = 0;
-
-  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
-  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(current_index), error::out_of_hashchain_bounds_error);
-
   tools::threadpool& tpool = tools::threadpool::getInstance();
   tools::threadpool::waiter waiter;
 
   size_t num_txes = 0;
-  std::vector<tx_cache_data> tx_cache_data;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
     num_txes += 1 + parsed_blocks[i].txes.size();
   tx_cache_data.resize(num_txes);
   size_t txidx = 0;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
   {
     THROW_WALLET_EXCEPTION_IF(parsed_blocks[i].txes.size() != parsed_blocks[i].block.tx_hashes.size(),
         error::wallet_internal_error, "Mismatched parsed_blocks[i].txes.size() and parsed_blocks[i].block.tx_hashes.size()");
@@ -2548,11 +2699,18 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
   THROW_WALLET_EXCEPTION_IF(txidx != num_txes, error::wallet_internal_error, "txidx does not match tx_cache_data size");
   waiter.wait(&tpool);
 
-  hw::device &hwdev =  m_account.get_device();
-  hw::reset_mode rst(hwdev);
-  hwdev.set_mode(hw::device::TRANSACTION_PARSE);
+  // without a device round trip, derivations only need the view key, so they are done here without
+  // the device lock, in parallel, which lets them run ahead of processing the blocks
+  if (m_account.get_device().get_type() == hw::device::SOFTWARE)
+    generate_tx_cache_derivations(tx_cache_data, false);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::generate_tx_cache_derivations(std::vector<tx_cache_data> &tx_cache_data, bool lock_device) const
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  hw::device &hwdev = m_account.get_device();
   const cryptonote::account_keys &keys = m_account.get_keys();
-
   auto gender = [&](wallet2::is_out_data &iod) {
     if (!hwdev.generate_key_derivation(iod.pkey, keys.m_view_secret_key, iod.derivation))
     {
@@ -2561,14 +2719,15 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
       memcpy(&iod.derivation, rct::identity().bytes, sizeof(iod.derivation));
     }
   };
-
   for (size_t i = 0; i < tx_cache_data.size(); ++i)
   {
     if (tx_cache_data[i].empty())
       continue;
-    tpool.submit(&waiter, [&hwdev, &gender, &tx_cache_data, i]() {
+    tpool.submit(&waiter, [&hwdev, &gender, &tx_cache_data, i, lock_device]() {
       auto &slot = tx_cache_data[i];
-      boost::unique_lock<hw::device> hwdev_lock(hwdev);
+      boost::unique_lock<hw::device> hwdev_lock(hwdev, boost::defer_lock);
+      if (lock_device)
+        hwdev_lock.lock();
       for (auto &iod: slot.primary)
         gender(iod);
       for (auto &iod: slot.additional)
@@ -2576,6 +2735,33 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
     }, true);
   }
   waiter.wait(&tpool);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, uint64_t& blocks_added, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache)
+{
+  size_t current_index = start_height;
+  blocks_added = 0;
+
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
+  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(current_index), error::out_of_hashchain_bounds_error);
+
+  size_t num_txes = 0;
+  for (const parsed_block &pb: parsed_blocks)
+    num_txes += 1 + pb.txes.size();
+  if (tx_cache_data.empty())
+    cache_parsed_blocks(start_height, parsed_blocks, tx_cache_data);
+  THROW_WALLET_EXCEPTION_IF(tx_cache_data.size() != num_txes, error::wallet_internal_error, "tx_cache_data does not match parsed_blocks");
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  hw::device &hwdev =  m_account.get_device();
+  hw::reset_mode rst(hwdev);
+  hwdev.set_mode(hw::device::TRANSACTION_PARSE);
+  const cryptonote::account_keys &keys = m_account.get_keys();
+
+  // software derivations were done by cache_parsed_blocks
+  if (hwdev.get_type() != hw::device::SOFTWARE)
+    generate_tx_cache_derivations(tx_cache_data, true);
 
   auto geniod = [&](const cryptonote::transaction &tx, size_t n_vouts, size_t txidx) {
     for (size_t k = 0; k < n_vouts; ++k)
@@ -2599,7 +2785,7 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
     }
   };
 
-  txidx = 0;
+  size_t txidx = 0;
   for (size_t i = 0; i < blocks.size(); ++i)
   {
     if (should_skip_block(parsed_blocks[i].block, start_height + i))
@@ -2669,7 +2855,48 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   refresh(trusted_daemon, start_height, blocks_fetched, received_money);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &last, bool &error, std::exception_ptr &exception)
+void wallet2::parse_blocks(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<parsed_block> &parsed_blocks, bool &error) const
+{
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  parsed_blocks.resize(blocks.size());
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
+      std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
+  }
+  waiter.wait(&tpool);
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (parsed_blocks[i].error)
+    {
+      error = true;
+      break;
+    }
+    parsed_blocks[i].o_indices = std::move(o_indices[i]);
+  }
+
+  boost::mutex error_lock;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    parsed_blocks[i].txes.resize(blocks[i].txs.size());
+    for (size_t j = 0; j < blocks[i].txs.size(); ++j)
+    {
+      tpool.submit(&waiter, [&, i, j](){
+        if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j].blob, parsed_blocks[i].txes[j]))
+        {
+          boost::unique_lock<boost::mutex> lock(error_lock);
+          error = true;
+        }
+      }, true);
+    }
+  }
+  waiter.wait(&tpool);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, shared_blocks &blocks, shared_parsed_blocks &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, refresh_pipeline &pipeline, bool &last, bool &error, std::exception_ptr &exception)
 {
   error = false;
   last = false;
@@ -2687,48 +2914,72 @@ void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks
       short_chain_history.push_front(s->hash);
     }
 
-    // pull the new blocks
-    std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
+    // the next batch may already have been requested by height while the previous ones were being processed
     uint64_t current_height;
-    pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices, current_height);
-    THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
+    std::vector<cryptonote::block_complete_entry> new_blocks;
+    std::vector<parsed_block> new_parsed_blocks;
+    if (start_height == 0 && !prev_parsed_blocks.empty() && take_prefetched_blocks(pipeline,
+        cryptonote::get_block_height(prev_parsed_blocks.back().block), prev_parsed_blocks.back().hash,
+        blocks_start_height, new_blocks, new_parsed_blocks, tx_cache_data, current_height))
+    {
+      last = cryptonote::get_block_height(new_parsed_blocks.back().block) + 1 == current_height;
+      blocks = std::make_shared<const std::vector<cryptonote::block_complete_entry>>(std::move(new_blocks));
+      parsed_blocks = std::make_shared<const std::vector<parsed_block>>(std::move(new_parsed_blocks));
+      prefetch_blocks(pipeline, current_height);
+      return;
+    }
 
-    tools::threadpool& tpool = tools::threadpool::getInstance();
-    tools::threadpool::waiter waiter;
-    parsed_blocks.resize(blocks.size());
-    for (size_t i = 0; i < blocks.size(); ++i)
+    // another wallet sharing the block cache may have pulled and parsed these blocks already
+    const bool no_miner_tx = m_refresh_type == RefreshNoCoinbase;
+    const bool use_cache = m_block_scan_cache && start_height == 0 && !short_chain_history.empty();
+    const crypto::hash top = use_cache ? short_chain_history.front() : crypto::null_hash;
+    if (use_cache && m_block_scan_cache->get(top, no_miner_tx, blocks_start_height, blocks, parsed_blocks, current_height))
     {
-      tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
-        std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
+      last = !blocks->empty() && cryptonote::get_block_height(parsed_blocks->back().block) + 1 == current_height;
+      auto start = std::chrono::steady_clock::now();
+      cache_parsed_blocks(blocks_start_height, *parsed_blocks, tx_cache_data);
+      pipeline.derive_ns += elapsed_ns(start);
+      return;
     }
-    waiter.wait(&tpool);
-    for (size_t i = 0; i < blocks.size(); ++i)
+    bool cached = false;
+    auto cache_abandoner = epee::misc_utils::create_scope_leave_handler([&](){
+      if (use_cache && !cached)
+        m_block_scan_cache->abandon(top, no_miner_tx);
+    });
+
+    // pull the new blocks
+    std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
+    auto start = std::chrono::steady_clock::now();
+    pull_blocks(start_height, blocks_start_height, short_chain_history, new_blocks, o_indices, current_height);
+    pipeline.fetch_ns += elapsed_ns(start);
+    ++pipeline.requests;
+
+    start = std::chrono::steady_clock::now();
+    parse_blocks(new_blocks, o_indices, new_parsed_blocks, error);
+    pipeline.parse_ns += elapsed_ns(start);
+    last = !new_blocks.empty() && cryptonote::get_block_height(new_parsed_blocks.back().block) + 1 == current_height;
+    blocks = std::make_shared<const std::vector<cryptonote::block_complete_entry>>(std::move(new_blocks));
+    parsed_blocks = std::make_shared<const std::vector<parsed_block>>(std::move(new_parsed_blocks));
+    if (error)
+      return;
+    if (use_cache)
     {
-      if (parsed_blocks[i].error)
-      {
-        error = true;
-        break;
-      }
-      parsed_blocks[i].o_indices = std::move(o_indices[i]);
+      m_block_scan_cache->add(top, no_miner_tx, blocks_start_height, blocks, parsed_blocks, current_height);
+      cached = true;
     }
 
-    boost::mutex error_lock;
-    for (size_t i = 0; i < blocks.size(); ++i)
+    // request the batches after this one while this one is being processed
+    if (blocks->size() > 1 && !m_block_scan_cache)
     {
-      parsed_blocks[i].txes.resize(blocks[i].txs.size());
-      for (size_t j = 0; j < blocks[i].txs.size(); ++j)
-      {
-        tpool.submit(&waiter, [&, i, j](){
-          if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j].blob, parsed_blocks[i].txes[j]))
-          {
-            boost::unique_lock<boost::mutex> lock(error_lock);
-            error = true;
-          }
-        }, true);
-      }
+      pipeline.stride = blocks->size() - 1;
+      if (pipeline.prefetches.empty())
+        pipeline.next_height = blocks_start_height + pipeline.stride;
+      prefetch_blocks(pipeline, current_height);
     }
-    waiter.wait(&tpool);
-    last = !blocks.empty() && cryptonote::get_block_height(parsed_blocks.back().block) + 1 == current_height;
+
+    start = std::chrono::steady_clock::now();
+    cache_parsed_blocks(blocks_start_height, *parsed_blocks, tx_cache_data);
+    pipeline.derive_ns += elapsed_ns(start);
   }
   catch(...)
   {
@@ -2736,6 +2987,138 @@ void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks
     exception = std::current_exception();
   }
 }
+//----------------------------------------------------------------------------------------------------
+void wallet2::prefetch_blocks(refresh_pipeline &pipeline, uint64_t current_height)
+{
+  // each response starts with the last block of the previous one, so the wallet can check they link up
+  while (pipeline.prefetches.size() + 1 < pipeline.depth && pipeline.next_height > 0 && pipeline.next_height + 1 < current_height)
+  {
+    std::unique_ptr<refresh_prefetch> prefetch(new refresh_prefetch());
+    prefetch->start_height = pipeline.next_height;
+    refresh_prefetch *p = prefetch.get();
+    pipeline.prefetches.push_back(std::move(prefetch));
+    pipeline.next_height += pipeline.stride;
+    p->thread = boost::thread([this, &pipeline, p](){ pull_prefetched_blocks(pipeline, *p); });
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_prefetched_blocks(refresh_pipeline &pipeline, refresh_prefetch &prefetch)
+{
+  try
+  {
+    // prefetches use their own connections so they do not queue behind each other on m_daemon_rpc_mutex
+    std::unique_ptr<epee::net_utils::http::http_simple_client> client;
+    {
+      boost::unique_lock<boost::mutex> lock(pipeline.clients_lock);
+      if (!pipeline.clients.empty())
+      {
+        client = std::move(pipeline.clients.back());
+        pipeline.clients.pop_back();
+      }
+    }
+    if (!client)
+    {
+      client.reset(new epee::net_utils::http::http_simple_client());
+      if (m_proxy != boost::asio::ip::tcp::endpoint{})
+        client->set_connector(net::socks::connector{m_proxy});
+      THROW_WALLET_EXCEPTION_IF(!client->set_server(get_daemon_address(), get_daemon_login(), m_daemon_ssl_options),
+          error::wallet_internal_error, "Failed to set up a daemon connection");
+    }
+
+    cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
+    cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
+    req.prune = true;
+    req.start_height = prefetch.start_height;
+    req.no_miner_tx = m_refresh_type == RefreshNoCoinbase;
+    auto start = std::chrono::steady_clock::now();
+    bool r = net_utils::invoke_http_bin("/getblocks.bin", req, res, *client, rpc_timeout);
+    THROW_ON_RPC_RESPONSE_ERROR(r, {}, res, "getblocks.bin", error::get_blocks_error, get_rpc_status(res.status));
+    pipeline.fetch_ns += elapsed_ns(start);
+    {
+      boost::unique_lock<boost::mutex> lock(pipeline.clients_lock);
+      pipeline.clients.push_back(std::move(client));
+    }
+    MDEBUG("Prefetched blocks: blocks_start_height " << res.start_height << ", count " << res.blocks.size());
+
+    prefetch.blocks_start_height = res.start_height;
+    prefetch.current_height = res.current_height;
+    prefetch.blocks = std::move(res.blocks);
+    start = std::chrono::steady_clock::now();
+    parse_blocks(prefetch.blocks, res.output_indices, prefetch.parsed_blocks, prefetch.error);
+    pipeline.parse_ns += elapsed_ns(start);
+    if (prefetch.error)
+      return;
+    start = std::chrono::steady_clock::now();
+    cache_parsed_blocks(prefetch.blocks_start_height, prefetch.parsed_blocks, prefetch.tx_cache);
+    pipeline.derive_ns += elapsed_ns(start);
+  }
+  catch (...)
+  {
+    MDEBUG("Failed to prefetch blocks from height " << prefetch.start_height);
+    prefetch.error = true;
+    prefetch.exception = std::current_exception();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::take_prefetched_blocks(refresh_pipeline &pipeline, uint64_t top_height, const crypto::hash &top_hash, uint64_t &blocks_start_height, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, uint64_t &current_height)
+{
+  while (!pipeline.prefetches.empty())
+  {
+    refresh_prefetch &prefetch = *pipeline.prefetches.front();
+    // a later batch may still be usable after the history based pull fills the gap
+    if (prefetch.start_height > top_height)
+      return false;
+    prefetch.wait();
+    if (prefetch.exception)
+    {
+      const std::exception_ptr exception = prefetch.exception;
+      discard_prefetched_blocks(pipeline);
+      std::rethrow_exception(exception);
+    }
+    if (prefetch.error || prefetch.blocks_start_height > top_height)
+      break;
+    const uint64_t end_height = prefetch.blocks_start_height + prefetch.blocks.size();
+    if (end_height <= top_height + 1)
+    {
+      ++pipeline.discarded;
+      pipeline.prefetches.pop_front();
+      continue;
+    }
+    // the daemon may have reorganized since the previous batch was pulled
+    const size_t skip = top_height - prefetch.blocks_start_height;
+    if (prefetch.parsed_blocks[skip].hash != top_hash)
+    {
+      MDEBUG("Prefetched blocks do not link up at height " << top_height << ", discarding them");
+      break;
+    }
+
+    size_t skip_txes = 0;
+    for (size_t i = 0; i < skip; ++i)
+      skip_txes += 1 + prefetch.parsed_blocks[i].txes.size();
+    THROW_WALLET_EXCEPTION_IF(skip_txes > prefetch.tx_cache.size(), error::wallet_internal_error, "Mismatched prefetched tx_cache_data size");
+    pipeline.stride = prefetch.blocks.size() - 1;
+    blocks_start_height = top_height;
+    current_height = prefetch.current_height;
+    blocks.assign(std::make_move_iterator(prefetch.blocks.begin() + skip), std::make_move_iterator(prefetch.blocks.end()));
+    parsed_blocks.assign(std::make_move_iterator(prefetch.parsed_blocks.begin() + skip), std::make_move_iterator(prefetch.parsed_blocks.end()));
+    tx_cache_data.assign(std::make_move_iterator(prefetch.tx_cache.begin() + skip_txes), std::make_move_iterator(prefetch.tx_cache.end()));
+    ++pipeline.prefetched;
+    pipeline.prefetches.pop_front();
+    return true;
+  }
+  discard_prefetched_blocks(pipeline);
+  return false;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::discard_prefetched_blocks(refresh_pipeline &pipeline)
+{
+  for (auto &prefetch: pipeline.prefetches)
+  {
+    prefetch->wait();
+    ++pipeline.discarded;
+  }
+  pipeline.prefetches.clear();
+}
 
 void wallet2::remove_obsolete_pool_txs(const std::vector<crypto::hash> &tx_hashes)
 {
@@ -3162,10 +3545,15 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   tools::threadpool& tpool = tools::threadpool::getInstance();
   tools::threadpool::waiter waiter;
   uint64_t blocks_start_height;
-  std::vector<cryptonote::block_complete_entry> blocks;
-  std::vector<parsed_block> parsed_blocks;
+  const shared_blocks no_blocks = std::make_shared<const std::vector<cryptonote::block_complete_entry>>();
+  const shared_parsed_blocks no_parsed_blocks = std::make_shared<const std::vector<parsed_block>>();
+  shared_blocks blocks = no_blocks;
+  shared_parsed_blocks parsed_blocks = no_parsed_blocks;
+  std::vector<tx_cache_data> tx_cache;
   std::shared_ptr<std::map<std::pair<uint64_t, uint64_t>, size_t>> output_tracker_cache;
   hw::device &hwdev = m_account.get_device();
+  // wallets sharing a block cache already avoid pulling the same blocks more than once
+  refresh_pipeline pipeline(m_block_scan_cache ? 1 : std::max<uint32_t>(m_refresh_pipeline_depth, 1));
 
   // pull the first set of blocks
   get_short_chain_history(short_chain_history, (m_first_refresh_done || trusted_daemon) ? 1 : FIRST_REFRESH_GRANULARITY);
@@ -3210,8 +3598,9 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   while(m_run.load(std::memory_order_relaxed))
   {
     uint64_t next_blocks_start_height;
-    std::vector<cryptonote::block_complete_entry> next_blocks;
-    std::vector<parsed_block> next_parsed_blocks;
+    shared_blocks next_blocks;
+    shared_parsed_blocks next_parsed_blocks;
+    std::vector<tx_cache_data> next_tx_cache;
     bool error;
     std::exception_ptr exception;
     try
@@ -3219,22 +3608,25 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
       // pull the next set of blocks while we're processing the current one
       error = false;
       exception = NULL;
-      next_blocks.clear();
-      next_parsed_blocks.clear();
+      next_blocks = no_blocks;
+      next_parsed_blocks = no_parsed_blocks;
+      next_tx_cache.clear();
       added_blocks = 0;
-      if (!first && blocks.empty())
+      if (!first && blocks->empty())
       {
         m_node_rpc_proxy.set_height(m_blockchain.size());
         break;
       }
       if (!last)
-        tpool.submit(&waiter, [&]{pull_and_parse_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks, parsed_blocks, next_blocks, next_parsed_blocks, last, error, exception);});
+        tpool.submit(&waiter, [&]{pull_and_parse_next_blocks(start_height, next_blocks_start_height, short_chain_history, *blocks, *parsed_blocks, next_blocks, next_parsed_blocks, next_tx_cache, pipeline, last, error, exception);});
 
       if (!first)
       {
         try
         {
-          process_parsed_blocks(blocks_start_height, blocks, parsed_blocks, added_blocks, output_tracker_cache.get());
+          auto start = std::chrono::steady_clock::now();
+          process_parsed_blocks(blocks_start_height, *blocks, *parsed_blocks, tx_cache, added_blocks, output_tracker_cache.get());
+          pipeline.apply_ns += elapsed_ns(start);
         }
         catch (const tools::error::out_of_hashchain_bounds_error&)
         {
@@ -3266,7 +3658,9 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
         }
       blocks_fetched += added_blocks;
       }
+      auto start = std::chrono::steady_clock::now();
       waiter.wait(&tpool);
+      pipeline.stall_ns += elapsed_ns(start);
       if(!first && blocks_start_height == next_blocks_start_height)
       {
         m_node_rpc_proxy.set_height(m_blockchain.size());
@@ -3284,12 +3678,13 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
           throw std::runtime_error("proxy exception in refresh thread");
       }
 
-      if (m_track_uses && (!output_tracker_cache || output_tracker_cache->empty()) && next_blocks.size() >= 10)
+      if (m_track_uses && (!output_tracker_cache || output_tracker_cache->empty()) && next_blocks->size() >= 10)
         output_tracker_cache = create_output_tracker_cache();
 
       blocks_start_height = next_blocks_start_height;
       blocks = std::move(next_blocks);
       parsed_blocks = std::move(next_parsed_blocks);
+      tx_cache = std::move(next_tx_cache);
     }
     catch (const tools::error::password_needed&)
     {
@@ -3306,8 +3701,10 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
         LOG_PRINT_L1("Another try pull_blocks (try_count=" << try_count << ")...");
         first = true;
         start_height = 0;
-        blocks.clear();
-        parsed_blocks.clear();
+        blocks = no_blocks;
+        parsed_blocks = no_parsed_blocks;
+        tx_cache.clear();
+        discard_prefetched_blocks(pipeline);
         short_chain_history.clear();
         get_short_chain_history(short_chain_history, 1);
         ++try_count;
@@ -3333,6 +3730,12 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
     LOG_PRINT_L1("Failed to check pending transactions");
   }
 
+  if (blocks_fetched > 0)
+    MINFO("Refresh pipeline (depth " << pipeline.depth << "): " << pipeline.requests << " history pulls, " << pipeline.prefetched << " prefetched batches used, "
+        << pipeline.discarded << " discarded; fetch " << pipeline.fetch_ns / 1000000 << " ms, parse " << pipeline.parse_ns / 1000000
+        << " ms, derive " << pipeline.derive_ns / 1000000 << " ms, apply " << pipeline.apply_ns / 1000000 << " ms, waiting for blocks "
+        << pipeline.stall_ns / 1000000 << " ms");
+
   m_first_refresh_done = true;
   LOG_PRINT_L1("Refresh done, blocks received: " << blocks_fetched << ", balance (all accounts): " << print_money(balance_all(false)) << ", unlocked: " << print_money(unlocked_balance_all(false)));
 }
@@ -3380,10 +3783,60 @@ bool wallet2::get_rct_distribution(uint64_t &start_height, std::vector<uint64_t>
     }
   }
 
+  // the cached part is reused if the wallet's chain still has the block it ends with
+  rct_distribution_cache &cache = m_rct_distribution_cache;
+  uint64_t from_height = 0;
+  if (!cache.distribution.empty())
+  {
+    const uint64_t cached_top = cache.start_height + cache.distribution.size() - 1;
+    if (m_blockchain.is_in_bounds(cached_top) && m_blockchain[cached_top] == cache.top_hash)
+    {
+      from_height = cached_top + 1;
+    }
+    else
+    {
+      MDEBUG("Cached rct distribution is not on the wallet's chain anymore, dropping it");
+      cache = rct_distribution_cache();
+    }
+  }
+
+  uint64_t tail_start_height;
+  std::vector<uint64_t> tail;
+  if (from_height > 0 && (!request_rct_distribution(from_height, tail_start_height, tail) || tail_start_height != from_height))
+  {
+    MDEBUG("Failed to request rct distribution from height " << from_height << ", requesting all of it");
+    from_height = 0;
+    cache = rct_distribution_cache();
+  }
+  if (from_height == 0 && !request_rct_distribution(0, tail_start_height, tail))
+    return false;
+
+  start_height = from_height > 0 ? cache.start_height : tail_start_height;
+  distribution.clear();
+  distribution.reserve(cache.distribution.size() + tail.size());
+  distribution.insert(distribution.end(), cache.distribution.begin(), cache.distribution.end());
+  uint64_t total = distribution.empty() ? 0 : distribution.back();
+  for (uint64_t n: tail)
+    distribution.push_back(total += n);
+
+  // cache what the wallet can later check against its own chain, leaving out the blocks that could still be reorganized
+  const uint64_t end_height = std::min<uint64_t>(start_height + distribution.size(), m_blockchain.size() > RCT_DISTRIBUTION_CACHE_MARGIN ? m_blockchain.size() - RCT_DISTRIBUTION_CACHE_MARGIN : 0);
+  if (end_height > start_height && end_height - start_height > cache.distribution.size() && m_blockchain.is_in_bounds(end_height - 1))
+  {
+    cache.start_height = start_height;
+    cache.distribution.assign(distribution.begin(), distribution.begin() + (end_height - start_height));
+    cache.top_hash = m_blockchain[end_height - 1];
+  }
+  MDEBUG("Got rct distribution from height " << start_height << " to " << start_height + distribution.size() << ", requested from height " << from_height);
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::request_rct_distribution(uint64_t from_height, uint64_t &start_height, std::vector<uint64_t> &distribution)
+{
   cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response res = AUTO_VAL_INIT(res);
   req.amounts.push_back(0);
-  req.from_height = 0;
+  req.from_height = from_height;
   req.cumulative = false;
   req.binary = true;
   req.compress = true;
@@ -3409,8 +3862,6 @@ bool wallet2::get_rct_distribution(uint64_t &start_height, std::vector<uint64_t>
     MWARNING("Failed to request output distribution: results are not for amount 0");
     return false;
   }
-  for (size_t i = 1; i < res.distributions[0].data.distribution.size(); ++i)
-    res.distributions[0].data.distribution[i] += res.distributions[0].data.distribution[i-1];
   start_height = res.distributions[0].data.start_height;
   distribution = std::move(res.distributions[0].data.distribution);
   return true;
@@ -3439,8 +3890,11 @@ void wallet2::detach_blockchain(uint64_t height, std::map<std::pair<uint64_t, ui
     }
   }
 
-  for (transfer_details &td: m_transfers)
+  for (size_t i = 0; i < m_transfers.size(); ++i)
   {
+    transfer_details &td = m_transfers[i];
+    if (!td.m_uses.empty() && td.m_uses.back().first >= height)
+      m_cache_journal_state.touch_transfer(i);
     while (!td.m_uses.empty() && td.m_uses.back().first >= height)
       td.m_uses.pop_back();
   }
@@ -3458,6 +3912,7 @@ void wallet2::detach_blockchain(uint64_t height, std::map<std::pair<uint64_t, ui
     auto it_ki = m_key_images.find(m_transfers[i].m_key_image);
     THROW_WALLET_EXCEPTION_IF(it_ki == m_key_images.end(), error::wallet_internal_error, "key image not found: index " + std::to_string(i) + ", ki " + epee::string_tools::pod_to_hex(m_transfers[i].m_key_image) + ", " + std::to_string(m_key_images.size()) + " key images known");
     m_key_images.erase(it_ki);
+    m_cache_journal_state.touch_key_image(m_transfers[i].m_key_image);
   }
 
   for(size_t i = i_start; i!= m_transfers.size();i++)
@@ -3465,9 +3920,12 @@ void wallet2::detach_blockchain(uint64_t height, std::map<std::pair<uint64_t, ui
     auto it_pk = m_pub_keys.find(m_transfers[i].get_public_key());
     THROW_WALLET_EXCEPTION_IF(it_pk == m_pub_keys.end(), error::wallet_internal_error, "public key not found");
     m_pub_keys.erase(it_pk);
+    m_cache_journal_state.touch_pub_key(m_transfers[i].get_public_key());
   }
   transfers_detached = std::distance(it, m_transfers.end());
   m_transfers.erase(it, m_transfers.end());
+  m_cache_journal_state.truncate_transfers(m_transfers.size());
+  invalidate_unspent_transfer_index();
 
   size_t blocks_detached = m_blockchain.size() - height;
   m_blockchain.crop(height);
@@ -3475,7 +3933,10 @@ void wallet2::detach_blockchain(uint64_t height, std::map<std::pair<uint64_t, ui
   for (auto it = m_payments.begin(); it != m_payments.end(); )
   {
     if(height <= it->second.m_block_height)
+    {
+      m_cache_journal_state.touch_payment(it->first, it->second);
       it = m_payments.erase(it);
+    }
     else
       ++it;
   }
@@ -3483,10 +3944,14 @@ void wallet2::detach_blockchain(uint64_t height, std::map<std::pair<uint64_t, ui
   for (auto it = m_confirmed_txs.begin(); it != m_confirmed_txs.end(); )
   {
     if(height <= it->second.m_block_height)
+    {
+      m_cache_journal_state.touch_confirmed_tx(it->first);
       it = m_confirmed_txs.erase(it);
+    }
     else
       ++it;
   }
+  invalidate_transfer_history_index();
 
   LOG_PRINT_L0("Detached blockchain on height " << height << ", transfers detached " << transfers_detached << ", blocks detached " << blocks_detached);
 }
@@ -3518,6 +3983,9 @@ bool wallet2::clear()
   m_subaddress_labels.clear();
   m_multisig_rounds_passed = 0;
   m_device_last_key_image_sync = 0;
+  m_cache_journal_state.deactivate();
+  invalidate_transfer_history_index();
+  invalidate_unspent_transfer_index();
   return true;
 }
 
@@ -3534,6 +4002,9 @@ void wallet2::clear_soft(bool keep_key_images)
   m_unconfirmed_payments.clear();
   m_scanned_pool_txs[0].clear();
   m_scanned_pool_txs[1].clear();
+  m_cache_journal_state.deactivate();
+  invalidate_transfer_history_index();
+  invalidate_unspent_transfer_index();
 
   cryptonote::block b;
   generate_genesis(b);
@@ -3684,6 +4155,12 @@ bool wallet2::store_keys(const std::string& keys_file_name, const epee::wipeable
   value2.SetInt(m_track_uses ? 1 : 0);
   json.AddMember("track_uses", value2, json.GetAllocator());
 
+  value2.SetInt(m_cache_journal ? 1 : 0);
+  json.AddMember("cache_journal", value2, json.GetAllocator());
+
+  value2.SetUint(m_refresh_pipeline_depth);
+  json.AddMember("refresh_pipeline_depth", value2, json.GetAllocator());
+
   value2.SetInt(m_inactivity_lock_timeout);
   json.AddMember("inactivity_lock_timeout", value2, json.GetAllocator());
   
@@ -3842,6 +4319,8 @@ bool wallet2::load_keys(const std::string& keys_file_name, const epee::wipeable_
     m_ignore_outputs_above = MONEY_SUPPLY;
     m_ignore_outputs_below = 0;
     m_track_uses = false;
+    m_cache_journal = false;
+    m_refresh_pipeline_depth = DEFAULT_REFRESH_PIPELINE_DEPTH;
     m_inactivity_lock_timeout = DEFAULT_INACTIVITY_LOCK_TIMEOUT;
     m_setup_background_mining = BackgroundMiningMaybe;
     m_subaddress_lookahead_major = SUBADDRESS_LOOKAHEAD_MAJOR;
@@ -3998,6 +4477,10 @@ bool wallet2::load_keys(const std::string& keys_file_name, const epee::wipeable_
     m_ignore_outputs_below = field_ignore_outputs_below;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, track_uses, int, Int, false, false);
     m_track_uses = field_track_uses;
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, cache_journal, int, Int, false, false);
+    m_cache_journal = field_cache_journal;
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, refresh_pipeline_depth, uint32_t, Uint, false, DEFAULT_REFRESH_PIPELINE_DEPTH);
+    m_refresh_pipeline_depth = field_refresh_pipeline_depth;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, inactivity_lock_timeout, uint32_t, Uint, false, DEFAULT_INACTIVITY_LOCK_TIMEOUT);
     m_inactivity_lock_timeout = field_inactivity_lock_timeout;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, setup_background_mining, BackgroundMiningSetupType, Int, false, BackgroundMiningMaybe);
@@ -4789,6 +5272,7 @@ std::string wallet2::exchange_multisig_keys(const epee::wipeable_string &passwor
 
     m_subaddresses.clear();
     m_subaddress_labels.clear();
+    m_cache_journal_state.deactivate();
     add_subaddress_account(tr("Primary account"));
 
     if (!m_wallet_file.empty())
@@ -5291,6 +5775,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
     std::string buf;
     bool r = load_from_file(m_wallet_file, buf, std::numeric_limits<size_t>::max());
     THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, m_wallet_file);
+    bool journal_base = false;
 
     // try to read it as an encrypted cache
     try
@@ -5308,6 +5793,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
         iss << cache_data;
         boost::archive::portable_binary_iarchive ar(iss);
         ar >> *this;
+        journal_base = true;
       }
       catch(...)
       {
@@ -5368,6 +5854,10 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
       m_account_public_address.m_spend_public_key != m_account.get_keys().m_account_address.m_spend_public_key ||
       m_account_public_address.m_view_public_key  != m_account.get_keys().m_account_address.m_view_public_key,
       error::wallet_files_doesnt_correspond, m_keys_file, m_wallet_file);
+
+    // the journal is only ever written against a cache in the current format
+    if (journal_base)
+      load_cache_journal(cache_file_data.iv, buf.size());
   }
 
   cryptonote::block genesis;
@@ -5457,6 +5947,242 @@ std::string wallet2::path() const
   return m_wallet_file;
 }
 //----------------------------------------------------------------------------------------------------
+std::string wallet2::get_cache_rest()
+{
+  std::stringstream oss;
+  boost::archive::portable_binary_oarchive ar(oss);
+  serialize_cache_rest(ar);
+  return oss.str();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::reset_cache_journal(const crypto::chacha_iv &base, uint64_t base_size, uint64_t journal_size)
+{
+  cache_journal_state &state = m_cache_journal_state;
+  state.deactivate();
+  state.base = crypto::cn_fast_hash(&base, sizeof(base));
+  state.base_size = base_size;
+  state.journal_size = journal_size;
+  state.blockchain_offset = m_blockchain.offset();
+  state.blockchain_genesis = m_blockchain.genesis();
+  m_blockchain.mark_journaled();
+  state.transfers_size = state.transfers_kept = m_transfers.size();
+  const std::string rest = get_cache_rest();
+  state.rest = crypto::cn_fast_hash(rest.data(), rest.size());
+  state.active = true;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::store_cache_journal()
+{
+  cache_journal_state &state = m_cache_journal_state;
+  if (!state.active)
+    return false;
+
+  cache_journal_record record;
+  record.base = state.base;
+
+  record.transfers_size = m_transfers.size();
+  state.truncate_transfers(m_transfers.size());
+  for (size_t i: state.transfers)
+    if (i < state.transfers_kept)
+      record.transfers.push_back(std::make_pair(i, m_transfers[i]));
+  for (size_t i = state.transfers_kept; i < m_transfers.size(); ++i)
+    record.transfers.push_back(std::make_pair(i, m_transfers[i]));
+
+  record.blockchain_offset = m_blockchain.offset();
+  record.blockchain_genesis = m_blockchain.genesis();
+  record.blockchain_start = m_blockchain.journaled();
+  for (size_t i = record.blockchain_start; i < m_blockchain.size(); ++i)
+    record.blockchain.push_back(m_blockchain[i]);
+
+  journal_cache_map(m_key_images, state.key_images, record.key_images, record.key_images_erased);
+  journal_cache_map(m_pub_keys, state.pub_keys, record.pub_keys, record.pub_keys_erased);
+  journal_cache_map(m_confirmed_txs, state.confirmed_txs, record.confirmed_txs, record.confirmed_txs_erased);
+  journal_cache_map(m_subaddresses, state.subaddresses, record.subaddresses, record.subaddresses_erased);
+  journal_cache_map(m_tx_keys, state.tx_keys, record.tx_keys, record.tx_keys_erased);
+  journal_cache_map(m_additional_tx_keys, state.tx_keys, record.additional_tx_keys, record.additional_tx_keys_erased);
+
+  // a touched payment is replaced by whatever entries now match it, if any
+  for (const payment_key &key: state.payments)
+  {
+    record.payments_erased.push_back(key);
+    const auto range = m_payments.equal_range(key.m_payment_id);
+    for (auto i = range.first; i != range.second; ++i)
+      if (i->second.m_tx_hash == key.m_tx_hash && i->second.m_subaddr_index == key.m_subaddr_index)
+        record.payments.push_back(*i);
+  }
+
+  const std::string rest = get_cache_rest();
+  const crypto::hash rest_hash = crypto::cn_fast_hash(rest.data(), rest.size());
+  if (rest_hash != state.rest)
+    record.rest = rest;
+
+  if (record.transfers.empty() && record.transfers_size == state.transfers_size &&
+      record.blockchain.empty() && record.blockchain_offset == state.blockchain_offset && record.blockchain_genesis == state.blockchain_genesis &&
+      record.key_images.empty() && record.key_images_erased.empty() && record.pub_keys.empty() && record.pub_keys_erased.empty() &&
+      record.payments.empty() && record.payments_erased.empty() && record.confirmed_txs.empty() && record.confirmed_txs_erased.empty() &&
+      record.subaddresses.empty() && record.subaddresses_erased.empty() && record.tx_keys.empty() && record.tx_keys_erased.empty() &&
+      record.additional_tx_keys.empty() && record.additional_tx_keys_erased.empty() && record.rest.empty())
+    return true;
+
+  std::stringstream oss;
+  boost::archive::portable_binary_oarchive ar(oss);
+  ar << record;
+
+  wallet2::cache_file_data cache_file_data = {};
+  cache_file_data.cache_data = oss.str();
+  std::string cipher;
+  cipher.resize(cache_file_data.cache_data.size());
+  cache_file_data.iv = crypto::rand<crypto::chacha_iv>();
+  crypto::chacha20(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), m_cache_key, cache_file_data.iv, &cipher[0]);
+  cache_file_data.cache_data = cipher;
+
+  std::string blob;
+  const std::string journal_file = get_cache_journal_file();
+  THROW_WALLET_EXCEPTION_IF(!::serialization::dump_binary(cache_file_data, blob), error::file_save_error, journal_file);
+
+  // compact once replaying the journal would cost a good part of loading the cache
+  const uint64_t record_size = sizeof(uint64_t) + blob.size();
+  if (state.journal_size + record_size > std::max<uint64_t>(state.base_size / 2, CACHE_JOURNAL_MIN_COMPACT_SIZE))
+    return false;
+
+  uint64_t size = SWAP64LE((uint64_t)blob.size());
+  std::ofstream ostr;
+  ostr.open(journal_file, std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+  ostr.write((const char*)&size, sizeof(size));
+  ostr.write(blob.data(), blob.size());
+  ostr.close();
+  THROW_WALLET_EXCEPTION_IF(!ostr.good(), error::file_save_error, journal_file);
+
+  state.journal_size += record_size;
+  state.blockchain_offset = record.blockchain_offset;
+  state.blockchain_genesis = record.blockchain_genesis;
+  m_blockchain.mark_journaled();
+  state.transfers_size = state.transfers_kept = m_transfers.size();
+  state.transfers.clear();
+  state.key_images.clear();
+  state.pub_keys.clear();
+  state.payments.clear();
+  state.confirmed_txs.clear();
+  state.subaddresses.clear();
+  state.tx_keys.clear();
+  state.rest = rest_hash;
+  MDEBUG("Appended " << record_size << " bytes to cache journal: " << record.transfers.size() << " transfers, " <<
+      record.blockchain.size() << " block hashes, " << record.payments.size() << " payments");
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::apply_cache_journal_record(cache_journal_record &record)
+{
+  m_transfers.resize(record.transfers_size);
+  for (auto &t: record.transfers)
+  {
+    THROW_WALLET_EXCEPTION_IF(t.first >= m_transfers.size(), error::wallet_internal_error, "Cache journal transfer index out of range");
+    m_transfers[t.first] = std::move(t.second);
+  }
+
+  try
+  {
+    m_blockchain.apply_journal(record.blockchain_offset, record.blockchain_genesis, record.blockchain_start, record.blockchain);
+  }
+  catch (const std::exception &e)
+  {
+    THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Failed to apply cache journal: ") + e.what());
+  }
+
+  apply_cache_map(m_key_images, record.key_images, record.key_images_erased);
+  apply_cache_map(m_pub_keys, record.pub_keys, record.pub_keys_erased);
+  apply_cache_map(m_confirmed_txs, record.confirmed_txs, record.confirmed_txs_erased);
+  apply_cache_map(m_subaddresses, record.subaddresses, record.subaddresses_erased);
+  apply_cache_map(m_tx_keys, record.tx_keys, record.tx_keys_erased);
+  apply_cache_map(m_additional_tx_keys, record.additional_tx_keys, record.additional_tx_keys_erased);
+
+  for (const payment_key &key: record.payments_erased)
+  {
+    auto range = m_payments.equal_range(key.m_payment_id);
+    for (auto i = range.first; i != range.second; )
+    {
+      if (i->second.m_tx_hash == key.m_tx_hash && i->second.m_subaddr_index == key.m_subaddr_index)
+        i = m_payments.erase(i);
+      else
+        ++i;
+    }
+  }
+  for (const auto &p: record.payments)
+    m_payments.emplace(p);
+  invalidate_transfer_history_index();
+  invalidate_unspent_transfer_index();
+
+  if (!record.rest.empty())
+  {
+    std::stringstream iss;
+    iss << record.rest;
+    boost::archive::portable_binary_iarchive ar(iss);
+    serialize_cache_rest(ar);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_cache_journal(const crypto::chacha_iv &base, uint64_t base_size)
+{
+  const std::string journal_file = get_cache_journal_file();
+  const crypto::hash base_hash = crypto::cn_fast_hash(&base, sizeof(base));
+  uint64_t journal_size = 0;
+  boost::system::error_code e;
+  if (boost::filesystem::exists(journal_file, e) && !e)
+  {
+    std::string buf;
+    THROW_WALLET_EXCEPTION_IF(!load_from_file(journal_file, buf, std::numeric_limits<size_t>::max()), error::file_read_error, journal_file);
+
+    // stop at the first record which can not be used: a torn write, or one
+    // written against an older cache file if a store was interrupted
+    size_t records = 0;
+    while (buf.size() - journal_size >= sizeof(uint64_t))
+    {
+      uint64_t size;
+      memcpy(&size, buf.data() + journal_size, sizeof(size));
+      size = SWAP64LE(size);
+      if (size > buf.size() - journal_size - sizeof(size))
+        break;
+      wallet2::cache_file_data cache_file_data;
+      if (!::serialization::parse_binary(buf.substr(journal_size + sizeof(size), size), cache_file_data))
+        break;
+      std::string data;
+      data.resize(cache_file_data.cache_data.size());
+      crypto::chacha20(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), m_cache_key, cache_file_data.iv, &data[0]);
+      cache_journal_record record;
+      try
+      {
+        std::stringstream iss;
+        iss << data;
+        boost::archive::portable_binary_iarchive ar(iss);
+        ar >> record;
+      }
+      catch (...)
+      {
+        break;
+      }
+      if (record.base != base_hash)
+        break;
+      apply_cache_journal_record(record);
+      journal_size += sizeof(size) + size;
+      ++records;
+    }
+    LOG_PRINT_L1("Applied " << records << " cache journal records from " << journal_file);
+
+    if (journal_size < buf.size())
+    {
+      MWARNING("Discarding " << (buf.size() - journal_size) << " unusable bytes at the end of " << journal_file);
+      if (journal_size == 0)
+        boost::filesystem::remove(journal_file, e);
+      else
+        boost::filesystem::resize_file(journal_file, journal_size, e);
+      THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, journal_file);
+    }
+  }
+
+  if (m_cache_journal)
+    reset_cache_journal(base, base_size, journal_size);
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::store()
 {
   if (!m_wallet_file.empty())
@@ -5481,6 +6207,12 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     same_file = pos != std::string::npos;
   }
 
+  if (same_file && m_cache_journal && store_cache_journal())
+  {
+    if (m_message_store.get_active())
+      m_message_store.write_to_file(get_multisig_wallet_state(), m_mms_file);
+    return;
+  }
 
   if (!same_file)
   {
@@ -5538,6 +6270,14 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     if (!r) {
       LOG_ERROR("error removing file: " << old_file);
     }
+    if (boost::filesystem::exists(old_file + ".journal"))
+    {
+      r = boost::filesystem::remove(old_file + ".journal");
+      if (!r) {
+        LOG_ERROR("error removing file: " << old_file << ".journal");
+      }
+    }
+    m_cache_journal_state.deactivate();
     // remove old keys file
     r = boost::filesystem::remove(old_keys_file);
     if (!r) {
@@ -5574,6 +6314,16 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     // here we have "*.new" file, we need to rename it to be without ".new"
     std::error_code e = tools::replace_file(new_file, m_wallet_file);
     THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_wallet_file, e);
+
+    // the journal was written against the previous cache, it is now part of it
+    const std::string journal_file = get_cache_journal_file();
+    boost::system::error_code ec;
+    if (boost::filesystem::exists(journal_file, ec) && !boost::filesystem::remove(journal_file, ec))
+      LOG_ERROR("error removing file: " << journal_file);
+    if (m_cache_journal)
+      reset_cache_journal(cache_file_data.iv, cache_file_data.cache_data.size(), 0);
+    else
+      m_cache_journal_state.deactivate();
   }
   if (m_message_store.get_active())
   {
@@ -5612,15 +6362,19 @@ uint64_t wallet2::unlocked_balance(uint32_t index_major, bool strict, uint64_t *
 std::map<uint32_t, uint64_t> wallet2::balance_per_subaddress(uint32_t index_major, bool strict) const
 {
   std::map<uint32_t, uint64_t> amount_per_subaddr;
-  for (const auto& td: m_transfers)
+  for (const auto &unspent: get_unspent_transfers(index_major))
   {
-    if (td.m_subaddr_index.major == index_major && !is_spent(td, strict) && !td.m_frozen)
+    for (size_t i: unspent.second)
     {
-      auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
-      if (found == amount_per_subaddr.end())
-        amount_per_subaddr[td.m_subaddr_index.minor] = td.amount();
-      else
-        found->second += td.amount();
+      const transfer_details& td = m_transfers[i];
+      if (!is_spent(td, strict) && !td.m_frozen)
+      {
+        auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
+        if (found == amount_per_subaddr.end())
+          amount_per_subaddr[td.m_subaddr_index.minor] = td.amount();
+        else
+          found->second += td.amount();
+      }
     }
   }
   if (!strict)
@@ -5645,31 +6399,35 @@ std::map<uint32_t, std::pair<uint64_t, uint64_t>> wallet2::unlocked_balance_per_
 {
   std::map<uint32_t, std::pair<uint64_t, uint64_t>> amount_per_subaddr;
   const uint64_t blockchain_height = get_blockchain_current_height();
-  for(const transfer_details& td: m_transfers)
+  for (const auto &unspent: get_unspent_transfers(index_major))
   {
-    if(td.m_subaddr_index.major == index_major && !is_spent(td, strict) && !td.m_frozen)
+    for (size_t i: unspent.second)
     {
-      uint64_t amount = 0, blocks_to_unlock = 0;
-      if (is_transfer_unlocked(td))
-      {
-        amount = td.amount();
-        blocks_to_unlock = 0;
-      }
-      else
-      {
-        uint64_t unlock_height = td.m_block_height + std::max<uint64_t>(CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE, CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS);
-        if (td.m_tx.unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER && td.m_tx.unlock_time > unlock_height)
-          unlock_height = td.m_tx.unlock_time;
-        blocks_to_unlock = unlock_height > blockchain_height ? unlock_height - blockchain_height : 0;
-        amount = 0;
-      }
-      auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
-      if (found == amount_per_subaddr.end())
-        amount_per_subaddr[td.m_subaddr_index.minor] = std::make_pair(amount, blocks_to_unlock);
-      else
+      const transfer_details& td = m_transfers[i];
+      if(!is_spent(td, strict) && !td.m_frozen)
       {
-        found->second.first += amount;
-        found->second.second = std::max(found->second.second, blocks_to_unlock);
+        uint64_t amount = 0, blocks_to_unlock = 0;
+        if (is_transfer_unlocked(td))
+        {
+          amount = td.amount();
+          blocks_to_unlock = 0;
+        }
+        else
+        {
+          uint64_t unlock_height = td.m_block_height + std::max<uint64_t>(CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE, CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS);
+          if (td.m_tx.unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER && td.m_tx.unlock_time > unlock_height)
+            unlock_height = td.m_tx.unlock_time;
+          blocks_to_unlock = unlock_height > blockchain_height ? unlock_height - blockchain_height : 0;
+          amount = 0;
+        }
+        auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
+        if (found == amount_per_subaddr.end())
+          amount_per_subaddr[td.m_subaddr_index.minor] = std::make_pair(amount, blocks_to_unlock);
+        else
+        {
+          found->second.first += amount;
+          found->second.second = std::max(found->second.second, blocks_to_unlock);
+        }
       }
     }
   }
@@ -5719,29 +6477,169 @@ void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::pa
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
 {
-  auto range = std::make_pair(m_payments.begin(), m_payments.end());
-  std::for_each(range.first, range.second, [&payments, &min_height, &max_height, &subaddr_account, &subaddr_indices](const payment_container::value_type& x) {
-    if (min_height < x.second.m_block_height && max_height >= x.second.m_block_height &&
-      (!subaddr_account || *subaddr_account == x.second.m_subaddr_index.major) &&
-      (subaddr_indices.empty() || subaddr_indices.count(x.second.m_subaddr_index.minor) == 1))
-    {
-      payments.push_back(x);
-    }
-  });
+  boost::optional<history_cursor> next;
+  get_transfer_history(&payments, NULL, min_height, max_height, subaddr_account, subaddr_indices, boost::none, 0, next);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
     uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
 {
-  for (auto i = m_confirmed_txs.begin(); i != m_confirmed_txs.end(); ++i) {
-    if (i->second.m_block_height <= min_height || i->second.m_block_height > max_height)
-      continue;
-    if (subaddr_account && *subaddr_account != i->second.m_subaddr_account)
-      continue;
-    if (!subaddr_indices.empty() && std::count_if(i->second.m_subaddr_indices.begin(), i->second.m_subaddr_indices.end(), [&subaddr_indices](uint32_t index) { return subaddr_indices.count(index) == 1; }) == 0)
-      continue;
-    confirmed_payments.push_back(*i);
+  boost::optional<history_cursor> next;
+  get_transfer_history(NULL, &confirmed_payments, min_height, max_height, subaddr_account, subaddr_indices, boost::none, 0, next);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::get_transfer_history(std::list<std::pair<crypto::hash,wallet2::payment_details>> *in, std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>> *out,
+    uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices,
+    const boost::optional<history_cursor> &after, size_t limit, boost::optional<history_cursor> &next) const
+{
+  next = boost::none;
+  if (min_height == std::numeric_limits<uint64_t>::max() || min_height >= max_height)
+    return;
+
+  boost::unique_lock<boost::mutex> lock(m_transfer_history_index_lock);
+  const transfer_history_index &index = get_transfer_history_index(lock);
+  static const std::multimap<history_cursor, const transfer_history_index::payment_entry*> no_in;
+  static const std::map<history_cursor, const transfer_history_index::confirmed_entry*> no_out;
+  const auto *in_index = &index.in;
+  const auto *out_index = &index.out;
+  if (subaddr_account)
+  {
+    auto i = index.in_by_account.find(*subaddr_account);
+    in_index = i == index.in_by_account.end() ? &no_in : &i->second;
+    auto o = index.out_by_account.find(*subaddr_account);
+    out_index = o == index.out_by_account.end() ? &no_out : &o->second;
+  }
+  if (!in)
+    in_index = &no_in;
+  if (!out)
+    out_index = &no_out;
+
+  // heights are exclusive of min_height, as for get_payments
+  history_cursor start{min_height + 1, crypto::null_hash};
+  const bool resume = after && !(*after < start);
+  auto i = resume ? in_index->upper_bound(*after) : in_index->lower_bound(start);
+  auto o = resume ? out_index->upper_bound(*after) : out_index->lower_bound(start);
+  auto in_range = [&]() { return i != in_index->end() && i->first.height <= max_height; };
+  auto out_range = [&]() { return o != out_index->end() && o->first.height <= max_height; };
+
+  // the cursor handed out is the last key looked at, and a resumed page starts after it
+  size_t count = 0;
+  boost::optional<history_cursor> last;
+  while (in_range() || out_range())
+  {
+    const history_cursor key = !out_range() || (in_range() && i->first < o->first) ? i->first : o->first;
+    if (limit && count >= limit)
+    {
+      next = last;
+      break;
+    }
+    last = key;
+    for (; in_range() && i->first == key; ++i)
+    {
+      const payment_details &pd = i->second->second;
+      if (subaddr_indices.empty() || subaddr_indices.count(pd.m_subaddr_index.minor) == 1)
+      {
+        in->push_back(*i->second);
+        ++count;
+      }
+    }
+    if (out_range() && o->first == key)
+    {
+      const confirmed_transfer_details &ctd = o->second->second;
+      if (subaddr_indices.empty() || std::count_if(ctd.m_subaddr_indices.begin(), ctd.m_subaddr_indices.end(), [&subaddr_indices](uint32_t index) { return subaddr_indices.count(index) == 1; }) != 0)
+      {
+        out->push_back(*o->second);
+        ++count;
+      }
+      ++o;
+    }
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::get_payments_by_txid(const crypto::hash &txid, std::list<std::pair<crypto::hash,wallet2::payment_details>> &payments, std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>> &confirmed_payments, const boost::optional<uint32_t>& subaddr_account) const
+{
+  boost::unique_lock<boost::mutex> lock(m_transfer_history_index_lock);
+  const transfer_history_index &index = get_transfer_history_index(lock);
+  auto range = index.in_by_txid.equal_range(txid);
+  for (auto i = range.first; i != range.second; ++i)
+  {
+    const payment_details &pd = i->second->second;
+    if (pd.m_block_height > 0 && (!subaddr_account || *subaddr_account == pd.m_subaddr_index.major))
+      payments.push_back(*i->second);
+  }
+  auto o = m_confirmed_txs.find(txid);
+  if (o != m_confirmed_txs.end() && o->second.m_block_height > 0 && (!subaddr_account || *subaddr_account == o->second.m_subaddr_account))
+    confirmed_payments.push_back(*o);
+}
+//----------------------------------------------------------------------------------------------------
+const wallet2::transfer_history_index &wallet2::get_transfer_history_index(const boost::unique_lock<boost::mutex> &lock) const
+{
+  THROW_WALLET_EXCEPTION_IF(!lock.owns_lock() || lock.mutex() != &m_transfer_history_index_lock, error::wallet_internal_error,
+      "The transfer history index is used without its lock");
+  transfer_history_index &index = m_transfer_history_index;
+  // a change that did not clear the index would at least show as a size mismatch
+  if (index.valid && index.in.size() == m_payments.size() && index.out.size() == m_confirmed_txs.size())
+    return index;
+
+  MDEBUG("Building transfer history index for " << m_payments.size() << " incoming and " << m_confirmed_txs.size() << " outgoing transfers");
+  index.clear();
+  for (const auto &p: m_payments)
+  {
+    const history_cursor key{p.second.m_block_height, p.second.m_tx_hash};
+    index.in.emplace(key, &p);
+    index.in_by_account[p.second.m_subaddr_index.major].emplace(key, &p);
+    index.in_by_txid.emplace(p.second.m_tx_hash, &p);
+  }
+  for (const auto &p: m_confirmed_txs)
+  {
+    const history_cursor key{p.second.m_block_height, p.first};
+    index.out.emplace(key, &p);
+    index.out_by_account[p.second.m_subaddr_account].emplace(key, &p);
   }
+  index.valid = true;
+  return index;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::invalidate_transfer_history_index()
+{
+  boost::unique_lock<boost::mutex> lock(m_transfer_history_index_lock);
+  m_transfer_history_index.clear();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_payment(const payment_container::value_type &payment)
+{
+  boost::unique_lock<boost::mutex> lock(m_transfer_history_index_lock);
+  transfer_history_index &index = m_transfer_history_index;
+  if (!index.valid)
+    return;
+  const history_cursor key{payment.second.m_block_height, payment.second.m_tx_hash};
+  index.in.emplace(key, &payment);
+  index.in_by_account[payment.second.m_subaddr_index.major].emplace(key, &payment);
+  index.in_by_txid.emplace(payment.second.m_tx_hash, &payment);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &ctd)
+{
+  boost::unique_lock<boost::mutex> lock(m_transfer_history_index_lock);
+  transfer_history_index &index = m_transfer_history_index;
+  if (!index.valid)
+    return;
+  const history_cursor key{ctd.second.m_block_height, ctd.first};
+  index.out.emplace(key, &ctd);
+  index.out_by_account[ctd.second.m_subaddr_account].emplace(key, &ctd);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::unindex_confirmed_tx(const crypto::hash &txid, uint64_t height, uint32_t subaddr_account)
+{
+  boost::unique_lock<boost::mutex> lock(m_transfer_history_index_lock);
+  transfer_history_index &index = m_transfer_history_index;
+  if (!index.valid)
+    return;
+  const history_cursor key{height, txid};
+  index.out.erase(key);
+  auto i = index.out_by_account.find(subaddr_account);
+  if (i != index.out_by_account.end())
+    i->second.erase(key);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_unconfirmed_payments_out(std::list<std::pair<crypto::hash,wallet2::unconfirmed_transfer_details>>& unconfirmed_payments, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
@@ -6155,6 +7053,7 @@ void wallet2::commit_tx(pending_tx& ptx)
   {
     m_tx_keys.insert(std::make_pair(txid, ptx.tx_key));
     m_additional_tx_keys.insert(std::make_pair(txid, ptx.additional_tx_keys));
+    m_cache_journal_state.touch_tx_keys(txid);
   }
 
   LOG_PRINT_L2("transaction " << txid << " generated ok and sent to daemon, key_images: [" << ptx.key_images << "]");
@@ -6166,7 +7065,10 @@ void wallet2::commit_tx(pending_tx& ptx)
 
   // tx generated, get rid of used k values
   for (size_t idx: ptx.selected_transfers)
+  {
     m_transfers[idx].m_multisig_k.clear();
+    m_cache_journal_state.touch_transfer(idx);
+  }
 
   //fee includes dust if dust policy specified it.
   LOG_PRINT_L1("Transaction successfully sent. <" << txid << ">" << ENDL
@@ -6353,6 +7255,7 @@ bool wallet2::sign_tx(unsigned_tx_set &exported_txs, std::vector<wallet2::pendin
       const crypto::hash txid = get_transaction_hash(ptx.tx);
       m_tx_keys.insert(std::make_pair(txid, tx_key));
       m_additional_tx_keys.insert(std::make_pair(txid, additional_tx_keys));
+      m_cache_journal_state.touch_tx_keys(txid);
     }
 
     std::string key_images;
@@ -6612,7 +7515,10 @@ std::string wallet2::save_multisig_tx(multisig_tx_set txs)
   // txes generated, get rid of used k values
   for (size_t n = 0; n < txs.m_ptx.size(); ++n)
     for (size_t idx: txs.m_ptx[n].construction_data.selected_transfers)
+    {
       m_transfers[idx].m_multisig_k.clear();
+      m_cache_journal_state.touch_transfer(idx);
+    }
 
   // zero out some data we don't want to share
   for (auto &ptx: txs.m_ptx)
@@ -6750,6 +7656,7 @@ bool wallet2::load_multisig_tx(cryptonote::blobdata s, multisig_tx_set &exported
       {
         m_tx_keys.insert(std::make_pair(txid, ptx.tx_key));
         m_additional_tx_keys.insert(std::make_pair(txid, ptx.additional_tx_keys));
+        m_cache_journal_state.touch_tx_keys(txid);
       }
     }
   }
@@ -6877,6 +7784,7 @@ bool wallet2::sign_multisig_tx(multisig_tx_set &exported_txs, std::vector<crypto
       {
         m_tx_keys.insert(std::make_pair(txid, ptx.tx_key));
         m_additional_tx_keys.insert(std::make_pair(txid, ptx.additional_tx_keys));
+        m_cache_journal_state.touch_tx_keys(txid);
       }
       txids.push_back(txid);
     }
@@ -6885,7 +7793,10 @@ bool wallet2::sign_multisig_tx(multisig_tx_set &exported_txs, std::vector<crypto
   // txes generated, get rid of used k values
   for (size_t n = 0; n < exported_txs.m_ptx.size(); ++n)
     for (size_t idx: exported_txs.m_ptx[n].construction_data.selected_transfers)
+    {
       m_transfers[idx].m_multisig_k.clear();
+      m_cache_journal_state.touch_transfer(idx);
+    }
 
   exported_txs.m_signers.insert(get_multisig_signer_public_key());
 
@@ -8303,11 +9214,22 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money, ui
 
   LOG_PRINT_L2("pick_preferred_rct_inputs: needed_money " << print_money(needed_money));
 
+  // the unspent outputs of the candidate subaddresses, in transfer order
+  const std::map<uint32_t, std::set<size_t>> &unspent = get_unspent_transfers(subaddr_account);
+  std::vector<size_t> candidates;
+  for (uint32_t index_minor: subaddr_indices)
+  {
+    auto it = unspent.find(index_minor);
+    if (it != unspent.end())
+      candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+  }
+  std::sort(candidates.begin(), candidates.end());
+
   // try to find a rct input of enough size
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (size_t i: candidates)
   {
     const transfer_details& td = m_transfers[i];
-    if (!is_spent(td, false) && !td.m_frozen && td.is_rct() && td.amount() >= needed_money && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && subaddr_indices.count(td.m_subaddr_index.minor) == 1)
+    if (!is_spent(td, false) && !td.m_frozen && td.is_rct() && td.amount() >= needed_money && is_transfer_unlocked(td))
     {
       if (td.amount() > m_ignore_outputs_above || td.amount() < m_ignore_outputs_below)
       {
@@ -8325,10 +9247,10 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money, ui
   // this could be made better by picking one of the outputs to be a small one, since those
   // are less useful since often below the needed money, so if one can be used in a pair,
   // it gets rid of it for the future
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (size_t i: candidates)
   {
     const transfer_details& td = m_transfers[i];
-    if (!is_spent(td, false) && !td.m_frozen && !td.m_key_image_partial && td.is_rct() && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && subaddr_indices.count(td.m_subaddr_index.minor) == 1)
+    if (!is_spent(td, false) && !td.m_frozen && !td.m_key_image_partial && td.is_rct() && is_transfer_unlocked(td))
     {
       if (td.amount() > m_ignore_outputs_above || td.amount() < m_ignore_outputs_below)
       {
@@ -8336,8 +9258,11 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money, ui
         continue;
       }
       LOG_PRINT_L2("Considering input " << i << ", " << print_money(td.amount()));
-      for (size_t j = i + 1; j < m_transfers.size(); ++j)
+      // the second output has to be from the same subaddress
+      const std::set<size_t> &same_subaddr = unspent.find(td.m_subaddr_index.minor)->second;
+      for (auto jt = same_subaddr.upper_bound(i); jt != same_subaddr.end(); ++jt)
       {
+        const size_t j = *jt;
         const transfer_details& td2 = m_transfers[j];
         if (td2.amount() > m_ignore_outputs_above || td2.amount() < m_ignore_outputs_below)
         {
@@ -8505,6 +9430,8 @@ void wallet2::light_wallet_get_unspent_outs()
   
   // Clear old outputs
   m_transfers.clear();
+  invalidate_unspent_transfer_index();
+  m_cache_journal_state.deactivate();
   
   for (const auto &o: ores.outputs) {
     bool spent = false;
@@ -8746,7 +9673,8 @@ void wallet2::light_wallet_get_address_txs()
         }
       } else {
         if (std::find(payments_txs.begin(), payments_txs.end(), tx_hash) == payments_txs.end()) {
-          m_payments.emplace(tx_hash, payment);
+          index_payment(*m_payments.emplace(tx_hash, payment));
+          m_cache_journal_state.touch_payment(tx_hash, payment);
           if (0 != m_callback) {
             m_callback->on_lw_money_received(t.height, payment.m_tx_hash, payment.m_amount);
           }
@@ -8794,7 +9722,12 @@ void wallet2::light_wallet_get_address_txs()
             ctd.m_payment_id = payment_id;
             ctd.m_block_height = t.height;
             ctd.m_timestamp = t.timestamp;
-            m_confirmed_txs.emplace(tx_hash,ctd);
+            auto entry = m_confirmed_txs.emplace(tx_hash,ctd);
+            if (entry.second)
+            {
+              index_confirmed_tx(*entry.first);
+              m_cache_journal_state.touch_confirmed_tx(tx_hash);
+            }
           }
           if (0 != m_callback)
           {
@@ -8811,6 +9744,7 @@ void wallet2::light_wallet_get_address_txs()
             confirmed_tx->second.m_amount_in = amount_sent;
             confirmed_tx->second.m_amount_out = amount_sent;
             confirmed_tx->second.m_change = 0;
+            m_cache_journal_state.touch_confirmed_tx(tx_hash);
           }
         }
       }
@@ -8895,6 +9829,44 @@ bool wallet2::light_wallet_key_image_is_ours(const crypto::key_image& key_image,
   m_key_image_cache.emplace(tx_public_key, index_keyimage_map);
   return key_image == calculated_key_image;
 }
+//----------------------------------------------------------------------------------------------------
+// Builds the final version of a set of txes. Once their inputs, destinations, fee and decoys are
+// chosen, the txes do not depend on each other, so they are proved and signed concurrently unless
+// a hardware device has to see them one at a time, or multisig signing draws on shared wallet state.
+// Results and errors are kept in tx order. Returns the time spent building them, summed over all txes.
+template<typename T, typename F>
+static uint64_t construct_txes(hw::device &hwdev, bool multisig, std::vector<T> &txes, const F &construct)
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  std::atomic<uint64_t> busy_ns{0};
+  if (hwdev.get_type() != hw::device::SOFTWARE || multisig || txes.size() < 2 || tpool.get_max_concurrency() < 2)
+  {
+    for (T &tx: txes)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      construct(tx);
+      busy_ns += elapsed_ns(start);
+    }
+    return busy_ns;
+  }
+
+  std::vector<std::exception_ptr> errors(txes.size());
+  tools::threadpool::waiter waiter;
+  for (size_t i = 0; i < txes.size(); ++i)
+  {
+    tpool.submit(&waiter, [&, i]() {
+      const auto start = std::chrono::steady_clock::now();
+      try { construct(txes[i]); }
+      catch (...) { errors[i] = std::current_exception(); }
+      busy_ns += elapsed_ns(start);
+    }, true);
+  }
+  waiter.wait(&tpool);
+  for (const std::exception_ptr &e: errors)
+    if (e)
+      std::rethrow_exception(e);
+  return busy_ns;
+}
 
 // Another implementation of transaction creation that is hopefully better
 // While there is anything left to pay, it goes through random outputs and tries
@@ -9025,46 +9997,39 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
   // gather all dust and non-dust outputs belonging to specified subaddresses
   size_t num_nondust_outputs = 0;
   size_t num_dust_outputs = 0;
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (const auto &unspent: get_unspent_transfers(subaddr_account))
   {
-    const transfer_details& td = m_transfers[i];
-    if (!is_spent(td, false) && !td.m_frozen && !td.m_key_image_partial && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && subaddr_indices.count(td.m_subaddr_index.minor) == 1)
+    const uint32_t index_minor = unspent.first;
+    if (subaddr_indices.count(index_minor) != 1)
+      continue;
+    std::vector<size_t> transfers_indices, dust_indices;
+    for (size_t i: unspent.second)
     {
-      if (td.amount() > m_ignore_outputs_above || td.amount() < m_ignore_outputs_below)
+      const transfer_details& td = m_transfers[i];
+      if (!is_spent(td, false) && !td.m_frozen && !td.m_key_image_partial && is_transfer_unlocked(td))
       {
-        MDEBUG("Ignoring output " << i << " of amount " << print_money(td.amount()) << " which is outside prescribed range [" << print_money(m_ignore_outputs_below) << ", " << print_money(m_ignore_outputs_above) << "]");
-        continue;
-      }
-      const uint32_t index_minor = td.m_subaddr_index.minor;
-      auto find_predicate = [&index_minor](const std::pair<uint32_t, std::vector<size_t>>& x) { return x.first == index_minor; };
-      if ((td.is_rct()) || is_valid_decomposed_amount(td.amount()))
-      {
-        auto found = std::find_if(unused_transfers_indices_per_subaddr.begin(), unused_transfers_indices_per_subaddr.end(), find_predicate);
-        if (found == unused_transfers_indices_per_subaddr.end())
+        if (td.amount() > m_ignore_outputs_above || td.amount() < m_ignore_outputs_below)
         {
-          unused_transfers_indices_per_subaddr.push_back({index_minor, {i}});
+          MDEBUG("Ignoring output " << i << " of amount " << print_money(td.amount()) << " which is outside prescribed range [" << print_money(m_ignore_outputs_below) << ", " << print_money(m_ignore_outputs_above) << "]");
+          continue;
         }
+        if ((td.is_rct()) || is_valid_decomposed_amount(td.amount()))
+          transfers_indices.push_back(i);
         else
-        {
-          found->second.push_back(i);
-        }
-        ++num_nondust_outputs;
-      }
-      else
-      {
-        auto found = std::find_if(unused_dust_indices_per_subaddr.begin(), unused_dust_indices_per_subaddr.end(), find_predicate);
-        if (found == unused_dust_indices_per_subaddr.end())
-        {
-          unused_dust_indices_per_subaddr.push_back({index_minor, {i}});
-        }
-        else
-        {
-          found->second.push_back(i);
-        }
-        ++num_dust_outputs;
+          dust_indices.push_back(i);
       }
     }
+    num_nondust_outputs += transfers_indices.size();
+    num_dust_outputs += dust_indices.size();
+    if (!transfers_indices.empty())
+      unused_transfers_indices_per_subaddr.push_back({index_minor, std::move(transfers_indices)});
+    if (!dust_indices.empty())
+      unused_dust_indices_per_subaddr.push_back({index_minor, std::move(dust_indices)});
   }
+  // list subaddresses in the order their first output was received, as when scanning all transfers
+  auto first_output_predicate = [](const std::pair<uint32_t, std::vector<size_t>>& x, const std::pair<uint32_t, std::vector<size_t>>& y) { return x.second.front() < y.second.front(); };
+  std::sort(unused_transfers_indices_per_subaddr.begin(), unused_transfers_indices_per_subaddr.end(), first_output_predicate);
+  std::sort(unused_dust_indices_per_subaddr.begin(), unused_dust_indices_per_subaddr.end(), first_output_predicate);
 
   // shuffle & sort output indices
   {
@@ -9081,6 +10046,10 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
   if (unused_dust_indices_per_subaddr.empty() && unused_transfers_indices_per_subaddr.empty())
     return std::vector<wallet2::pending_tx>();
 
+  // per stage timings: trial txes are built with dummy range proofs, only the final ones are proved
+  const auto selection_start = std::chrono::steady_clock::now();
+  uint64_t decoy_ns = 0, trial_ns = 0;
+
   // if empty, put dummy entry so that the front can be referenced later in the loop
   if (unused_dust_indices_per_subaddr.empty())
     unused_dust_indices_per_subaddr.push_back({});
@@ -9283,8 +10252,16 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
       LOG_PRINT_L2("Trying to create a tx now, with " << tx.dsts.size() << " outputs and " <<
         tx.selected_transfers.size() << " inputs");
 
+      auto start = std::chrono::steady_clock::now();
+      if (outs.empty())
+      {
+        get_outs(outs, tx.selected_transfers, fake_outs_count, rct_config); // may throw
+        decoy_ns += elapsed_ns(start);
+        start = std::chrono::steady_clock::now();
+      }
       transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, outs, unlock_time, needed_fee, extra,
         test_tx, test_ptx, rct_config);
+      trial_ns += elapsed_ns(start);
 
       auto txBlob = t_serializable_object_to_blob(test_ptx.tx);
       needed_fee = calculate_fee(fee_per_kb, txBlob, fee_multiplier);
@@ -9324,8 +10301,10 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
         LOG_PRINT_L2("We made a tx, adjusting fee and saving it, we need " << print_money(needed_fee) << " and we have " << print_money(test_ptx.fee));
         while (needed_fee > test_ptx.fee) {
 
+          start = std::chrono::steady_clock::now();
           transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, outs, unlock_time, needed_fee, extra,
             test_tx, test_ptx, rct_config);
+          trial_ns += elapsed_ns(start);
 
           txBlob = t_serializable_object_to_blob(test_ptx.tx);
           needed_fee = calculate_fee(fee_per_kb, txBlob, fee_multiplier);
@@ -9379,11 +10358,12 @@ skip_tx:
 
   LOG_PRINT_L1("Done creating " << txes.size() << " transactions, " << print_money(accumulated_fee) <<
     " total fee, " << print_money(accumulated_change) << " total change");
+  const uint64_t selection_ns = elapsed_ns(selection_start);
 
   hwdev.set_mode(hw::device::TRANSACTION_CREATE_REAL);
-  for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
+  const auto construct_start = std::chrono::steady_clock::now();
+  const uint64_t construct_busy_ns = construct_txes(hwdev, m_multisig, txes, [&](TX &tx)
   {
-    TX &tx = *i;
     cryptonote::transaction test_tx;
     pending_tx test_ptx;
 
@@ -9402,7 +10382,11 @@ skip_tx:
     tx.tx = test_tx;
     tx.ptx = test_ptx;
     tx.weight = get_transaction_weight(test_tx, txBlob.size());
-  }
+  });
+  const uint64_t construct_ns = elapsed_ns(construct_start);
+  MINFO("Created " << txes.size() << " txes: output selection " << (selection_ns - decoy_ns - trial_ns) / 1000000 << " ms, decoy fetch "
+      << decoy_ns / 1000000 << " ms, trial txes " << trial_ns / 1000000 << " ms, proving and signing " << construct_ns / 1000000
+      << " ms (" << construct_busy_ns / 1000000 << " ms over all txes)");
 
   std::vector<wallet2::pending_tx> ptx_vector;
   for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
@@ -9502,18 +10486,23 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_all(uint64_t below
 
   // gather all dust and non-dust outputs of specified subaddress (if any) and below specified threshold (if any)
   bool fund_found = false;
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (const auto &unspent: get_unspent_transfers(subaddr_account))
   {
-    const transfer_details& td = m_transfers[i];
-    if (!is_spent(td, false) && !td.m_frozen && !td.m_key_image_partial && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && (subaddr_indices.empty() || subaddr_indices.count(td.m_subaddr_index.minor) == 1))
+    if (!subaddr_indices.empty() && subaddr_indices.count(unspent.first) != 1)
+      continue;
+    for (size_t i: unspent.second)
     {
-      fund_found = true;
-      if (below == 0 || td.amount() < below)
+      const transfer_details& td = m_transfers[i];
+      if (!is_spent(td, false) && !td.m_frozen && !td.m_key_image_partial && is_transfer_unlocked(td))
       {
-        if ((td.is_rct()) || is_valid_decomposed_amount(td.amount()))
-          unused_transfer_dust_indices_per_subaddr[td.m_subaddr_index.minor].first.push_back(i);
-        else
-          unused_transfer_dust_indices_per_subaddr[td.m_subaddr_index.minor].second.push_back(i);
+        fund_found = true;
+        if (below == 0 || td.amount() < below)
+        {
+          if ((td.is_rct()) || is_valid_decomposed_amount(td.amount()))
+            unused_transfer_dust_indices_per_subaddr[td.m_subaddr_index.minor].first.push_back(i);
+          else
+            unused_transfer_dust_indices_per_subaddr[td.m_subaddr_index.minor].second.push_back(i);
+        }
       }
     }
   }
@@ -9712,9 +10701,9 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_from(const crypton
     " total fee, " << print_money(accumulated_change) << " total change");
  
   hwdev.set_mode(hw::device::TRANSACTION_CREATE_REAL);
-  for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
+  const auto construct_start = std::chrono::steady_clock::now();
+  const uint64_t construct_busy_ns = construct_txes(hwdev, m_multisig, txes, [&](TX &tx)
   {
-    TX &tx = *i;
     cryptonote::transaction test_tx;
     pending_tx test_ptx;
 
@@ -9725,7 +10714,9 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_from(const crypton
     tx.tx = test_tx;
     tx.ptx = test_ptx;
     tx.weight = get_transaction_weight(test_tx, txBlob.size());
-  }
+  });
+  MINFO("Created " << txes.size() << " txes: proving and signing " << elapsed_ns(construct_start) / 1000000
+      << " ms (" << construct_busy_ns / 1000000 << " ms over all txes)");
 
   std::vector<wallet2::pending_tx> ptx_vector;
   for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
@@ -10181,6 +11172,7 @@ void wallet2::set_tx_key(const crypto::hash &txid, const crypto::secret_key &tx_
   THROW_WALLET_EXCEPTION_IF(additional_tx_keys.size() != additional_tx_pub_keys.data.size(), error::wallet_internal_error, "The number of additional tx secret keys doesn't agree with the number of additional tx public keys in the blockchain" );
   m_tx_keys.insert(std::make_pair(txid, tx_key));
   m_additional_tx_keys.insert(std::make_pair(txid, additional_tx_keys));
+  m_cache_journal_state.touch_tx_keys(txid);
 }
 std::string wallet2::get_spend_proof(const crypto::hash &txid, const std::string &message)
 {
@@ -11531,6 +12523,7 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
   PERF_TIMER_STOP(import_key_images_A);
 
   PERF_TIMER_START(import_key_images_B);
+  m_cache_journal_state.deactivate();
   for (size_t n = 0; n < signed_key_images.size(); ++n)
   {
     m_transfers[n + offset].m_key_image = signed_key_images[n].first;
@@ -11558,6 +12551,7 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
       transfer_details &td = m_transfers[n + offset];
       td.m_spent = daemon_resp.spent_status[n] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT;
     }
+    invalidate_unspent_transfer_index();
   }
   spent = 0;
   unspent = 0;
@@ -11750,6 +12744,7 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
       m_confirmed_txs.insert(std::make_pair(spent_txid, pd));
     }
     PERF_TIMER_STOP(import_key_images_G);
+    invalidate_transfer_history_index();
   }
 
   return m_transfers[signed_key_images.size() + offset - 1].m_block_height;
@@ -11777,6 +12772,9 @@ bool wallet2::import_key_images(std::vector<crypto::key_image> key_images, size_
     td.m_key_image_request = false;
     td.m_key_image_partial = false;
     m_pub_keys[td.get_public_key()] = transfer_idx;
+    m_cache_journal_state.touch_transfer(transfer_idx);
+    m_cache_journal_state.touch_key_image(td.m_key_image);
+    m_cache_journal_state.touch_pub_key(td.get_public_key());
   }
 
   return true;
@@ -11809,18 +12807,22 @@ wallet2::payment_container wallet2::export_payments() const
 void wallet2::import_payments(const payment_container &payments)
 {
   m_payments.clear();
+  m_cache_journal_state.deactivate();
   for (auto const &p : payments)
   {
     m_payments.emplace(p);
   }
+  invalidate_transfer_history_index();
 }
 void wallet2::import_payments_out(const std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>> &confirmed_payments)
 {
   m_confirmed_txs.clear();
+  m_cache_journal_state.deactivate();
   for (auto const &p : confirmed_payments)
   {
     m_confirmed_txs.emplace(p);
   }
+  invalidate_transfer_history_index();
 }
 
 std::tuple<size_t,crypto::hash,std::vector<crypto::hash>> wallet2::export_blockchain() const
@@ -11838,6 +12840,7 @@ std::tuple<size_t,crypto::hash,std::vector<crypto::hash>> wallet2::export_blockc
 void wallet2::import_blockchain(const std::tuple<size_t, crypto::hash, std::vector<crypto::hash>> &bc)
 {
   m_blockchain.clear();
+  m_cache_journal_state.deactivate();
   if (std::get<0>(bc))
   {
     for (size_t n = std::get<0>(bc); n > 0; --n)
@@ -11905,6 +12908,8 @@ size_t wallet2::import_outputs(const std::pair<size_t, std::vector<tools::wallet
   const size_t offset = outputs.first;
   const size_t original_size = m_transfers.size();
   m_transfers.resize(offset + outputs.second.size());
+  invalidate_unspent_transfer_index();
+  m_cache_journal_state.deactivate();
   for (size_t i = 0; i < offset; ++i)
     m_transfers[i].m_key_image_request = false;
   for (size_t i = 0; i < outputs.second.size(); ++i)
@@ -12131,6 +13136,7 @@ cryptonote::blobdata wallet2::export_multisig()
   const crypto::public_key signer = get_multisig_signer_public_key();
 
   info.resize(m_transfers.size());
+  m_cache_journal_state.deactivate();
   for (size_t n = 0; n < m_transfers.size(); ++n)
   {
     transfer_details &td = m_transfers[n];
@@ -12186,12 +13192,15 @@ void wallet2::update_multisig_rescan_info(const std::vector<std::vector<rct::key
     td.m_multisig_info.push_back(pi[n]);
   }
   m_key_images.erase(td.m_key_image);
+  m_cache_journal_state.touch_key_image(td.m_key_image);
   td.m_key_image = get_multisig_composite_key_image(n);
   td.m_key_image_known = true;
   td.m_key_image_request = false;
   td.m_key_image_partial = false;
   td.m_multisig_k = multisig_k[n];
   m_key_images[td.m_key_image] = n;
+  m_cache_journal_state.touch_key_image(td.m_key_image);
+  m_cache_journal_state.touch_transfer(n);
 }
 //----------------------------------------------------------------------------------------------------
 size_t wallet2::import_multisig(std::vector<cryptonote::blobdata> blobs)
@@ -12955,6 +13964,7 @@ void wallet2::finish_rescan_bc_keep_key_images(uint64_t transfer_height, const c
   }
 
   // Restore key images in m_transfers from m_key_images
+  m_cache_journal_state.deactivate();
   for(auto it = m_key_images.begin(); it != m_key_images.end(); it++)
   {
     THROW_WALLET_EXCEPTION_IF(it->second >= m_transfers.size(), error::wallet_internal_error, "Key images cache contains illegal transfer offset");
@@ -12993,4 +14003,117 @@ std::vector<cryptonote::public_node> wallet2::get_public_nodes(bool white_only)
   std::copy(res.gray.begin(), res.gray.end(), std::back_inserter(nodes));
   return nodes;
 }
+//----------------------------------------------------------------------------------------------------
+block_scan_cache::block_scan_cache(size_t max_blocks, std::chrono::seconds tip_lifetime):
+  m_max_blocks(max_blocks),
+  m_tip_lifetime(tip_lifetime),
+  m_num_blocks(0),
+  m_hits(0),
+  m_misses(0)
+{
+}
+//----------------------------------------------------------------------------------------------------
+const block_scan_cache::range *block_scan_cache::find(const crypto::hash &top, bool no_miner_tx, size_t &offset) const
+{
+  // newest first, so a wallet gets the most recent view of the chain after its top
+  for (auto r = m_ranges.rbegin(); r != m_ranges.rend(); ++r)
+  {
+    if (r->no_miner_tx != no_miner_tx)
+      continue;
+    const auto i = r->index.find(top);
+    if (i == r->index.end())
+      continue;
+    offset = i->second;
+    return &*r;
+  }
+  return NULL;
+}
+//----------------------------------------------------------------------------------------------------
+void block_scan_cache::expire()
+{
+  // ranges near the daemon's top go stale once new blocks come in or a reorg happens
+  static constexpr uint64_t TIP_DEPTH = 10;
+  const auto now = std::chrono::steady_clock::now();
+  for (auto r = m_ranges.begin(); r != m_ranges.end(); )
+  {
+    const bool tip = r->start_height + r->blocks->size() + TIP_DEPTH >= r->current_height;
+    if (tip && now - r->added > m_tip_lifetime)
+    {
+      m_num_blocks -= r->blocks->size();
+      r = m_ranges.erase(r);
+    }
+    else
+      ++r;
+  }
+  while (m_num_blocks > m_max_blocks && !m_ranges.empty())
+  {
+    m_num_blocks -= m_ranges.front().blocks->size();
+    m_ranges.pop_front();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+bool block_scan_cache::get(const crypto::hash &top, bool no_miner_tx, uint64_t &blocks_start_height, wallet2::shared_blocks &blocks,
+    wallet2::shared_parsed_blocks &parsed_blocks, uint64_t &current_height)
+{
+  size_t offset;
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    expire();
+    while (m_fetching[no_miner_tx].find(top) != m_fetching[no_miner_tx].end())
+      m_fetched.wait(lock);
+    const range *r = find(top, no_miner_tx, offset);
+    if (!r)
+    {
+      ++m_misses;
+      m_fetching[no_miner_tx].insert(top);
+      return false;
+    }
+    ++m_hits;
+    blocks_start_height = r->start_height + offset;
+    current_height = r->current_height;
+    blocks = r->blocks;
+    parsed_blocks = r->parsed_blocks;
+  }
+
+  // wallets in step with the one which fetched the range start at its first block and share it,
+  // others copy the part they need, outside the lock
+  if (offset > 0)
+  {
+    blocks = std::make_shared<const std::vector<cryptonote::block_complete_entry>>(blocks->begin() + offset, blocks->end());
+    parsed_blocks = std::make_shared<const std::vector<wallet2::parsed_block>>(parsed_blocks->begin() + offset, parsed_blocks->end());
+  }
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void block_scan_cache::add(const crypto::hash &top, bool no_miner_tx, uint64_t blocks_start_height, const wallet2::shared_blocks &blocks,
+    const wallet2::shared_parsed_blocks &parsed_blocks, uint64_t current_height)
+{
+  range r;
+  r.no_miner_tx = no_miner_tx;
+  r.start_height = blocks_start_height;
+  r.current_height = current_height;
+  r.added = std::chrono::steady_clock::now();
+  r.blocks = blocks;
+  r.parsed_blocks = parsed_blocks;
+  r.index.reserve(parsed_blocks->size());
+  for (size_t i = 0; i < parsed_blocks->size(); ++i)
+    r.index.emplace((*parsed_blocks)[i].hash, i);
+
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  m_fetching[no_miner_tx].erase(top);
+  if (!r.blocks->empty())
+  {
+    m_num_blocks += r.blocks->size();
+    m_ranges.push_back(std::move(r));
+    expire();
+  }
+  m_fetched.notify_all();
+}
+//----------------------------------------------------------------------------------------------------
+void block_scan_cache::abandon(const crypto::hash &top, bool no_miner_tx)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  m_fetching[no_miner_tx].erase(top);
+  m_fetched.notify_all();
+}
 }
\ No newline at end of file
@@ -42,6 +42,7 @@
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/deque.hpp>
 #include <boost/thread/lock_guard.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <atomic>
 #include <random>
 
@@ -88,6 +89,7 @@ namespace tools
 {
   class ringdb;
   class wallet2;
+  class block_scan_cache;
   class Notify;
 
   class gamma_picker
@@ -184,7 +186,7 @@ private:
   class hashchain
   {
   public:
-    hashchain(): m_genesis(crypto::null_hash), m_offset(0) {}
+    hashchain(): m_genesis(crypto::null_hash), m_offset(0), m_journaled(0) {}
 
     size_t size() const { return m_blockchain.size() + m_offset; }
     size_t offset() const { return m_offset; }
@@ -193,11 +195,32 @@ private:
     bool is_in_bounds(size_t idx) const { return idx >= m_offset && idx < size(); }
     const crypto::hash &operator[](size_t idx) const { return m_blockchain[idx - m_offset]; }
     crypto::hash &operator[](size_t idx) { return m_blockchain[idx - m_offset]; }
-    void crop(size_t height) { m_blockchain.resize(height - m_offset); }
-    void clear() { m_offset = 0; m_blockchain.clear(); }
+    void crop(size_t height) { m_blockchain.resize(height - m_offset); m_journaled = std::min(m_journaled, height); }
+    void clear() { m_offset = 0; m_blockchain.clear(); m_journaled = 0; }
     bool empty() const { return m_blockchain.empty() && m_offset == 0; }
     void trim(size_t height) { while (height > m_offset && m_blockchain.size() > 1) { m_blockchain.pop_front(); ++m_offset; } m_blockchain.shrink_to_fit(); }
-    void refill(const crypto::hash &hash) { m_blockchain.push_back(hash); --m_offset; }
+    void refill(const crypto::hash &hash) { m_blockchain.push_back(hash); --m_offset; m_journaled = std::min(m_journaled, m_offset); }
+
+    // hashes below this height are unchanged since the last mark_journaled
+    size_t journaled() const { return std::max(std::min(m_journaled, size()), m_offset); }
+    void mark_journaled() { m_journaled = size(); }
+    // keeps [offset, start) and replaces the rest with tail
+    void apply_journal(size_t offset, const crypto::hash &genesis, size_t start, const std::vector<crypto::hash> &tail)
+    {
+      if (start < offset || start > size() || (start > offset && offset < m_offset))
+        throw std::runtime_error("hashchain journal does not match");
+      if (start >= m_offset)
+      {
+        m_blockchain.resize(start - m_offset);
+        m_blockchain.erase(m_blockchain.begin(), m_blockchain.begin() + (offset - m_offset));
+      }
+      else
+        m_blockchain.clear();
+      m_offset = offset;
+      m_genesis = genesis;
+      m_blockchain.insert(m_blockchain.end(), tail.begin(), tail.end());
+      m_journaled = size();
+    }
 
     template <class t_archive>
     inline void serialize(t_archive &a, const unsigned int ver)
@@ -211,6 +234,7 @@ private:
     size_t m_offset;
     crypto::hash m_genesis;
     std::deque<crypto::hash> m_blockchain;
+    size_t m_journaled;
   };
 
   class wallet_keys_unlocker;
@@ -451,6 +475,16 @@ private:
     typedef std::vector<transfer_details> transfer_container;
     typedef std::unordered_multimap<crypto::hash, payment_details> payment_container;
 
+    // confirmed transfers are listed in (height, txid) order, and a paginated query resumes after a cursor
+    struct history_cursor
+    {
+      uint64_t height;
+      crypto::hash txid;
+
+      bool operator<(const history_cursor &other) const { return height < other.height || (height == other.height && memcmp(&txid, &other.txid, sizeof(txid)) < 0); }
+      bool operator==(const history_cursor &other) const { return height == other.height && txid == other.txid; }
+    };
+
     struct multisig_sig
     {
       rct::rctSig sigs;
@@ -571,6 +605,9 @@ private:
       cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices o_indices;
       bool error;
     };
+    // batches handed from the fetching thread to the refresh loop, shared with the block scan cache
+    typedef std::shared_ptr<const std::vector<cryptonote::block_complete_entry>> shared_blocks;
+    typedef std::shared_ptr<const std::vector<parsed_block>> shared_parsed_blocks;
 
     struct is_out_data
     {
@@ -587,6 +624,10 @@ private:
 
       bool empty() const { return tx_extra_fields.empty() && primary.empty() && additional.empty(); }
     };
+
+    // batches of blocks requested ahead of the refresh loop, defined in wallet2.cpp
+    struct refresh_prefetch;
+    struct refresh_pipeline;
     
     /*!
      * \brief  Generates a wallet or restores one.
@@ -877,6 +918,17 @@ private:
       uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
     void get_unconfirmed_payments_out(std::list<std::pair<crypto::hash,wallet2::unconfirmed_transfer_details>>& unconfirmed_payments, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
     void get_unconfirmed_payments(std::list<std::pair<crypto::hash,wallet2::pool_payment_details>>& unconfirmed_payments, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
+    /*!
+     * \brief Gets a page of confirmed incoming and/or outgoing transfers, in (height, txid) order
+     * \param in, out     lists to fill, or NULL to skip that direction
+     * \param after       only transfers after this cursor are returned
+     * \param limit       stop after this many transfers, 0 for no limit (a transaction is never split across pages)
+     * \param next        set to the cursor of the last transaction returned if more follow, to pass as after for the next page
+     */
+    void get_transfer_history(std::list<std::pair<crypto::hash,wallet2::payment_details>> *in, std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>> *out,
+      uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices,
+      const boost::optional<history_cursor> &after, size_t limit, boost::optional<history_cursor> &next) const;
+    void get_payments_by_txid(const crypto::hash &txid, std::list<std::pair<crypto::hash,wallet2::payment_details>> &payments, std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>> &confirmed_payments, const boost::optional<uint32_t>& subaddr_account = boost::none) const;
 
     uint64_t get_blockchain_current_height() const { return m_light_wallet_blockchain_height ? m_light_wallet_blockchain_height : m_blockchain.size(); }
     void rescan_spent();
@@ -919,6 +971,27 @@ private:
       a & m_cold_key_images;
     }
 
+    // everything in the cache but the parts the cache journal tracks piecewise
+    template <class t_archive>
+    inline void serialize_cache_rest(t_archive &a)
+    {
+      a & m_account_public_address;
+      a & m_unconfirmed_txs;
+      a & m_tx_notes;
+      a & m_address_book;
+      a & m_scanned_pool_txs[0];
+      a & m_scanned_pool_txs[1];
+      a & m_subaddress_labels;
+      a & m_attributes;
+      a & m_unconfirmed_payments;
+      a & m_account_tags;
+      a & m_ring_history_saved;
+      a & m_tx_device;
+      a & m_device_last_key_image_sync;
+      a & m_last_block_reward;
+      a & m_cold_key_images;
+    }
+
     /*!
      * \brief  Check if wallet keys and bin files exist
      * \param  file_path           Wallet file path
@@ -976,6 +1049,10 @@ private:
     void ignore_outputs_below(uint64_t value) { m_ignore_outputs_below = value; }
     bool track_uses() const { return m_track_uses; }
     void track_uses(bool value) { m_track_uses = value; }
+    bool cache_journal() const { return m_cache_journal; }
+    void cache_journal(bool value) { m_cache_journal = value; }
+    uint32_t refresh_pipeline_depth() const { return m_refresh_pipeline_depth; }
+    void refresh_pipeline_depth(uint32_t value) { m_refresh_pipeline_depth = value; }
     BackgroundMiningSetupType setup_background_mining() const { return m_setup_background_mining; }
     void setup_background_mining(BackgroundMiningSetupType value) { m_setup_background_mining = value; }
     uint32_t inactivity_lock_timeout() const { return m_inactivity_lock_timeout; }
@@ -1251,6 +1328,7 @@ private:
     void change_password(const std::string &filename, const epee::wipeable_string &original_password, const epee::wipeable_string &new_password);
 
     void set_tx_notify(const std::shared_ptr<tools::Notify> &notify) { m_tx_notify = notify; }
+    void set_block_scan_cache(const std::shared_ptr<block_scan_cache> &cache) { m_block_scan_cache = cache; }
     
 	bool is_tx_spendtime_unlocked(uint64_t unlock_time, uint64_t block_height) const;
     void hash_m_transfer(const transfer_details & transfer, crypto::hash &hash) const;
@@ -1260,6 +1338,164 @@ private:
     void set_offline(bool offline = true);
 
   private:
+    // identifies an entry of m_payments
+    struct payment_key
+    {
+      crypto::hash m_payment_id;
+      crypto::hash m_tx_hash;
+      cryptonote::subaddress_index m_subaddr_index;
+
+      bool operator==(const payment_key &other) const { return m_payment_id == other.m_payment_id && m_tx_hash == other.m_tx_hash && m_subaddr_index == other.m_subaddr_index; }
+
+      template <class t_archive>
+      inline void serialize(t_archive &a, const unsigned int ver)
+      {
+        a & m_payment_id;
+        a & m_tx_hash;
+        a & m_subaddr_index;
+      }
+    };
+
+    struct payment_key_hash
+    {
+      size_t operator()(const payment_key &key) const { return std::hash<crypto::hash>()(key.m_tx_hash) ^ std::hash<cryptonote::subaddress_index>()(key.m_subaddr_index); }
+    };
+
+    /*!
+     * \brief  Changes to the cache since the previous store, appended to the
+     *         cache journal. Changed entries are erased then reinserted.
+     */
+    struct cache_journal_record
+    {
+      crypto::hash base; // hash of the iv of the cache file it applies to
+      uint64_t transfers_size;
+      std::vector<std::pair<uint64_t, transfer_details>> transfers;
+      uint64_t blockchain_offset;
+      crypto::hash blockchain_genesis;
+      uint64_t blockchain_start;
+      std::vector<crypto::hash> blockchain;
+      std::vector<crypto::key_image> key_images_erased;
+      std::vector<std::pair<crypto::key_image, size_t>> key_images;
+      std::vector<crypto::public_key> pub_keys_erased;
+      std::vector<std::pair<crypto::public_key, size_t>> pub_keys;
+      std::vector<payment_key> payments_erased;
+      std::vector<std::pair<crypto::hash, payment_details>> payments;
+      std::vector<crypto::hash> confirmed_txs_erased;
+      std::vector<std::pair<crypto::hash, confirmed_transfer_details>> confirmed_txs;
+      std::vector<crypto::public_key> subaddresses_erased;
+      std::vector<std::pair<crypto::public_key, cryptonote::subaddress_index>> subaddresses;
+      std::vector<crypto::hash> tx_keys_erased;
+      std::vector<std::pair<crypto::hash, crypto::secret_key>> tx_keys;
+      std::vector<crypto::hash> additional_tx_keys_erased;
+      std::vector<std::pair<crypto::hash, std::vector<crypto::secret_key>>> additional_tx_keys;
+      std::string rest; // serialize_cache_rest output, empty if unchanged
+
+      template <class t_archive>
+      inline void serialize(t_archive &a, const unsigned int ver)
+      {
+        a & base;
+        a & transfers_size;
+        a & transfers;
+        a & blockchain_offset;
+        a & blockchain_genesis;
+        a & blockchain_start;
+        a & blockchain;
+        a & key_images_erased;
+        a & key_images;
+        a & pub_keys_erased;
+        a & pub_keys;
+        a & payments_erased;
+        a & payments;
+        a & confirmed_txs_erased;
+        a & confirmed_txs;
+        a & subaddresses_erased;
+        a & subaddresses;
+        a & tx_keys_erased;
+        a & tx_keys;
+        a & additional_tx_keys_erased;
+        a & additional_tx_keys;
+        a & rest;
+      }
+    };
+
+    // what changed since the cache file and journal on disk were written. Entries appended
+    // to m_transfers are found from transfers_kept, anything changed in place or erased is
+    // touched where it happens; changes too broad to track deactivate the journal, so the
+    // next store writes the whole cache
+    struct cache_journal_state
+    {
+      bool active;
+      crypto::hash base;
+      uint64_t base_size;
+      uint64_t journal_size;
+      uint64_t blockchain_offset;
+      crypto::hash blockchain_genesis;
+      uint64_t transfers_size; // on disk
+      uint64_t transfers_kept; // entries below this are as on disk unless touched
+      std::unordered_set<size_t> transfers;
+      std::unordered_set<crypto::key_image> key_images;
+      std::unordered_set<crypto::public_key> pub_keys;
+      std::unordered_set<payment_key, payment_key_hash> payments;
+      std::unordered_set<crypto::hash> confirmed_txs;
+      std::unordered_set<crypto::public_key> subaddresses;
+      std::unordered_set<crypto::hash> tx_keys;
+      crypto::hash rest;
+
+      cache_journal_state(): active(false), base(crypto::null_hash), base_size(0), journal_size(0), blockchain_offset(0), blockchain_genesis(crypto::null_hash), transfers_size(0), transfers_kept(0), rest(crypto::null_hash) {}
+
+      void touch_transfer(size_t idx) { if (active && idx < transfers_kept) transfers.insert(idx); }
+      void truncate_transfers(size_t size) { transfers_kept = std::min<uint64_t>(transfers_kept, size); }
+      void touch_key_image(const crypto::key_image &ki) { if (active) key_images.insert(ki); }
+      void touch_pub_key(const crypto::public_key &pk) { if (active) pub_keys.insert(pk); }
+      void touch_payment(const crypto::hash &payment_id, const payment_details &pd) { if (active) payments.insert(payment_key{payment_id, pd.m_tx_hash, pd.m_subaddr_index}); }
+      void touch_confirmed_tx(const crypto::hash &txid) { if (active) confirmed_txs.insert(txid); }
+      void touch_subaddress(const crypto::public_key &pk) { if (active) subaddresses.insert(pk); }
+      void touch_tx_keys(const crypto::hash &txid) { if (active) tx_keys.insert(txid); }
+      void deactivate() { *this = cache_journal_state(); }
+    };
+
+    // secondary indexes over m_payments and m_confirmed_txs, built on first use and then kept up to date
+    // while blocks are processed; anything else that changes those containers clears them. The const history
+    // getters build it too and may run beside a refresh, so it is only touched under m_transfer_history_index_lock
+    struct transfer_history_index
+    {
+      typedef payment_container::value_type payment_entry;
+      typedef std::pair<const crypto::hash, confirmed_transfer_details> confirmed_entry;
+
+      bool valid;
+      std::multimap<history_cursor, const payment_entry*> in;
+      std::map<uint32_t, std::multimap<history_cursor, const payment_entry*>> in_by_account;
+      std::unordered_multimap<crypto::hash, const payment_entry*> in_by_txid;
+      std::map<history_cursor, const confirmed_entry*> out;
+      std::map<uint32_t, std::map<history_cursor, const confirmed_entry*>> out_by_account;
+
+      transfer_history_index(): valid(false) {}
+      void clear() { *this = transfer_history_index(); }
+    };
+
+    // indices of the transfers not spent in a block, per account and subaddress, in transfer order; transfers are
+    // added as m_transfers grows and set_spent/set_unspent keep it current, anything else clears it. The const
+    // balance getters build it too and may run beside a refresh, so it is only touched under m_unspent_transfer_index_lock
+    struct unspent_transfer_index
+    {
+      bool valid;
+      size_t transfers_size;
+      std::map<uint32_t, std::map<uint32_t, std::set<size_t>>> by_subaddr;
+
+      unspent_transfer_index(): valid(false), transfers_size(0) {}
+      void clear() { *this = unspent_transfer_index(); }
+    };
+
+    // the cumulative rct output distribution up to a block the wallet has scanned, so later requests only need the blocks after it
+    struct rct_distribution_cache
+    {
+      uint64_t start_height;
+      std::vector<uint64_t> distribution;
+      crypto::hash top_hash;
+
+      rct_distribution_cache(): start_height(0), top_hash(crypto::null_hash) {}
+    };
+
     /*!
      * \brief  Stores wallet information to wallet file.
      * \param  keys_file_name Name of wallet file
@@ -1284,8 +1520,15 @@ private:
     void pull_blocks(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t &current_height);
     void pull_hashes(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<crypto::hash> &hashes);
     void fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, bool force = false);
-    void pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &last, bool &error, std::exception_ptr &exception);
-    void process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL);
+    void pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, shared_blocks &blocks, shared_parsed_blocks &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, refresh_pipeline &pipeline, bool &last, bool &error, std::exception_ptr &exception);
+    void parse_blocks(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<parsed_block> &parsed_blocks, bool &error) const;
+    void cache_parsed_blocks(uint64_t start_height, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const;
+    void generate_tx_cache_derivations(std::vector<tx_cache_data> &tx_cache_data, bool lock_device) const;
+    void prefetch_blocks(refresh_pipeline &pipeline, uint64_t current_height);
+    void pull_prefetched_blocks(refresh_pipeline &pipeline, refresh_prefetch &prefetch);
+    bool take_prefetched_blocks(refresh_pipeline &pipeline, uint64_t top_height, const crypto::hash &top_hash, uint64_t &blocks_start_height, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, uint64_t &current_height);
+    void discard_prefetched_blocks(refresh_pipeline &pipeline);
+    void process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, uint64_t& blocks_added, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL);
     uint64_t select_transfers(uint64_t needed_money, std::vector<size_t> unused_transfers_indices, std::vector<size_t>& selected_transfers) const;
     bool prepare_file_names(const std::string& file_path);
     void process_unconfirmed(const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t height);
@@ -1315,6 +1558,12 @@ private:
     std::vector<size_t> get_only_rct(const std::vector<size_t> &unused_dust_indices, const std::vector<size_t> &unused_transfers_indices) const;
     void scan_output(const cryptonote::transaction &tx, bool miner_tx, const crypto::public_key &tx_pub_key, size_t i, tx_scan_info_t &tx_scan_info, int &num_vouts_received, std::unordered_map<cryptonote::subaddress_index, uint64_t> &tx_money_got_in_outs, std::vector<size_t> &outs, bool pool);
     void trim_hashchain();
+    std::string get_cache_journal_file() const { return m_wallet_file + ".journal"; }
+    bool store_cache_journal();
+    void load_cache_journal(const crypto::chacha_iv &base, uint64_t base_size);
+    void reset_cache_journal(const crypto::chacha_iv &base, uint64_t base_size, uint64_t journal_size);
+    std::string get_cache_rest();
+    void apply_cache_journal_record(cache_journal_record &record);
     crypto::key_image get_multisig_composite_key_image(size_t n) const;
     rct::multisig_kLRki get_multisig_composite_kLRki(size_t n,  const std::unordered_set<crypto::public_key> &ignore_set, std::unordered_set<rct::key> &used_L, std::unordered_set<rct::key> &new_used_L) const;
     rct::multisig_kLRki get_multisig_kLRki(size_t n, const rct::key &k) const;
@@ -1332,6 +1581,15 @@ private:
     hw::device& lookup_device(const std::string & device_descriptor);
 
     bool get_rct_distribution(uint64_t &start_height, std::vector<uint64_t> &distribution);
+    bool request_rct_distribution(uint64_t from_height, uint64_t &start_height, std::vector<uint64_t> &distribution);
+    const transfer_history_index &get_transfer_history_index(const boost::unique_lock<boost::mutex> &lock) const;
+    void invalidate_transfer_history_index();
+    std::map<uint32_t, std::set<size_t>> get_unspent_transfers(uint32_t subaddr_account) const;
+    void update_unspent_transfer_index(size_t idx);
+    void invalidate_unspent_transfer_index();
+    void index_payment(const payment_container::value_type &payment);
+    void index_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &ctd);
+    void unindex_confirmed_tx(const crypto::hash &txid, uint64_t height, uint32_t subaddr_account);
     uint64_t get_segregation_fork_height() const;
     void unpack_multisig_info(const std::vector<std::string>& info,
       std::vector<crypto::public_key> &public_keys,
@@ -1360,6 +1618,8 @@ private:
     cryptonote::account_base m_account;
     boost::optional<epee::net_utils::http::login> m_daemon_login;
     std::string m_daemon_address;
+    epee::net_utils::ssl_options_t m_daemon_ssl_options;
+    boost::asio::ip::tcp::endpoint m_proxy;
     std::string m_wallet_file;
     std::string m_keys_file;
     std::string m_mms_file;
@@ -1431,11 +1691,19 @@ private:
     uint64_t m_ignore_outputs_above;
     uint64_t m_ignore_outputs_below;
     bool m_track_uses;
+    bool m_cache_journal;
+    cache_journal_state m_cache_journal_state;
+    uint32_t m_refresh_pipeline_depth;
     uint32_t m_inactivity_lock_timeout;
     BackgroundMiningSetupType m_setup_background_mining;
     bool m_is_initialized;
     NodeRPCProxy m_node_rpc_proxy;
     std::unordered_set<crypto::hash> m_scanned_pool_txs[2];
+    rct_distribution_cache m_rct_distribution_cache;
+    mutable transfer_history_index m_transfer_history_index;
+    mutable boost::mutex m_transfer_history_index_lock;
+    mutable unspent_transfer_index m_unspent_transfer_index;
+    mutable boost::mutex m_unspent_transfer_index_lock;
     size_t m_subaddress_lookahead_major, m_subaddress_lookahead_minor;
     std::string m_device_name;
     std::string m_device_derivation_path;
@@ -1481,9 +1749,60 @@ private:
 
     std::shared_ptr<tools::Notify> m_tx_notify;
     std::unique_ptr<wallet_device_callback> m_device_callback;
+    std::shared_ptr<block_scan_cache> m_block_scan_cache;
 
     ExportFormat m_export_format;
   };
+
+  /*!
+   * \brief Fetched and parsed blocks, shared between wallets refreshing from the same daemon.
+   *
+   * A wallet asking for the blocks after its top block hash gets them from a cached range which
+   * contains that hash, the way the daemon would return them. If another wallet is already
+   * fetching after the same hash, it waits for that fetch instead of making its own, so wallets
+   * refreshing side by side fetch and parse each range once. Ranges reaching the daemon's top
+   * expire after a short time so that new blocks and reorgs are seen.
+   */
+  class block_scan_cache
+  {
+  public:
+    block_scan_cache(size_t max_blocks, std::chrono::seconds tip_lifetime);
+
+    // on a miss, the caller fetches the blocks itself, then must call add or abandon with the same top
+    bool get(const crypto::hash &top, bool no_miner_tx, uint64_t &blocks_start_height, wallet2::shared_blocks &blocks,
+        wallet2::shared_parsed_blocks &parsed_blocks, uint64_t &current_height);
+    void add(const crypto::hash &top, bool no_miner_tx, uint64_t blocks_start_height, const wallet2::shared_blocks &blocks,
+        const wallet2::shared_parsed_blocks &parsed_blocks, uint64_t current_height);
+    void abandon(const crypto::hash &top, bool no_miner_tx);
+
+    uint64_t get_hits() const { return m_hits; }
+    uint64_t get_misses() const { return m_misses; }
+
+  private:
+    struct range
+    {
+      bool no_miner_tx;
+      uint64_t start_height;
+      uint64_t current_height;
+      std::chrono::steady_clock::time_point added;
+      wallet2::shared_blocks blocks;
+      wallet2::shared_parsed_blocks parsed_blocks;
+      std::unordered_map<crypto::hash, size_t> index;
+    };
+
+    const range *find(const crypto::hash &top, bool no_miner_tx, size_t &offset) const;
+    void expire();
+
+    const size_t m_max_blocks;
+    const std::chrono::seconds m_tip_lifetime;
+    boost::mutex m_mutex;
+    boost::condition_variable m_fetched;
+    std::list<range> m_ranges;
+    size_t m_num_blocks;
+    std::unordered_set<crypto::hash> m_fetching[2];
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+  };
 }
 
 namespace boost
@@ -2392,24 +2392,38 @@ namespace tools
       subaddr_indices.clear();
     }
 
-    if (req.in)
+    // the cursor is "<height>:<txid>" of the last transaction on the previous page
+    boost::optional<tools::wallet2::history_cursor> after;
+    if (!req.cursor.empty())
+    {
+      tools::wallet2::history_cursor cursor;
+      const std::string::size_type sep = req.cursor.find(':');
+      if (sep == std::string::npos || !epee::string_tools::get_xtype_from_string(cursor.height, req.cursor.substr(0, sep))
+          || !epee::string_tools::hex_to_pod(req.cursor.substr(sep + 1), cursor.txid))
+      {
+        er.code = WALLET_RPC_ERROR_CODE_WRONG_CURSOR;
+        er.message = "Invalid cursor: " + req.cursor;
+        return false;
+      }
+      after = cursor;
+    }
+
+    if (req.in || req.out)
     {
       std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments;
-      m_wallet->get_payments(payments, min_height, max_height, account_index, subaddr_indices);
+      std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> payments_out;
+      boost::optional<tools::wallet2::history_cursor> next;
+      m_wallet->get_transfer_history(req.in ? &payments : NULL, req.out ? &payments_out : NULL, min_height, max_height, account_index, subaddr_indices, after, req.limit, next);
       for (std::list<std::pair<crypto::hash, tools::wallet2::payment_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i) {
         res.in.push_back(wallet_rpc::transfer_entry());
         fill_transfer_entry(res.in.back(), i->second.m_tx_hash, i->first, i->second);
       }
-    }
-
-    if (req.out)
-    {
-      std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> payments;
-      m_wallet->get_payments_out(payments, min_height, max_height, account_index, subaddr_indices);
-      for (std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i) {
+      for (std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>>::const_iterator i = payments_out.begin(); i != payments_out.end(); ++i) {
         res.out.push_back(wallet_rpc::transfer_entry());
         fill_transfer_entry(res.out.back(), i->first, i->second);
       }
+      if (next)
+        res.next_cursor = std::to_string(next->height) + ":" + epee::string_tools::pod_to_hex(next->txid);
     }
 
     if (req.pending || req.failed) {
@@ -2482,23 +2496,15 @@ namespace tools
     }
 
     std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments;
-    m_wallet->get_payments(payments, 0, (uint64_t)-1, req.account_index);
+    std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> payments_out;
+    m_wallet->get_payments_by_txid(txid, payments, payments_out, req.account_index);
     for (std::list<std::pair<crypto::hash, tools::wallet2::payment_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i) {
-      if (i->second.m_tx_hash == txid)
-      {
-        res.transfers.resize(res.transfers.size() + 1);
-        fill_transfer_entry(res.transfers.back(), i->second.m_tx_hash, i->first, i->second);
-      }
+      res.transfers.resize(res.transfers.size() + 1);
+      fill_transfer_entry(res.transfers.back(), i->second.m_tx_hash, i->first, i->second);
     }
-
-    std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> payments_out;
-    m_wallet->get_payments_out(payments_out, 0, (uint64_t)-1, req.account_index);
     for (std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>>::const_iterator i = payments_out.begin(); i != payments_out.end(); ++i) {
-      if (i->first == txid)
-      {
-        res.transfers.resize(res.transfers.size() + 1);
-        fill_transfer_entry(res.transfers.back(), i->first, i->second);
-      }
+      res.transfers.resize(res.transfers.size() + 1);
+      fill_transfer_entry(res.transfers.back(), i->first, i->second);
     }
 
     std::list<std::pair<crypto::hash, tools::wallet2::unconfirmed_transfer_details>> upayments;
@@ -41,7 +41,7 @@
 #define MONERO_DEFAULT_LOG_CATEGORY "wallet.rpc"
 
 #define WALLET_RPC_VERSION_MAJOR 1
-#define WALLET_RPC_VERSION_MINOR 10
+#define WALLET_RPC_VERSION_MINOR 11
 #define MAKE_WALLET_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define WALLET_RPC_VERSION MAKE_WALLET_RPC_VERSION(WALLET_RPC_VERSION_MAJOR, WALLET_RPC_VERSION_MINOR)
 namespace tools
@@ -1525,6 +1525,8 @@ namespace wallet_rpc
       uint32_t account_index;
       std::set<uint32_t> subaddr_indices;
       bool all_accounts;
+      uint32_t limit;
+      std::string cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(in);
@@ -1538,6 +1540,8 @@ namespace wallet_rpc
         KV_SERIALIZE(account_index);
         KV_SERIALIZE(subaddr_indices);
         KV_SERIALIZE_OPT(all_accounts, false);
+        KV_SERIALIZE_OPT(limit, (uint32_t)0);
+        KV_SERIALIZE(cursor);
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<request_t> request;
@@ -1549,6 +1553,7 @@ namespace wallet_rpc
       std::list<transfer_entry> pending;
       std::list<transfer_entry> failed;
       std::list<transfer_entry> pool;
+      std::string next_cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(in);
@@ -1556,6 +1561,7 @@ namespace wallet_rpc
         KV_SERIALIZE(pending);
         KV_SERIALIZE(failed);
         KV_SERIALIZE(pool);
+        KV_SERIALIZE(next_cursor);
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
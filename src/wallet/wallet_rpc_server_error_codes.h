@@ -77,3 +77,4 @@
 #define WALLET_RPC_ERROR_CODE_NON_DETERMINISTIC      -43
 #define WALLET_RPC_ERROR_CODE_INVALID_LOG_LEVEL      -44
 #define WALLET_RPC_ERROR_CODE_ATTRIBUTE_NOT_FOUND    -45
+#define WALLET_RPC_ERROR_CODE_WRONG_CURSOR           -46
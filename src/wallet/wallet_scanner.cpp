@@ -0,0 +1,198 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <chrono>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/thread/thread.hpp>
+#include "include_base_utils.h"
+#include "common/command_line.h"
+#include "common/util.h"
+#include "wallet/wallet_args.h"
+#include "wallet/wallet2.h"
+#include "version.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.scanner"
+
+namespace po = boost::program_options;
+
+namespace
+{
+  const command_line::arg_descriptor<std::string, true> arg_wallet_dir = {"wallet-dir", "Directory of the wallets to keep refreshed"};
+  const command_line::arg_descriptor<unsigned> arg_scan_threads = {"scan-threads", "Number of wallets refreshed at the same time, 0 for the number of CPUs", 0};
+  const command_line::arg_descriptor<unsigned> arg_refresh_interval = {"refresh-interval", "Seconds between refreshes of all wallets", 20};
+  const command_line::arg_descriptor<uint64_t> arg_cache_blocks = {"cache-blocks", "Number of fetched blocks kept for other wallets", 20000};
+
+  std::atomic<bool> stop_requested(false);
+}
+
+int main(int argc, char** argv)
+{
+  TRY_ENTRY();
+
+  po::options_description desc_params(wallet_args::tr("Wallet options"));
+  tools::wallet2::init_options(desc_params);
+  command_line::add_arg(desc_params, arg_wallet_dir);
+  command_line::add_arg(desc_params, arg_scan_threads);
+  command_line::add_arg(desc_params, arg_refresh_interval);
+  command_line::add_arg(desc_params, arg_cache_blocks);
+
+  boost::optional<po::variables_map> vm;
+  bool should_terminate = false;
+  std::tie(vm, should_terminate) = wallet_args::main(
+    argc, argv,
+    "nerva-wallet-scanner --wallet-dir=<directory> [--password-file=<file>]",
+    wallet_args::tr("This keeps all wallets in a directory refreshed from one daemon. Blocks are\nfetched and parsed once, and shared between the wallets."),
+    desc_params,
+    po::positional_options_description(),
+    [](const std::string &s, bool emphasis){ std::cout << s << std::endl; },
+    "nerva-wallet-scanner.log",
+    true
+  );
+  if (!vm)
+    return 1;
+  if (should_terminate)
+    return 0;
+
+  const std::string wallet_dir = command_line::get_arg(*vm, arg_wallet_dir);
+  unsigned scan_threads = command_line::get_arg(*vm, arg_scan_threads);
+  if (scan_threads == 0)
+    scan_threads = std::max(1u, boost::thread::hardware_concurrency());
+  const unsigned refresh_interval = command_line::get_arg(*vm, arg_refresh_interval);
+  const uint64_t cache_blocks = command_line::get_arg(*vm, arg_cache_blocks);
+
+  // fetches near the top of the chain are shared within a round of refreshes, and done again in the next
+  const auto cache = std::make_shared<tools::block_scan_cache>(cache_blocks, std::chrono::seconds(std::max(1u, refresh_interval)));
+
+  std::vector<std::unique_ptr<tools::wallet2>> wallets;
+  std::vector<std::string> wallet_files;
+  boost::system::error_code ec;
+  for (boost::filesystem::directory_iterator i(wallet_dir, ec), end; !ec && i != end; i.increment(ec))
+  {
+    const boost::filesystem::path &path = i->path();
+    if (path.extension() != ".keys")
+      continue;
+    wallet_files.push_back((path.parent_path() / path.stem()).string());
+  }
+  if (ec)
+  {
+    MERROR("Failed to read wallet directory " << wallet_dir << ": " << ec.message());
+    return 1;
+  }
+  std::sort(wallet_files.begin(), wallet_files.end());
+
+  for (const std::string &wallet_file: wallet_files)
+  {
+    try
+    {
+      auto wallet = tools::wallet2::make_from_file(*vm, true, wallet_file, nullptr).first;
+      if (!wallet)
+      {
+        MERROR("Failed to open wallet " << wallet_file);
+        continue;
+      }
+      wallet->set_block_scan_cache(cache);
+      wallets.push_back(std::move(wallet));
+      MINFO("Opened wallet " << wallet_file);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to open wallet " << wallet_file << ": " << e.what());
+    }
+  }
+  if (wallets.empty())
+  {
+    MERROR("No wallets to refresh in " << wallet_dir);
+    return 1;
+  }
+  MGINFO("Refreshing " << wallets.size() << " wallets with " << scan_threads << " threads");
+
+  tools::signal_handler::install([&wallets](int) {
+    stop_requested = true;
+    for (const auto &wallet: wallets)
+      wallet->stop();
+  });
+
+  while (!stop_requested)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t hits = cache->get_hits(), misses = cache->get_misses();
+    std::atomic<size_t> next(0);
+    std::atomic<uint64_t> blocks_fetched(0), failed(0);
+    boost::thread_group threads;
+    for (unsigned t = 0; t < std::min<size_t>(scan_threads, wallets.size()); ++t)
+    {
+      threads.create_thread([&]() {
+        for (size_t i = next++; i < wallets.size() && !stop_requested; i = next++)
+        {
+          tools::wallet2 &wallet = *wallets[i];
+          try
+          {
+            uint64_t fetched = 0;
+            bool received_money = false;
+            wallet.refresh(wallet.is_trusted_daemon(), 0, fetched, received_money);
+            if (fetched > 0)
+              wallet.store();
+            blocks_fetched += fetched;
+          }
+          catch (const std::exception &e)
+          {
+            MERROR("Failed to refresh wallet " << wallet.get_wallet_file() << ": " << e.what());
+            ++failed;
+          }
+        }
+      });
+    }
+    threads.join_all();
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    MGINFO(boost::format("Refreshed %u wallets in %.1f s: %u blocks scanned, %u failed, %u block fetches shared, %u made")
+        % wallets.size() % seconds % blocks_fetched.load() % failed.load() % (cache->get_hits() - hits) % (cache->get_misses() - misses));
+
+    for (unsigned s = 0; s < refresh_interval * 10 && !stop_requested; ++s)
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+  }
+
+  for (const auto &wallet: wallets)
+  {
+    try
+    {
+      wallet->store();
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to store wallet " << wallet->get_wallet_file() << ": " << e.what());
+    }
+  }
+  return 0;
+
+  CATCH_ENTRY_L0("main", 1);
+}
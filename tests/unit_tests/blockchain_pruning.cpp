@@ -0,0 +1,128 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "common/pruning.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+
+namespace
+{
+  // a v2 tx with no outputs and no prunable signatures, made unique by its gen input
+  cryptonote::transaction make_tx(uint64_t n)
+  {
+    cryptonote::transaction tx;
+    tx.version = 2;
+    tx.unlock_time = 0;
+    cryptonote::txin_gen in;
+    in.height = n;
+    tx.vin.push_back(in);
+    tx.rct_signatures.type = rct::RCTTypeNull;
+    return tx;
+  }
+
+  // adds blocks with a miner tx and txes_per_block more txes each, returning their tx hashes by height
+  void add_blocks(cryptonote::BlockchainDB &db, uint64_t n_blocks, size_t txes_per_block, std::vector<std::vector<crypto::hash>> &tx_hashes)
+  {
+    uint64_t tx_n = db.get_tx_count();
+    db.batch_start(n_blocks);
+    for (uint64_t i = 0; i < n_blocks; ++i)
+    {
+      cryptonote::block b;
+      b.major_version = 1;
+      b.minor_version = 1;
+      b.timestamp = db.height();
+      b.prev_id = db.height() ? db.top_block_hash() : crypto::null_hash;
+      b.nonce = 0;
+      b.miner_tx = make_tx(tx_n++);
+      tx_hashes.push_back({cryptonote::get_transaction_hash(b.miner_tx)});
+      std::vector<std::pair<cryptonote::transaction, cryptonote::blobdata>> txs;
+      for (size_t j = 0; j < txes_per_block; ++j)
+      {
+        cryptonote::transaction tx = make_tx(tx_n++);
+        b.tx_hashes.push_back(cryptonote::get_transaction_hash(tx));
+        tx_hashes.back().push_back(b.tx_hashes.back());
+        txs.push_back(std::make_pair(tx, cryptonote::tx_to_blob(tx)));
+      }
+      db.add_block(std::make_pair(b, cryptonote::block_to_blob(b)), 0, 0, 1, 0, txs);
+    }
+    db.batch_stop();
+  }
+
+  void check_pruned(const cryptonote::BlockchainDB &db, const std::vector<std::vector<crypto::hash>> &tx_hashes, uint32_t pruning_seed)
+  {
+    for (uint64_t height = 0; height < tx_hashes.size(); ++height)
+    {
+      const bool unpruned = tools::has_unpruned_block(height, db.height(), pruning_seed);
+      for (const crypto::hash &h: tx_hashes[height])
+      {
+        cryptonote::blobdata blob;
+        ASSERT_TRUE(db.get_pruned_tx_blob(h, blob)) << "height " << height;
+        ASSERT_EQ(unpruned, db.get_prunable_tx_blob(h, blob)) << "height " << height;
+      }
+    }
+  }
+}
+
+TEST(blockchain_pruning, prunes_outside_stripe_and_tip)
+{
+  const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  {
+    cryptonote::BlockchainLMDB db;
+    db.open(dir.string(), DBF_FAST);
+
+    // enough transactions for the pass to be split into several hash ranges, and blocks
+    // below the tip in both the kept and the pruned stripes
+    const uint64_t n_blocks = CRYPTONOTE_PRUNING_TIP_BLOCKS + CRYPTONOTE_PRUNING_STRIPE_SIZE + 100;
+    std::vector<std::vector<crypto::hash>> tx_hashes;
+    add_blocks(db, n_blocks, 4, tx_hashes);
+    check_pruned(db, tx_hashes, 0);
+
+    const uint32_t pruning_seed = tools::make_pruning_seed(2, CRYPTONOTE_PRUNING_LOG_STRIPES);
+    ASSERT_TRUE(db.prune_blockchain(pruning_seed));
+    ASSERT_EQ(pruning_seed, db.get_blockchain_pruning_seed());
+    check_pruned(db, tx_hashes, pruning_seed);
+    ASSERT_TRUE(db.check_pruning());
+
+    // a second pass finds nothing left to prune
+    ASSERT_TRUE(db.prune_blockchain(pruning_seed));
+    check_pruned(db, tx_hashes, pruning_seed);
+
+    // blocks leaving the tip get pruned by the update from the tip table
+    add_blocks(db, CRYPTONOTE_PRUNING_STRIPE_SIZE, 0, tx_hashes);
+    ASSERT_TRUE(db.update_pruning());
+    check_pruned(db, tx_hashes, pruning_seed);
+
+    db.close();
+  }
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(dir, ec);
+}
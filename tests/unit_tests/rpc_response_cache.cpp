@@ -0,0 +1,134 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <thread>
+#include "gtest/gtest.h"
+
+#include "net/jsonrpc_structs.h"
+#include "rpc/rpc_response_cache.h"
+#include "storages/portable_storage_template_helper.h"
+
+namespace
+{
+  struct test_result
+  {
+    std::string status;
+    uint64_t height;
+    std::vector<std::string> names;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(status)
+      KV_SERIALIZE(height)
+      KV_SERIALIZE(names)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  cryptonote::rpc_response_cache::token make_token(uint8_t top, uint64_t pool_cookie)
+  {
+    cryptonote::rpc_response_cache::token t{crypto::null_hash, pool_cookie};
+    t.top_hash.data[0] = top;
+    return t;
+  }
+
+  void check_body(const epee::serialization::storage_entry &id)
+  {
+    epee::json_rpc::response<test_result, epee::json_rpc::dummy_error> resp;
+    resp.jsonrpc = "2.0";
+    resp.id = id;
+    resp.result.status = "OK";
+    resp.result.height = 1234;
+    resp.result.names = {"a", "b\"c"};
+    std::string expected, result_json;
+    epee::serialization::store_t_to_json(resp, expected);
+    epee::serialization::store_t_to_json(resp.result, result_json, 1);
+    ASSERT_EQ(expected, epee::json_rpc::make_response_body(id, result_json));
+  }
+}
+
+TEST(rpc_response_cache, json_rpc_body_matches_full_response)
+{
+  check_body(epee::serialization::storage_entry(uint64_t(7)));
+  check_body(epee::serialization::storage_entry(std::string("an \"id\"")));
+  check_body(epee::serialization::storage_entry());
+}
+
+TEST(rpc_response_cache, hit_and_invalidation)
+{
+  cryptonote::rpc_response_cache cache(16, std::chrono::seconds(60));
+  std::string body;
+  ASSERT_FALSE(cache.get("get_info", "params", make_token(1, 1), body));
+  cache.put("get_info", "params", make_token(1, 1), "result");
+  ASSERT_TRUE(cache.get("get_info", "params", make_token(1, 1), body));
+  ASSERT_EQ(body, "result");
+  ASSERT_FALSE(cache.get("get_info", "other params", make_token(1, 1), body));
+  ASSERT_FALSE(cache.get("hard_fork_info", "params", make_token(1, 1), body));
+
+  // a new top block or a pool change drops everything
+  ASSERT_FALSE(cache.get("get_info", "params", make_token(2, 1), body));
+  cache.put("get_info", "params", make_token(2, 1), "result");
+  ASSERT_FALSE(cache.get("get_info", "params", make_token(2, 2), body));
+
+  // a response built against an older state is not kept
+  cache.put("get_info", "params", make_token(2, 1), "stale");
+  ASSERT_FALSE(cache.get("get_info", "params", make_token(2, 2), body));
+
+  std::map<std::string, cryptonote::rpc_response_cache::method_stats> stats;
+  uint64_t entries, invalidations;
+  cache.get_stats(stats, entries, invalidations);
+  ASSERT_EQ(stats["get_info"].hits, 1u);
+  ASSERT_EQ(invalidations, 2u);
+}
+
+TEST(rpc_response_cache, least_recently_used_evicted)
+{
+  cryptonote::rpc_response_cache cache(2, std::chrono::seconds(60));
+  const auto t = make_token(1, 1);
+  std::string body;
+  ASSERT_FALSE(cache.get("m", "a", t, body));
+  cache.put("m", "a", t, "A");
+  cache.put("m", "b", t, "B");
+  ASSERT_TRUE(cache.get("m", "a", t, body));
+  cache.put("m", "c", t, "C");
+  ASSERT_TRUE(cache.get("m", "a", t, body));
+  ASSERT_FALSE(cache.get("m", "b", t, body));
+  ASSERT_TRUE(cache.get("m", "c", t, body));
+  ASSERT_EQ(body, "C");
+}
+
+TEST(rpc_response_cache, entries_expire)
+{
+  cryptonote::rpc_response_cache cache(16, std::chrono::milliseconds(100));
+  const auto t = make_token(1, 1);
+  std::string body;
+  ASSERT_FALSE(cache.get("get_info", "", t, body));
+  cache.put("get_info", "", t, "result");
+  ASSERT_TRUE(cache.get("get_info", "", t, body));
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  ASSERT_FALSE(cache.get("get_info", "", t, body));
+}
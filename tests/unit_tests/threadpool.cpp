@@ -0,0 +1,104 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <memory>
+#include "gtest/gtest.h"
+
+#include "common/threadpool.h"
+
+TEST(threadpool, waiting_thread_runs_tasks)
+{
+  // one worker, which the first task keeps busy until the waiting thread has run one of the others
+  std::unique_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(2));
+  const boost::thread::id caller = boost::this_thread::get_id();
+  std::atomic<bool> ran_on_caller(false);
+  std::atomic<unsigned> done(0);
+  tools::threadpool::waiter waiter;
+  for (int i = 0; i < 4; ++i)
+  {
+    tpool->submit(&waiter, [&]() {
+      if (boost::this_thread::get_id() == caller)
+        ran_on_caller = true;
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+      while (!ran_on_caller && std::chrono::steady_clock::now() < deadline)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+      ++done;
+    });
+  }
+  waiter.wait(tpool.get());
+  ASSERT_EQ(done.load(), 4u);
+  ASSERT_TRUE(ran_on_caller.load());
+}
+
+TEST(threadpool, nested_waits_complete)
+{
+  std::unique_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(2));
+  std::atomic<unsigned> done(0);
+  tools::threadpool::waiter waiter;
+  for (int i = 0; i < 8; ++i)
+  {
+    tpool->submit(&waiter, [&]() {
+      tools::threadpool::waiter inner;
+      for (int j = 0; j < 8; ++j)
+        tpool->submit(&inner, [&]() { ++done; }, true);
+      inner.wait(tpool.get());
+    });
+  }
+  waiter.wait(tpool.get());
+  ASSERT_EQ(done.load(), 64u);
+}
+
+TEST(threadpool, higher_priority_first)
+{
+  // with the single worker held, queued tasks are run by priority class, not submission order
+  std::unique_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(2));
+  std::atomic<bool> release(false);
+  std::atomic<bool> started(false);
+  tools::threadpool::waiter blocker;
+  tpool->submit(&blocker, [&]() { started = true; while (!release) boost::this_thread::sleep_for(boost::chrono::milliseconds(1)); });
+  while (!started)
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+
+  boost::mutex order_mutex;
+  std::vector<int> order;
+  tools::threadpool::waiter waiter;
+  {
+    tools::threadpool::priority_scope scope(tools::threadpool::priority_low);
+    tpool->submit(&waiter, [&]() { const boost::unique_lock<boost::mutex> lock(order_mutex); order.push_back(2); });
+  }
+  {
+    tools::threadpool::priority_scope scope(tools::threadpool::priority_high);
+    tpool->submit(&waiter, [&]() { const boost::unique_lock<boost::mutex> lock(order_mutex); order.push_back(0); });
+  }
+  release = true;
+  blocker.wait(NULL);
+  waiter.wait(NULL);
+  ASSERT_EQ(order, std::vector<int>({0, 2}));
+}
@@ -0,0 +1,209 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "blockchain_db/lmdb/tx_compression.h"
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+
+namespace
+{
+  std::string encode(cryptonote::lmdb_tx_compression &c, cryptonote::tx_compression_table table, const std::string &raw)
+  {
+    std::string buffer;
+    const MDB_val v = c.encode(table, MDB_val{raw.size(), (void*)raw.data()}, buffer);
+    return std::string((const char*)v.mv_data, v.mv_size);
+  }
+
+  std::string decode(const cryptonote::lmdb_tx_compression &c, cryptonote::tx_compression_table table, const std::string &stored)
+  {
+    std::string out;
+    c.decode(table, MDB_val{stored.size(), (void*)stored.data()}, out);
+    return out;
+  }
+
+  std::string make_record(size_t n)
+  {
+    // a repetitive header, like tx prefixes have, followed by a few random bytes
+    std::string s;
+    for (size_t i = 0; i < 16; ++i)
+      s += "\x02\x00\x01\x02\x00\x10" + std::string(1, (char)i);
+    s.resize(s.size() + 32);
+    crypto::generate_random_bytes_thread_safe(32, (uint8_t*)&s[s.size() - 32]);
+    s += std::to_string(n);
+    return s;
+  }
+
+  cryptonote::transaction make_tx(uint64_t n)
+  {
+    cryptonote::transaction tx;
+    tx.version = 2;
+    tx.unlock_time = 0;
+    cryptonote::txin_gen in;
+    in.height = n;
+    tx.vin.push_back(in);
+    tx.rct_signatures.type = rct::RCTTypeNull;
+    return tx;
+  }
+
+  std::vector<std::pair<crypto::hash, cryptonote::blobdata>> add_blocks(cryptonote::BlockchainDB &db, uint64_t n_blocks)
+  {
+    std::vector<std::pair<crypto::hash, cryptonote::blobdata>> added;
+    db.batch_start(n_blocks);
+    for (uint64_t i = 0; i < n_blocks; ++i)
+    {
+      cryptonote::block b;
+      b.major_version = 1;
+      b.minor_version = 1;
+      b.timestamp = db.height();
+      b.prev_id = db.height() ? db.top_block_hash() : crypto::null_hash;
+      b.nonce = 0;
+      b.miner_tx = make_tx(2 * db.height());
+      added.push_back(std::make_pair(cryptonote::get_transaction_hash(b.miner_tx), cryptonote::tx_to_blob(b.miner_tx)));
+      const cryptonote::transaction tx = make_tx(2 * db.height() + 1);
+      b.tx_hashes.push_back(cryptonote::get_transaction_hash(tx));
+      added.push_back(std::make_pair(b.tx_hashes.back(), cryptonote::tx_to_blob(tx)));
+      db.add_block(std::make_pair(b, cryptonote::block_to_blob(b)), 0, 0, 1, 0, {std::make_pair(tx, added.back().second)});
+    }
+    db.batch_stop();
+    return added;
+  }
+
+  std::string compression_method(const cryptonote::BlockchainDB &db)
+  {
+    return db.get_tx_compression_stats().method;
+  }
+
+  void check_blobs(const cryptonote::BlockchainDB &db, const std::vector<std::pair<crypto::hash, cryptonote::blobdata>> &txes)
+  {
+    for (const auto &e: txes)
+    {
+      cryptonote::blobdata blob;
+      ASSERT_TRUE(db.get_tx_blob(e.first, blob));
+      ASSERT_EQ(e.second, blob);
+    }
+  }
+}
+
+TEST(tx_compression, legacy_records_pass_through)
+{
+  cryptonote::lmdb_tx_compression c;
+  ASSERT_FALSE(c.enabled());
+
+  // without compression, records are stored and read as they are, whatever their first byte
+  for (const std::string raw: {std::string(), std::string("\x00raw", 4), std::string("\x01not zstd"), make_record(0)})
+  {
+    std::string buffer;
+    const MDB_val in{raw.size(), (void*)raw.data()};
+    const MDB_val stored = c.encode(cryptonote::txc_pruned, in, buffer);
+    ASSERT_EQ(in.mv_data, stored.mv_data);
+    ASSERT_EQ(in.mv_size, stored.mv_size);
+    ASSERT_EQ(raw, decode(c, cryptonote::txc_pruned, raw));
+  }
+}
+
+TEST(tx_compression, zstd_round_trip)
+{
+  if (!cryptonote::lmdb_tx_compression::supported())
+    return;
+
+  cryptonote::lmdb_tx_compression c;
+  c.set_method(cryptonote::lmdb_tx_compression::method_zstd);
+  ASSERT_TRUE(c.enabled());
+
+  // compressible records shrink, others are stored raw behind their tag
+  std::string raw(4096, 'a');
+  std::string stored = encode(c, cryptonote::txc_prunable, raw);
+  ASSERT_EQ(1, stored[0]);
+  ASSERT_LT(stored.size(), raw.size());
+  ASSERT_EQ(raw, decode(c, cryptonote::txc_prunable, stored));
+
+  raw.resize(64);
+  crypto::generate_random_bytes_thread_safe(raw.size(), (uint8_t*)&raw[0]);
+  stored = encode(c, cryptonote::txc_prunable, raw);
+  ASSERT_EQ(0, stored[0]);
+  ASSERT_EQ(raw.size() + 1, stored.size());
+  ASSERT_EQ(raw, decode(c, cryptonote::txc_prunable, stored));
+
+  ASSERT_EQ(std::string(), encode(c, cryptonote::txc_prunable, std::string()));
+  ASSERT_EQ(std::string(), decode(c, cryptonote::txc_prunable, std::string()));
+
+  // with a trained dictionary, for the table it was trained for
+  std::vector<std::string> samples;
+  for (size_t i = 0; i < 256; ++i)
+    samples.push_back(make_record(i));
+  if (!c.train(cryptonote::txc_pruned, samples))
+    return;
+  ASSERT_TRUE(c.has_dictionary(cryptonote::txc_pruned));
+  ASSERT_FALSE(c.has_dictionary(cryptonote::txc_prunable));
+  for (size_t i = 0; i < 16; ++i)
+  {
+    raw = make_record(1000 + i);
+    ASSERT_EQ(raw, decode(c, cryptonote::txc_pruned, encode(c, cryptonote::txc_pruned, raw)));
+  }
+}
+
+TEST(tx_compression, database_converts_legacy_records)
+{
+  const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::vector<std::pair<crypto::hash, cryptonote::blobdata>> txes;
+  {
+    cryptonote::BlockchainLMDB db;
+    db.open(dir.string(), DBF_FAST);
+    txes = add_blocks(db, 200);
+    ASSERT_EQ("none", compression_method(db));
+    check_blobs(db, txes);
+    db.close();
+  }
+  {
+    // records written without compression are converted in place
+    cryptonote::BlockchainLMDB db;
+    db.open(dir.string(), DBF_FAST | DBF_COMPRESS);
+    const bool compressed = cryptonote::lmdb_tx_compression::supported();
+    ASSERT_EQ(compressed ? "zstd" : "none", compression_method(db));
+    check_blobs(db, txes);
+    const std::vector<std::pair<crypto::hash, cryptonote::blobdata>> more = add_blocks(db, 10);
+    txes.insert(txes.end(), more.begin(), more.end());
+    check_blobs(db, txes);
+    db.close();
+  }
+  {
+    // the setting is kept in the database
+    cryptonote::BlockchainLMDB db;
+    db.open(dir.string(), DBF_FAST);
+    ASSERT_EQ(cryptonote::lmdb_tx_compression::supported() ? "zstd" : "none", compression_method(db));
+    check_blobs(db, txes);
+    db.close();
+  }
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(dir, ec);
+}
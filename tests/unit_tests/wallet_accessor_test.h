@@ -0,0 +1,178 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/archive/portable_binary_oarchive.hpp>
+#include "crypto/crypto.h"
+#include "ringct/rctOps.h"
+#include "string_tools.h"
+#include "wallet/wallet2.h"
+
+// the wallet declares this class a friend, so tests can set up and inspect its state directly
+class wallet_accessor_test
+{
+public:
+  static void add_block(tools::wallet2 &w, uint64_t n)
+  {
+    w.m_blockchain.push_back(make_hash(n));
+  }
+
+  // as process_new_transaction adds a received output
+  static void add_transfer(tools::wallet2 &w, uint64_t n, uint64_t height)
+  {
+    crypto::public_key pk;
+    crypto::key_image ki;
+    const crypto::hash pk_bytes = make_hash(3000 + n), ki_bytes = make_hash(4000 + n);
+    memcpy(&pk, pk_bytes.data, sizeof(pk));
+    memcpy(&ki, ki_bytes.data, sizeof(ki));
+
+    w.m_transfers.push_back(tools::wallet2::transfer_details{});
+    tools::wallet2::transfer_details &td = w.m_transfers.back();
+    td.m_block_height = height;
+    cryptonote::tx_out out;
+    out.amount = 0;
+    out.target = cryptonote::txout_to_key(pk);
+    td.m_tx.vout.push_back(out);
+    td.m_txid = make_hash(n);
+    td.m_internal_output_index = 0;
+    td.m_global_output_index = n;
+    td.m_key_image = ki;
+    td.m_key_image_known = true;
+    td.m_amount = n + 1;
+    td.m_rct = true;
+    td.m_mask = rct::identity();
+    td.m_subaddr_index = {0, (uint32_t)(n % 2)};
+    const size_t idx = w.m_transfers.size() - 1;
+    w.set_unspent(idx);
+    w.m_key_images[ki] = idx;
+    w.m_cache_journal_state.touch_key_image(ki);
+    w.m_pub_keys[pk] = idx;
+    w.m_cache_journal_state.touch_pub_key(pk);
+
+    tools::wallet2::payment_details pd = AUTO_VAL_INIT(pd);
+    pd.m_tx_hash = td.m_txid;
+    pd.m_amount = td.m_amount;
+    pd.m_block_height = height;
+    pd.m_subaddr_index = td.m_subaddr_index;
+    w.m_payments.emplace(crypto::null_hash, pd);
+    w.m_cache_journal_state.touch_payment(crypto::null_hash, pd);
+  }
+
+  static void add_confirmed_tx(tools::wallet2 &w, uint64_t n, uint64_t height)
+  {
+    tools::wallet2::confirmed_transfer_details ctd;
+    ctd.m_block_height = height;
+    ctd.m_amount_in = n + 1;
+    ctd.m_amount_out = n;
+    w.m_confirmed_txs.emplace(make_hash(2000 + n), ctd);
+    w.m_cache_journal_state.touch_confirmed_tx(make_hash(2000 + n));
+  }
+
+  static void set_spent(tools::wallet2 &w, size_t idx, uint64_t height) { w.set_spent(idx, height); }
+  static void set_unspent(tools::wallet2 &w, size_t idx) { w.set_unspent(idx); }
+  static void detach(tools::wallet2 &w, uint64_t height) { w.detach_blockchain(height); }
+
+  static std::map<uint32_t, std::set<size_t>> get_unspent_transfers(const tools::wallet2 &w, uint32_t account)
+  {
+    return w.get_unspent_transfers(account);
+  }
+
+  // what get_unspent_transfers should return, from a walk over all transfers
+  static std::map<uint32_t, std::set<size_t>> scan_unspent_transfers(const tools::wallet2 &w, uint32_t account)
+  {
+    std::map<uint32_t, std::set<size_t>> unspent;
+    for (size_t i = 0; i < w.m_transfers.size(); ++i)
+    {
+      const tools::wallet2::transfer_details &td = w.m_transfers[i];
+      if (td.m_subaddr_index.major == account && !w.is_spent(td, true))
+        unspent[td.m_subaddr_index.minor].insert(i);
+    }
+    return unspent;
+  }
+
+  // everything a store writes, in a form independent of container history
+  static std::string state(tools::wallet2 &w)
+  {
+    std::string s;
+    for (const tools::wallet2::transfer_details &td: w.m_transfers)
+      s += dump(td);
+    s += std::to_string(w.m_blockchain.offset()) + epee::string_tools::pod_to_hex(w.m_blockchain.genesis());
+    for (size_t i = w.m_blockchain.offset(); i < w.m_blockchain.size(); ++i)
+      s += epee::string_tools::pod_to_hex(w.m_blockchain[i]);
+    s += dump_sorted(w.m_key_images);
+    s += dump_sorted(w.m_pub_keys);
+    s += dump_sorted(w.m_payments);
+    s += dump_sorted(w.m_confirmed_txs);
+    s += dump_sorted(w.m_subaddresses);
+    s += dump_sorted(w.m_tx_keys);
+    s += dump_sorted(w.m_additional_tx_keys);
+    s += w.get_cache_rest();
+    return s;
+  }
+
+  static std::string load_state(const std::string &wallet_file, const epee::wipeable_string &password)
+  {
+    tools::wallet2 w(cryptonote::MAINNET, 1, true);
+    w.load(wallet_file, password);
+    return state(w);
+  }
+
+private:
+  static crypto::hash make_hash(uint64_t n)
+  {
+    crypto::hash h = crypto::null_hash;
+    memcpy(h.data, &n, sizeof(n));
+    h.data[31] = 2;
+    return h;
+  }
+
+  template<typename T>
+  static std::string dump(const T &t)
+  {
+    std::stringstream oss;
+    boost::archive::portable_binary_oarchive ar(oss);
+    ar << t;
+    return oss.str();
+  }
+
+  // iteration order of an unordered container depends on its history, not just its contents
+  template<typename M>
+  static std::string dump_sorted(const M &map)
+  {
+    std::vector<std::string> entries;
+    for (const auto &e: map)
+      entries.push_back(epee::string_tools::pod_to_hex(e.first) + dump(e.second));
+    std::sort(entries.begin(), entries.end());
+    std::string s = std::to_string(entries.size());
+    for (const std::string &e: entries)
+      s += e;
+    return s;
+  }
+};
@@ -0,0 +1,97 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+#include "wallet_accessor_test.h"
+
+TEST(wallet_cache_journal, incremental_stores_load_as_full_store)
+{
+  const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  ASSERT_TRUE(boost::filesystem::create_directories(dir));
+  const std::string wallet_file = (dir / "wallet").string();
+  const std::string journal_file = wallet_file + ".journal";
+  const epee::wipeable_string password("journal");
+
+  tools::wallet2 w(cryptonote::MAINNET, 1, true);
+  w.cache_journal(true);
+  w.generate(wallet_file, password, rct::rct2sk(rct::skGen()), true);
+  for (uint64_t h = 1; h < 8; ++h)
+    wallet_accessor_test::add_block(w, 500 + h);
+
+  // new entries only
+  for (uint64_t n = 0; n < 4; ++n)
+    wallet_accessor_test::add_transfer(w, n, n + 1);
+  wallet_accessor_test::add_confirmed_tx(w, 0, 2);
+  wallet_accessor_test::add_confirmed_tx(w, 1, 4);
+  w.store();
+  ASSERT_TRUE(boost::filesystem::exists(journal_file));
+  const uint64_t journal_size_1 = boost::filesystem::file_size(journal_file);
+  ASSERT_GT(journal_size_1, 0u);
+
+  // nothing changed, nothing appended
+  w.store();
+  ASSERT_EQ(journal_size_1, boost::filesystem::file_size(journal_file));
+
+  // entries changed in place, and more new ones
+  wallet_accessor_test::set_spent(w, 1, 3);
+  w.freeze(0);
+  w.add_subaddress(0, "change");
+  wallet_accessor_test::add_transfer(w, 4, 5);
+  wallet_accessor_test::add_transfer(w, 5, 6);
+  w.store();
+  const uint64_t journal_size_2 = boost::filesystem::file_size(journal_file);
+  ASSERT_GT(journal_size_2, journal_size_1);
+
+  // a reorg erases entries, then others take their place
+  wallet_accessor_test::detach(w, 5);
+  wallet_accessor_test::add_block(w, 605);
+  wallet_accessor_test::add_block(w, 606);
+  wallet_accessor_test::add_transfer(w, 6, 5);
+  wallet_accessor_test::add_confirmed_tx(w, 2, 5);
+  w.store();
+  ASSERT_GT(boost::filesystem::file_size(journal_file), journal_size_2);
+
+  const std::string expected = wallet_accessor_test::state(w);
+  w.unlock_keys_file();
+  const std::string journaled = wallet_accessor_test::load_state(wallet_file, password);
+  EXPECT_EQ(expected, journaled);
+
+  // the same wallet stored whole
+  w.cache_journal(false);
+  w.store();
+  ASSERT_FALSE(boost::filesystem::exists(journal_file));
+  const std::string whole = wallet_accessor_test::load_state(wallet_file, password);
+  EXPECT_EQ(expected, whole);
+  EXPECT_EQ(journaled, whole);
+
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(dir, ec);
+}
@@ -0,0 +1,148 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "wallet/wallet2.h"
+
+namespace
+{
+  typedef std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payment_list;
+  typedef std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> confirmed_list;
+
+  crypto::hash make_hash(uint64_t n)
+  {
+    crypto::hash h = crypto::null_hash;
+    memcpy(h.data, &n, sizeof(n));
+    h.data[31] = 1;
+    return h;
+  }
+
+  // 60 incoming payments over 25 heights, some transactions paying several subaddresses, and 20 outgoing transfers
+  void fill_wallet(tools::wallet2 &w)
+  {
+    tools::wallet2::payment_container payments;
+    for (uint64_t n = 0; n < 60; ++n)
+    {
+      tools::wallet2::payment_details pd = AUTO_VAL_INIT(pd);
+      pd.m_tx_hash = make_hash(n / 2 * 7 % 41);
+      pd.m_amount = n + 1;
+      pd.m_block_height = 1 + n / 2 % 25;
+      pd.m_subaddr_index = {(uint32_t)(n % 2), (uint32_t)(n % 3)};
+      payments.emplace(make_hash(1000 + n), pd);
+    }
+    w.import_payments(payments);
+
+    confirmed_list out;
+    for (uint64_t n = 0; n < 20; ++n)
+    {
+      tools::wallet2::confirmed_transfer_details ctd;
+      ctd.m_block_height = 1 + n * 3 % 25;
+      ctd.m_amount_in = n + 1;
+      ctd.m_subaddr_account = n % 2;
+      ctd.m_subaddr_indices = {(uint32_t)(n % 3)};
+      out.emplace_back(make_hash(2000 + n), ctd);
+    }
+    w.import_payments_out(out);
+  }
+
+  std::vector<crypto::hash> txids(const payment_list &payments)
+  {
+    std::vector<crypto::hash> ids;
+    for (const auto &p: payments)
+      ids.push_back(p.second.m_tx_hash);
+    return ids;
+  }
+
+  std::vector<crypto::hash> txids(const confirmed_list &payments)
+  {
+    std::vector<crypto::hash> ids;
+    for (const auto &p: payments)
+      ids.push_back(p.first);
+    return ids;
+  }
+
+  void check_pages(const tools::wallet2 &w, const boost::optional<uint32_t> &account, const std::set<uint32_t> &subaddr_indices, size_t limit)
+  {
+    payment_list all_in;
+    confirmed_list all_out;
+    boost::optional<tools::wallet2::history_cursor> next;
+    w.get_transfer_history(&all_in, &all_out, 0, (uint64_t)-1, account, subaddr_indices, boost::none, 0, next);
+    ASSERT_FALSE(next);
+    ASSERT_FALSE(all_in.empty());
+    ASSERT_FALSE(all_out.empty());
+
+    payment_list paged_in;
+    confirmed_list paged_out;
+    boost::optional<tools::wallet2::history_cursor> after;
+    size_t pages = 0;
+    do
+    {
+      payment_list in;
+      confirmed_list out;
+      w.get_transfer_history(&in, &out, 0, (uint64_t)-1, account, subaddr_indices, after, limit, next);
+      ASSERT_LE(in.size() + out.size(), limit + 1); // a transaction is never split, and pays at most two of ours here
+      paged_in.splice(paged_in.end(), in);
+      paged_out.splice(paged_out.end(), out);
+      after = next;
+      ASSERT_LT(++pages, 200u);
+    } while (next);
+
+    ASSERT_EQ(txids(all_in), txids(paged_in));
+    ASSERT_EQ(txids(all_out), txids(paged_out));
+  }
+}
+
+TEST(wallet_transfer_history, pages_concatenate_to_unpaged)
+{
+  tools::wallet2 w(cryptonote::MAINNET, 1, true);
+  fill_wallet(w);
+  for (size_t limit: {1, 2, 3, 7, 100})
+  {
+    check_pages(w, boost::none, {}, limit);
+    check_pages(w, 1, {}, limit);
+    check_pages(w, 0, {1, 2}, limit);
+  }
+}
+
+TEST(wallet_transfer_history, cursor_is_last_returned)
+{
+  tools::wallet2 w(cryptonote::MAINNET, 1, true);
+  fill_wallet(w);
+
+  payment_list in;
+  confirmed_list out;
+  boost::optional<tools::wallet2::history_cursor> next;
+  w.get_transfer_history(&in, NULL, 0, (uint64_t)-1, boost::none, {}, boost::none, 1, next);
+  ASSERT_TRUE(next);
+  ASSERT_FALSE(in.empty());
+  ASSERT_EQ(in.back().second.m_block_height, next->height);
+  ASSERT_EQ(in.back().second.m_tx_hash, next->txid);
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2018-2024, The Nerva Project
+// Copyright (c) 2014-2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "wallet_accessor_test.h"
+
+namespace
+{
+  // spending every transfer of a subaddress may leave it in the index with no transfers
+  std::map<uint32_t, std::set<size_t>> unspent_transfers(const tools::wallet2 &w, uint32_t account)
+  {
+    std::map<uint32_t, std::set<size_t>> unspent = wallet_accessor_test::get_unspent_transfers(w, account);
+    for (auto i = unspent.begin(); i != unspent.end(); )
+      i = i->second.empty() ? unspent.erase(i) : std::next(i);
+    return unspent;
+  }
+
+  void check_unspent(const tools::wallet2 &w)
+  {
+    for (uint32_t account = 0; account < 2; ++account)
+      ASSERT_EQ(wallet_accessor_test::scan_unspent_transfers(w, account), unspent_transfers(w, account)) << "account " << account;
+  }
+}
+
+TEST(wallet_unspent_transfers, index_follows_transfers)
+{
+  tools::wallet2 w(cryptonote::MAINNET, 1, true);
+  w.generate("", "unspent", rct::rct2sk(rct::skGen()), true);
+  for (uint64_t h = 1; h < 10; ++h)
+    wallet_accessor_test::add_block(w, 500 + h);
+
+  // transfers alternate between subaddresses 0 and 1, with amounts n + 1
+  for (uint64_t n = 0; n < 6; ++n)
+    wallet_accessor_test::add_transfer(w, n, n + 1);
+  check_unspent(w);
+  ASSERT_EQ((std::map<uint32_t, std::set<size_t>>{{0, {0, 2, 4}}, {1, {1, 3, 5}}}), unspent_transfers(w, 0));
+  ASSERT_TRUE(unspent_transfers(w, 1).empty());
+  ASSERT_EQ((std::map<uint32_t, uint64_t>{{0, 9}, {1, 12}}), w.balance_per_subaddress(0, true));
+
+  // spending and unspending once the index is built
+  wallet_accessor_test::set_spent(w, 1, 7);
+  wallet_accessor_test::set_spent(w, 4, 7);
+  check_unspent(w);
+  ASSERT_EQ((std::map<uint32_t, uint64_t>{{0, 4}, {1, 10}}), w.balance_per_subaddress(0, true));
+  wallet_accessor_test::set_unspent(w, 4);
+  check_unspent(w);
+
+  // a subaddress with all of its transfers spent
+  wallet_accessor_test::set_spent(w, 3, 8);
+  wallet_accessor_test::set_spent(w, 5, 8);
+  check_unspent(w);
+  ASSERT_EQ((std::map<uint32_t, uint64_t>{{0, 9}}), w.balance_per_subaddress(0, true));
+
+  // transfers added after the index was built are picked up on use
+  wallet_accessor_test::add_transfer(w, 6, 8);
+  wallet_accessor_test::add_transfer(w, 7, 9);
+  check_unspent(w);
+
+  // a reorg drops the transfers received and unspends the ones spent from the detached height
+  wallet_accessor_test::detach(w, 7);
+  check_unspent(w);
+  ASSERT_EQ((std::map<uint32_t, std::set<size_t>>{{0, {0, 2, 4}}, {1, {1, 3, 5}}}), unspent_transfers(w, 0));
+}